@@ -45,6 +45,29 @@ const char *gengetopt_args_info_help[] = {
 	"      --timelimit=INT    Exit after timelimit seconds  (default=`0')",
 	"  -a, --apn=STRING       Access point name  (default=`internet')",
 	"  -q, --qos=INT          Requested quality of service  (default=`0x0b921f')",
+	"      --gtpcbudget=INT   Max GTP-C packets per poll  (default=`256')",
+	"      --gtpubudget=INT   Max GTP-U packets per poll  (default=`64')",
+	"      --tunbudget=INT    Max TUN packets per poll  (default=`64')",
+	"      --createrate=INT   Max create requests per second  (default=`0')",
+	"      --peerrate=INT     Max create requests per second per peer  (default=`0')",
+	"      --reserve=INT      Contexts and addresses kept free  (default=`0')",
+	"      --ipv6pool=STRING  IPv6 prefix pool",
+	"      --framedroutes=STRING  Routed prefixes per IMSI",
+	"      --apns=STRING      APNs with own network and DNS",
+	"      --hairpin=STRING   APNs forwarding between own contexts",
+	"      --reflect          Send uplink packets back to the sender  (default=off)",
+	"      --gpdushort        Send GTPv1 G-PDUs without sequence numbers  \n                           (default=off)",
+	"      --datathreads=INT  Threads for user plane packets  (default=`0')",
+	"      --upsock=STRING    Unix socket for user plane processes",
+	"      --userplane=STRING  Run as user plane of the control plane at socket",
+	"      --gtpdev=STRING    Hand GTP-U to the kernel gtp device of this name",
+	"      --bpfdev=STRING    Gn interface for the eBPF GTP-U fast path",
+	"      --xskdev=STRING    Gn interface for the AF_XDP GTP-U socket",
+	"      --dpdk=STRING      EAL arguments of the DPDK GTP-U port",
+	"      --sgidev=STRING    Ethernet interface for SGi on packet rings, in place of the tun",
+	"      --sgigw=STRING     Gateway on the SGi interface for uplink packets",
+	"      --busypoll=INT     Microseconds to poll without blocking after a packet  \n                           (default=`0')",
+	"      --memlock          Hugepages, locked and prefaulted memory  (default=off)",
 	0
 };
 
@@ -103,6 +126,29 @@ void clear_given(struct gengetopt_args_info *args_info)
 	args_info->timelimit_given = 0;
 	args_info->apn_given = 0;
 	args_info->qos_given = 0;
+	args_info->gtpcbudget_given = 0;
+	args_info->gtpubudget_given = 0;
+	args_info->tunbudget_given = 0;
+	args_info->createrate_given = 0;
+	args_info->peerrate_given = 0;
+	args_info->reserve_given = 0;
+	args_info->ipv6pool_given = 0;
+	args_info->framedroutes_given = 0;
+	args_info->apns_given = 0;
+	args_info->hairpin_given = 0;
+	args_info->reflect_given = 0;
+	args_info->gpdushort_given = 0;
+	args_info->datathreads_given = 0;
+	args_info->upsock_given = 0;
+	args_info->userplane_given = 0;
+	args_info->gtpdev_given = 0;
+	args_info->bpfdev_given = 0;
+	args_info->xskdev_given = 0;
+	args_info->dpdk_given = 0;
+	args_info->sgidev_given = 0;
+	args_info->sgigw_given = 0;
+	args_info->busypoll_given = 0;
+	args_info->memlock_given = 0;
 }
 
 static
@@ -138,6 +184,49 @@ void clear_args(struct gengetopt_args_info *args_info)
 	args_info->apn_orig = NULL;
 	args_info->qos_arg = 0x0b921f;
 	args_info->qos_orig = NULL;
+	args_info->gtpcbudget_arg = 256;
+	args_info->gtpcbudget_orig = NULL;
+	args_info->gtpubudget_arg = 64;
+	args_info->gtpubudget_orig = NULL;
+	args_info->tunbudget_arg = 64;
+	args_info->tunbudget_orig = NULL;
+	args_info->createrate_arg = 0;
+	args_info->createrate_orig = NULL;
+	args_info->peerrate_arg = 0;
+	args_info->peerrate_orig = NULL;
+	args_info->reserve_arg = 0;
+	args_info->reserve_orig = NULL;
+	args_info->ipv6pool_arg = NULL;
+	args_info->ipv6pool_orig = NULL;
+	args_info->framedroutes_arg = NULL;
+	args_info->framedroutes_orig = NULL;
+	args_info->apns_arg = NULL;
+	args_info->apns_orig = NULL;
+	args_info->hairpin_arg = NULL;
+	args_info->hairpin_orig = NULL;
+	args_info->reflect_flag = 0;
+	args_info->gpdushort_flag = 0;
+	args_info->datathreads_arg = 0;
+	args_info->datathreads_orig = NULL;
+	args_info->upsock_arg = NULL;
+	args_info->upsock_orig = NULL;
+	args_info->userplane_arg = NULL;
+	args_info->userplane_orig = NULL;
+	args_info->gtpdev_arg = NULL;
+	args_info->gtpdev_orig = NULL;
+	args_info->bpfdev_arg = NULL;
+	args_info->bpfdev_orig = NULL;
+	args_info->xskdev_arg = NULL;
+	args_info->xskdev_orig = NULL;
+	args_info->dpdk_arg = NULL;
+	args_info->dpdk_orig = NULL;
+	args_info->sgidev_arg = NULL;
+	args_info->sgidev_orig = NULL;
+	args_info->sgigw_arg = NULL;
+	args_info->sgigw_orig = NULL;
+	args_info->busypoll_arg = 0;
+	args_info->busypoll_orig = NULL;
+	args_info->memlock_flag = 0;
 
 }
 
@@ -162,6 +251,29 @@ void init_args_info(struct gengetopt_args_info *args_info)
 	args_info->timelimit_help = gengetopt_args_info_help[15];
 	args_info->apn_help = gengetopt_args_info_help[16];
 	args_info->qos_help = gengetopt_args_info_help[17];
+	args_info->gtpcbudget_help = gengetopt_args_info_help[18];
+	args_info->gtpubudget_help = gengetopt_args_info_help[19];
+	args_info->tunbudget_help = gengetopt_args_info_help[20];
+	args_info->createrate_help = gengetopt_args_info_help[21];
+	args_info->peerrate_help = gengetopt_args_info_help[22];
+	args_info->reserve_help = gengetopt_args_info_help[23];
+	args_info->ipv6pool_help = gengetopt_args_info_help[24];
+	args_info->framedroutes_help = gengetopt_args_info_help[25];
+	args_info->apns_help = gengetopt_args_info_help[26];
+	args_info->hairpin_help = gengetopt_args_info_help[27];
+	args_info->reflect_help = gengetopt_args_info_help[28];
+	args_info->gpdushort_help = gengetopt_args_info_help[29];
+	args_info->datathreads_help = gengetopt_args_info_help[30];
+	args_info->upsock_help = gengetopt_args_info_help[31];
+	args_info->userplane_help = gengetopt_args_info_help[32];
+	args_info->gtpdev_help = gengetopt_args_info_help[33];
+	args_info->bpfdev_help = gengetopt_args_info_help[34];
+	args_info->xskdev_help = gengetopt_args_info_help[35];
+	args_info->dpdk_help = gengetopt_args_info_help[36];
+	args_info->sgidev_help = gengetopt_args_info_help[37];
+	args_info->sgigw_help = gengetopt_args_info_help[38];
+	args_info->busypoll_help = gengetopt_args_info_help[39];
+	args_info->memlock_help = gengetopt_args_info_help[40];
 
 }
 
@@ -297,6 +409,134 @@ static void cmdline_parser_release(struct gengetopt_args_info *args_info)
 		free(args_info->qos_orig);	/* free previous argument */
 		args_info->qos_orig = 0;
 	}
+	if (args_info->gtpcbudget_orig) {
+		free(args_info->gtpcbudget_orig);	/* free previous argument */
+		args_info->gtpcbudget_orig = 0;
+	}
+	if (args_info->gtpubudget_orig) {
+		free(args_info->gtpubudget_orig);	/* free previous argument */
+		args_info->gtpubudget_orig = 0;
+	}
+	if (args_info->tunbudget_orig) {
+		free(args_info->tunbudget_orig);	/* free previous argument */
+		args_info->tunbudget_orig = 0;
+	}
+	if (args_info->createrate_orig) {
+		free(args_info->createrate_orig);	/* free previous argument */
+		args_info->createrate_orig = 0;
+	}
+	if (args_info->peerrate_orig) {
+		free(args_info->peerrate_orig);	/* free previous argument */
+		args_info->peerrate_orig = 0;
+	}
+	if (args_info->reserve_orig) {
+		free(args_info->reserve_orig);	/* free previous argument */
+		args_info->reserve_orig = 0;
+	}
+	if (args_info->ipv6pool_arg) {
+		free(args_info->ipv6pool_arg);	/* free previous argument */
+		args_info->ipv6pool_arg = 0;
+	}
+	if (args_info->ipv6pool_orig) {
+		free(args_info->ipv6pool_orig);	/* free previous argument */
+		args_info->ipv6pool_orig = 0;
+	}
+	if (args_info->framedroutes_arg) {
+		free(args_info->framedroutes_arg);	/* free previous argument */
+		args_info->framedroutes_arg = 0;
+	}
+	if (args_info->framedroutes_orig) {
+		free(args_info->framedroutes_orig);	/* free previous argument */
+		args_info->framedroutes_orig = 0;
+	}
+	if (args_info->apns_arg) {
+		free(args_info->apns_arg);	/* free previous argument */
+		args_info->apns_arg = 0;
+	}
+	if (args_info->apns_orig) {
+		free(args_info->apns_orig);	/* free previous argument */
+		args_info->apns_orig = 0;
+	}
+	if (args_info->hairpin_arg) {
+		free(args_info->hairpin_arg);	/* free previous argument */
+		args_info->hairpin_arg = 0;
+	}
+	if (args_info->hairpin_orig) {
+		free(args_info->hairpin_orig);	/* free previous argument */
+		args_info->hairpin_orig = 0;
+	}
+	if (args_info->datathreads_orig) {
+		free(args_info->datathreads_orig);	/* free previous argument */
+		args_info->datathreads_orig = 0;
+	}
+	if (args_info->upsock_arg) {
+		free(args_info->upsock_arg);	/* free previous argument */
+		args_info->upsock_arg = 0;
+	}
+	if (args_info->upsock_orig) {
+		free(args_info->upsock_orig);	/* free previous argument */
+		args_info->upsock_orig = 0;
+	}
+	if (args_info->userplane_arg) {
+		free(args_info->userplane_arg);	/* free previous argument */
+		args_info->userplane_arg = 0;
+	}
+	if (args_info->userplane_orig) {
+		free(args_info->userplane_orig);	/* free previous argument */
+		args_info->userplane_orig = 0;
+	}
+	if (args_info->gtpdev_arg) {
+		free(args_info->gtpdev_arg);	/* free previous argument */
+		args_info->gtpdev_arg = 0;
+	}
+	if (args_info->gtpdev_orig) {
+		free(args_info->gtpdev_orig);	/* free previous argument */
+		args_info->gtpdev_orig = 0;
+	}
+	if (args_info->bpfdev_arg) {
+		free(args_info->bpfdev_arg);	/* free previous argument */
+		args_info->bpfdev_arg = 0;
+	}
+	if (args_info->bpfdev_orig) {
+		free(args_info->bpfdev_orig);	/* free previous argument */
+		args_info->bpfdev_orig = 0;
+	}
+	if (args_info->xskdev_arg) {
+		free(args_info->xskdev_arg);	/* free previous argument */
+		args_info->xskdev_arg = 0;
+	}
+	if (args_info->xskdev_orig) {
+		free(args_info->xskdev_orig);	/* free previous argument */
+		args_info->xskdev_orig = 0;
+	}
+	if (args_info->dpdk_arg) {
+		free(args_info->dpdk_arg);	/* free previous argument */
+		args_info->dpdk_arg = 0;
+	}
+	if (args_info->dpdk_orig) {
+		free(args_info->dpdk_orig);	/* free previous argument */
+		args_info->dpdk_orig = 0;
+	}
+	if (args_info->sgidev_arg) {
+		free(args_info->sgidev_arg);	/* free previous argument */
+		args_info->sgidev_arg = 0;
+	}
+	if (args_info->sgidev_orig) {
+		free(args_info->sgidev_orig);	/* free previous argument */
+		args_info->sgidev_orig = 0;
+	}
+	if (args_info->sgigw_arg) {
+		free(args_info->sgigw_arg);	/* free previous argument */
+		args_info->sgigw_arg = 0;
+	}
+	if (args_info->sgigw_orig) {
+		free(args_info->sgigw_orig);	/* free previous argument */
+		args_info->sgigw_orig = 0;
+	}
+	if (args_info->busypoll_orig) {
+		free(args_info->busypoll_orig);	/* free previous argument */
+		args_info->busypoll_orig = 0;
+	}
 
 	clear_given(args_info);
 }
@@ -440,6 +680,175 @@ cmdline_parser_file_save(const char *filename,
 			fprintf(outfile, "%s\n", "qos");
 		}
 	}
+	if (args_info->gtpcbudget_given) {
+		if (args_info->gtpcbudget_orig) {
+			fprintf(outfile, "%s=\"%s\"\n", "gtpcbudget",
+				args_info->gtpcbudget_orig);
+		} else {
+			fprintf(outfile, "%s\n", "gtpcbudget");
+		}
+	}
+	if (args_info->gtpubudget_given) {
+		if (args_info->gtpubudget_orig) {
+			fprintf(outfile, "%s=\"%s\"\n", "gtpubudget",
+				args_info->gtpubudget_orig);
+		} else {
+			fprintf(outfile, "%s\n", "gtpubudget");
+		}
+	}
+	if (args_info->tunbudget_given) {
+		if (args_info->tunbudget_orig) {
+			fprintf(outfile, "%s=\"%s\"\n", "tunbudget",
+				args_info->tunbudget_orig);
+		} else {
+			fprintf(outfile, "%s\n", "tunbudget");
+		}
+	}
+	if (args_info->createrate_given) {
+		if (args_info->createrate_orig) {
+			fprintf(outfile, "%s=\"%s\"\n", "createrate",
+				args_info->createrate_orig);
+		} else {
+			fprintf(outfile, "%s\n", "createrate");
+		}
+	}
+	if (args_info->peerrate_given) {
+		if (args_info->peerrate_orig) {
+			fprintf(outfile, "%s=\"%s\"\n", "peerrate",
+				args_info->peerrate_orig);
+		} else {
+			fprintf(outfile, "%s\n", "peerrate");
+		}
+	}
+	if (args_info->reserve_given) {
+		if (args_info->reserve_orig) {
+			fprintf(outfile, "%s=\"%s\"\n", "reserve",
+				args_info->reserve_orig);
+		} else {
+			fprintf(outfile, "%s\n", "reserve");
+		}
+	}
+	if (args_info->ipv6pool_given) {
+		if (args_info->ipv6pool_orig) {
+			fprintf(outfile, "%s=\"%s\"\n", "ipv6pool",
+				args_info->ipv6pool_orig);
+		} else {
+			fprintf(outfile, "%s\n", "ipv6pool");
+		}
+	}
+	if (args_info->framedroutes_given) {
+		if (args_info->framedroutes_orig) {
+			fprintf(outfile, "%s=\"%s\"\n", "framedroutes",
+				args_info->framedroutes_orig);
+		} else {
+			fprintf(outfile, "%s\n", "framedroutes");
+		}
+	}
+	if (args_info->apns_given) {
+		if (args_info->apns_orig) {
+			fprintf(outfile, "%s=\"%s\"\n", "apns",
+				args_info->apns_orig);
+		} else {
+			fprintf(outfile, "%s\n", "apns");
+		}
+	}
+	if (args_info->hairpin_given) {
+		if (args_info->hairpin_orig) {
+			fprintf(outfile, "%s=\"%s\"\n", "hairpin",
+				args_info->hairpin_orig);
+		} else {
+			fprintf(outfile, "%s\n", "hairpin");
+		}
+	}
+	if (args_info->reflect_given) {
+		fprintf(outfile, "%s\n", "reflect");
+	}
+	if (args_info->gpdushort_given) {
+		fprintf(outfile, "%s\n", "gpdushort");
+	}
+	if (args_info->datathreads_given) {
+		if (args_info->datathreads_orig) {
+			fprintf(outfile, "%s=\"%s\"\n", "datathreads",
+				args_info->datathreads_orig);
+		} else {
+			fprintf(outfile, "%s\n", "datathreads");
+		}
+	}
+	if (args_info->upsock_given) {
+		if (args_info->upsock_orig) {
+			fprintf(outfile, "%s=\"%s\"\n", "upsock",
+				args_info->upsock_orig);
+		} else {
+			fprintf(outfile, "%s\n", "upsock");
+		}
+	}
+	if (args_info->userplane_given) {
+		if (args_info->userplane_orig) {
+			fprintf(outfile, "%s=\"%s\"\n", "userplane",
+				args_info->userplane_orig);
+		} else {
+			fprintf(outfile, "%s\n", "userplane");
+		}
+	}
+	if (args_info->gtpdev_given) {
+		if (args_info->gtpdev_orig) {
+			fprintf(outfile, "%s=\"%s\"\n", "gtpdev",
+				args_info->gtpdev_orig);
+		} else {
+			fprintf(outfile, "%s\n", "gtpdev");
+		}
+	}
+	if (args_info->bpfdev_given) {
+		if (args_info->bpfdev_orig) {
+			fprintf(outfile, "%s=\"%s\"\n", "bpfdev",
+				args_info->bpfdev_orig);
+		} else {
+			fprintf(outfile, "%s\n", "bpfdev");
+		}
+	}
+	if (args_info->xskdev_given) {
+		if (args_info->xskdev_orig) {
+			fprintf(outfile, "%s=\"%s\"\n", "xskdev",
+				args_info->xskdev_orig);
+		} else {
+			fprintf(outfile, "%s\n", "xskdev");
+		}
+	}
+	if (args_info->dpdk_given) {
+		if (args_info->dpdk_orig) {
+			fprintf(outfile, "%s=\"%s\"\n", "dpdk",
+				args_info->dpdk_orig);
+		} else {
+			fprintf(outfile, "%s\n", "dpdk");
+		}
+	}
+	if (args_info->sgidev_given) {
+		if (args_info->sgidev_orig) {
+			fprintf(outfile, "%s=\"%s\"\n", "sgidev",
+				args_info->sgidev_orig);
+		} else {
+			fprintf(outfile, "%s\n", "sgidev");
+		}
+	}
+	if (args_info->sgigw_given) {
+		if (args_info->sgigw_orig) {
+			fprintf(outfile, "%s=\"%s\"\n", "sgigw",
+				args_info->sgigw_orig);
+		} else {
+			fprintf(outfile, "%s\n", "sgigw");
+		}
+	}
+	if (args_info->busypoll_given) {
+		if (args_info->busypoll_orig) {
+			fprintf(outfile, "%s=\"%s\"\n", "busypoll",
+				args_info->busypoll_orig);
+		} else {
+			fprintf(outfile, "%s\n", "busypoll");
+		}
+	}
+	if (args_info->memlock_given) {
+		fprintf(outfile, "%s\n", "memlock");
+	}
 
 	fclose(outfile);
 
@@ -544,6 +953,29 @@ cmdline_parser_internal(int argc, char *const *argv,
 			{"timelimit", 1, NULL, 0},
 			{"apn", 1, NULL, 'a'},
 			{"qos", 1, NULL, 'q'},
+			{"gtpcbudget", 1, NULL, 0},
+			{"gtpubudget", 1, NULL, 0},
+			{"tunbudget", 1, NULL, 0},
+			{"createrate", 1, NULL, 0},
+			{"peerrate", 1, NULL, 0},
+			{"reserve", 1, NULL, 0},
+			{"ipv6pool", 1, NULL, 0},
+			{"framedroutes", 1, NULL, 0},
+			{"apns", 1, NULL, 0},
+			{"hairpin", 1, NULL, 0},
+			{"reflect", 0, NULL, 0},
+			{"gpdushort", 0, NULL, 0},
+			{"datathreads", 1, NULL, 0},
+			{"upsock", 1, NULL, 0},
+			{"userplane", 1, NULL, 0},
+			{"gtpdev", 1, NULL, 0},
+			{"bpfdev", 1, NULL, 0},
+			{"xskdev", 1, NULL, 0},
+			{"dpdk", 1, NULL, 0},
+			{"sgidev", 1, NULL, 0},
+			{"sgigw", 1, NULL, 0},
+			{"busypoll", 1, NULL, 0},
+			{"memlock", 0, NULL, 0},
 			{NULL, 0, NULL, 0}
 		};
 
@@ -931,6 +1363,595 @@ cmdline_parser_internal(int argc, char *const *argv,
 				args_info->timelimit_orig =
 				    gengetopt_strdup(optarg);
 			}
+			/* Max GTP-C packets per poll.  */
+			else if (strcmp
+				 (long_options[option_index].name,
+				  "gtpcbudget") == 0) {
+				if (local_args_info.gtpcbudget_given) {
+					fprintf(stderr,
+						"%s: `--gtpcbudget' option given more than once%s\n",
+						argv[0],
+						(additional_error ?
+						 additional_error : ""));
+					goto failure;
+				}
+				if (args_info->gtpcbudget_given && !override)
+					continue;
+				local_args_info.gtpcbudget_given = 1;
+				args_info->gtpcbudget_given = 1;
+				args_info->gtpcbudget_arg =
+				    strtol(optarg, &stop_char, 0);
+				if (!(stop_char && *stop_char == '\0')) {
+					fprintf(stderr,
+						"%s: invalid numeric value: %s\n",
+						argv[0], optarg);
+					goto failure;
+				}
+				if (args_info->gtpcbudget_orig)
+					free(args_info->gtpcbudget_orig);	/* free previous string */
+				args_info->gtpcbudget_orig =
+				    gengetopt_strdup(optarg);
+			}
+			/* Max GTP-U packets per poll.  */
+			else if (strcmp
+				 (long_options[option_index].name,
+				  "gtpubudget") == 0) {
+				if (local_args_info.gtpubudget_given) {
+					fprintf(stderr,
+						"%s: `--gtpubudget' option given more than once%s\n",
+						argv[0],
+						(additional_error ?
+						 additional_error : ""));
+					goto failure;
+				}
+				if (args_info->gtpubudget_given && !override)
+					continue;
+				local_args_info.gtpubudget_given = 1;
+				args_info->gtpubudget_given = 1;
+				args_info->gtpubudget_arg =
+				    strtol(optarg, &stop_char, 0);
+				if (!(stop_char && *stop_char == '\0')) {
+					fprintf(stderr,
+						"%s: invalid numeric value: %s\n",
+						argv[0], optarg);
+					goto failure;
+				}
+				if (args_info->gtpubudget_orig)
+					free(args_info->gtpubudget_orig);	/* free previous string */
+				args_info->gtpubudget_orig =
+				    gengetopt_strdup(optarg);
+			}
+			/* Max TUN packets per poll.  */
+			else if (strcmp
+				 (long_options[option_index].name,
+				  "tunbudget") == 0) {
+				if (local_args_info.tunbudget_given) {
+					fprintf(stderr,
+						"%s: `--tunbudget' option given more than once%s\n",
+						argv[0],
+						(additional_error ?
+						 additional_error : ""));
+					goto failure;
+				}
+				if (args_info->tunbudget_given && !override)
+					continue;
+				local_args_info.tunbudget_given = 1;
+				args_info->tunbudget_given = 1;
+				args_info->tunbudget_arg =
+				    strtol(optarg, &stop_char, 0);
+				if (!(stop_char && *stop_char == '\0')) {
+					fprintf(stderr,
+						"%s: invalid numeric value: %s\n",
+						argv[0], optarg);
+					goto failure;
+				}
+				if (args_info->tunbudget_orig)
+					free(args_info->tunbudget_orig);	/* free previous string */
+				args_info->tunbudget_orig =
+				    gengetopt_strdup(optarg);
+			}
+			/* Max create requests per second.  */
+			else if (strcmp
+				 (long_options[option_index].name,
+				  "createrate") == 0) {
+				if (local_args_info.createrate_given) {
+					fprintf(stderr,
+						"%s: `--createrate' option given more than once%s\n",
+						argv[0],
+						(additional_error ?
+						 additional_error : ""));
+					goto failure;
+				}
+				if (args_info->createrate_given && !override)
+					continue;
+				local_args_info.createrate_given = 1;
+				args_info->createrate_given = 1;
+				args_info->createrate_arg =
+				    strtol(optarg, &stop_char, 0);
+				if (!(stop_char && *stop_char == '\0')) {
+					fprintf(stderr,
+						"%s: invalid numeric value: %s\n",
+						argv[0], optarg);
+					goto failure;
+				}
+				if (args_info->createrate_orig)
+					free(args_info->createrate_orig);	/* free previous string */
+				args_info->createrate_orig =
+				    gengetopt_strdup(optarg);
+			}
+			/* Max create requests per second per peer.  */
+			else if (strcmp
+				 (long_options[option_index].name,
+				  "peerrate") == 0) {
+				if (local_args_info.peerrate_given) {
+					fprintf(stderr,
+						"%s: `--peerrate' option given more than once%s\n",
+						argv[0],
+						(additional_error ?
+						 additional_error : ""));
+					goto failure;
+				}
+				if (args_info->peerrate_given && !override)
+					continue;
+				local_args_info.peerrate_given = 1;
+				args_info->peerrate_given = 1;
+				args_info->peerrate_arg =
+				    strtol(optarg, &stop_char, 0);
+				if (!(stop_char && *stop_char == '\0')) {
+					fprintf(stderr,
+						"%s: invalid numeric value: %s\n",
+						argv[0], optarg);
+					goto failure;
+				}
+				if (args_info->peerrate_orig)
+					free(args_info->peerrate_orig);	/* free previous string */
+				args_info->peerrate_orig =
+				    gengetopt_strdup(optarg);
+			}
+			/* Contexts and addresses kept free.  */
+			else if (strcmp
+				 (long_options[option_index].name,
+				  "reserve") == 0) {
+				if (local_args_info.reserve_given) {
+					fprintf(stderr,
+						"%s: `--reserve' option given more than once%s\n",
+						argv[0],
+						(additional_error ?
+						 additional_error : ""));
+					goto failure;
+				}
+				if (args_info->reserve_given && !override)
+					continue;
+				local_args_info.reserve_given = 1;
+				args_info->reserve_given = 1;
+				args_info->reserve_arg =
+				    strtol(optarg, &stop_char, 0);
+				if (!(stop_char && *stop_char == '\0')) {
+					fprintf(stderr,
+						"%s: invalid numeric value: %s\n",
+						argv[0], optarg);
+					goto failure;
+				}
+				if (args_info->reserve_orig)
+					free(args_info->reserve_orig);	/* free previous string */
+				args_info->reserve_orig =
+				    gengetopt_strdup(optarg);
+			}
+			/* IPv6 prefix pool.  */
+			else if (strcmp
+				 (long_options[option_index].name,
+				  "ipv6pool") == 0) {
+				if (local_args_info.ipv6pool_given) {
+					fprintf(stderr,
+						"%s: `--ipv6pool' option given more than once%s\n",
+						argv[0],
+						(additional_error ?
+						 additional_error : ""));
+					goto failure;
+				}
+				if (args_info->ipv6pool_given && !override)
+					continue;
+				local_args_info.ipv6pool_given = 1;
+				args_info->ipv6pool_given = 1;
+				if (args_info->ipv6pool_arg)
+					free(args_info->ipv6pool_arg);	/* free previous string */
+				args_info->ipv6pool_arg =
+				    gengetopt_strdup(optarg);
+				if (args_info->ipv6pool_orig)
+					free(args_info->ipv6pool_orig);	/* free previous string */
+				args_info->ipv6pool_orig =
+				    gengetopt_strdup(optarg);
+			}
+			/* Routed prefixes per IMSI.  */
+			else if (strcmp
+				 (long_options[option_index].name,
+				  "framedroutes") == 0) {
+				if (local_args_info.framedroutes_given) {
+					fprintf(stderr,
+						"%s: `--framedroutes' option given more than once%s\n",
+						argv[0],
+						(additional_error ?
+						 additional_error : ""));
+					goto failure;
+				}
+				if (args_info->framedroutes_given && !override)
+					continue;
+				local_args_info.framedroutes_given = 1;
+				args_info->framedroutes_given = 1;
+				if (args_info->framedroutes_arg)
+					free(args_info->framedroutes_arg);	/* free previous string */
+				args_info->framedroutes_arg =
+				    gengetopt_strdup(optarg);
+				if (args_info->framedroutes_orig)
+					free(args_info->framedroutes_orig);	/* free previous string */
+				args_info->framedroutes_orig =
+				    gengetopt_strdup(optarg);
+			}
+			/* APNs with own network and DNS.  */
+			else if (strcmp
+				 (long_options[option_index].name,
+				  "apns") == 0) {
+				if (local_args_info.apns_given) {
+					fprintf(stderr,
+						"%s: `--apns' option given more than once%s\n",
+						argv[0],
+						(additional_error ?
+						 additional_error : ""));
+					goto failure;
+				}
+				if (args_info->apns_given && !override)
+					continue;
+				local_args_info.apns_given = 1;
+				args_info->apns_given = 1;
+				if (args_info->apns_arg)
+					free(args_info->apns_arg);	/* free previous string */
+				args_info->apns_arg =
+				    gengetopt_strdup(optarg);
+				if (args_info->apns_orig)
+					free(args_info->apns_orig);	/* free previous string */
+				args_info->apns_orig =
+				    gengetopt_strdup(optarg);
+			}
+			/* APNs forwarding between own contexts.  */
+			else if (strcmp
+				 (long_options[option_index].name,
+				  "hairpin") == 0) {
+				if (local_args_info.hairpin_given) {
+					fprintf(stderr,
+						"%s: `--hairpin' option given more than once%s\n",
+						argv[0],
+						(additional_error ?
+						 additional_error : ""));
+					goto failure;
+				}
+				if (args_info->hairpin_given && !override)
+					continue;
+				local_args_info.hairpin_given = 1;
+				args_info->hairpin_given = 1;
+				if (args_info->hairpin_arg)
+					free(args_info->hairpin_arg);	/* free previous string */
+				args_info->hairpin_arg =
+				    gengetopt_strdup(optarg);
+				if (args_info->hairpin_orig)
+					free(args_info->hairpin_orig);	/* free previous string */
+				args_info->hairpin_orig =
+				    gengetopt_strdup(optarg);
+			}
+			/* Send uplink packets back to the sender.  */
+			else if (strcmp
+				 (long_options[option_index].name,
+				  "reflect") == 0) {
+				if (local_args_info.reflect_given) {
+					fprintf(stderr,
+						"%s: `--reflect' option given more than once%s\n",
+						argv[0],
+						(additional_error ?
+						 additional_error : ""));
+					goto failure;
+				}
+				if (args_info->reflect_given && !override)
+					continue;
+				local_args_info.reflect_given = 1;
+				args_info->reflect_given = 1;
+				args_info->reflect_flag =
+				    !(args_info->reflect_flag);
+			}
+			/* Send GTPv1 G-PDUs without sequence numbers.  */
+			else if (strcmp
+				 (long_options[option_index].name,
+				  "gpdushort") == 0) {
+				if (local_args_info.gpdushort_given) {
+					fprintf(stderr,
+						"%s: `--gpdushort' option given more than once%s\n",
+						argv[0],
+						(additional_error ?
+						 additional_error : ""));
+					goto failure;
+				}
+				if (args_info->gpdushort_given && !override)
+					continue;
+				local_args_info.gpdushort_given = 1;
+				args_info->gpdushort_given = 1;
+				args_info->gpdushort_flag =
+				    !(args_info->gpdushort_flag);
+			}
+			/* Threads for user plane packets.  */
+			else if (strcmp
+				 (long_options[option_index].name,
+				  "datathreads") == 0) {
+				if (local_args_info.datathreads_given) {
+					fprintf(stderr,
+						"%s: `--datathreads' option given more than once%s\n",
+						argv[0],
+						(additional_error ?
+						 additional_error : ""));
+					goto failure;
+				}
+				if (args_info->datathreads_given && !override)
+					continue;
+				local_args_info.datathreads_given = 1;
+				args_info->datathreads_given = 1;
+				args_info->datathreads_arg =
+				    strtol(optarg, &stop_char, 0);
+				if (!(stop_char && *stop_char == '\0')) {
+					fprintf(stderr,
+						"%s: invalid numeric value: %s\n",
+						argv[0], optarg);
+					goto failure;
+				}
+				if (args_info->datathreads_orig)
+					free(args_info->datathreads_orig);	/* free previous string */
+				args_info->datathreads_orig =
+				    gengetopt_strdup(optarg);
+			}
+			/* Unix socket for user plane processes.  */
+			else if (strcmp
+				 (long_options[option_index].name,
+				  "upsock") == 0) {
+				if (local_args_info.upsock_given) {
+					fprintf(stderr,
+						"%s: `--upsock' option given more than once%s\n",
+						argv[0],
+						(additional_error ?
+						 additional_error : ""));
+					goto failure;
+				}
+				if (args_info->upsock_given && !override)
+					continue;
+				local_args_info.upsock_given = 1;
+				args_info->upsock_given = 1;
+				if (args_info->upsock_arg)
+					free(args_info->upsock_arg);	/* free previous string */
+				args_info->upsock_arg =
+				    gengetopt_strdup(optarg);
+				if (args_info->upsock_orig)
+					free(args_info->upsock_orig);	/* free previous string */
+				args_info->upsock_orig =
+				    gengetopt_strdup(optarg);
+			}
+			/* Run as user plane of the control plane at socket.  */
+			else if (strcmp
+				 (long_options[option_index].name,
+				  "userplane") == 0) {
+				if (local_args_info.userplane_given) {
+					fprintf(stderr,
+						"%s: `--userplane' option given more than once%s\n",
+						argv[0],
+						(additional_error ?
+						 additional_error : ""));
+					goto failure;
+				}
+				if (args_info->userplane_given && !override)
+					continue;
+				local_args_info.userplane_given = 1;
+				args_info->userplane_given = 1;
+				if (args_info->userplane_arg)
+					free(args_info->userplane_arg);	/* free previous string */
+				args_info->userplane_arg =
+				    gengetopt_strdup(optarg);
+				if (args_info->userplane_orig)
+					free(args_info->userplane_orig);	/* free previous string */
+				args_info->userplane_orig =
+				    gengetopt_strdup(optarg);
+			}
+			/* Hand GTP-U to the kernel gtp device of this name.  */
+			else if (strcmp
+				 (long_options[option_index].name,
+				  "gtpdev") == 0) {
+				if (local_args_info.gtpdev_given) {
+					fprintf(stderr,
+						"%s: `--gtpdev' option given more than once%s\n",
+						argv[0],
+						(additional_error ?
+						 additional_error : ""));
+					goto failure;
+				}
+				if (args_info->gtpdev_given && !override)
+					continue;
+				local_args_info.gtpdev_given = 1;
+				args_info->gtpdev_given = 1;
+				if (args_info->gtpdev_arg)
+					free(args_info->gtpdev_arg);	/* free previous string */
+				args_info->gtpdev_arg =
+				    gengetopt_strdup(optarg);
+				if (args_info->gtpdev_orig)
+					free(args_info->gtpdev_orig);	/* free previous string */
+				args_info->gtpdev_orig =
+				    gengetopt_strdup(optarg);
+			}
+			/* Gn interface for the eBPF GTP-U fast path.  */
+			else if (strcmp
+				 (long_options[option_index].name,
+				  "bpfdev") == 0) {
+				if (local_args_info.bpfdev_given) {
+					fprintf(stderr,
+						"%s: `--bpfdev' option given more than once%s\n",
+						argv[0],
+						(additional_error ?
+						 additional_error : ""));
+					goto failure;
+				}
+				if (args_info->bpfdev_given && !override)
+					continue;
+				local_args_info.bpfdev_given = 1;
+				args_info->bpfdev_given = 1;
+				if (args_info->bpfdev_arg)
+					free(args_info->bpfdev_arg);	/* free previous string */
+				args_info->bpfdev_arg =
+				    gengetopt_strdup(optarg);
+				if (args_info->bpfdev_orig)
+					free(args_info->bpfdev_orig);	/* free previous string */
+				args_info->bpfdev_orig =
+				    gengetopt_strdup(optarg);
+			}
+			/* Gn interface for the AF_XDP GTP-U socket.  */
+			else if (strcmp
+				 (long_options[option_index].name,
+				  "xskdev") == 0) {
+				if (local_args_info.xskdev_given) {
+					fprintf(stderr,
+						"%s: `--xskdev' option given more than once%s\n",
+						argv[0],
+						(additional_error ?
+						 additional_error : ""));
+					goto failure;
+				}
+				if (args_info->xskdev_given && !override)
+					continue;
+				local_args_info.xskdev_given = 1;
+				args_info->xskdev_given = 1;
+				if (args_info->xskdev_arg)
+					free(args_info->xskdev_arg);	/* free previous string */
+				args_info->xskdev_arg =
+				    gengetopt_strdup(optarg);
+				if (args_info->xskdev_orig)
+					free(args_info->xskdev_orig);	/* free previous string */
+				args_info->xskdev_orig =
+				    gengetopt_strdup(optarg);
+			}
+			/* EAL arguments of the DPDK GTP-U port.  */
+			else if (strcmp
+				 (long_options[option_index].name,
+				  "dpdk") == 0) {
+				if (local_args_info.dpdk_given) {
+					fprintf(stderr,
+						"%s: `--dpdk' option given more than once%s\n",
+						argv[0],
+						(additional_error ?
+						 additional_error : ""));
+					goto failure;
+				}
+				if (args_info->dpdk_given && !override)
+					continue;
+				local_args_info.dpdk_given = 1;
+				args_info->dpdk_given = 1;
+				if (args_info->dpdk_arg)
+					free(args_info->dpdk_arg);	/* free previous string */
+				args_info->dpdk_arg =
+				    gengetopt_strdup(optarg);
+				if (args_info->dpdk_orig)
+					free(args_info->dpdk_orig);	/* free previous string */
+				args_info->dpdk_orig =
+				    gengetopt_strdup(optarg);
+			}
+			/* Ethernet interface for SGi on packet rings, in place of the tun.  */
+			else if (strcmp
+				 (long_options[option_index].name,
+				  "sgidev") == 0) {
+				if (local_args_info.sgidev_given) {
+					fprintf(stderr,
+						"%s: `--sgidev' option given more than once%s\n",
+						argv[0],
+						(additional_error ?
+						 additional_error : ""));
+					goto failure;
+				}
+				if (args_info->sgidev_given && !override)
+					continue;
+				local_args_info.sgidev_given = 1;
+				args_info->sgidev_given = 1;
+				if (args_info->sgidev_arg)
+					free(args_info->sgidev_arg);	/* free previous string */
+				args_info->sgidev_arg =
+				    gengetopt_strdup(optarg);
+				if (args_info->sgidev_orig)
+					free(args_info->sgidev_orig);	/* free previous string */
+				args_info->sgidev_orig =
+				    gengetopt_strdup(optarg);
+			}
+			/* Gateway on the SGi interface for uplink packets.  */
+			else if (strcmp
+				 (long_options[option_index].name,
+				  "sgigw") == 0) {
+				if (local_args_info.sgigw_given) {
+					fprintf(stderr,
+						"%s: `--sgigw' option given more than once%s\n",
+						argv[0],
+						(additional_error ?
+						 additional_error : ""));
+					goto failure;
+				}
+				if (args_info->sgigw_given && !override)
+					continue;
+				local_args_info.sgigw_given = 1;
+				args_info->sgigw_given = 1;
+				if (args_info->sgigw_arg)
+					free(args_info->sgigw_arg);	/* free previous string */
+				args_info->sgigw_arg =
+				    gengetopt_strdup(optarg);
+				if (args_info->sgigw_orig)
+					free(args_info->sgigw_orig);	/* free previous string */
+				args_info->sgigw_orig =
+				    gengetopt_strdup(optarg);
+			}
+			/* Microseconds to poll without blocking after a packet.  */
+			else if (strcmp
+				 (long_options[option_index].name,
+				  "busypoll") == 0) {
+				if (local_args_info.busypoll_given) {
+					fprintf(stderr,
+						"%s: `--busypoll' option given more than once%s\n",
+						argv[0],
+						(additional_error ?
+						 additional_error : ""));
+					goto failure;
+				}
+				if (args_info->busypoll_given && !override)
+					continue;
+				local_args_info.busypoll_given = 1;
+				args_info->busypoll_given = 1;
+				args_info->busypoll_arg =
+				    strtol(optarg, &stop_char, 0);
+				if (!(stop_char && *stop_char == '\0')) {
+					fprintf(stderr,
+						"%s: invalid numeric value: %s\n",
+						argv[0], optarg);
+					goto failure;
+				}
+				if (args_info->busypoll_orig)
+					free(args_info->busypoll_orig);	/* free previous string */
+				args_info->busypoll_orig =
+				    gengetopt_strdup(optarg);
+			}
+			/* Hugepages, locked and prefaulted memory.  */
+			else if (strcmp
+				 (long_options[option_index].name,
+				  "memlock") == 0) {
+				if (local_args_info.memlock_given) {
+					fprintf(stderr,
+						"%s: `--memlock' option given more than once%s\n",
+						argv[0],
+						(additional_error ?
+						 additional_error : ""));
+					goto failure;
+				}
+				if (args_info->memlock_given && !override)
+					continue;
+				local_args_info.memlock_given = 1;
+				args_info->memlock_given = 1;
+				args_info->memlock_flag =
+				    !(args_info->memlock_flag);
+			}
 
 			break;
 		case '?':	/* Invalid option.  */
@@ -71,6 +71,72 @@ extern "C" {
 		int qos_arg;	/* Requested quality of service (default='0x0b921f').  */
 		char *qos_orig;	/* Requested quality of service original value given at command line.  */
 		const char *qos_help;	/* Requested quality of service help description.  */
+		int gtpcbudget_arg;	/* Max GTP-C packets per poll (default='256').  */
+		char *gtpcbudget_orig;	/* Max GTP-C packets per poll original value given at command line.  */
+		const char *gtpcbudget_help;	/* Max GTP-C packets per poll help description.  */
+		int gtpubudget_arg;	/* Max GTP-U packets per poll (default='64').  */
+		char *gtpubudget_orig;	/* Max GTP-U packets per poll original value given at command line.  */
+		const char *gtpubudget_help;	/* Max GTP-U packets per poll help description.  */
+		int tunbudget_arg;	/* Max TUN packets per poll (default='64').  */
+		char *tunbudget_orig;	/* Max TUN packets per poll original value given at command line.  */
+		const char *tunbudget_help;	/* Max TUN packets per poll help description.  */
+		int createrate_arg;	/* Max create requests per second (default='0').  */
+		char *createrate_orig;	/* Max create requests per second original value given at command line.  */
+		const char *createrate_help;	/* Max create requests per second help description.  */
+		int peerrate_arg;	/* Max create requests per second per peer (default='0').  */
+		char *peerrate_orig;	/* Max create requests per second per peer original value given at command line.  */
+		const char *peerrate_help;	/* Max create requests per second per peer help description.  */
+		int reserve_arg;	/* Contexts and addresses kept free (default='0').  */
+		char *reserve_orig;	/* Contexts and addresses kept free original value given at command line.  */
+		const char *reserve_help;	/* Contexts and addresses kept free help description.  */
+		char *ipv6pool_arg;	/* IPv6 prefix pool.  */
+		char *ipv6pool_orig;	/* IPv6 prefix pool original value given at command line.  */
+		const char *ipv6pool_help;	/* IPv6 prefix pool help description.  */
+		char *framedroutes_arg;	/* Routed prefixes per IMSI.  */
+		char *framedroutes_orig;	/* Routed prefixes per IMSI original value given at command line.  */
+		const char *framedroutes_help;	/* Routed prefixes per IMSI help description.  */
+		char *apns_arg;	/* APNs with own network and DNS.  */
+		char *apns_orig;	/* APNs with own network and DNS original value given at command line.  */
+		const char *apns_help;	/* APNs with own network and DNS help description.  */
+		char *hairpin_arg;	/* APNs forwarding between own contexts.  */
+		char *hairpin_orig;	/* APNs forwarding between own contexts original value given at command line.  */
+		const char *hairpin_help;	/* APNs forwarding between own contexts help description.  */
+		int reflect_flag;	/* Send uplink packets back to the sender (default=off).  */
+		const char *reflect_help;	/* Send uplink packets back to the sender help description.  */
+		int gpdushort_flag;	/* Send GTPv1 G-PDUs without sequence numbers (default=off).  */
+		const char *gpdushort_help;	/* Send GTPv1 G-PDUs without sequence numbers help description.  */
+		int datathreads_arg;	/* Threads for user plane packets (default='0').  */
+		char *datathreads_orig;	/* Threads for user plane packets original value given at command line.  */
+		const char *datathreads_help;	/* Threads for user plane packets help description.  */
+		char *upsock_arg;	/* Unix socket for user plane processes.  */
+		char *upsock_orig;	/* Unix socket for user plane processes original value given at command line.  */
+		const char *upsock_help;	/* Unix socket for user plane processes help description.  */
+		char *userplane_arg;	/* Run as user plane of the control plane at socket.  */
+		char *userplane_orig;	/* Run as user plane of the control plane at socket original value given at command line.  */
+		const char *userplane_help;	/* Run as user plane of the control plane at socket help description.  */
+		char *gtpdev_arg;	/* Hand GTP-U to the kernel gtp device of this name.  */
+		char *gtpdev_orig;	/* Hand GTP-U to the kernel gtp device of this name original value given at command line.  */
+		const char *gtpdev_help;	/* Hand GTP-U to the kernel gtp device of this name help description.  */
+		char *bpfdev_arg;	/* Gn interface for the eBPF GTP-U fast path.  */
+		char *bpfdev_orig;	/* Gn interface for the eBPF GTP-U fast path original value given at command line.  */
+		const char *bpfdev_help;	/* Gn interface for the eBPF GTP-U fast path help description.  */
+		char *xskdev_arg;	/* Gn interface for the AF_XDP GTP-U socket.  */
+		char *xskdev_orig;	/* Gn interface for the AF_XDP GTP-U socket original value given at command line.  */
+		const char *xskdev_help;	/* Gn interface for the AF_XDP GTP-U socket help description.  */
+		char *dpdk_arg;	/* EAL arguments of the DPDK GTP-U port.  */
+		char *dpdk_orig;	/* EAL arguments of the DPDK GTP-U port original value given at command line.  */
+		const char *dpdk_help;	/* EAL arguments of the DPDK GTP-U port help description.  */
+		char *sgidev_arg;	/* Ethernet interface for SGi on packet rings, in place of the tun.  */
+		char *sgidev_orig;	/* Ethernet interface for SGi on packet rings, in place of the tun original value given at command line.  */
+		const char *sgidev_help;	/* Ethernet interface for SGi on packet rings, in place of the tun help description.  */
+		char *sgigw_arg;	/* Gateway on the SGi interface for uplink packets.  */
+		char *sgigw_orig;	/* Gateway on the SGi interface for uplink packets original value given at command line.  */
+		const char *sgigw_help;	/* Gateway on the SGi interface for uplink packets help description.  */
+		int busypoll_arg;	/* Microseconds to poll without blocking after a packet (default='0').  */
+		char *busypoll_orig;	/* Microseconds to poll without blocking after a packet original value given at command line.  */
+		const char *busypoll_help;	/* Microseconds to poll without blocking after a packet help description.  */
+		int memlock_flag;	/* Hugepages, locked and prefaulted memory (default=off).  */
+		const char *memlock_help;	/* Hugepages, locked and prefaulted memory help description.  */
 
 		int help_given;	/* Whether help was given.  */
 		int version_given;	/* Whether version was given.  */
@@ -90,6 +156,29 @@ extern "C" {
 		int timelimit_given;	/* Whether timelimit was given.  */
 		int apn_given;	/* Whether apn was given.  */
 		int qos_given;	/* Whether qos was given.  */
+		int gtpcbudget_given;	/* Whether gtpcbudget was given.  */
+		int gtpubudget_given;	/* Whether gtpubudget was given.  */
+		int tunbudget_given;	/* Whether tunbudget was given.  */
+		int createrate_given;	/* Whether createrate was given.  */
+		int peerrate_given;	/* Whether peerrate was given.  */
+		int reserve_given;	/* Whether reserve was given.  */
+		int ipv6pool_given;	/* Whether ipv6pool was given.  */
+		int framedroutes_given;	/* Whether framedroutes was given.  */
+		int apns_given;	/* Whether apns was given.  */
+		int hairpin_given;	/* Whether hairpin was given.  */
+		int reflect_given;	/* Whether reflect was given.  */
+		int gpdushort_given;	/* Whether gpdushort was given.  */
+		int datathreads_given;	/* Whether datathreads was given.  */
+		int upsock_given;	/* Whether upsock was given.  */
+		int userplane_given;	/* Whether userplane was given.  */
+		int gtpdev_given;	/* Whether gtpdev was given.  */
+		int bpfdev_given;	/* Whether bpfdev was given.  */
+		int xskdev_given;	/* Whether xskdev was given.  */
+		int dpdk_given;	/* Whether dpdk was given.  */
+		int sgidev_given;	/* Whether sgidev was given.  */
+		int sgigw_given;	/* Whether sgigw was given.  */
+		int busypoll_given;	/* Whether busypoll was given.  */
+		int memlock_given;	/* Whether memlock was given.  */
 
 	};
 
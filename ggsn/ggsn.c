@@ -38,6 +38,7 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <pthread.h>
 
 #include <sys/socket.h>
 #include <sys/ioctl.h>
@@ -48,19 +49,74 @@
 #include <time.h>
 
 #include "../lib/tun.h"
+#include "../lib/dpdk.h"
+#include "../lib/gtpbpf.h"
+#include "../lib/gtpkern.h"
 #include "../lib/ippool.h"
+#include "../lib/lpm.h"
+#include "../lib/lookup.h"
+#include "../lib/rcu.h"
+#include "../lib/session.h"
 #include "../lib/syserr.h"
+#include "../lib/xsk.h"
+#include "../lib/afpacket.h"
+#include "../lib/memlock.h"
 #include "../gtp/pdp.h"
 #include "../gtp/gtp.h"
 #include "cmdline.h"
 
 int end = 0;
+int dump = 0;			/* Log statistics          */
+int reload = 0;			/* Add new address ranges  */
+char *confpath;			/* Configuration file      */
 int maxfd = 0;			/* For select()            */
+int tunbudget;			/* TUN packets per poll    */
+uint64_t tun_exhausted;		/* TUN budget used up      */
+int reserve;			/* Addresses to keep free  */
+int reflect;			/* Send uplink back down   */
+
+struct busy_t {			/* Busy polling of a thread */
+	struct timespec last;	/* Last packet */
+	uint64_t spin_ns;	/* Polling without blocking */
+	uint64_t sleep_ns;	/* Blocked in select() */
+	uint64_t sleeps;	/* Times blocked in select() */
+};
+#define BUSY_SELECT 16		/* Busy polling rounds per select() */
+int busypoll;			/* Microseconds to poll    */
+struct busy_t mainbusy;		/* Of the main thread      */
+
+struct dp_t {			/* Data plane thread */
+	pthread_t thread;
+	int reader;		/* RCU reader number */
+	struct busy_t busy;
+};
+struct dp_t *dps;		/* Data plane threads      */
+int ndps;			/* Number of them. 0: none */
+__thread int dp_reader = -1;	/* RCU reader of this thread */
+__thread uint64_t dp_packets;	/* Data packets handled by the thread */
+__thread struct gtp_pkt *dlburst;	/* Burst of tun_poll(), or NULL */
+__thread int ndlburst;
+__thread uint8_t(*dlbuf)[PACKET_MAX];	/* Packets of the burst */
+
+#define UP_MAX 16		/* Max number of user plane processes */
+
+int upfd = -1;			/* Control plane: listening socket */
+struct session_t ups[UP_MAX];	/* Control plane: user planes */
+int nups;			/* Slots used in ups       */
+struct pdp_t *uppending[PDP_MAX];	/* Creates waiting for flush */
+int nuppending;			/* Number of them          */
+struct {
+	uint32_t tei;		/* Own TEID                */
+	uint64_t tid;		/* Tunnel identifier       */
+} kernlost[PDP_MAX];		/* Updates the kernel refused */
+int nkernlost;			/* Number of them          */
+struct session_t cp;		/* User plane: control plane */
 
 struct in_addr listen_;
 struct in_addr netaddr, destaddr, net, mask;	/* Network interface       */
 struct in_addr dns1, dns2;	/* PCO DNS address         */
 char *ipup, *ipdown;		/* Filename of scripts     */
+char *gtpdev;			/* Kernel gtp device name  */
 int debug;			/* Print debug output      */
 struct ul255_t pco;
 struct ul255_t qos;
@@ -68,7 +124,48 @@ struct ul255_t apn;
 
 struct gsn_t *gsn;		/* GSN instance            */
 struct tun_t *tun;		/* TUN instance            */
+struct gtpkern_t *gk;		/* Kernel GTP-U device     */
+struct gtpbpf_t *gb;		/* eBPF GTP-U fast path    */
+struct xsk_t *xsk;		/* AF_XDP GTP-U socket     */
+struct afpacket_t *sgi;		/* SGi on packet rings     */
+struct dpdk_t *dpdk;		/* DPDK GTP-U port         */
 struct ippool_t *ippool;	/* Pool of IP addresses    */
+struct ippool6_t *ippool6;	/* Pool of IPv6 prefixes   */
+
+#define FRAMED_GROUPS 4096	/* Max routes longer than /24 in use */
+
+struct framed_t {		/* Prefix routed to the context of an IMSI */
+	uint64_t imsi;
+	struct in_addr net;
+	struct in_addr mask;
+	int len;
+};
+struct framed_t *framed;	/* Framed routes           */
+int nframed;			/* Number of framed routes */
+struct lpm_t *lpm;		/* Framed routes in use    */
+
+#define APN_HASHSIZE 256	/* Buckets in APN hash. Power of two */
+
+struct apn_t {			/* Access point with its own network */
+	char *name;		/* APN as configured */
+	struct ul255_t apn;	/* Encoded APN */
+	unsigned long int hash;	/* Hash of encoded APN */
+	struct apn_t *next;	/* Next in hash chain */
+	char *netarg;		/* Network as configured */
+	struct in_addr net, mask, netaddr;
+	struct ul255_t pco;	/* PCO with DNS addresses */
+	struct ippool_t *ippool;	/* Pool of IP addresses */
+	struct tun_t *tun;	/* TUN instance */
+	int ifindex;		/* Of tun, for the eBPF fast path */
+	int hairpin;		/* Forward between own contexts directly */
+	uint64_t accept;	/* Contexts created */
+	uint64_t reject;	/* Create requests rejected */
+	uint64_t deleted;	/* Contexts deleted */
+	uint64_t hairpinned;	/* Packets forwarded between own contexts */
+};
+struct apn_t *apns;		/* APNs. The first is the default */
+int napns;			/* Number of APNs */
+struct apn_t *apnhash[APN_HASHSIZE];	/* APNs by hash of encoded APN */
 
 /* To exit gracefully. Used with GCC compilation flag -pg and gprof */
 void signal_handler(int s)
@@ -78,6 +175,671 @@ void signal_handler(int s)
 	end = 1;
 }
 
+/* SIGUSR1: Log statistics from the main loop */
+void stats_handler(int s)
+{
+	dump = 1;
+}
+
+/* Resident footprint, once everything is set up */
+void log_memory(void)
+{
+	long rss, locked, huge;
+
+	if (!mem_usage(&rss, &locked, &huge))
+		syslog(LOG_INFO,
+		       "Memory: %ld kB resident, %ld kB locked, %ld kB in hugepages",
+		       rss, locked, huge);
+}
+
+void log_stats(void)
+{
+	static time_t last = 0;
+	static uint64_t last_accept = 0, last_reject = 0;
+	uint64_t reject;
+	uint64_t ulp, ulb, dlp, dlb;
+	time_t now = time(NULL);
+	int n;
+	long secs = (last && (now > last)) ? (long)(now - last) : 1;
+
+	syslog(LOG_INFO,
+	       "Budget used up: fd0 %llu, fd1c %llu, fd1u %llu, tun %llu",
+	       (unsigned long long)gsn->exhausted0,
+	       (unsigned long long)gsn->exhausted1c,
+	       (unsigned long long)gsn->exhausted1u,
+	       (unsigned long long)tun_exhausted);
+
+	reject = gsn->adm_reject_rate + gsn->adm_reject_peer +
+	    gsn->adm_reject_full;
+	syslog(LOG_INFO,
+	       "Create requests: accepted %llu (%llu/s), rejected %llu (%llu/s): rate %llu, peer rate %llu, overload %llu",
+	       (unsigned long long)gsn->adm_accept,
+	       (unsigned long long)(gsn->adm_accept - last_accept) / secs,
+	       (unsigned long long)reject,
+	       (unsigned long long)(reject - last_reject) / secs,
+	       (unsigned long long)gsn->adm_reject_rate,
+	       (unsigned long long)gsn->adm_reject_peer,
+	       (unsigned long long)gsn->adm_reject_full);
+	for (n = 0; n < napns; n++)
+		syslog(LOG_INFO,
+		       "APN %s: %llu contexts, %llu created, %llu rejected, %llu deleted, %u addresses free, %llu packets hairpinned",
+		       apns[n].name,
+		       (unsigned long long)(apns[n].accept - apns[n].deleted),
+		       (unsigned long long)apns[n].accept,
+		       (unsigned long long)apns[n].reject,
+		       (unsigned long long)apns[n].deleted,
+		       apns[n].ippool->dynfree,
+		       (unsigned long long)apns[n].hairpinned);
+	if (gb && !gtpbpf_stats(gb, GTPBPF_UPLINK, &ulp, &ulb) &&
+	    !gtpbpf_stats(gb, GTPBPF_DOWNLINK, &dlp, &dlb))
+		syslog(LOG_INFO,
+		       "eBPF fast path: uplink %llu packets, %llu bytes, downlink %llu packets, %llu bytes",
+		       (unsigned long long)ulp, (unsigned long long)ulb,
+		       (unsigned long long)dlp, (unsigned long long)dlb);
+	if (xsk)
+		syslog(LOG_INFO,
+		       "AF_XDP socket: received %llu packets, %llu bytes, sent %llu packets, %llu bytes, %llu left to the UDP socket",
+		       (unsigned long long)xsk->rxpackets,
+		       (unsigned long long)xsk->rxbytes,
+		       (unsigned long long)xsk->txpackets,
+		       (unsigned long long)xsk->txbytes,
+		       (unsigned long long)xsk->fallback);
+	if (dpdk)
+		syslog(LOG_INFO,
+		       "DPDK port: received %llu packets, %llu bytes, sent %llu packets, %llu bytes, %llu ARP requests answered, %llu other packets, %llu not sent, %llu left to the UDP socket",
+		       (unsigned long long)dpdk->rxpackets,
+		       (unsigned long long)dpdk->rxbytes,
+		       (unsigned long long)dpdk->txpackets,
+		       (unsigned long long)dpdk->txbytes,
+		       (unsigned long long)dpdk->arp,
+		       (unsigned long long)dpdk->other,
+		       (unsigned long long)dpdk->txdrop,
+		       (unsigned long long)dpdk->fallback);
+	if (busypoll && !ndps)
+		syslog(LOG_INFO,
+		       "Main thread: polled %llu ms, slept %llu ms in %llu sleeps",
+		       (unsigned long long)mainbusy.spin_ns / 1000000,
+		       (unsigned long long)mainbusy.sleep_ns / 1000000,
+		       (unsigned long long)mainbusy.sleeps);
+	for (n = 0; busypoll && (n < ndps); n++)
+		syslog(LOG_INFO,
+		       "Data thread %d: polled %llu ms, slept %llu ms in %llu sleeps",
+		       n, (unsigned long long)dps[n].busy.spin_ns / 1000000,
+		       (unsigned long long)dps[n].busy.sleep_ns / 1000000,
+		       (unsigned long long)dps[n].busy.sleeps);
+	if (sgi)
+		syslog(LOG_INFO,
+		       "SGi interface %s: received %llu packets, %llu bytes in %llu blocks, sent %llu packets, %llu bytes, %llu not sent",
+		       sgi->tun->devname,
+		       (unsigned long long)sgi->rxpackets,
+		       (unsigned long long)sgi->rxbytes,
+		       (unsigned long long)sgi->rxblocks,
+		       (unsigned long long)sgi->txpackets,
+		       (unsigned long long)sgi->txbytes,
+		       (unsigned long long)sgi->txdrop);
+	for (n = 0; n < nups; n++)
+		if (ups[n].fd >= 0)
+			syslog(LOG_INFO,
+			       "User plane %s: %llu session messages in %llu batches",
+			       inet_ntoa(ups[n].addr),
+			       (unsigned long long)ups[n].msgs,
+			       (unsigned long long)ups[n].batches);
+	last = now;
+	last_accept = gsn->adm_accept;
+	last_reject = reject;
+}
+
+/* Tell libgtp to reject creates early when the pools are nearly empty.
+   As libgtp then rejects every create, IPv6 creates are only turned
+   away when the IPv6 pool is nearly empty as well. Without a reserve
+   create_context_ind() rejects the creates of an empty pool itself */
+void check_overload(void)
+{
+	unsigned int dynfree = 0;
+	int n, dyn = 0;
+
+	if (!reserve)
+		return;
+	for (n = 0; n < napns; n++) {
+		if (apns[n].ippool && apns[n].ippool->allowdyn) {
+			dynfree += apns[n].ippool->dynfree;
+			dyn = 1;
+		}
+	}
+	if (dyn)
+		gtp_set_overload(gsn, dynfree <= (unsigned int)reserve &&
+				 (!ippool6 ||
+				  ippool6->free <= (uint64_t) reserve));
+}
+
+/* Convert a DNS server address */
+int dns_aton(char *s, struct in_addr *addr)
+{
+#ifdef HAVE_INET_ATON
+	return inet_aton(s, addr) ? 0 : -1;
+#else
+	addr->s_addr = inet_addr(s);
+	return (addr->s_addr == -1) ? -1 : 0;
+#endif
+}
+
+/* PCO with the DNS addresses, sent in create PDP context responses */
+void pco_dns(struct ul255_t *pco, struct in_addr *dns1, struct in_addr *dns2)
+{
+	pco->l = 20;
+	pco->v[0] = 0x80;	/* x0000yyy x=1, yyy=000: PPP */
+	pco->v[1] = 0x80;	/* IPCP */
+	pco->v[2] = 0x21;
+	pco->v[3] = 0x10;	/* Length of contents */
+	pco->v[4] = 0x02;	/* ACK */
+	pco->v[5] = 0x00;	/* ID: Need to match request */
+	pco->v[6] = 0x00;	/* Length */
+	pco->v[7] = 0x10;
+	pco->v[8] = 0x81;	/* DNS 1 */
+	pco->v[9] = 0x06;
+	memcpy(&pco->v[10], dns1, sizeof(*dns1));
+	pco->v[14] = 0x83;
+	pco->v[15] = 0x06;	/* DNS 2 */
+	memcpy(&pco->v[16], dns2, sizeof(*dns2));
+}
+
+/* Encode a dotted APN as length prefixed labels, as sent by the SGSN */
+int apn_encode(struct ul255_t *apn, char *name)
+{
+	char *p = name;
+	unsigned int len;
+
+	apn->l = 0;
+	do {
+		len = strcspn(p, ".");
+		if ((len == 0) || (len > 63) || (apn->l + 1 + len > 100))
+			return -1;
+		apn->v[apn->l++] = len;
+		memcpy(&apn->v[apn->l], p, len);
+		apn->l += len;
+		p += len;
+	} while (*p++ == '.');
+	return 0;
+}
+
+/* Parse APNs given as "apn=net[,dns1[,dns2]] apn=net ..." */
+int apn_parse(char *s)
+{
+	struct apn_t *a;
+	struct in_addr dns1, dns2;
+	char *tok, *eq, *d1, *d2;
+
+	for (tok = strtok(s, " \t"); tok; tok = strtok(NULL, " \t")) {
+		if (!(a = realloc(apns, sizeof(*a) * (napns + 1))))
+			return -1;
+		apns = a;
+		a = &apns[napns];
+		memset(a, 0, sizeof(*a));
+		dns1.s_addr = 0;
+		dns2.s_addr = 0;
+		d1 = d2 = NULL;
+		if ((eq = strchr(tok, '='))) {
+			*eq = 0;
+			if ((d1 = strchr(eq + 1, ','))) {
+				*d1++ = 0;
+				if ((d2 = strchr(d1, ',')))
+					*d2++ = 0;
+			}
+		}
+		if (!eq || apn_encode(&a->apn, tok) ||
+		    ippool_aton(&a->net, &a->mask, eq + 1, 0) ||
+		    (d1 && dns_aton(d1, &dns1)) || (d2 && dns_aton(d2, &dns2))) {
+			sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+				"Invalid APN: %s", tok);
+			return -1;
+		}
+		a->name = tok;
+		a->netarg = eq + 1;
+		a->netaddr.s_addr = htonl(ntohl(a->net.s_addr) + 1);
+		a->hash = lookup(a->apn.v, a->apn.l, 0);
+		pco_dns(&a->pco, &dns1, &dns2);
+		napns++;
+	}
+	return 0;
+}
+
+/* Find the APN of a create request. Other APNs use the default APN */
+struct apn_t *apn_find(struct ul255_t *apn)
+{
+	struct apn_t *a;
+	unsigned long int hash = lookup(apn->v, apn->l, 0);
+
+	for (a = apnhash[hash & (APN_HASHSIZE - 1)]; a; a = a->next)
+		if ((a->hash == hash) && (a->apn.l == apn->l) &&
+		    !memcmp(a->apn.v, apn->v, apn->l))
+			return a;
+	return &apns[0];
+}
+
+/* Enable hairpinning for APNs given as "apn apn ..." */
+int apn_hairpin(char *s)
+{
+	char *tok;
+	int n;
+
+	for (tok = strtok(s, " \t,"); tok; tok = strtok(NULL, " \t,")) {
+		for (n = 0; (n < napns) && strcmp(apns[n].name, tok); n++) ;
+		if (n == napns) {
+			sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+				"Unknown APN: %s", tok);
+			return -1;
+		}
+		apns[n].hairpin = 1;
+	}
+	return 0;
+}
+
+/* Add the APNs to the hash. Networks of APNs must not overlap */
+int apn_index(void)
+{
+	struct apn_t *a;
+	int n, m;
+
+	for (n = 1; n < napns; n++) {
+		a = &apns[n];
+		for (m = 0; m < n; m++) {
+			if ((a->net.s_addr ^ apns[m].net.s_addr) &
+			    a->mask.s_addr & apns[m].mask.s_addr)
+				continue;
+			sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+				"Network of APN %s overlaps APN %s",
+				a->name, apns[m].name);
+			return -1;
+		}
+		if (apn_find(&a->apn) != &apns[0]) {
+			sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+				"Duplicate APN: %s", a->name);
+			return -1;
+		}
+		a->next = apnhash[a->hash & (APN_HASHSIZE - 1)];
+		apnhash[a->hash & (APN_HASHSIZE - 1)] = a;
+	}
+	return 0;
+}
+
+/* Convert IMSI digits to the format of pdp->imsi */
+int imsi_aton(char *s, uint64_t * imsi)
+{
+	int i;
+
+	*imsi = ~0ULL;
+	for (i = 0; (i < 16) && isdigit((unsigned char)s[i]); i++) {
+		*imsi &= ~(0xfULL << (4 * i));
+		*imsi |= (uint64_t) (s[i] - '0') << (4 * i);
+	}
+	return ((i == 0) || (i > 15)) ? -1 : i;
+}
+
+/* Parse framed routes given as "imsi=net/mask imsi=net/mask ..." */
+int framed_parse(char *s)
+{
+	struct framed_t *f;
+	char *tok, *eq;
+	int n;
+
+	for (tok = strtok(s, " \t,"); tok; tok = strtok(NULL, " \t,")) {
+		if (!(f = realloc(framed, sizeof(*f) * (nframed + 1))))
+			return -1;
+		framed = f;
+		f = &framed[nframed];
+		if (!(eq = strchr(tok, '=')) ||
+		    (imsi_aton(tok, &f->imsi) != eq - tok) ||
+		    ippool_aton(&f->net, &f->mask, eq + 1, 0)) {
+			sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+				"Invalid framed route: %s", tok);
+			return -1;
+		}
+		for (n = 0; (n < 32) && (ntohl(f->mask.s_addr) << n); n++) ;
+		f->len = n;
+		nframed++;
+	}
+	return 0;
+}
+
+/* Route framed routes of a new context to it */
+void framed_add(struct pdp_t *pdp)
+{
+	int n;
+
+	for (n = 0; n < nframed; n++)
+		if ((framed[n].imsi == pdp->imsi) &&
+		    lpm_add(lpm, &framed[n].net, framed[n].len, pdp))
+			sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+				"Failed to add framed route %s/%d",
+				inet_ntoa(framed[n].net), framed[n].len);
+}
+
+/* Remove framed routes of a deleted context */
+void framed_del(struct pdp_t *pdp)
+{
+	int n;
+
+	for (n = 0; n < nframed; n++)
+		if (framed[n].imsi == pdp->imsi)
+			lpm_del(lpm, &framed[n].net, framed[n].len, pdp);
+}
+
+/* Route dynamic ranges outside the tun network to the tun interface */
+void route_ranges(int first)
+{
+	int n;
+
+	for (n = first; n < ippool->nranges; n++)
+		if ((ippool->range[n].net.s_addr & mask.s_addr) != net.s_addr)
+			tun_addroute(tun, &ippool->range[n].net, &netaddr,
+				     &ippool->range[n].mask);
+}
+
+/* SIGHUP: Add new address ranges from the main loop */
+void reload_handler(int s)
+{
+	reload = 1;
+}
+
+/* Add dynamic ranges found in the configuration file. Existing ranges
+   and the contexts using them are not touched */
+void reload_pool(void)
+{
+	struct gengetopt_args_info conf;
+	int first = ippool->nranges;
+	int n;
+
+	if (cmdline_parser_configfile(confpath, &conf, 0, 1, 0)) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Failed to read configuration file %s", confpath);
+		return;
+	}
+
+	n = ippool_grow(ippool, conf.dynip_arg ? conf.dynip_arg : conf.net_arg);
+	if (n < 0)
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Failed to add dynamic IP address range");
+	route_ranges(first);
+	for (n = first; n < ippool->nranges; n++)
+		syslog(LOG_INFO, "Added dynamic IP address range %s/%d",
+		       inet_ntoa(ippool->range[n].net),
+		       32 - __builtin_ctz(ntohl(ippool->range[n].mask.s_addr)));
+	syslog(LOG_INFO, "%u dynamic IP addresses free", ippool->dynfree);
+	check_overload();
+	cmdline_parser_free(&conf);
+}
+
+/* The context of a downlink packet of APN a. For an IPv4 address that
+ * is not in the pool, NULL is returned with the address in host order
+ * in framed, to be looked up in the framed routes */
+static struct pdp_t *dl_lookup(struct apn_t *a, void *pack, unsigned len,
+			       uint32_t * framed)
+{
+	struct tun_packet_t *iph = (struct tun_packet_t *)pack;
+	struct ippoolm_t *ipm;
+	struct ippool6m_t *ipm6;
+	struct in_addr dst;
+
+	*framed = 0;
+
+	/* IPv6: Look up the /64 prefix of the destination address */
+	if ((len >= 40) && ((((uint8_t *) pack)[0] >> 4) == 6)) {
+		if (!ippool6 ||
+		    ippool6_getip(ippool6, &ipm6,
+				  (struct in6_addr *)((uint8_t *) pack + 24)))
+			return NULL;
+		return ipm6->peer;
+	}
+
+	dst.s_addr = iph->dst;
+	if (ippool_getip(a->ippool, &ipm, &dst)) {
+		/* Not a context address. Try framed routes */
+		*framed = ntohl(dst.s_addr);
+		return NULL;
+	}
+	return ipm->peer;	/* NULL if no peer protocol is defined */
+}
+
+/* Send the burst of tun_poll() in stages over the whole burst: the
+ * destinations are looked up in the pool, prefetching the members of
+ * those a few packets ahead, then the misses in the framed routes all
+ * at once, and the packets with a context are sent together */
+void dl_flush(struct apn_t *a)
+{
+	struct tun_packet_t *iph;
+	struct in_addr dst;
+	uint32_t addr[GTP_BURST];
+	void *data[GTP_BURST];
+	int miss[GTP_BURST];
+	int i, k, m = 0;
+
+	for (i = 0; i < ndlburst; i++) {
+		if (i + GTP_PREFETCH < ndlburst) {
+			iph = dlburst[i + GTP_PREFETCH].pack;
+			dst.s_addr = iph->dst;
+			ippool_prefetch(a->ippool, &dst);
+		}
+		dlburst[i].pdp = dl_lookup(a, dlburst[i].pack, dlburst[i].len,
+					   &addr[m]);
+		if (!dlburst[i].pdp && addr[m] && lpm)
+			miss[m++] = i;
+	}
+
+	if (m) {
+		lpm_lookup_bulk(lpm, addr, data, m);
+		for (i = 0; i < m; i++)
+			dlburst[miss[i]].pdp = data[i];
+	}
+
+	for (i = 0, k = 0; i < ndlburst; i++)
+		if (dlburst[i].pdp)
+			dlburst[k++] = dlburst[i];
+	if (debug && (k < ndlburst))
+		printf("Received packet with no destination!!!\n");
+	if (k)
+		gtp_data_req_burst(gsn, dlburst, k);
+	ndlburst = 0;
+}
+
+/* Read up to tunbudget packets from tun. 0 means until empty. With an
+ * AF_XDP socket or DPDK port packets are read into its buffers, to be
+ * sent from there. The SGi interface is read from its receive ring.
+ * Otherwise packets are read into the buffers of the thread, and looked
+ * up and sent by dl_flush() every GTP_BURST packets.
+ * Returns 1 if the budget was used up, otherwise 0 */
+int tun_poll(struct tun_t *tun)
+{
+	struct gtp_pkt pkts[GTP_BURST];
+	unsigned room;
+	void *buf;
+	int n, rc = 0;
+
+	if (sgi && (tun == sgi->tun)) {
+		if (!afpacket_decaps(sgi, tunbudget))
+			return 0;
+		__atomic_add_fetch(&tun_exhausted, 1, __ATOMIC_RELAXED);
+		return 1;
+	}
+
+	/* Buffers are allocated on first use, and kept for the life of
+	   the thread */
+	if (!xsk && !dpdk) {
+		if (!dlbuf && !(dlbuf = malloc(GTP_BURST * PACKET_MAX)))
+			sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+				"Failed to allocate tun buffers");
+		if (dlbuf) {
+			dlburst = pkts;
+			ndlburst = 0;
+		}
+	}
+
+	for (n = 0; (tunbudget == 0) || (n < tunbudget); n++) {
+		if (dlburst && !(n % GTP_BURST) && ndlburst)
+			dl_flush(tun->priv);
+		if (xsk && (buf = xsk_txbuf(xsk, &room)))
+			rc = tun_decaps_buf(tun, buf, room);
+		else if (dpdk && (buf = dpdk_txbuf(dpdk, &room)))
+			rc = tun_decaps_buf(tun, buf, room);
+		else if (dlburst)
+			rc = tun_decaps_buf(tun, dlbuf[n % GTP_BURST],
+					    PACKET_MAX);
+		else
+			rc = tun_decaps(tun);
+		if (rc < 0) {
+			if (errno != EAGAIN)
+				sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+					"TUN read failed (fd)=(%d)", tun->fd);
+			break;
+		}
+	}
+	if (dlburst) {
+		if (ndlburst)
+			dl_flush(tun->priv);
+		dlburst = NULL;
+	}
+	if (rc < 0)
+		return 0;
+	__atomic_add_fetch(&tun_exhausted, 1, __ATOMIC_RELAXED);
+	return 1;
+}
+
+/* Data plane threads are readers of the pools and framed routes. They
+ * hold no reference while blocked in select() or waiting for the lock
+ * of libgtp, and none between rounds */
+void dp_lock_wait(int waiting)
+{
+	if (dp_reader < 0)
+		return;		/* Main thread */
+	if (waiting)
+		rcu_offline(dp_reader);
+	else
+		rcu_online(dp_reader);
+}
+
+/* Whether a thread should keep polling without blocking, as less than
+ * busypoll microseconds have passed since its last packet. The time is
+ * returned in now */
+int busy_spin(struct busy_t *b, struct timespec *now)
+{
+	clock_gettime(CLOCK_MONOTONIC, now);
+	if (!busypoll)
+		return 0;
+	return ((now->tv_sec - b->last.tv_sec) * 1000000 +
+		(now->tv_nsec - b->last.tv_nsec) / 1000) < busypoll;
+}
+
+/* Account the time since start to polling or sleeping, depending on
+ * whether the thread was allowed to block. Packets restart the period
+ * of busy polling */
+void busy_account(struct busy_t *b, int blocked, struct timespec *start,
+		  int packets)
+{
+	struct timespec now;
+	uint64_t ns;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ns = (now.tv_sec - start->tv_sec) * 1000000000 +
+	    (now.tv_nsec - start->tv_nsec);
+	if (blocked) {
+		b->sleep_ns += ns;
+		b->sleeps++;
+	} else
+		b->spin_ns += ns;
+	if (packets)
+		b->last = now;
+}
+
+/* Data plane thread: G-PDUs from fd1u and packets from the tuns.
+ * Signalling is left to the main thread. With busypoll the thread
+ * reads fd1u and the tuns without blocking until busypoll microseconds
+ * pass without packets, and only then sleeps in select() */
+void *dp_main(void *arg)
+{
+	struct dp_t *dp = arg;
+	struct timeval idleTime;
+	struct timespec start;
+	uint64_t packets;
+	fd_set fds;
+	int pending = 0;
+	int i, n;
+
+	dp_reader = dp->reader;
+	while (!end) {
+		if (busy_spin(&dp->busy, &start) || pending) {
+			packets = dp_packets;
+			pending = 0;
+			if (gtp_decaps1u(gsn) > 0)
+				pending = 1;
+			for (i = 0; i < napns; i++)
+				if (apns[i].tun && tun_poll(apns[i].tun))
+					pending = 1;
+			rcu_quiescent(dp_reader);
+			busy_account(&dp->busy, 0, &start,
+				     dp_packets != packets);
+			continue;
+		}
+
+		FD_ZERO(&fds);
+		for (i = 0; i < napns; i++)
+			if (apns[i].tun)
+				FD_SET(apns[i].tun->fd, &fds);
+		FD_SET(gsn->fd1u, &fds);
+		idleTime.tv_sec = 1;	/* To notice end */
+		idleTime.tv_usec = 0;
+
+		rcu_offline(dp_reader);
+		n = select(maxfd + 1, &fds, NULL, NULL, &idleTime);
+		rcu_online(dp_reader);
+		busy_account(&dp->busy, 1, &start, n > 0);
+		if (n <= 0)
+			continue;
+
+		if (FD_ISSET(gsn->fd1u, &fds) && (gtp_decaps1u(gsn) > 0))
+			pending = 1;
+		for (i = 0; i < napns; i++)
+			if (apns[i].tun && FD_ISSET(apns[i].tun->fd, &fds) &&
+			    tun_poll(apns[i].tun))
+				pending = 1;
+		rcu_quiescent(dp_reader);
+	}
+	rcu_offline(dp_reader);
+	return NULL;
+}
+
+/* Start the data plane threads. Signals are left to the main thread */
+int dp_start(int n)
+{
+	sigset_t all, old;
+
+	if (n < 0) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Invalid number of data threads: %d", n);
+		return -1;
+	}
+	if (n == 0)
+		return 0;
+	if (!(dps = calloc(sizeof(struct dp_t), n))) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Failed to allocate memory for data threads");
+		return -1;
+	}
+	gtp_set_cb_lock_wait(gsn, dp_lock_wait);
+
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, &old);
+	for (ndps = 0; ndps < n; ndps++) {
+		if (((dps[ndps].reader = rcu_register()) < 0) ||
+		    (errno = pthread_create(&dps[ndps].thread, NULL, dp_main,
+					    &dps[ndps]))) {
+			sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+				"Failed to start data thread");
+			break;
+		}
+	}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
+	return (ndps == n) ? 0 : -1;
+}
+
 /* Used to write process ID to file. Assume someone else will delete */
 void log_pid(char *pidfile)
 {
@@ -142,88 +904,864 @@ int encaps_printf(void *p, void *packet, unsigned len)
 	return 0;
 }
 
-int delete_context(struct pdp_t *pdp)
-{
-	if (debug)
-		printf("Deleting PDP context\n");
-	if (pdp->peer)
-		ippool_freeip(ippool, (struct ippoolm_t *)pdp->peer);
-	else
-		sys_err(LOG_ERR, __FILE__, __LINE__, 0, "Peer not defined!");
-	return 0;
+/* Control plane: The user plane process serving an end user address */
+struct session_t *up_find(struct in_addr *addr)
+{
+	int i;
+
+	for (i = 0; i < nups; i++)
+		if ((ups[i].fd >= 0) && ups[i].mask.s_addr &&
+		    ((addr->s_addr & ups[i].mask.s_addr) == ups[i].net.s_addr))
+			return &ups[i];
+	return NULL;
+}
+
+/* Control plane: Queue a session message for the user plane of pdp */
+int up_session(int type, struct pdp_t *pdp)
+{
+	struct session_msg msg;
+	struct session_t *up;
+	struct in_addr ue;
+
+	if (pdp_euaton(&pdp->eua, &ue) || !(up = up_find(&ue)))
+		return -1;
+	memset(&msg, 0, sizeof(msg));
+	msg.type = type;
+	msg.version = pdp->version;
+	msg.nsapi = pdp->nsapi;
+	msg.tei = pdp->teid_own;
+	msg.teid_gn = pdp->teid_gn;
+	msg.flru = pdp->flru;
+	msg.imsi = pdp->imsi;
+	memcpy(&msg.peer, pdp->gsnru.v, sizeof(msg.peer));
+	msg.ue = ue;
+	return session_queue(up, &msg);
+}
+
+/* Control plane: Give a new context to the user plane serving its
+   address. The create request is answered after the session is sent */
+int up_establish(struct pdp_t *pdp)
+{
+	struct apn_t *a = pdp->priv;
+	struct session_t *up;
+	struct in_addr ue;
+
+	pdp_euaton(&pdp->eua, &ue);
+	if (!(up = up_find(&ue)) || up_session(SESSION_ESTABLISH, pdp)) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"No user plane for %s", inet_ntoa(ue));
+		ippool_freeip(a->ippool, (struct ippoolm_t *)pdp->peer);
+		a->reject++;
+		gtp_create_context_resp(gsn, pdp, GTPCAUSE_NO_RESOURCES);
+		return 0;
+	}
+	in_addr2gsna(&pdp->gsnlu, &up->addr);
+	uppending[nuppending++] = pdp;
+	return 0;
+}
+
+/* Control plane: Forget a create that waits for its user plane, as its
+   context is deleted. Returns 1 if it was waiting */
+int up_unpend(struct pdp_t *pdp)
+{
+	int i;
+
+	for (i = 0; i < nuppending; i++) {
+		if (uppending[i] != pdp)
+			continue;
+		memmove(&uppending[i], &uppending[i + 1],
+			sizeof(uppending[0]) * (--nuppending - i));
+		return 1;
+	}
+	return 0;
+}
+
+/* Control plane: Send the queued sessions, then answer the create
+   requests that waited for them. Those of a user plane that has not
+   taken all its sessions yet wait for the next round */
+void up_flush(void)
+{
+	struct session_t *up;
+	struct pdp_t *pdp;
+	struct apn_t *a;
+	struct in_addr ue;
+	int i, n;
+
+	for (i = 0; i < nups; i++)
+		session_flush(&ups[i]);
+
+	for (i = 0, n = 0; i < nuppending; i++) {
+		pdp = uppending[i];
+		a = pdp->priv;
+		pdp_euaton(&pdp->eua, &ue);
+		if (!(up = up_find(&ue))) {	/* Lost while sending */
+			ippool_freeip(a->ippool, (struct ippoolm_t *)pdp->peer);
+			a->reject++;
+			gtp_create_context_resp(gsn, pdp,
+						GTPCAUSE_NO_RESOURCES);
+			continue;
+		}
+		if (session_pending(up)) {
+			uppending[n++] = pdp;
+			continue;
+		}
+		a->accept++;
+		gtp_create_context_resp(gsn, pdp, GTPCAUSE_ACC_REQ);
+	}
+	nuppending = n;
+	check_overload();
+}
+
+/* Control plane: Accept a user plane process */
+void up_accept(void)
+{
+	int i;
+
+	for (i = 0; (i < nups) && (ups[i].fd >= 0); i++) ;
+	if (i == UP_MAX) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Too many user plane processes");
+		close(accept(upfd, NULL, NULL));
+		return;
+	}
+	if (session_accept(&ups[i], upfd))
+		return;
+	if (i == nups)
+		nups++;
+	if (ups[i].fd > maxfd)
+		maxfd = ups[i].fd;
+}
+
+/* Control plane: Give the contexts in its network to a user plane that
+   announced itself, as after a restart it knows none of them. Those set
+   up with another GTP-U address are deleted, as the SGSN sends there */
+void up_resync(struct session_t *up)
+{
+	struct pdp_t *pdpa, *pdp;
+	struct in_addr ue, lu;
+	int n, sent = 0, deleted = 0;
+
+	pdp_getpdp(&pdpa);
+	for (n = 0; n < PDP_MAX; n++) {
+		pdp = &pdpa[n];
+		if (!pdp->inuse || !pdp->peer || pdp_euaisv6(&pdp->eua) ||
+		    pdp_euaton(&pdp->eua, &ue) ||
+		    ((ue.s_addr & up->mask.s_addr) != up->net.s_addr))
+			continue;
+		if (gsna2in_addr(&lu, &pdp->gsnlu) ||
+		    (lu.s_addr != up->addr.s_addr)) {
+			gtp_delete_context_req(gsn, pdp, NULL, 1);
+			deleted++;
+		} else if (!up_session(SESSION_ESTABLISH, pdp))
+			sent++;
+	}
+	if (sent || deleted)
+		syslog(LOG_INFO,
+		       "User plane %s: %d contexts sent, %d deleted",
+		       inet_ntoa(up->addr), sent, deleted);
+}
+
+/* Control plane: Read the announcement of a user plane process. Its
+   contexts are given to it again when it comes back */
+void up_read(struct session_t *up)
+{
+	struct session_msg msgs[SESSION_BATCH];
+	char addr[INET_ADDRSTRLEN];
+	int i, n;
+
+	if ((n = session_recv(up, msgs)) < 0) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"User plane %s disconnected", inet_ntoa(up->addr));
+		return;
+	}
+	for (i = 0; i < n; i++) {
+		if (msgs[i].type != SESSION_HELLO)
+			continue;
+		up->addr = msgs[i].peer;
+		up->net.s_addr = msgs[i].ue.s_addr & msgs[i].mask.s_addr;
+		up->mask = msgs[i].mask;
+		strcpy(addr, inet_ntoa(up->addr));
+		syslog(LOG_INFO, "User plane %s serves %s/%d", addr,
+		       inet_ntoa(up->net),
+		       32 - __builtin_ctz(ntohl(up->mask.s_addr)));
+		up_resync(up);
+	}
+}
+
+/* User plane: Set the peer of a context from a session message */
+void cp_setpeer(struct pdp_t *pdp, struct session_msg *m)
+{
+	pdp->version = m->version;
+	pdp->teid_gn = m->teid_gn;
+	pdp->flru = m->flru;
+	pdp->gsnru.l = sizeof(m->peer);
+	memcpy(pdp->gsnru.v, &m->peer, sizeof(m->peer));
+}
+
+/* Add a context in the kernel gtp device */
+int kern_addpdp(struct pdp_t *pdp)
+{
+	struct in_addr peer, ms;
+
+	memcpy(&peer, pdp->gsnru.v, sizeof(peer));
+	pdp_euaton(&pdp->eua, &ms);
+	return gtpkern_addpdp(gk, pdp->version, pdp->tid, pdp->flru,
+			      pdp->teid_own, pdp->teid_gn, &peer, &ms);
+}
+
+/* Replace a context in the kernel gtp device. The kernel refuses a
+   context whose address or tunnel it already has, so the old one is
+   deleted first. Until it is added again its packets are dropped */
+int kern_modpdp(struct pdp_t *pdp)
+{
+	gtpkern_delpdp(gk, pdp->version, pdp->tid, pdp->teid_own);
+	return kern_addpdp(pdp);
+}
+
+/* Add or replace a context in the eBPF fast path. GTPv0 contexts stay
+   on the slow path */
+void bpf_addpdp(struct pdp_t *pdp)
+{
+	struct apn_t *a = pdp->priv;
+	struct in_addr peer, ms;
+
+	if (pdp->version != 1)
+		return;
+	memcpy(&peer, pdp->gsnru.v, sizeof(peer));
+	pdp_euaton(&pdp->eua, &ms);
+	gtpbpf_addpdp(gb, pdp->teid_own, pdp->teid_gn, &peer, &ms,
+		      a->ifindex);
+}
+
+/* Delete a context from the eBPF fast path */
+void bpf_delpdp(struct pdp_t *pdp)
+{
+	struct in_addr ms;
+
+	if (pdp->version != 1)
+		return;
+	pdp_euaton(&pdp->eua, &ms);
+	gtpbpf_delpdp(gb, pdp->teid_own, &ms);
+}
+
+/* User plane: Delete the context of a session */
+void cp_drop(struct pdp_t *pdp)
+{
+	struct apn_t *a = pdp->priv;
+
+	gtp_set_ready(gsn, pdp, 0);
+	if (gk)
+		gtpkern_delpdp(gk, pdp->version, pdp->tid, pdp->teid_own);
+	if (gb)
+		bpf_delpdp(pdp);
+	ippool_freeip(a->ippool, (struct ippoolm_t *)pdp->peer);
+	a->deleted++;
+	rcu_synchronize();	/* See delete_context() */
+	gtp_freepdp(gsn, pdp);
+}
+
+/* User plane: Apply a session message of the control plane */
+void cp_apply(struct session_msg *m)
+{
+	struct apn_t *a = &apns[0];
+	struct ippoolm_t *member;
+	struct pdp_t *pdp;
+
+	switch (m->type) {
+	case SESSION_ESTABLISH:
+		if (gtp_newpdp_tei(gsn, &pdp, m->tei, m->imsi, m->nsapi)) {
+			sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+				"Session %u already exists", m->tei);
+			return;
+		}
+		if (ippool_newip(a->ippool, &member, &m->ue, 0)) {
+			sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+				"Address %s of session %u not available",
+				inet_ntoa(m->ue), m->tei);
+			gtp_freepdp(gsn, pdp);
+			return;
+		}
+		pdp_ntoeua(&m->ue, &pdp->eua);
+		pdp->peer = member;
+		pdp->ipif = a->tun;
+		pdp->priv = a;
+		member->peer = pdp;
+		cp_setpeer(pdp, m);
+		if (gk && kern_addpdp(pdp)) {
+			ippool_freeip(a->ippool, member);
+			gtp_freepdp(gsn, pdp);
+			return;
+		}
+		if (gb)
+			bpf_addpdp(pdp);
+		gtp_set_ready(gsn, pdp, 1);
+		a->accept++;
+		break;
+	case SESSION_MODIFY:
+		if (pdp_getgtp1(&pdp, m->tei)) {
+			sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+				"Unknown session %u", m->tei);
+			return;
+		}
+		cp_setpeer(pdp, m);
+		if (gk && kern_modpdp(pdp)) {
+			/* The kernel carries no data of it any more */
+			sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+				"Dropping session %u", m->tei);
+			cp_drop(pdp);
+			return;
+		}
+		if (gb)
+			bpf_addpdp(pdp);
+		gtp_set_ready(gsn, pdp, 1);
+		break;
+	case SESSION_DELETE:
+		if (pdp_getgtp1(&pdp, m->tei)) {
+			sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+				"Unknown session %u", m->tei);
+			return;
+		}
+		cp_drop(pdp);
+		break;
+	default:
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Unknown session message type: %d", m->type);
+		break;
+	}
+}
+
+/* User plane: Read and apply the waiting sessions */
+void cp_read(void)
+{
+	struct session_msg msgs[SESSION_BATCH];
+	int i, n;
+
+	while ((n = session_recv(&cp, msgs)) > 0)
+		for (i = 0; i < n; i++)
+			cp_apply(&msgs[i]);
+	if (n < 0) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Control plane closed the connection");
+		end = 1;
+	}
+}
+
+/* Delete the contexts that the kernel gtp device lost on update. The
+   kernel is their only data path, so they are torn down towards the
+   SGSN rather than kept without one. Those already deleted, maybe with
+   their slot taken by another context since, are skipped */
+void kern_reap(void)
+{
+	struct pdp_t *pdp;
+	int i;
+
+	for (i = 0; i < nkernlost; i++)
+		if (!pdp_getgtp1(&pdp, kernlost[i].tei) &&
+		    (pdp->tid == kernlost[i].tid))
+			gtp_delete_context_req(gsn, pdp, NULL, 1);
+	nkernlost = 0;
+}
+
+/* The peer of a context changed. Tell its user plane. A context the
+   kernel refuses is deleted after the update is answered, as libgtp
+   still uses it until then */
+int update_context(struct pdp_t *pdp)
+{
+	if (upfd >= 0)
+		up_session(SESSION_MODIFY, pdp);
+	if (gk && !pdp_euaisv6(&pdp->eua) && kern_modpdp(pdp) &&
+	    (nkernlost < PDP_MAX)) {
+		kernlost[nkernlost].tei = pdp->teid_own;
+		kernlost[nkernlost++].tid = pdp->tid;
+	}
+	if (gb && !pdp_euaisv6(&pdp->eua))
+		bpf_addpdp(pdp);
+	return 0;
+}
+
+int delete_context(struct pdp_t *pdp)
+{
+	struct apn_t *a = pdp->priv;
+
+	if (debug)
+		printf("Deleting PDP context\n");
+	if (!pdp->peer) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0, "Peer not defined!");
+		return 0;
+	}
+	if (pdp_euaisv6(&pdp->eua)) {
+		ippool6_freeip(ippool6, (struct ippool6m_t *)pdp->peer);
+	} else {
+		if (upfd >= 0)
+			up_session(SESSION_DELETE, pdp);
+		if (gk)
+			gtpkern_delpdp(gk, pdp->version, pdp->tid,
+				       pdp->teid_own);
+		if (gb)
+			bpf_delpdp(pdp);
+		ippool_freeip(a->ippool, (struct ippoolm_t *)pdp->peer);
+		if (lpm)
+			framed_del(pdp);
+	}
+
+	/* A create still waiting for its user plane was never accepted */
+	if (nuppending && up_unpend(pdp))
+		a->reject++;
+	else
+		a->deleted++;
+	check_overload();
+
+	/* libgtp clears the context on return. Data plane threads that
+	   found it before it was withdrawn must be done with it */
+	rcu_synchronize();
+	return 0;
+}
+
+/* Give an IPv6 context a /64 prefix. The end user address carries the
+   prefix with interface identifier 1 */
+int create_context_ind6(struct pdp_t *pdp)
+{
+	struct apn_t *a = pdp->priv;
+	struct ippool6m_t *member;
+	struct in6_addr addr;
+
+	if (!ippool6 || (upfd >= 0) || gk) {
+		a->reject++;
+		gtp_create_context_resp(gsn, pdp, GTPCAUSE_NOT_SUPPORTED);
+		return 0;
+	}
+
+	if (ippool6_newip(ippool6, &member)) {
+		a->reject++;
+		gtp_create_context_resp(gsn, pdp, GTPCAUSE_ADDR_OCCUPIED);
+		return 0;
+	}
+
+	addr = member->addr;
+	addr.s6_addr[15] = 1;
+	pdp_ntoeua6(&addr, &pdp->eua);
+	pdp->peer = member;
+	pdp->ipif = a->tun;
+	member->peer = pdp;
+	a->accept++;
+	check_overload();
+
+	gtp_create_context_resp(gsn, pdp, GTPCAUSE_ACC_REQ);
+	return 0;		/* Success */
 }
 
 int create_context_ind(struct pdp_t *pdp)
 {
 	struct in_addr addr;
 	struct ippoolm_t *member;
+	struct apn_t *a;
+	int ipv6;
 
 	if (debug)
 		printf("Received create PDP context request\n");
 
+	a = apn_find(&pdp->apn_req);
+	pdp->priv = a;
+
+	ipv6 = pdp_euaisv6(&pdp->eua);
 	pdp->eua.l = 0;		/* TODO: Indicates dynamic IP */
 
 	/* ulcpy(&pdp->qos_neg, &pdp->qos_req, sizeof(pdp->qos_req.v)); */
 	memcpy(pdp->qos_neg0, pdp->qos_req0, sizeof(pdp->qos_req0));
-	memcpy(&pdp->pco_neg, &pco, sizeof(pdp->pco_neg));
+	memcpy(&pdp->pco_neg, &a->pco, sizeof(pdp->pco_neg));
 
 	memcpy(pdp->qos_neg.v, pdp->qos_req.v, pdp->qos_req.l);	/* TODO */
 	pdp->qos_neg.l = pdp->qos_req.l;
 
+	if (ipv6)
+		return create_context_ind6(pdp);
+
 	if (pdp_euaton(&pdp->eua, &addr)) {
 		addr.s_addr = 0;	/* Request dynamic */
 	}
 
-	if (ippool_newip(ippool, &member, &addr, 0)) {
+	if (ippool_newip(a->ippool, &member, &addr, 0)) {
+		a->reject++;
 		gtp_create_context_resp(gsn, pdp, GTPCAUSE_NO_RESOURCES);
 		return 0;	/* Allready in use, or no more available */
 	}
 
 	pdp_ntoeua(&member->addr, &pdp->eua);
 	pdp->peer = member;
-	pdp->ipif = tun;	/* TODO */
+	pdp->ipif = a->tun;
 	member->peer = pdp;
+	if (upfd >= 0)
+		return up_establish(pdp);
+	if (gk && kern_addpdp(pdp)) {
+		ippool_freeip(a->ippool, member);
+		pdp->peer = NULL;
+		a->reject++;
+		gtp_create_context_resp(gsn, pdp, GTPCAUSE_NO_RESOURCES);
+		return 0;
+	}
+	if (gb)
+		bpf_addpdp(pdp);
+	a->accept++;
+	check_overload();
+	if (lpm)
+		framed_add(pdp);
 
 	gtp_create_context_resp(gsn, pdp, GTPCAUSE_ACC_REQ);
 	return 0;		/* Success */
 }
 
-/* Callback for receiving messages from tun */
+/* Callback for receiving messages from tun. Within tun_poll() the
+ * packet is added to its burst, to be looked up and sent by dl_flush() */
 int cb_tun_ind(struct tun_t *tun, void *pack, unsigned len)
 {
-	struct ippoolm_t *ipm;
-	struct in_addr dst;
-	struct tun_packet_t *iph = (struct tun_packet_t *)pack;
-
-	dst.s_addr = iph->dst;
+	struct apn_t *a = tun->priv;
+	struct pdp_t *pdp;
+	uint32_t framed;
 
 	if (debug)
 		printf("Received packet from tun!\n");
 
-	if (ippool_getip(ippool, &ipm, &dst)) {
+	dp_packets++;
+	if (dlburst) {
+		dlburst[ndlburst].pack = pack;
+		dlburst[ndlburst].len = len;
+		ndlburst++;
+		return 0;
+	}
+
+	if (!(pdp = dl_lookup(a, pack, len, &framed)) && framed && lpm)
+		pdp = lpm_lookup(lpm, framed);
+	if (!pdp) {
 		if (debug)
 			printf("Received packet with no destination!!!\n");
 		return 0;
 	}
-
-	if (ipm->peer)		/* Check if a peer protocol is defined */
-		gtp_data_req(gsn, (struct pdp_t *)ipm->peer, pack, len);
+	gtp_data_req(gsn, pdp, pack, len);
 	return 0;
 }
 
-int encaps_tun(struct pdp_t *pdp, void *pack, unsigned len)
+/* Reflector: Swap the addresses of an uplink packet, to be sent back
+   down the same tunnel. Echo requests are turned into echo replies, so
+   that the pings of sgsnemu measure the GTP round trip only */
+void reflect_swap(void *pack, unsigned len)
+{
+	uint8_t *p = (uint8_t *) pack;
+	uint8_t tmp[16];
+	unsigned int hlen, sum;
+
+	if ((len >= 20) && ((p[0] >> 4) == 4)) {
+		memcpy(tmp, p + 12, 4);
+		memcpy(p + 12, p + 16, 4);
+		memcpy(p + 16, tmp, 4);
+		hlen = (p[0] & 0x0f) * 4;
+		if ((p[9] == 1) && (len >= hlen + 4) && (p[hlen] == 8)) {
+			p[hlen] = 0;	/* ICMP echo reply */
+			sum = ((p[hlen + 2] << 8) | p[hlen + 3]) + 0x0800;
+			sum = (sum & 0xffff) + (sum >> 16);
+			p[hlen + 2] = sum >> 8;
+			p[hlen + 3] = sum & 0xff;
+		}
+	} else if ((len >= 40) && ((p[0] >> 4) == 6)) {
+		memcpy(tmp, p + 8, 16);
+		memcpy(p + 8, p + 24, 16);
+		memcpy(p + 24, tmp, 16);
+		if ((p[6] == 58) && (len >= 44) && (p[40] == 128)) {
+			p[40] = 129;	/* ICMPv6 echo reply */
+			sum = ((p[42] << 8) | p[43]) + 0xfeff;
+			sum = (sum & 0xffff) + (sum >> 16);
+			p[42] = sum >> 8;
+			p[43] = sum & 0xff;
+		}
+	}
+}
+
+/* Answer a router solicitation of an IPv6 context with a router
+   advertisement of its /64 prefix, sent back down the tunnel. The
+   prefix is not on-link, so the MS sends all packets to the GGSN.
+   Returns 1 if the packet was a router solicitation, otherwise 0 */
+int router_solicit(struct pdp_t *pdp, void *pack, unsigned len)
+{
+	uint8_t *p = (uint8_t *) pack;
+	uint8_t ra[88];
+	unsigned int i, sum;
+
+	if ((len < 48) || ((p[0] >> 4) != 6) || (p[6] != 58) ||
+	    (p[40] != 133))
+		return 0;	/* Not ICMPv6, or not a router solicitation */
+	if ((p[7] != 255) || p[41] || !pdp_euaisv6(&pdp->eua))
+		return 1;	/* Invalid, or not from an IPv6 context */
+
+	memset(ra, 0, sizeof(ra));
+	ra[0] = 0x60;		/* Version 6 */
+	ra[5] = sizeof(ra) - 40;	/* Payload length */
+	ra[6] = 58;		/* ICMPv6 */
+	ra[7] = 255;		/* Hop limit */
+	ra[8] = 0xfe;		/* Source fe80::2, as the MS has identifier 1 */
+	ra[9] = 0x80;
+	ra[23] = 2;
+	for (i = 8; (i < 24) && !p[i]; i++) ;
+	if (i < 24)
+		memcpy(ra + 24, p + 8, 16);	/* To the soliciting address */
+	else {
+		ra[24] = 0xff;	/* Unspecified source: To all nodes ff02::1 */
+		ra[25] = 0x02;
+		ra[39] = 1;
+	}
+	ra[40] = 134;		/* Router advertisement */
+	ra[44] = 64;		/* Current hop limit */
+	ra[46] = 0x23;		/* Router lifetime 9000 s */
+	ra[47] = 0x28;
+	ra[56] = 3;		/* Prefix information option */
+	ra[57] = 4;		/* Length in units of 8 octets */
+	ra[58] = 64;		/* Prefix length */
+	ra[59] = 0x40;		/* Autonomous, not on-link */
+	memset(ra + 60, 0xff, 8);	/* Valid and preferred lifetimes */
+	memcpy(ra + 72, &pdp->eua.v[2], 8);	/* The /64 prefix */
+
+	/* Checksum over the pseudo header and the ICMPv6 message */
+	sum = (sizeof(ra) - 40) + 58;
+	for (i = 8; i < sizeof(ra); i += 2)
+		sum += (ra[i] << 8) | ra[i + 1];
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+	ra[42] = ~sum >> 8;
+	ra[43] = ~sum & 0xff;
+
+	gtp_data_req(gsn, pdp, ra, sizeof(ra));
+	return 1;
+}
+
+/* The context of another context's address of the APN, for packets
+   that skip the tun and kernel. NULL if the packet leaves the APN */
+struct pdp_t *hairpin_lookup(struct apn_t *a, void *pack, unsigned len)
+{
+	struct tun_packet_t *iph = (struct tun_packet_t *)pack;
+	struct ippoolm_t *ipm;
+	struct in_addr dst;
+
+	if (!a->hairpin || (len < 20) || ((((uint8_t *) pack)[0] >> 4) != 4))
+		return NULL;
+	dst.s_addr = iph->dst;
+	if (ippool_getip(a->ippool, &ipm, &dst) || !ipm->peer)
+		return NULL;
+	__atomic_add_fetch(&a->hairpinned, 1, __ATOMIC_RELAXED);
+	return (struct pdp_t *)ipm->peer;
+}
+
+/* Write an uplink packet out of the APN */
+int encaps_out(struct pdp_t *pdp, void *pack, unsigned len)
 {
+	/* The kernel gtp device missed it. Nothing to write it to */
+	if (!pdp->ipif)
+		return 0;
+
 	if (debug)
 		printf("encaps_tun. Packet received: forwarding to tun\n");
+	if (sgi && (pdp->ipif == sgi->tun))
+		return afpacket_encaps(sgi, pack, len);
 	return tun_encaps((struct tun_t *)pdp->ipif, pack, len);
 }
 
+int encaps_tun(struct pdp_t *pdp, void *pack, unsigned len)
+{
+	struct pdp_t *peer;
+
+	dp_packets++;
+	if (reflect) {
+		reflect_swap(pack, len);
+		return gtp_data_req(gsn, pdp, pack, len);
+	}
+
+	if (router_solicit(pdp, pack, len))
+		return 0;
+
+	/* Packets to another context of the APN skip the tun and kernel */
+	if ((peer = hairpin_lookup(pdp->priv, pack, len)))
+		return gtp_data_req(gsn, peer, pack, len);
+
+	return encaps_out(pdp, pack, len);
+}
+
+/* As encaps_tun() for a burst of at most GTP_BURST uplink packets.
+   Reflected and hairpinned packets go back down in one burst */
+int encaps_tun_burst(struct gtp_pkt *pkts, int n)
+{
+	struct gtp_pkt dl[GTP_BURST];
+	struct pdp_t *peer;
+	int i, m = 0, rc = 0;
+
+	dp_packets += n;
+	for (i = 0; i < n; i++) {
+		if (reflect) {
+			reflect_swap(pkts[i].pack, pkts[i].len);
+			dl[m++] = pkts[i];
+		} else if (router_solicit(pkts[i].pdp, pkts[i].pack,
+					  pkts[i].len)) {
+			continue;
+		} else if ((peer = hairpin_lookup(pkts[i].pdp->priv,
+						  pkts[i].pack,
+						  pkts[i].len))) {
+			dl[m] = pkts[i];
+			dl[m++].pdp = peer;
+		} else if (encaps_out(pkts[i].pdp, pkts[i].pack, pkts[i].len))
+			rc = EOF;
+	}
+	if (m && gtp_data_req_burst(gsn, dl, m))
+		rc = EOF;
+	return rc;
+}
+
+/* G-PDUs from the AF_XDP socket take the path of those from fd1u */
+int xsk_ind(struct xsk_t *x, struct sockaddr_in *peer, void *pack,
+	    unsigned len)
+{
+	return gtp_decaps1u_buf(gsn, peer, pack, len);
+}
+
+/* G-PDUs go out of the AF_XDP socket when it can send them */
+int xsk_send(struct pdp_t *pdp, struct sockaddr_in *peer, void *hdr,
+	     unsigned hlen, void *pack, unsigned len)
+{
+	return xsk_encaps(xsk, peer, hdr, hlen, pack, len);
+}
+
+/* G-PDUs from the DPDK port take the path of those from fd1u */
+int dpdk_ind(struct dpdk_t *d, struct sockaddr_in *peer, void *pack,
+	     unsigned len)
+{
+	return gtp_decaps1u_buf(gsn, peer, pack, len);
+}
+
+/* G-PDUs go out of the DPDK port when it can send them */
+int dpdk_send(struct pdp_t *pdp, struct sockaddr_in *peer, void *hdr,
+	      unsigned hlen, void *pack, unsigned len)
+{
+	return dpdk_encaps(dpdk, peer, hdr, hlen, pack, len);
+}
+
+/* Create the IP pool and tun interface of an APN */
+int apn_setup(struct apn_t *a)
+{
+	if (ippool_new(&a->ippool, a->netarg, NULL, 1, 0,
+		       IPPOOL_NONETWORK | IPPOOL_NOGATEWAY |
+		       IPPOOL_NOBROADCAST)) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Failed to set up APN %s", a->name);
+		return -1;
+	}
+	if (upfd >= 0)
+		return 0;	/* Tuns are in the user plane processes */
+	if (gk)			/* The kernel gtp device carries all APNs */
+		return tun_addroute(gk->tun, &a->net, &netaddr, &a->mask);
+	if (tun_new(&a->tun) ||
+	    tun_setaddr(a->tun, &a->netaddr, &a->netaddr, &a->mask)) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Failed to set up APN %s", a->name);
+		return -1;
+	}
+	if (fcntl(a->tun->fd, F_SETFL, O_NONBLOCK)) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno, "fcntl() failed");
+		return -1;
+	}
+	a->tun->priv = a;
+	tun_set_cb_ind(a->tun, cb_tun_ind);
+	if (gb && gtpbpf_attach(gb, a->tun, &a->ifindex))
+		return -1;
+	if (a->tun->fd > maxfd)
+		maxfd = a->tun->fd;
+	if (ipup)
+		tun_runscript(a->tun, ipup);
+	return 0;
+}
+
+/* Create the tun interface of the default APN */
+int tun_setup(void)
+{
+	int i;
+
+	/* The kernel gtp device takes the place of the tun. G-PDUs of
+	   contexts in the kernel never reach libgtp */
+	if (gtpdev) {
+		if (gtpkern_new(&gk, gtpdev, gsn->fd0, gsn->fd1u))
+			return -1;
+		tun = gk->tun;
+		if (tun_setaddr(tun, &netaddr, &destaddr, &mask))
+			return -1;
+		route_ranges(0);
+		for (i = 0; i < nframed; i++)
+			tun_addroute(tun, &framed[i].net, &netaddr,
+				     &framed[i].mask);
+		if (ipup)
+			tun_runscript(tun, ipup);
+		return 0;
+	}
+
+	/* The SGi interface takes the place of the tun. Its addresses and
+	   routes are left to the administrator */
+	if (sgi) {
+		tun = sgi->tun;
+		tun->priv = &apns[0];
+		apns[0].tun = tun;
+		tun_set_cb_ind(tun, cb_tun_ind);
+		if (tun->fd > maxfd)
+			maxfd = tun->fd;
+		if (ipup)
+			tun_runscript(tun, ipup);
+		return 0;
+	}
+
+	/* Create a tunnel interface */
+	if (debug)
+		printf("Creating tun interface\n");
+	if (tun_new((struct tun_t **)&tun)) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0, "Failed to create tun");
+		if (debug)
+			printf("Failed to create tun\n");
+		return -1;
+	}
+
+	if (debug)
+		printf("Setting tun IP address\n");
+	if (tun_setaddr(tun, &netaddr, &destaddr, &mask)) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Failed to set tun IP address");
+		if (debug)
+			printf("Failed to set tun IP address\n");
+		return -1;
+	}
+	route_ranges(0);
+	for (i = 0; i < nframed; i++)
+		tun_addroute(tun, &framed[i].net, &netaddr, &framed[i].mask);
+	if (ippool6)
+		tun_addroute6(tun, &ippool6->net, ippool6->prefixlen);
+
+	tun->priv = &apns[0];
+	apns[0].tun = tun;
+	tun_set_cb_ind(tun, cb_tun_ind);
+	if (gb && gtpbpf_attach(gb, tun, &apns[0].ifindex))
+		return -1;
+	if (tun->fd > maxfd)
+		maxfd = tun->fd;
+
+	/* tun_poll() reads until EAGAIN */
+	if (fcntl(tun->fd, F_SETFL, O_NONBLOCK)) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno, "fcntl() failed");
+		return -1;
+	}
+
+	if (ipup)
+		tun_runscript(tun, ipup);
+	return 0;
+}
+
 int main(int argc, char **argv)
 {
 	/* gengeopt declarations */
 	struct gengetopt_args_info args_info;
 
 	struct hostent *host;
+	struct in_addr sgigw;
+	int i;
 
 	/* Handle keyboard interrupt SIGINT */
 	struct sigaction s;
@@ -234,8 +1772,27 @@ int main(int argc, char **argv)
 	if ((sigaction(SIGINT, &s, NULL) != 0) && debug)
 		printf("Could not register SIGINT signal handler.\n");
 
+	/* Log statistics on SIGUSR1 */
+	struct sigaction su;
+	su.sa_handler = (void *)stats_handler;
+	sigemptyset(&su.sa_mask);
+	su.sa_flags = 0;
+	if ((sigaction(SIGUSR1, &su, NULL) != 0) && debug)
+		printf("Could not register SIGUSR1 signal handler.\n");
+
+	/* Add new address ranges on SIGHUP */
+	su.sa_handler = (void *)reload_handler;
+	if ((sigaction(SIGHUP, &su, NULL) != 0) && debug)
+		printf("Could not register SIGHUP signal handler.\n");
+
 	fd_set fds;		/* For select() */
+	fd_set wfds;		/* User planes with sessions queued */
 	struct timeval idleTime;	/* How long to select() */
+	int pending = 0;	/* A source used up its budget */
+	int spin;		/* Not to block in select() */
+	struct timespec start;	/* Of select() */
+	unsigned int spins = 0;	/* Busy polling rounds */
+	uint64_t packets;	/* Handled before a busy polling round */
 
 	int timelimit;		/* Number of seconds to be connected */
 	int starttime;		/* Time program was started */
@@ -314,6 +1871,11 @@ int main(int argc, char **argv)
 	/* debug                                                        */
 	debug = args_info.debug_flag;
 
+	/* memlock                                                      */
+	/* Hugepages for the static tables, before they are first touched */
+	if (args_info.memlock_flag && (mem_huge() < 0))
+		exit(1);
+
 	/* listen                                                       */
 	/* Do hostname lookup to translate hostname to IP address       */
 	/* Any port listening is not possible as a valid address is     */
@@ -372,60 +1934,69 @@ int main(int argc, char **argv)
 		}
 	}
 
-	/* DNS1 and DNS2 */
-#ifdef HAVE_INET_ATON
-	dns1.s_addr = 0;
-	if (args_info.pcodns1_arg) {
-		if (0 == inet_aton(args_info.pcodns1_arg, &dns1)) {
-			sys_err(LOG_ERR, __FILE__, __LINE__, 0,
-				"Failed to convert pcodns1!");
-			exit(1);
-		}
+	/* ipv6pool                                                     */
+	if (args_info.ipv6pool_arg &&
+	    ippool6_new(&ippool6, args_info.ipv6pool_arg)) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Failed to allocate IPv6 prefix pool!");
+		exit(1);
 	}
-	dns2.s_addr = 0;
-	if (args_info.pcodns2_arg) {
-		if (0 == inet_aton(args_info.pcodns2_arg, &dns2)) {
+
+	/* framedroutes                                                 */
+	if (args_info.framedroutes_arg) {
+		if (framed_parse(args_info.framedroutes_arg) ||
+		    lpm_new(&lpm, FRAMED_GROUPS)) {
 			sys_err(LOG_ERR, __FILE__, __LINE__, 0,
-				"Failed to convert pcodns2!");
+				"Failed to set up framed routes!");
 			exit(1);
 		}
 	}
-#else
+
+	/* DNS1 and DNS2 */
 	dns1.s_addr = 0;
-	if (args_info.pcodns1_arg) {
-		dns1.s_addr = inet_addr(args_info.pcodns1_arg);
-		if (dns1.s_addr == -1) {
-			sys_err(LOG_ERR, __FILE__, __LINE__, 0,
-				"Failed to convert pcodns1!");
-			exit(1);
-		}
+	if (args_info.pcodns1_arg && dns_aton(args_info.pcodns1_arg, &dns1)) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Failed to convert pcodns1!");
+		exit(1);
 	}
 	dns2.s_addr = 0;
-	if (args_info.pcodns2_arg) {
-		dns2.s_addr = inet_addr(args_info.pcodns2_arg);
-		if (dns2.s_addr == -1) {
-			sys_err(LOG_ERR, __FILE__, __LINE__, 0,
-				"Failed to convert pcodns2!");
-			exit(1);
-		}
+	if (args_info.pcodns2_arg && dns_aton(args_info.pcodns2_arg, &dns2)) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Failed to convert pcodns2!");
+		exit(1);
+	}
+	pco_dns(&pco, &dns1, &dns2);
+
+	/* apns                                                         */
+	/* The first APN serves requests for APNs not given by --apns   */
+	if (!(apns = calloc(sizeof(struct apn_t), 1))) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Failed to allocate memory for APNs");
+		exit(1);
+	}
+	napns = 1;
+	apns[0].name = args_info.apn_arg;
+	apns[0].net = net;
+	apns[0].mask = mask;
+	apns[0].netaddr = netaddr;
+	apns[0].pco = pco;
+	apns[0].ippool = ippool;
+	if (args_info.apns_arg &&
+	    (apn_parse(args_info.apns_arg) || apn_index())) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Failed to set up APNs!");
+		exit(1);
+	}
+
+	/* hairpin                                                      */
+	if (args_info.hairpin_arg && apn_hairpin(args_info.hairpin_arg)) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Failed to set up hairpinning!");
+		exit(1);
 	}
-#endif
 
-	pco.l = 20;
-	pco.v[0] = 0x80;	/* x0000yyy x=1, yyy=000: PPP */
-	pco.v[1] = 0x80;	/* IPCP */
-	pco.v[2] = 0x21;
-	pco.v[3] = 0x10;	/* Length of contents */
-	pco.v[4] = 0x02;	/* ACK */
-	pco.v[5] = 0x00;	/* ID: Need to match request */
-	pco.v[6] = 0x00;	/* Length */
-	pco.v[7] = 0x10;
-	pco.v[8] = 0x81;	/* DNS 1 */
-	pco.v[9] = 0x06;
-	memcpy(&pco.v[10], &dns1, sizeof(dns1));
-	pco.v[14] = 0x83;
-	pco.v[15] = 0x06;	/* DNS 2 */
-	memcpy(&pco.v[16], &dns2, sizeof(dns2));
+	/* Configuration file, read again on SIGHUP */
+	confpath = args_info.conf_arg;
 
 	/* ipup */
 	ipup = args_info.ipup_arg;
@@ -437,6 +2008,15 @@ int main(int argc, char **argv)
 	timelimit = args_info.timelimit_arg;
 	starttime = time(NULL);
 
+	/* TUN packets read per poll                                       */
+	tunbudget = args_info.tunbudget_arg;
+
+	/* Reflector instead of tun for uplink packets                     */
+	reflect = args_info.reflect_flag;
+
+	/* Addresses to keep free for admission control                    */
+	reserve = args_info.reserve_arg;
+
 	/* qos                                                             */
 	qos.l = 3;
 	qos.v[2] = (args_info.qos_arg) & 0xff;
@@ -505,36 +2085,183 @@ int main(int argc, char **argv)
 	if (gsn->fd1u > maxfd)
 		maxfd = gsn->fd1u;
 
+	if (gtp_set_budget(gsn, args_info.gtpcbudget_arg,
+			   args_info.gtpubudget_arg)) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Invalid gtpcbudget or gtpubudget");
+		exit(1);
+	}
+
+	/* busypoll: the kernel also polls the device in receive calls on
+	   fd1u. Needs CAP_NET_ADMIN above net.core.busy_read */
+	busypoll = args_info.busypoll_arg;
+	if (busypoll < 0) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0, "Invalid busypoll");
+		exit(1);
+	}
+#ifdef SO_BUSY_POLL
+	if (busypoll &&
+	    setsockopt(gsn->fd1u, SOL_SOCKET, SO_BUSY_POLL, &busypoll,
+		       sizeof(busypoll)))
+		sys_err(LOG_WARNING, __FILE__, __LINE__, errno,
+			"Failed to set SO_BUSY_POLL on GTP-U socket");
+#endif
+#ifdef SO_PREFER_BUSY_POLL
+	i = 1;
+	if (busypoll &&
+	    setsockopt(gsn->fd1u, SOL_SOCKET, SO_PREFER_BUSY_POLL, &i,
+		       sizeof(i)))
+		sys_err(LOG_WARNING, __FILE__, __LINE__, errno,
+			"Failed to set SO_PREFER_BUSY_POLL on GTP-U socket");
+#endif
+
+	if (gtp_set_admission(gsn, args_info.createrate_arg,
+			      args_info.peerrate_arg, reserve)) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Invalid createrate, peerrate or reserve");
+		exit(1);
+	}
+	check_overload();
+
+	gtp_set_gpdu_short(gsn, args_info.gpdushort_flag);
+
 	gtp_set_cb_data_ind(gsn, encaps_tun);
+	gtp_set_cb_data_ind_burst(gsn, encaps_tun_burst);
 	gtp_set_cb_delete_context(gsn, delete_context);
 	gtp_set_cb_create_context_ind(gsn, create_context_ind);
+	gtp_set_cb_update_context(gsn, update_context);
 
-	/* Create a tunnel interface */
-	if (debug)
-		printf("Creating tun interface\n");
-	if (tun_new((struct tun_t **)&tun)) {
-		sys_err(LOG_ERR, __FILE__, __LINE__, 0, "Failed to create tun");
-		if (debug)
-			printf("Failed to create tun\n");
+	/* Control plane: user plane processes connect to upsock         */
+	cp.fd = -1;
+	if (args_info.upsock_arg && args_info.userplane_arg) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Only one of upsock and userplane can be given");
 		exit(1);
 	}
-
-	if (debug)
-		printf("Setting tun IP address\n");
-	if (tun_setaddr(tun, &netaddr, &destaddr, &mask)) {
+	if (args_info.upsock_arg && args_info.gtpdev_arg) {
 		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
-			"Failed to set tun IP address");
-		if (debug)
-			printf("Failed to set tun IP address\n");
+			"The control plane has no gtp device");
 		exit(1);
 	}
+	gtpdev = args_info.gtpdev_arg;
+	if (args_info.upsock_arg) {
+		if ((upfd = session_listen(args_info.upsock_arg)) < 0)
+			exit(1);
+		if (upfd > maxfd)
+			maxfd = upfd;
+	}
 
-	tun_set_cb_ind(tun, cb_tun_ind);
-	if (tun->fd > maxfd)
-		maxfd = tun->fd;
+	/* tun_poll() reads until EAGAIN */
+	if (tunbudget < 0) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0, "Invalid tunbudget");
+		exit(1);
+	}
 
-	if (ipup)
-		tun_runscript(tun, ipup);
+	/* eBPF fast path on the Gn interface, for the tuns to come */
+	if (args_info.bpfdev_arg) {
+		if (args_info.upsock_arg || args_info.gtpdev_arg) {
+			sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+				"bpfdev can not be used with upsock or gtpdev");
+			exit(1);
+		}
+		if (gtpbpf_new(&gb, args_info.bpfdev_arg, &listen_, PDP_MAX))
+			exit(1);
+	}
+
+	/* AF_XDP socket on the Gn interface. Its rings have one reader
+	   and one writer, the main thread */
+	if (args_info.xskdev_arg) {
+		if (args_info.upsock_arg || args_info.gtpdev_arg ||
+		    args_info.bpfdev_arg || args_info.datathreads_arg) {
+			sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+				"xskdev can not be used with upsock, gtpdev, bpfdev or datathreads");
+			exit(1);
+		}
+		if (xsk_new(&xsk, args_info.xskdev_arg, &listen_))
+			exit(1);
+		xsk_set_cb_ind(xsk, xsk_ind);
+		gtp_set_cb_data_send(gsn, xsk_send);
+		if (xsk->fd > maxfd)
+			maxfd = xsk->fd;
+	}
+
+	/* DPDK port as Gn interface. It is polled by the main thread,
+	   which never sleeps in select() */
+	if (args_info.dpdk_arg) {
+		if (args_info.upsock_arg || args_info.gtpdev_arg ||
+		    args_info.bpfdev_arg || args_info.xskdev_arg ||
+		    args_info.datathreads_arg) {
+			sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+				"dpdk can not be used with upsock, gtpdev, bpfdev, xskdev or datathreads");
+			exit(1);
+		}
+		if (dpdk_new(&dpdk, args_info.dpdk_arg, &listen_))
+			exit(1);
+		dpdk_set_cb_ind(dpdk, dpdk_ind);
+		gtp_set_cb_data_send(gsn, dpdk_send);
+	}
+
+	/* Ethernet interface on packet rings as SGi interface, for the
+	   default APN. Its rings have one reader and one writer, the main
+	   thread */
+	if (args_info.sgidev_arg) {
+		if (args_info.upsock_arg || args_info.gtpdev_arg ||
+		    args_info.bpfdev_arg || args_info.datathreads_arg ||
+		    (napns > 1)) {
+			sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+				"sgidev can not be used with upsock, gtpdev, bpfdev, datathreads or apns");
+			exit(1);
+		}
+		if (!args_info.sgigw_arg ||
+		    !inet_aton(args_info.sgigw_arg, &sgigw)) {
+			sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+				"sgidev needs the IPv4 address of a gateway in sgigw");
+			exit(1);
+		}
+		if (afpacket_new(&sgi, args_info.sgidev_arg, &sgigw))
+			exit(1);
+	}
+
+	/* The tun interfaces are left to the user plane processes */
+	if ((upfd < 0) && tun_setup())
+		exit(1);
+
+	/* User plane: announce address and network to the control plane */
+	if (args_info.userplane_arg) {
+		struct session_msg hello;
+
+		memset(&hello, 0, sizeof(hello));
+		hello.type = SESSION_HELLO;
+		hello.peer = listen_;
+		hello.ue = net;
+		hello.mask = mask;
+		if (session_connect(&cp, args_info.userplane_arg) ||
+		    session_queue(&cp, &hello) || session_flush(&cp))
+			exit(1);
+		if (cp.fd > maxfd)
+			maxfd = cp.fd;
+	}
+
+	for (i = 1; i < napns; i++)
+		if (apn_setup(&apns[i]))
+			exit(1);
+	check_overload();
+
+	/* The main thread holds the lock of libgtp except in select() */
+	gtp_lock(gsn);
+	/* memlock: Fault in everything allocated so far, and whatever is
+	   allocated later, as it is allocated. Data thread stacks too */
+	if (args_info.memlock_flag) {
+		mem_huge();	/* Allocated since. Collapsed by the kernel */
+		if (mem_lock())
+			exit(1);
+	}
+
+	if (dp_start(args_info.datathreads_arg))
+		exit(1);
+
+	if (args_info.memlock_flag)
+		log_memory();
 
   /******************************************************************/
 	/* Main select loop                                               */
@@ -543,15 +2270,79 @@ int main(int argc, char **argv)
 	while ((((starttime + timelimit) > time(NULL)) || (0 == timelimit))
 	       && (!end)) {
 
+		/* Sessions changed in the last round go out in one batch */
+		if (upfd >= 0)
+			up_flush();
+
+		if (nkernlost)
+			kern_reap();
+
+		/* Busy polling of the data plane: fd1u and the tuns are read
+		   without blocking, and signalling is checked with select()
+		   every BUSY_SELECT rounds only */
+		if (!ndps && busy_spin(&mainbusy, &start) &&
+		    (++spins % BUSY_SELECT)) {
+			packets = dp_packets;
+			pending = 0;
+			if (gtp_decaps1u(gsn) > 0)
+				pending = 1;
+			for (i = 0; i < napns; i++)
+				if (apns[i].tun && tun_poll(apns[i].tun))
+					pending = 1;
+			if (xsk && (xsk_decaps(xsk, gsn->budget_u) > 0))
+				pending = 1;
+			if (xsk)
+				xsk_kick(xsk);
+			if (sgi)
+				afpacket_kick(sgi);
+			if (dpdk && (dpdk_decaps(dpdk, gsn->budget_u) > 0))
+				pending = 1;
+			if (dpdk)
+				dpdk_kick(dpdk);
+			rcu_reclaim();
+			busy_account(&mainbusy, 0, &start,
+				     dp_packets != packets);
+			continue;
+		}
+
 		FD_ZERO(&fds);
-		if (tun)
-			FD_SET(tun->fd, &fds);
+		if (!ndps) {
+			for (i = 0; i < napns; i++)
+				if (apns[i].tun)
+					FD_SET(apns[i].tun->fd, &fds);
+			FD_SET(gsn->fd1u, &fds);
+			if (xsk)
+				FD_SET(xsk->fd, &fds);
+		}
 		FD_SET(gsn->fd0, &fds);
 		FD_SET(gsn->fd1c, &fds);
-		FD_SET(gsn->fd1u, &fds);
+		if (upfd >= 0)
+			FD_SET(upfd, &fds);
+		FD_ZERO(&wfds);
+		for (i = 0; i < nups; i++) {
+			if (ups[i].fd >= 0)
+				FD_SET(ups[i].fd, &fds);
+			if ((ups[i].fd >= 0) && session_pending(&ups[i]))
+				FD_SET(ups[i].fd, &wfds);
+		}
+		if (cp.fd >= 0)
+			FD_SET(cp.fd, &fds);
 
 		gtp_retranstimeout(gsn, &idleTime);
-		switch (select(maxfd + 1, &fds, NULL, NULL, &idleTime)) {
+		spin = pending || dpdk;
+		if (!ndps && busy_spin(&mainbusy, &start))
+			spin = 1;	/* Busy polling of the data plane */
+		if (spin) {
+			/* Poll, and give signalling a chance before more data */
+			idleTime.tv_sec = 0;
+			idleTime.tv_usec = 0;
+		}
+		gtp_unlock(gsn);
+		i = select(maxfd + 1, &fds, &wfds, NULL, &idleTime);
+		gtp_lock(gsn);
+		if (!ndps)
+			busy_account(&mainbusy, !spin, &start, i > 0);
+		switch (i) {
 		case -1:	/* errno == EINTR : unblocked signal */
 			sys_err(LOG_ERR, __FILE__, __LINE__, 0,
 				"select() returned -1");
@@ -563,30 +2354,92 @@ int main(int argc, char **argv)
 			gtp_retrans(gsn);	/* Only retransmit if nothing else */
 			break;
 		default:
+			/* Retransmit also when kept busy by user plane */
+			if (pending)
+				gtp_retrans(gsn);
 			break;
 		}
 
-		if (tun->fd != -1 && FD_ISSET(tun->fd, &fds) &&
-		    tun_decaps(tun) < 0) {
-			sys_err(LOG_ERR, __FILE__, __LINE__, 0,
-				"TUN read failed (fd)=(%d)", tun->fd);
+		if (dump) {
+			log_stats();
+			dump = 0;
 		}
 
-		if (FD_ISSET(gsn->fd0, &fds))
-			gtp_decaps0(gsn);
-
-		if (FD_ISSET(gsn->fd1c, &fds))
-			gtp_decaps1c(gsn);
-
-		if (FD_ISSET(gsn->fd1u, &fds))
-			gtp_decaps1u(gsn);
+		if (reload) {
+			reload = 0;
+			reload_pool();
+		}
 
+		/* Free what data plane threads may have been reading */
+		rcu_reclaim();
+
+		/* Sessions before data. The control plane sends a session
+		   before it answers the create request */
+		if (cp.fd >= 0)
+			cp_read();
+
+		/* Signalling first. Each source reads at most its budget */
+		/* per round, so signalling waits for at most one round */
+		pending = 0;
+
+		if (FD_ISSET(gsn->fd1c, &fds) && (gtp_decaps1c(gsn) > 0))
+			pending = 1;
+
+		if (FD_ISSET(gsn->fd0, &fds) && (gtp_decaps0(gsn) > 0))
+			pending = 1;
+
+		if (FD_ISSET(gsn->fd1u, &fds) && (gtp_decaps1u(gsn) > 0))
+			pending = 1;
+
+		for (i = 0; i < napns; i++)
+			if (apns[i].tun && FD_ISSET(apns[i].tun->fd, &fds) &&
+			    tun_poll(apns[i].tun))
+				pending = 1;
+
+		if (xsk && FD_ISSET(xsk->fd, &fds) &&
+		    (xsk_decaps(xsk, gsn->budget_u) > 0))
+			pending = 1;
+		if (xsk)
+			xsk_kick(xsk);
+		if (sgi)
+			afpacket_kick(sgi);
+
+		if (dpdk && (dpdk_decaps(dpdk, gsn->budget_u) > 0))
+			pending = 1;
+		if (dpdk)
+			dpdk_kick(dpdk);
+
+		if ((upfd >= 0) && FD_ISSET(upfd, &fds))
+			up_accept();
+		for (i = 0; i < nups; i++)
+			if ((ups[i].fd >= 0) && FD_ISSET(ups[i].fd, &fds))
+				up_read(&ups[i]);
 	}
 
-	cmdline_parser_free(&args_info);
-	ippool_free(ippool);
+	end = 1;
+	gtp_unlock(gsn);
+	for (i = 0; i < ndps; i++)
+		pthread_join(dps[i].thread, NULL);
+	free(dps);
+
+	if (gk)
+		gtpkern_free(gk);
+	if (gb)
+		gtpbpf_free(gb);
+	if (xsk)
+		xsk_free(xsk);
+	if (dpdk)
+		dpdk_free(dpdk);
 	gtp_free(gsn);
-	tun_free(tun);
+	for (i = 0; i < napns; i++) {
+		ippool_free(apns[i].ippool);
+		if (apns[i].tun && (!sgi || (apns[i].tun != sgi->tun)))
+			tun_free(apns[i].tun);
+	}
+	if (sgi)
+		afpacket_free(sgi);
+	free(apns);
+	cmdline_parser_free(&args_info);
 
 	return 1;
 
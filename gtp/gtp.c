@@ -50,12 +50,20 @@
 #include "gtp.h"
 #include "gtpie.h"
 #include "queue.h"
+#include "lookupa.h"
 
 /* According to section 14.2 of 3GPP TS 29.006 version 6.9.0 */
 #define N3_REQUESTS	5
 
 #define T3_REQUEST	3
 
+static void gtp_gpdu_build(struct gsn_t *gsn, struct pdp_t *pdp);
+static void gtp_gpdu_publish(struct gsn_t *gsn, struct pdp_t *pdp);
+static void gtp_delete_ind(struct gsn_t *gsn, struct pdp_t *pdp);
+static void gtp_update_ind(struct gsn_t *gsn, struct pdp_t *pdp);
+static void gtp_gpdu_copy(struct pdp_t *pdp, uint8_t * hdr,
+			  unsigned int *hlen, struct sockaddr_in *peer);
+
 /* Error reporting functions */
 
 void gtp_err(int priority, char *filename, int linenum, char *fmt, ...)
@@ -123,6 +131,26 @@ int gtp_freepdp(struct gsn_t *gsn, struct pdp_t *pdp)
 	return pdp_freepdp(pdp);
 }
 
+/* API: Take the context of the TEID given by a control plane, in a
+ * user plane process. The caller fills in the peer, then makes it
+ * usable with gtp_set_ready() */
+int gtp_newpdp_tei(struct gsn_t *gsn, struct pdp_t **pdp, uint32_t tei,
+		   uint64_t imsi, uint8_t nsapi)
+{
+	return pdp_newpdp_tei(pdp, tei, imsi, nsapi);
+}
+
+/* API: Make a context usable by the data plane, after its peer was set
+ * or changed, or withdraw it before it is freed */
+int gtp_set_ready(struct gsn_t *gsn, struct pdp_t *pdp, int ready)
+{
+	if (ready)
+		gtp_gpdu_publish(gsn, pdp);
+	else
+		__atomic_store_n(&pdp->ready, 0, __ATOMIC_SEQ_CST);
+	return 0;
+}
+
 /* gtp_gpdu */
 
 extern int gtp_fd(struct gsn_t *gsn)
@@ -134,6 +162,83 @@ extern int gtp_fd(struct gsn_t *gsn)
 /* gtp_retrans */
 /* gtp_retranstimeout */
 
+/* API: Limit the number of packets read per call of gtp_decaps0(),
+ * gtp_decaps1c() (budget_c) and gtp_decaps1u() (budget_u). When the
+ * budget is used up the function returns 1, leaving the rest of the
+ * packets on the socket for the next call. 0 means read until empty. */
+int gtp_set_budget(struct gsn_t *gsn, int budget_c, int budget_u)
+{
+	if ((budget_c < 0) || (budget_u < 0))
+		return EOF;
+	gsn->budget_c = budget_c;
+	gsn->budget_u = budget_u;
+	return 0;
+}
+
+/* API: Send GTPv1 G-PDUs with the 8 byte header, without sequence
+ * numbers. Must be set before any G-PDU is sent. */
+int gtp_set_gpdu_short(struct gsn_t *gsn, int gpdu_short)
+{
+	gsn->gpdu_short = gpdu_short;
+	return 0;
+}
+
+/* API: Take the lock of gsn. When data plane threads run, all other
+ * functions are called with it held. Data plane threads call only
+ * gtp_decaps1u() and gtp_data_req(), which take it when they need it.
+ * The lock is recursive */
+void gtp_lock(struct gsn_t *gsn)
+{
+	if (!pthread_mutex_trylock(&gsn->lock))
+		return;
+	if (gsn->cb_lock_wait)
+		gsn->cb_lock_wait(1);
+	pthread_mutex_lock(&gsn->lock);
+	if (gsn->cb_lock_wait)
+		gsn->cb_lock_wait(0);
+}
+
+void gtp_unlock(struct gsn_t *gsn)
+{
+	pthread_mutex_unlock(&gsn->lock);
+}
+
+/* API: Admission control of create PDP context requests. Requests are
+ * limited to rate per second in total and peer_rate per second from
+ * each peer, allowing bursts of up to one second worth. Requests are
+ * also rejected when no more than reserve PDP contexts are free, or
+ * while the application has set overload. Rejected requests are
+ * answered with GTPCAUSE_NO_RESOURCES before the IEs are decoded. */
+int gtp_set_admission(struct gsn_t *gsn, int rate, int peer_rate,
+		      int reserve)
+{
+	if ((rate < 0) || (peer_rate < 0) || (reserve < 0))
+		return EOF;
+
+	if (peer_rate && !gsn->adm_peers) {
+		if (!(gsn->adm_peers = calloc(GTP_ADM_PEERS,
+					      sizeof(struct gtp_bucket)))) {
+			gtp_err(LOG_ERR, __FILE__, __LINE__,
+				"Failed to allocate admission table");
+			return EOF;
+		}
+	}
+
+	gsn->adm_rate = rate;
+	gsn->adm_peer_rate = peer_rate;
+	gsn->adm_reserve = reserve;
+	gettimeofday(&gsn->adm_bucket.last, NULL);
+	gsn->adm_bucket.tokens = (uint64_t) rate *1000;
+	return 0;
+}
+
+/* API: Reject all create PDP context requests while overload is set */
+int gtp_set_overload(struct gsn_t *gsn, int overload)
+{
+	gsn->overload = overload;
+	return 0;
+}
+
 int gtp_set_cb_unsup_ind(struct gsn_t *gsn,
 			 int (*cb) (struct sockaddr_in * peer))
 {
@@ -171,6 +276,37 @@ int gtp_set_cb_recovery(struct gsn_t *gsn,
 	return 0;
 }
 
+/* API: Called after the peer has changed the user plane address or
+ * TEID of a context, with an update or a repeated create request */
+int gtp_set_cb_update_context(struct gsn_t *gsn,
+			      int (*cb) (struct pdp_t * pdp))
+{
+	gsn->cb_update_context = cb;
+	return 0;
+}
+
+/* API: Called by gtp_data_req() with the G-PDU header and destination of
+ * a packet, to send it on another path than the socket. Returns 0 when
+ * it was sent, -1 on error, or 1 to have it sent on the socket */
+int gtp_set_cb_data_send(struct gsn_t *gsn,
+			 int (*cb) (struct pdp_t * pdp,
+				    struct sockaddr_in * peer,
+				    void *hdr, unsigned hlen,
+				    void *pack, unsigned len))
+{
+	gsn->cb_data_send = cb;
+	return 0;
+}
+
+/* API: Called with waiting set before a thread blocks in gtp_lock(), and
+ * cleared once it has the lock. Lets the application know that the
+ * thread holds no references meanwhile */
+int gtp_set_cb_lock_wait(struct gsn_t *gsn, void (*cb) (int waiting))
+{
+	gsn->cb_lock_wait = cb;
+	return 0;
+}
+
 extern int gtp_set_cb_data_ind(struct gsn_t *gsn,
 			       int (*cb_data_ind) (struct pdp_t * pdp,
 						   void *pack, unsigned len))
@@ -179,6 +315,15 @@ extern int gtp_set_cb_data_ind(struct gsn_t *gsn,
 	return 0;
 }
 
+/* API: Called with the G-PDUs of a burst from fd1u, instead of calling
+ * cb_data_ind for each. Returns 0, or EOF if any packet failed */
+int gtp_set_cb_data_ind_burst(struct gsn_t *gsn,
+			      int (*cb) (struct gtp_pkt * pkts, int n))
+{
+	gsn->cb_data_ind_burst = cb;
+	return 0;
+}
+
 /**
  * get_default_gtp()
  * Generate a GPRS Tunneling Protocol signalling packet header, depending
@@ -599,11 +744,6 @@ int gtp_resp(int version, struct gsn_t *gsn, struct pdp_t *pdp,
 		return -1;
 	}
 
-	if (fcntl(fd, F_SETFL, 0)) {
-		gtp_err(LOG_ERR, __FILE__, __LINE__, "fnctl()");
-		return -1;
-	}
-
 	if (sendto(fd, packet, len, 0,
 		   (struct sockaddr *)peer, sizeof(struct sockaddr_in)) < 0) {
 		gsn->err_sendto++;
@@ -658,11 +798,6 @@ int gtp_notification(struct gsn_t *gsn, int version,
 		return -1;
 	}
 
-	if (fcntl(fd, F_SETFL, 0)) {
-		gtp_err(LOG_ERR, __FILE__, __LINE__, "fnctl()");
-		return -1;
-	}
-
 	if (sendto(fd, packet, len, 0,
 		   (struct sockaddr *)&addr, sizeof(struct sockaddr_in)) < 0) {
 		gsn->err_sendto++;
@@ -683,11 +818,6 @@ int gtp_dublicate(struct gsn_t *gsn, int version,
 		return EOF;	/* Notfound */
 	}
 
-	if (fcntl(qmsg->fd, F_SETFL, 0)) {
-		gtp_err(LOG_ERR, __FILE__, __LINE__, "fnctl()");
-		return -1;
-	}
-
 	if (sendto(qmsg->fd, &qmsg->p, qmsg->l, 0,
 		   (struct sockaddr *)peer, sizeof(struct sockaddr_in)) < 0) {
 		gsn->err_sendto++;
@@ -756,11 +886,17 @@ int gtp_new(struct gsn_t **gsn, char *statedir, struct in_addr *listen,
 	    int mode)
 {
 	struct sockaddr_in addr;
+	pthread_mutexattr_t attr;
 
 	syslog(LOG_ERR, "GTP: gtp_newgsn() started");
 
 	*gsn = calloc(sizeof(struct gsn_t), 1);	/* TODO */
 
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&(*gsn)->lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+
 	(*gsn)->statedir = statedir;
 	log_restart(*gsn);
 
@@ -780,6 +916,7 @@ int gtp_new(struct gsn_t **gsn, char *statedir, struct in_addr *listen,
 	(*gsn)->cb_unsup_ind = 0;
 	(*gsn)->cb_conf = 0;
 	(*gsn)->cb_data_ind = 0;
+	(*gsn)->cb_data_ind_burst = 0;
 
 	/* Store function parameters */
 	(*gsn)->gsnc = *listen;
@@ -878,6 +1015,9 @@ int gtp_free(struct gsn_t *gsn)
 	close(gsn->fd1c);
 	close(gsn->fd1u);
 
+	if (gsn->adm_peers)
+		free(gsn->adm_peers);
+	pthread_mutex_destroy(&gsn->lock);
 	free(gsn);
 	return 0;
 }
@@ -949,7 +1089,7 @@ int gtp_echo_ind(struct gsn_t *gsn, int version, struct sockaddr_in *peer,
 int gtp_echo_conf(struct gsn_t *gsn, int version, struct sockaddr_in *peer,
 		  void *pack, unsigned len)
 {
-	union gtpie_member *ie[GTPIE_SIZE];
+	struct gtpie_tab ie;
 	unsigned char recovery;
 	void *cbp = NULL;
 	uint8_t type = 0;
@@ -960,7 +1100,7 @@ int gtp_echo_conf(struct gsn_t *gsn, int version, struct sockaddr_in *peer,
 		return EOF;
 
 	/* Extract information elements into a pointer array */
-	if (gtpie_decaps(ie, version, pack + hlen, len - hlen)) {
+	if (gtpie_decaps(&ie, version, pack + hlen, len - hlen)) {
 		gsn->invalid++;
 		gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack, len,
 			    "Invalid message format");
@@ -969,7 +1109,7 @@ int gtp_echo_conf(struct gsn_t *gsn, int version, struct sockaddr_in *peer,
 		return EOF;
 	}
 
-	if (gtpie_gettv1(ie, GTPIE_RECOVERY, 0, &recovery)) {
+	if (gtpie_gettv1(&ie, GTPIE_RECOVERY, 0, &recovery)) {
 		gsn->missing++;
 		gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack, len,
 			    "Missing mandatory field");
@@ -1225,6 +1365,9 @@ extern int gtp_create_context_req(struct gsn_t *gsn, struct pdp_t *pdp,
 int gtp_create_context_resp(struct gsn_t *gsn, struct pdp_t *pdp, int cause)
 {
 
+	if (cause == GTPCAUSE_ACC_REQ)
+		gtp_gpdu_publish(gsn, pdp);
+
 	/* Now send off a reply to the peer */
 	gtp_create_pdp_resp(gsn, pdp->version, pdp, cause);
 
@@ -1251,62 +1394,157 @@ int gtp_create_pdp_resp(struct gsn_t *gsn, int version, struct pdp_t *pdp,
 	union gtp_packet packet;
 	unsigned int length =
 	    get_default_gtp(version, GTP_CREATE_PDP_RSP, &packet);
+	struct gtpie_bld b;
 
-	gtpie_tv1(&packet, &length, GTP_MAX, GTPIE_CAUSE, cause);
+	gtpie_bld_init(&b, &packet, length, GTP_MAX);
+	gtpie_bld_tv1(&b, GTPIE_CAUSE, cause);
 
 	if (cause == GTPCAUSE_ACC_REQ) {
 
 		if (version == 0)
-			gtpie_tv0(&packet, &length, GTP_MAX, GTPIE_QOS_PROFILE0,
-				  sizeof(pdp->qos_neg0), pdp->qos_neg0);
+			gtpie_bld_tv0(&b, GTPIE_QOS_PROFILE0,
+				      sizeof(pdp->qos_neg0), pdp->qos_neg0);
 
-		gtpie_tv1(&packet, &length, GTP_MAX, GTPIE_REORDER,
-			  pdp->reorder);
-		gtpie_tv1(&packet, &length, GTP_MAX, GTPIE_RECOVERY,
-			  gsn->restart_counter);
+		gtpie_bld_tv1(&b, GTPIE_REORDER, pdp->reorder);
+		gtpie_bld_tv1(&b, GTPIE_RECOVERY, gsn->restart_counter);
 
 		if (version == 0) {
-			gtpie_tv2(&packet, &length, GTP_MAX, GTPIE_FL_DI,
-				  pdp->fllu);
-			gtpie_tv2(&packet, &length, GTP_MAX, GTPIE_FL_C,
-				  pdp->fllc);
+			gtpie_bld_tv2(&b, GTPIE_FL_DI, pdp->fllu);
+			gtpie_bld_tv2(&b, GTPIE_FL_C, pdp->fllc);
 		}
 
 		if (version == 1) {
-			gtpie_tv4(&packet, &length, GTP_MAX, GTPIE_TEI_DI,
-				  pdp->teid_own);
-			gtpie_tv4(&packet, &length, GTP_MAX, GTPIE_TEI_C,
-				  pdp->teic_own);
+			gtpie_bld_tv4(&b, GTPIE_TEI_DI, pdp->teid_own);
+			gtpie_bld_tv4(&b, GTPIE_TEI_C, pdp->teic_own);
 		}
 
 		/* TODO: We use teic_own as charging ID */
-		gtpie_tv4(&packet, &length, GTP_MAX, GTPIE_CHARGING_ID,
-			  pdp->teic_own);
+		gtpie_bld_tv4(&b, GTPIE_CHARGING_ID, pdp->teic_own);
 
-		gtpie_tlv(&packet, &length, GTP_MAX, GTPIE_EUA,
-			  pdp->eua.l, pdp->eua.v);
+		gtpie_bld_tlv(&b, GTPIE_EUA, pdp->eua.l, pdp->eua.v);
 
 		if (pdp->pco_neg.l) {	/* Optional PCO */
-			gtpie_tlv(&packet, &length, GTP_MAX, GTPIE_PCO,
-				  pdp->pco_neg.l, pdp->pco_neg.v);
+			gtpie_bld_tlv(&b, GTPIE_PCO,
+				      pdp->pco_neg.l, pdp->pco_neg.v);
 		}
 
-		gtpie_tlv(&packet, &length, GTP_MAX, GTPIE_GSN_ADDR,
-			  pdp->gsnlc.l, pdp->gsnlc.v);
-		gtpie_tlv(&packet, &length, GTP_MAX, GTPIE_GSN_ADDR,
-			  pdp->gsnlu.l, pdp->gsnlu.v);
+		gtpie_bld_tlv(&b, GTPIE_GSN_ADDR, pdp->gsnlc.l, pdp->gsnlc.v);
+		gtpie_bld_tlv(&b, GTPIE_GSN_ADDR, pdp->gsnlu.l, pdp->gsnlu.v);
 
 		if (version == 1)
-			gtpie_tlv(&packet, &length, GTP_MAX, GTPIE_QOS_PROFILE,
-				  pdp->qos_neg.l, pdp->qos_neg.v);
+			gtpie_bld_tlv(&b, GTPIE_QOS_PROFILE,
+				      pdp->qos_neg.l, pdp->qos_neg.v);
 
 		/* TODO: Charging gateway address */
 	}
 
+	if (gtpie_bld_end(&b, &length)) {
+		gtp_err(LOG_ERR, __FILE__, __LINE__,
+			"Failed to encode create PDP context response");
+		return EOF;
+	}
+
 	return gtp_resp(version, gsn, pdp, &packet, length, &pdp->sa_peer,
 			pdp->fd, pdp->seq, pdp->tid);
 }
 
+/* Take a token from bucket b, refilled at rate tokens per second.
+ * Returns 0 on success, or 1 if the bucket is empty */
+static int gtp_bucket_take(struct gtp_bucket *b, int rate,
+			   struct timeval *now)
+{
+	int64_t us, ms;
+	uint64_t depth = (uint64_t) rate *1000;
+
+	us = (int64_t) (now->tv_sec - b->last.tv_sec) * 1000000 +
+	    now->tv_usec - b->last.tv_usec;
+	if ((us < 0) || (us >= 1000000)) {
+		/* Enough to fill any bucket, or the clock went back */
+		if (us > 0)
+			b->tokens = depth;
+		b->last = *now;
+	} else if (us >= 1000) {
+		/* Credit whole ms, keeping the rest for the next refill */
+		ms = us / 1000;
+		b->tokens += ms * rate;
+		if (b->tokens > depth)
+			b->tokens = depth;
+		b->last.tv_usec += ms * 1000;
+		b->last.tv_sec += b->last.tv_usec / 1000000;
+		b->last.tv_usec %= 1000000;
+	}
+
+	if (b->tokens < 1000)
+		return 1;
+	b->tokens -= 1000;
+	return 0;
+}
+
+/* Find the bucket of peer in the per peer table, which is searched
+ * by linear probing. A peer without a bucket takes an unused one, or
+ * one that has not been touched for a second: That bucket is full, so
+ * its old owner would start again from a full bucket as well.
+ * Returns NULL if all buckets are in use */
+static struct gtp_bucket *gtp_peer_bucket(struct gsn_t *gsn,
+					  struct in_addr *peer,
+					  struct timeval *now)
+{
+	struct gtp_bucket *b, *idle = NULL;
+	int n, i;
+
+	i = lookup((ub1 *) peer, sizeof(*peer), 0) % GTP_ADM_PEERS;
+	for (n = 0; n < GTP_ADM_PEERS; n++, i = (i + 1) % GTP_ADM_PEERS) {
+		b = &gsn->adm_peers[i];
+		if (b->addr.s_addr == peer->s_addr)
+			return b;
+		if (!b->addr.s_addr)
+			break;
+		if (!idle && (now->tv_sec - b->last.tv_sec > 1))
+			idle = b;
+	}
+	if (idle || (n == GTP_ADM_PEERS))
+		b = idle;
+	if (b) {
+		b->addr = *peer;
+		b->tokens = (uint64_t) gsn->adm_peer_rate * 1000;
+		b->last = *now;
+	}
+	return b;
+}
+
+/* Admission control for create PDP context requests.
+ * Returns 0 if the request from peer may proceed, otherwise 1 */
+static int gtp_admit(struct gsn_t *gsn, struct sockaddr_in *peer)
+{
+	struct gtp_bucket *b;
+	struct timeval now;
+
+	if (gsn->overload || (PDP_MAX - pdp_inuse() <= gsn->adm_reserve)) {
+		gsn->adm_reject_full++;
+		return 1;
+	}
+
+	if (gsn->adm_rate || gsn->adm_peer_rate)
+		gettimeofday(&now, NULL);
+
+	if (gsn->adm_peer_rate && gsn->adm_peers) {
+		if (!(b = gtp_peer_bucket(gsn, &peer->sin_addr, &now)) ||
+		    gtp_bucket_take(b, gsn->adm_peer_rate, &now)) {
+			gsn->adm_reject_peer++;
+			return 1;
+		}
+	}
+
+	if (gsn->adm_rate &&
+	    gtp_bucket_take(&gsn->adm_bucket, gsn->adm_rate, &now)) {
+		gsn->adm_reject_rate++;
+		return 1;
+	}
+
+	gsn->adm_accept++;
+	return 0;
+}
+
 /* Handle Create PDP Context Request */
 int gtp_create_pdp_ind(struct gsn_t *gsn, int version,
 		       struct sockaddr_in *peer, int fd,
@@ -1314,7 +1552,7 @@ int gtp_create_pdp_ind(struct gsn_t *gsn, int version,
 {
 	struct pdp_t *pdp, *pdp_old;
 	struct pdp_t pdp_buf;
-	union gtpie_member *ie[GTPIE_SIZE];
+	struct gtpie_tab ie;
 	uint8_t recovery;
 
 	uint16_t seq = get_seq(pack);
@@ -1342,8 +1580,14 @@ int gtp_create_pdp_ind(struct gsn_t *gsn, int version,
 	pdp->fd = fd;
 	pdp->version = version;
 
+	/* Admission control. Reject before doing any further work. */
+	/* Counted, but not logged, as rejects may come in storms */
+	if (gtp_admit(gsn, peer))
+		return gtp_create_pdp_resp(gsn, version, pdp,
+					   GTPCAUSE_NO_RESOURCES);
+
 	/* Decode information elements */
-	if (gtpie_decaps(ie, version, pack + hlen, len - hlen)) {
+	if (gtpie_decaps(&ie, version, pack + hlen, len - hlen)) {
 		gsn->invalid++;
 		gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack, len,
 			    "Invalid message format");
@@ -1354,12 +1598,21 @@ int gtp_create_pdp_ind(struct gsn_t *gsn, int version,
 						   GTPCAUSE_INVALID_MESSAGE);
 	}
 
+	/* Check for unconditionally mandatory information elements */
+	if (gtpie_check(&ie, version, GTPIE_MSG_CREATE_REQ)) {
+		gsn->missing++;
+		gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack, len,
+			    "Missing mandatory information field");
+		return gtp_create_pdp_resp(gsn, version, pdp,
+					   GTPCAUSE_MAN_IE_MISSING);
+	}
+
 	if (version == 1) {
 		/* Linked NSAPI (conditional) */
 		/* If included this is the Secondary PDP Context Activation Procedure */
 		/* In secondary activation IMSI is not included, so the context must be */
 		/* identified by the tei */
-		if (!gtpie_gettv1(ie, GTPIE_NSAPI, 1, &linked_nsapi)) {
+		if (!gtpie_gettv1(&ie, GTPIE_NSAPI, 1, &linked_nsapi)) {
 
 			/* Find the primary PDP context */
 			if (pdp_getgtp1(&linked_pdp, get_tei(pack))) {
@@ -1393,22 +1646,15 @@ int gtp_create_pdp_ind(struct gsn_t *gsn, int version,
 		}
 	}
 	/* if (version == 1) */
-	if (version == 0) {
-		if (gtpie_gettv0(ie, GTPIE_QOS_PROFILE0, 0,
-				 pdp->qos_req0, sizeof(pdp->qos_req0))) {
-			gsn->missing++;
-			gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack,
-				    len, "Missing mandatory information field");
-			return gtp_create_pdp_resp(gsn, version, pdp,
-						   GTPCAUSE_MAN_IE_MISSING);
-		}
-	}
+	if (version == 0)
+		gtpie_gettv0(&ie, GTPIE_QOS_PROFILE0, 0,
+			     pdp->qos_req0, sizeof(pdp->qos_req0));
 
 	if ((version == 1) && (!linked_pdp)) {
 		/* Not Secondary PDP Context Activation Procedure */
 		/* IMSI (conditional) */
 		if (gtpie_gettv0
-		    (ie, GTPIE_IMSI, 0, &pdp->imsi, sizeof(pdp->imsi))) {
+		    (&ie, GTPIE_IMSI, 0, &pdp->imsi, sizeof(pdp->imsi))) {
 			gsn->missing++;
 			gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack,
 				    len, "Missing mandatory information field");
@@ -1418,14 +1664,14 @@ int gtp_create_pdp_ind(struct gsn_t *gsn, int version,
 	}
 
 	/* Recovery (optional) */
-	if (!gtpie_gettv1(ie, GTPIE_RECOVERY, 0, &recovery)) {
+	if (!gtpie_gettv1(&ie, GTPIE_RECOVERY, 0, &recovery)) {
 		if (gsn->cb_recovery)
 			gsn->cb_recovery(peer, recovery);
 	}
 
 	/* Selection mode (conditional) */
 	if (!linked_pdp) {	/* Not Secondary PDP Context Activation Procedure */
-		if (gtpie_gettv0(ie, GTPIE_SELECTION_MODE, 0,
+		if (gtpie_gettv0(&ie, GTPIE_SELECTION_MODE, 0,
 				 &pdp->selmode, sizeof(pdp->selmode))) {
 			gsn->missing++;
 			gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack,
@@ -1436,36 +1682,17 @@ int gtp_create_pdp_ind(struct gsn_t *gsn, int version,
 	}
 
 	if (version == 0) {
-		if (gtpie_gettv2(ie, GTPIE_FL_DI, 0, &pdp->flru)) {
-			gsn->missing++;
-			gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack,
-				    len, "Missing mandatory information field");
-			return gtp_create_pdp_resp(gsn, version, pdp,
-						   GTPCAUSE_MAN_IE_MISSING);
-		}
-
-		if (gtpie_gettv2(ie, GTPIE_FL_C, 0, &pdp->flrc)) {
-			gsn->missing++;
-			gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack,
-				    len, "Missing mandatory information field");
-			return gtp_create_pdp_resp(gsn, version, pdp,
-						   GTPCAUSE_MAN_IE_MISSING);
-		}
+		gtpie_gettv2(&ie, GTPIE_FL_DI, 0, &pdp->flru);
+		gtpie_gettv2(&ie, GTPIE_FL_C, 0, &pdp->flrc);
 	}
 
 	if (version == 1) {
 		/* TEID (mandatory) */
-		if (gtpie_gettv4(ie, GTPIE_TEI_DI, 0, &pdp->teid_gn)) {
-			gsn->missing++;
-			gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack,
-				    len, "Missing mandatory information field");
-			return gtp_create_pdp_resp(gsn, version, pdp,
-						   GTPCAUSE_MAN_IE_MISSING);
-		}
+		gtpie_gettv4(&ie, GTPIE_TEI_DI, 0, &pdp->teid_gn);
 
 		/* TEIC (conditional) */
 		if (!linked_pdp) {	/* Not Secondary PDP Context Activation Procedure */
-			if (gtpie_gettv4(ie, GTPIE_TEI_C, 0, &pdp->teic_gn)) {
+			if (gtpie_gettv4(&ie, GTPIE_TEI_C, 0, &pdp->teic_gn)) {
 				gsn->missing++;
 				gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer,
 					    pack, len,
@@ -1476,13 +1703,7 @@ int gtp_create_pdp_ind(struct gsn_t *gsn, int version,
 		}
 
 		/* NSAPI (mandatory) */
-		if (gtpie_gettv1(ie, GTPIE_NSAPI, 0, &pdp->nsapi)) {
-			gsn->missing++;
-			gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack,
-				    len, "Missing mandatory information field");
-			return gtp_create_pdp_resp(gsn, version, pdp,
-						   GTPCAUSE_MAN_IE_MISSING);
-		}
+		gtpie_gettv1(&ie, GTPIE_NSAPI, 0, &pdp->nsapi);
 	}
 
 	/* Charging Characteriatics (optional) */
@@ -1492,7 +1713,7 @@ int gtp_create_pdp_ind(struct gsn_t *gsn, int version,
 
 	if (!linked_pdp) {	/* Not Secondary PDP Context Activation Procedure */
 		/* End User Address (conditional) */
-		if (gtpie_gettlv(ie, GTPIE_EUA, 0, &pdp->eua.l,
+		if (gtpie_gettlv(&ie, GTPIE_EUA, 0, &pdp->eua.l,
 				 &pdp->eua.v, sizeof(pdp->eua.v))) {
 			gsn->missing++;
 			gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack,
@@ -1502,7 +1723,7 @@ int gtp_create_pdp_ind(struct gsn_t *gsn, int version,
 		}
 
 		/* APN */
-		if (gtpie_gettlv(ie, GTPIE_APN, 0, &pdp->apn_req.l,
+		if (gtpie_gettlv(&ie, GTPIE_APN, 0, &pdp->apn_req.l,
 				 &pdp->apn_req.v, sizeof(pdp->apn_req.v))) {
 			gsn->missing++;
 			gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack,
@@ -1512,13 +1733,13 @@ int gtp_create_pdp_ind(struct gsn_t *gsn, int version,
 		}
 
 		/* Extract protocol configuration options (optional) */
-		if (!gtpie_gettlv(ie, GTPIE_PCO, 0, &pdp->pco_req.l,
+		if (!gtpie_gettlv(&ie, GTPIE_PCO, 0, &pdp->pco_req.l,
 				  &pdp->pco_req.v, sizeof(pdp->pco_req.v))) {
 		}
 	}
 
 	/* SGSN address for signalling (mandatory) */
-	if (gtpie_gettlv(ie, GTPIE_GSN_ADDR, 0, &pdp->gsnrc.l,
+	if (gtpie_gettlv(&ie, GTPIE_GSN_ADDR, 0, &pdp->gsnrc.l,
 			 &pdp->gsnrc.v, sizeof(pdp->gsnrc.v))) {
 		gsn->missing++;
 		gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack, len,
@@ -1528,7 +1749,7 @@ int gtp_create_pdp_ind(struct gsn_t *gsn, int version,
 	}
 
 	/* SGSN address for user traffic (mandatory) */
-	if (gtpie_gettlv(ie, GTPIE_GSN_ADDR, 1, &pdp->gsnru.l,
+	if (gtpie_gettlv(&ie, GTPIE_GSN_ADDR, 1, &pdp->gsnru.l,
 			 &pdp->gsnru.v, sizeof(pdp->gsnru.v))) {
 		gsn->missing++;
 		gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack, len,
@@ -1539,7 +1760,7 @@ int gtp_create_pdp_ind(struct gsn_t *gsn, int version,
 
 	if (!linked_pdp) {	/* Not Secondary PDP Context Activation Procedure */
 		/* MSISDN (conditional) */
-		if (gtpie_gettlv(ie, GTPIE_MSISDN, 0, &pdp->msisdn.l,
+		if (gtpie_gettlv(&ie, GTPIE_MSISDN, 0, &pdp->msisdn.l,
 				 &pdp->msisdn.v, sizeof(pdp->msisdn.v))) {
 			gsn->missing++;
 			gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack,
@@ -1551,7 +1772,7 @@ int gtp_create_pdp_ind(struct gsn_t *gsn, int version,
 
 	if (version == 1) {
 		/* QoS (mandatory) */
-		if (gtpie_gettlv(ie, GTPIE_QOS_PROFILE, 0, &pdp->qos_req.l,
+		if (gtpie_gettlv(&ie, GTPIE_QOS_PROFILE, 0, &pdp->qos_req.l,
 				 &pdp->qos_req.v, sizeof(pdp->qos_req.v))) {
 			gsn->missing++;
 			gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack,
@@ -1561,7 +1782,7 @@ int gtp_create_pdp_ind(struct gsn_t *gsn, int version,
 		}
 
 		/* TFT (conditional) */
-		if (gtpie_gettlv(ie, GTPIE_TFT, 0, &pdp->tft.l,
+		if (gtpie_gettlv(&ie, GTPIE_TFT, 0, &pdp->tft.l,
 				 &pdp->tft.v, sizeof(pdp->tft.v))) {
 		}
 
@@ -1592,6 +1813,17 @@ int gtp_create_pdp_ind(struct gsn_t *gsn, int version,
 		    &&
 		    (!memcmp(pdp->msisdn.v, pdp_old->msisdn.v, pdp->msisdn.l)))
 		{
+			/* The application has not answered the create of the
+			   old context yet, so this is a retransmission that
+			   is not in the response queue. It is answered when
+			   the application answers */
+			if (!__atomic_load_n(&pdp_old->ready, __ATOMIC_ACQUIRE)) {
+				if (GTP_DEBUG)
+					printf
+					    ("gtp_create_pdp_ind: Old context not answered yet\n");
+				return 0;
+			}
+
 			/* OK! We are dealing with the same APN. We will copy new
 			 * parameters to the old pdp and send off confirmation 
 			 * We ignore the following information elements:
@@ -1625,6 +1857,7 @@ int gtp_create_pdp_ind(struct gsn_t *gsn, int version,
 
 			/* Switch to using the old pdp context */
 			pdp = pdp_old;
+			gtp_update_ind(gsn, pdp);
 
 			/* Confirm to peer that things were "successful" */
 			return gtp_create_pdp_resp(gsn, version, pdp,
@@ -1635,8 +1868,7 @@ int gtp_create_pdp_ind(struct gsn_t *gsn, int version,
 				printf
 				    ("gtp_create_pdp_ind: Deleting old context\n");
 
-			if (gsn->cb_delete_context)
-				gsn->cb_delete_context(pdp_old);
+			gtp_delete_ind(gsn, pdp_old);
 			pdp_freepdp(pdp_old);
 
 			if (GTP_DEBUG)
@@ -1662,7 +1894,7 @@ int gtp_create_pdp_conf(struct gsn_t *gsn, int version,
 			struct sockaddr_in *peer, void *pack, unsigned len)
 {
 	struct pdp_t *pdp;
-	union gtpie_member *ie[GTPIE_SIZE];
+	struct gtpie_tab ie;
 	uint8_t cause, recovery;
 	void *cbp = NULL;
 	uint8_t type = 0;
@@ -1686,7 +1918,7 @@ int gtp_create_pdp_conf(struct gsn_t *gsn, int version,
 	pdp->teic_confirmed = 1;
 
 	/* Decode information elements */
-	if (gtpie_decaps(ie, version, pack + hlen, len - hlen)) {
+	if (gtpie_decaps(&ie, version, pack + hlen, len - hlen)) {
 		gsn->invalid++;
 		gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack, len,
 			    "Invalid message format");
@@ -1698,7 +1930,7 @@ int gtp_create_pdp_conf(struct gsn_t *gsn, int version,
 	}
 
 	/* Extract cause value (mandatory) */
-	if (gtpie_gettv1(ie, GTPIE_CAUSE, 0, &cause)) {
+	if (gtpie_gettv1(&ie, GTPIE_CAUSE, 0, &cause)) {
 		gsn->missing++;
 		gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack, len,
 			    "Missing mandatory information field");
@@ -1710,13 +1942,13 @@ int gtp_create_pdp_conf(struct gsn_t *gsn, int version,
 	}
 
 	/* Extract recovery (optional) */
-	if (!gtpie_gettv1(ie, GTPIE_RECOVERY, 0, &recovery)) {
+	if (!gtpie_gettv1(&ie, GTPIE_RECOVERY, 0, &recovery)) {
 		if (gsn->cb_recovery)
 			gsn->cb_recovery(peer, recovery);
 	}
 
 	/* Extract protocol configuration options (optional) */
-	if (!gtpie_gettlv(ie, GTPIE_PCO, 0, &pdp->pco_req.l,
+	if (!gtpie_gettlv(&ie, GTPIE_PCO, 0, &pdp->pco_req.l,
 			  &pdp->pco_req.v, sizeof(pdp->pco_req.v))) {
 	}
 
@@ -1724,7 +1956,7 @@ int gtp_create_pdp_conf(struct gsn_t *gsn, int version,
 	if (GTPCAUSE_ACC_REQ == cause) {
 
 		if (version == 0) {
-			if (gtpie_gettv0(ie, GTPIE_QOS_PROFILE0, 0,
+			if (gtpie_gettv0(&ie, GTPIE_QOS_PROFILE0, 0,
 					 &pdp->qos_neg0,
 					 sizeof(pdp->qos_neg0))) {
 				gsn->missing++;
@@ -1739,7 +1971,7 @@ int gtp_create_pdp_conf(struct gsn_t *gsn, int version,
 			}
 		}
 
-		if (gtpie_gettv1(ie, GTPIE_REORDER, 0, &pdp->reorder)) {
+		if (gtpie_gettv1(&ie, GTPIE_REORDER, 0, &pdp->reorder)) {
 			gsn->missing++;
 			gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack,
 				    len,
@@ -1752,7 +1984,7 @@ int gtp_create_pdp_conf(struct gsn_t *gsn, int version,
 		}
 
 		if (version == 0) {
-			if (gtpie_gettv2(ie, GTPIE_FL_DI, 0, &pdp->flru)) {
+			if (gtpie_gettv2(&ie, GTPIE_FL_DI, 0, &pdp->flru)) {
 				gsn->missing++;
 				gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer,
 					    pack, len,
@@ -1764,7 +1996,7 @@ int gtp_create_pdp_conf(struct gsn_t *gsn, int version,
 				return EOF;
 			}
 
-			if (gtpie_gettv2(ie, GTPIE_FL_C, 0, &pdp->flrc)) {
+			if (gtpie_gettv2(&ie, GTPIE_FL_C, 0, &pdp->flrc)) {
 				gsn->missing++;
 				gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer,
 					    pack, len,
@@ -1778,7 +2010,7 @@ int gtp_create_pdp_conf(struct gsn_t *gsn, int version,
 		}
 
 		if (version == 1) {
-			if (gtpie_gettv4(ie, GTPIE_TEI_DI, 0, &pdp->teid_gn)) {
+			if (gtpie_gettv4(&ie, GTPIE_TEI_DI, 0, &pdp->teid_gn)) {
 				gsn->missing++;
 				gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer,
 					    pack, len,
@@ -1790,7 +2022,7 @@ int gtp_create_pdp_conf(struct gsn_t *gsn, int version,
 				return EOF;
 			}
 
-			if (gtpie_gettv4(ie, GTPIE_TEI_C, 0, &pdp->teic_gn)) {
+			if (gtpie_gettv4(&ie, GTPIE_TEI_C, 0, &pdp->teic_gn)) {
 				gsn->missing++;
 				gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer,
 					    pack, len,
@@ -1803,7 +2035,7 @@ int gtp_create_pdp_conf(struct gsn_t *gsn, int version,
 			}
 		}
 
-		if (gtpie_gettv4(ie, GTPIE_CHARGING_ID, 0, &pdp->cid)) {
+		if (gtpie_gettv4(&ie, GTPIE_CHARGING_ID, 0, &pdp->cid)) {
 			gsn->missing++;
 			gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack,
 				    len,
@@ -1814,7 +2046,7 @@ int gtp_create_pdp_conf(struct gsn_t *gsn, int version,
 			   pdp_freepdp(pdp); */
 		}
 
-		if (gtpie_gettlv(ie, GTPIE_EUA, 0, &pdp->eua.l,
+		if (gtpie_gettlv(&ie, GTPIE_EUA, 0, &pdp->eua.l,
 				 &pdp->eua.v, sizeof(pdp->eua.v))) {
 			gsn->missing++;
 			gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack,
@@ -1827,7 +2059,7 @@ int gtp_create_pdp_conf(struct gsn_t *gsn, int version,
 			return EOF;
 		}
 
-		if (gtpie_gettlv(ie, GTPIE_GSN_ADDR, 0, &pdp->gsnrc.l,
+		if (gtpie_gettlv(&ie, GTPIE_GSN_ADDR, 0, &pdp->gsnrc.l,
 				 &pdp->gsnrc.v, sizeof(pdp->gsnrc.v))) {
 			gsn->missing++;
 			gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack,
@@ -1840,7 +2072,7 @@ int gtp_create_pdp_conf(struct gsn_t *gsn, int version,
 			return EOF;
 		}
 
-		if (gtpie_gettlv(ie, GTPIE_GSN_ADDR, 1, &pdp->gsnru.l,
+		if (gtpie_gettlv(&ie, GTPIE_GSN_ADDR, 1, &pdp->gsnru.l,
 				 &pdp->gsnru.v, sizeof(pdp->gsnru.v))) {
 			gsn->missing++;
 			gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack,
@@ -1855,7 +2087,7 @@ int gtp_create_pdp_conf(struct gsn_t *gsn, int version,
 
 		if (version == 1) {
 			if (gtpie_gettlv
-			    (ie, GTPIE_QOS_PROFILE, 0, &pdp->qos_neg.l,
+			    (&ie, GTPIE_QOS_PROFILE, 0, &pdp->qos_neg.l,
 			     &pdp->qos_neg.v, sizeof(pdp->qos_neg.v))) {
 				gsn->missing++;
 				gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer,
@@ -1871,6 +2103,9 @@ int gtp_create_pdp_conf(struct gsn_t *gsn, int version,
 
 	}
 
+	if (cause == GTPCAUSE_ACC_REQ)
+		gtp_gpdu_publish(gsn, pdp);
+
 	if (gsn->cb_conf)
 		gsn->cb_conf(type, cause, pdp, cbp);
 
@@ -1960,54 +2195,54 @@ int gtp_update_pdp_resp(struct gsn_t *gsn, int version,
 	union gtp_packet packet;
 	unsigned int length =
 	    get_default_gtp(version, GTP_UPDATE_PDP_RSP, &packet);
+	struct gtpie_bld b;
 
-	gtpie_tv1(&packet, &length, GTP_MAX, GTPIE_CAUSE, cause);
+	gtpie_bld_init(&b, &packet, length, GTP_MAX);
+	gtpie_bld_tv1(&b, GTPIE_CAUSE, cause);
 
 	if (cause == GTPCAUSE_ACC_REQ) {
 
 		if (version == 0)
-			gtpie_tv0(&packet, &length, GTP_MAX, GTPIE_QOS_PROFILE0,
-				  sizeof(pdp->qos_neg0), pdp->qos_neg0);
+			gtpie_bld_tv0(&b, GTPIE_QOS_PROFILE0,
+				      sizeof(pdp->qos_neg0), pdp->qos_neg0);
 
-		gtpie_tv1(&packet, &length, GTP_MAX, GTPIE_RECOVERY,
-			  gsn->restart_counter);
+		gtpie_bld_tv1(&b, GTPIE_RECOVERY, gsn->restart_counter);
 
 		if (version == 0) {
-			gtpie_tv2(&packet, &length, GTP_MAX, GTPIE_FL_DI,
-				  pdp->fllu);
-			gtpie_tv2(&packet, &length, GTP_MAX, GTPIE_FL_C,
-				  pdp->fllc);
+			gtpie_bld_tv2(&b, GTPIE_FL_DI, pdp->fllu);
+			gtpie_bld_tv2(&b, GTPIE_FL_C, pdp->fllc);
 		}
 
 		if (version == 1) {
-			gtpie_tv4(&packet, &length, GTP_MAX, GTPIE_TEI_DI,
-				  pdp->teid_own);
+			gtpie_bld_tv4(&b, GTPIE_TEI_DI, pdp->teid_own);
 
 			if (!pdp->teic_confirmed)
-				gtpie_tv4(&packet, &length, GTP_MAX,
-					  GTPIE_TEI_C, pdp->teic_own);
+				gtpie_bld_tv4(&b, GTPIE_TEI_C, pdp->teic_own);
 		}
 
 		/* TODO we use teid_own as charging ID address */
-		gtpie_tv4(&packet, &length, GTP_MAX, GTPIE_CHARGING_ID,
-			  pdp->teid_own);
+		gtpie_bld_tv4(&b, GTPIE_CHARGING_ID, pdp->teid_own);
 
 		/* If ggsn 
 		   gtpie_tlv(&packet, &length, GTP_MAX, GTPIE_EUA, 
 		   pdp->eua.l, pdp->eua.v); */
 
-		gtpie_tlv(&packet, &length, GTP_MAX, GTPIE_GSN_ADDR,
-			  pdp->gsnlc.l, pdp->gsnlc.v);
-		gtpie_tlv(&packet, &length, GTP_MAX, GTPIE_GSN_ADDR,
-			  pdp->gsnlu.l, pdp->gsnlu.v);
+		gtpie_bld_tlv(&b, GTPIE_GSN_ADDR, pdp->gsnlc.l, pdp->gsnlc.v);
+		gtpie_bld_tlv(&b, GTPIE_GSN_ADDR, pdp->gsnlu.l, pdp->gsnlu.v);
 
 		if (version == 1)
-			gtpie_tlv(&packet, &length, GTP_MAX, GTPIE_QOS_PROFILE,
-				  pdp->qos_neg.l, pdp->qos_neg.v);
+			gtpie_bld_tlv(&b, GTPIE_QOS_PROFILE,
+				      pdp->qos_neg.l, pdp->qos_neg.v);
 
 		/* TODO: Charging gateway address */
 	}
 
+	if (gtpie_bld_end(&b, &length)) {
+		gtp_err(LOG_ERR, __FILE__, __LINE__,
+			"Failed to encode update PDP context response");
+		return EOF;
+	}
+
 	return gtp_resp(version, gsn, pdp, &packet, length, peer,
 			fd, get_seq(pack), get_tid(pack));
 }
@@ -2019,7 +2254,7 @@ int gtp_update_pdp_ind(struct gsn_t *gsn, int version,
 {
 	struct pdp_t *pdp;
 	struct pdp_t pdp_backup;
-	union gtpie_member *ie[GTPIE_SIZE];
+	struct gtpie_tab ie;
 	uint8_t recovery;
 
 	uint16_t seq = get_seq(pack);
@@ -2034,7 +2269,7 @@ int gtp_update_pdp_ind(struct gsn_t *gsn, int version,
 	}
 
 	/* Decode information elements */
-	if (gtpie_decaps(ie, version, pack + hlen, len - hlen)) {
+	if (gtpie_decaps(&ie, version, pack + hlen, len - hlen)) {
 		gsn->invalid++;
 		gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack, len,
 			    "Invalid message format");
@@ -2046,6 +2281,15 @@ int gtp_update_pdp_ind(struct gsn_t *gsn, int version,
 						   GTPCAUSE_INVALID_MESSAGE);
 	}
 
+	/* Check for unconditionally mandatory information elements */
+	if (gtpie_check(&ie, version, GTPIE_MSG_UPDATE_REQ)) {
+		gsn->missing++;
+		gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack, len,
+			    "Missing mandatory information field");
+		return gtp_update_pdp_resp(gsn, version, peer, fd, pack, len,
+					   NULL, GTPCAUSE_MAN_IE_MISSING);
+	}
+
 	/* Finding PDP: */
 	/* For GTP0 we use the tunnel identifier to provide imsi and nsapi. */
 	/* For GTP1 we must use imsi and nsapi if imsi is present. Otherwise */
@@ -2069,17 +2313,10 @@ int gtp_update_pdp_ind(struct gsn_t *gsn, int version,
 		}
 	} else if (version == 1) {
 		/* NSAPI (mandatory) */
-		if (gtpie_gettv1(ie, GTPIE_NSAPI, 0, &nsapi)) {
-			gsn->missing++;
-			gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack,
-				    len, "Missing mandatory information field");
-			return gtp_update_pdp_resp(gsn, version, peer, fd, pack,
-						   len, NULL,
-						   GTPCAUSE_MAN_IE_MISSING);
-		}
+		gtpie_gettv1(&ie, GTPIE_NSAPI, 0, &nsapi);
 
 		/* IMSI (conditional) */
-		if (gtpie_gettv0(ie, GTPIE_IMSI, 0, &imsi, sizeof(imsi))) {
+		if (gtpie_gettv0(&ie, GTPIE_IMSI, 0, &imsi, sizeof(imsi))) {
 			/* Find the context in question */
 			if (pdp_getgtp1(&pdp, get_tei(pack))) {
 				gsn->err_unknownpdp++;
@@ -2108,82 +2345,40 @@ int gtp_update_pdp_ind(struct gsn_t *gsn, int version,
 	/* Make a backup copy in case anything is wrong */
 	memcpy(&pdp_backup, pdp, sizeof(pdp_backup));
 
-	if (version == 0) {
-		if (gtpie_gettv0(ie, GTPIE_QOS_PROFILE0, 0,
-				 pdp->qos_req0, sizeof(pdp->qos_req0))) {
-			gsn->missing++;
-			gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack,
-				    len, "Missing mandatory information field");
-			memcpy(pdp, &pdp_backup, sizeof(pdp_backup));
-			return gtp_update_pdp_resp(gsn, version, peer, fd, pack,
-						   len, pdp,
-						   GTPCAUSE_MAN_IE_MISSING);
-		}
-	}
+	if (version == 0)
+		gtpie_gettv0(&ie, GTPIE_QOS_PROFILE0, 0,
+			     pdp->qos_req0, sizeof(pdp->qos_req0));
 
 	/* Recovery (optional) */
-	if (!gtpie_gettv1(ie, GTPIE_RECOVERY, 0, &recovery)) {
+	if (!gtpie_gettv1(&ie, GTPIE_RECOVERY, 0, &recovery)) {
 		if (gsn->cb_recovery)
 			gsn->cb_recovery(peer, recovery);
 	}
 
 	if (version == 0) {
-		if (gtpie_gettv2(ie, GTPIE_FL_DI, 0, &pdp->flru)) {
-			gsn->missing++;
-			gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack,
-				    len, "Missing mandatory information field");
-			memcpy(pdp, &pdp_backup, sizeof(pdp_backup));
-			return gtp_update_pdp_resp(gsn, version, peer, fd, pack,
-						   len, pdp,
-						   GTPCAUSE_MAN_IE_MISSING);
-		}
-
-		if (gtpie_gettv2(ie, GTPIE_FL_C, 0, &pdp->flrc)) {
-			gsn->missing++;
-			gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack,
-				    len, "Missing mandatory information field");
-			memcpy(pdp, &pdp_backup, sizeof(pdp_backup));
-			return gtp_update_pdp_resp(gsn, version, peer, fd, pack,
-						   len, pdp,
-						   GTPCAUSE_MAN_IE_MISSING);
-		}
+		gtpie_gettv2(&ie, GTPIE_FL_DI, 0, &pdp->flru);
+		gtpie_gettv2(&ie, GTPIE_FL_C, 0, &pdp->flrc);
 	}
 
 	if (version == 1) {
 		/* TEID (mandatory) */
-		if (gtpie_gettv4(ie, GTPIE_TEI_DI, 0, &pdp->teid_gn)) {
-			gsn->missing++;
-			gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack,
-				    len, "Missing mandatory information field");
-			memcpy(pdp, &pdp_backup, sizeof(pdp_backup));
-			return gtp_update_pdp_resp(gsn, version, peer, fd, pack,
-						   len, pdp,
-						   GTPCAUSE_MAN_IE_MISSING);
-		}
+		gtpie_gettv4(&ie, GTPIE_TEI_DI, 0, &pdp->teid_gn);
 
 		/* TEIC (conditional) */
 		/* If TEIC is not included it means that we have allready received it */
 		/* TODO: From 29.060 it is not clear if TEI_C MUST be included for */
 		/* all updated contexts, or only for one of the linked contexts */
-		gtpie_gettv4(ie, GTPIE_TEI_C, 0, &pdp->teic_gn);
+		gtpie_gettv4(&ie, GTPIE_TEI_C, 0, &pdp->teic_gn);
 
 		/* NSAPI (mandatory) */
-		if (gtpie_gettv1(ie, GTPIE_NSAPI, 0, &pdp->nsapi)) {
-			gsn->missing++;
-			gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack,
-				    len, "Missing mandatory information field");
-			memcpy(pdp, &pdp_backup, sizeof(pdp_backup));
-			return gtp_update_pdp_resp(gsn, version, peer, fd, pack,
-						   len, pdp,
-						   GTPCAUSE_MAN_IE_MISSING);
-		}
+		gtpie_gettv1(&ie, GTPIE_NSAPI, 0, &pdp->nsapi);
 	}
 
 	/* Trace reference (optional) */
 	/* Trace type (optional) */
 
 	/* End User Address (conditional) TODO: GGSN Initiated
-	   if (gtpie_gettlv(ie, GTPIE_EUA, 0, &pdp->eua.l,
+	   if (gtpie_gettlv(&ie, GTPIE_EUA, 0, &pdp->eua.l,
 	   &pdp->eua.v, sizeof(pdp->eua.v))) {
 	   gsn->missing++;
 	   gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack, len,
@@ -2195,7 +2390,7 @@ int gtp_update_pdp_ind(struct gsn_t *gsn, int version,
 
 	/* SGSN address for signalling (mandatory) */
 	/* It is weird that this is mandatory when TEIC is conditional */
-	if (gtpie_gettlv(ie, GTPIE_GSN_ADDR, 0, &pdp->gsnrc.l,
+	if (gtpie_gettlv(&ie, GTPIE_GSN_ADDR, 0, &pdp->gsnrc.l,
 			 &pdp->gsnrc.v, sizeof(pdp->gsnrc.v))) {
 		gsn->missing++;
 		gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack, len,
@@ -2206,7 +2401,7 @@ int gtp_update_pdp_ind(struct gsn_t *gsn, int version,
 	}
 
 	/* SGSN address for user traffic (mandatory) */
-	if (gtpie_gettlv(ie, GTPIE_GSN_ADDR, 1, &pdp->gsnru.l,
+	if (gtpie_gettlv(&ie, GTPIE_GSN_ADDR, 1, &pdp->gsnru.l,
 			 &pdp->gsnru.v, sizeof(pdp->gsnru.v))) {
 		gsn->missing++;
 		gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack, len,
@@ -2218,7 +2413,7 @@ int gtp_update_pdp_ind(struct gsn_t *gsn, int version,
 
 	if (version == 1) {
 		/* QoS (mandatory) */
-		if (gtpie_gettlv(ie, GTPIE_QOS_PROFILE, 0, &pdp->qos_req.l,
+		if (gtpie_gettlv(&ie, GTPIE_QOS_PROFILE, 0, &pdp->qos_req.l,
 				 &pdp->qos_req.v, sizeof(pdp->qos_req.v))) {
 			gsn->missing++;
 			gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack,
@@ -2230,13 +2425,15 @@ int gtp_update_pdp_ind(struct gsn_t *gsn, int version,
 		}
 
 		/* TFT (conditional) */
-		if (gtpie_gettlv(ie, GTPIE_TFT, 0, &pdp->tft.l,
+		if (gtpie_gettlv(&ie, GTPIE_TFT, 0, &pdp->tft.l,
 				 &pdp->tft.v, sizeof(pdp->tft.v))) {
 		}
 
 		/* OMC identity */
 	}
 
+	gtp_update_ind(gsn, pdp);
+
 	/* Confirm to peer that things were "successful" */
 	return gtp_update_pdp_resp(gsn, version, peer, fd, pack, len, pdp,
 				   GTPCAUSE_ACC_REQ);
@@ -2247,7 +2444,7 @@ int gtp_update_pdp_conf(struct gsn_t *gsn, int version,
 			struct sockaddr_in *peer, void *pack, unsigned len)
 {
 	struct pdp_t *pdp;
-	union gtpie_member *ie[GTPIE_SIZE];
+	struct gtpie_tab ie;
 	uint8_t cause, recovery;
 	void *cbp = NULL;
 	uint8_t type = 0;
@@ -2271,7 +2468,7 @@ int gtp_update_pdp_conf(struct gsn_t *gsn, int version,
 
 	/* Decode information elements */
 	if (gtpie_decaps
-	    (ie, 0, pack + GTP0_HEADER_SIZE, len - GTP0_HEADER_SIZE)) {
+	    (&ie, 0, pack + GTP0_HEADER_SIZE, len - GTP0_HEADER_SIZE)) {
 		gsn->invalid++;
 		gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack, len,
 			    "Invalid message format");
@@ -2283,7 +2480,7 @@ int gtp_update_pdp_conf(struct gsn_t *gsn, int version,
 	}
 
 	/* Extract cause value (mandatory) */
-	if (gtpie_gettv1(ie, GTPIE_CAUSE, 0, &cause)) {
+	if (gtpie_gettv1(&ie, GTPIE_CAUSE, 0, &cause)) {
 		gsn->missing++;
 		gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack, len,
 			    "Missing mandatory information field");
@@ -2295,7 +2492,7 @@ int gtp_update_pdp_conf(struct gsn_t *gsn, int version,
 	}
 
 	/* Extract recovery (optional) */
-	if (!gtpie_gettv1(ie, GTPIE_RECOVERY, 0, &recovery)) {
+	if (!gtpie_gettv1(&ie, GTPIE_RECOVERY, 0, &recovery)) {
 		if (gsn->cb_recovery)
 			gsn->cb_recovery(peer, recovery);
 	}
@@ -2309,14 +2506,14 @@ int gtp_update_pdp_conf(struct gsn_t *gsn, int version,
 		return 0;
 	} else {
 		/* Check for missing conditionary information elements */
-		if (!(gtpie_exist(ie, GTPIE_QOS_PROFILE0, 0) &&
-		      gtpie_exist(ie, GTPIE_REORDER, 0) &&
-		      gtpie_exist(ie, GTPIE_FL_DI, 0) &&
-		      gtpie_exist(ie, GTPIE_FL_C, 0) &&
-		      gtpie_exist(ie, GTPIE_CHARGING_ID, 0) &&
-		      gtpie_exist(ie, GTPIE_EUA, 0) &&
-		      gtpie_exist(ie, GTPIE_GSN_ADDR, 0) &&
-		      gtpie_exist(ie, GTPIE_GSN_ADDR, 1))) {
+		if (!(gtpie_exist(&ie, GTPIE_QOS_PROFILE0, 0) &&
+		      gtpie_exist(&ie, GTPIE_REORDER, 0) &&
+		      gtpie_exist(&ie, GTPIE_FL_DI, 0) &&
+		      gtpie_exist(&ie, GTPIE_FL_C, 0) &&
+		      gtpie_exist(&ie, GTPIE_CHARGING_ID, 0) &&
+		      gtpie_exist(&ie, GTPIE_EUA, 0) &&
+		      gtpie_exist(&ie, GTPIE_GSN_ADDR, 0) &&
+		      gtpie_exist(&ie, GTPIE_GSN_ADDR, 1))) {
 			gsn->missing++;
 			gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack,
 				    len,
@@ -2329,18 +2526,19 @@ int gtp_update_pdp_conf(struct gsn_t *gsn, int version,
 		}
 
 		/* Update pdp with new values */
-		gtpie_gettv0(ie, GTPIE_QOS_PROFILE0, 0,
+		gtpie_gettv0(&ie, GTPIE_QOS_PROFILE0, 0,
 			     pdp->qos_neg0, sizeof(pdp->qos_neg0));
-		gtpie_gettv1(ie, GTPIE_REORDER, 0, &pdp->reorder);
-		gtpie_gettv2(ie, GTPIE_FL_DI, 0, &pdp->flru);
-		gtpie_gettv2(ie, GTPIE_FL_C, 0, &pdp->flrc);
-		gtpie_gettv4(ie, GTPIE_CHARGING_ID, 0, &pdp->cid);
-		gtpie_gettlv(ie, GTPIE_EUA, 0, &pdp->eua.l,
+		gtpie_gettv1(&ie, GTPIE_REORDER, 0, &pdp->reorder);
+		gtpie_gettv2(&ie, GTPIE_FL_DI, 0, &pdp->flru);
+		gtpie_gettv2(&ie, GTPIE_FL_C, 0, &pdp->flrc);
+		gtpie_gettv4(&ie, GTPIE_CHARGING_ID, 0, &pdp->cid);
+		gtpie_gettlv(&ie, GTPIE_EUA, 0, &pdp->eua.l,
 			     &pdp->eua.v, sizeof(pdp->eua.v));
-		gtpie_gettlv(ie, GTPIE_GSN_ADDR, 0, &pdp->gsnrc.l,
+		gtpie_gettlv(&ie, GTPIE_GSN_ADDR, 0, &pdp->gsnrc.l,
 			     &pdp->gsnrc.v, sizeof(pdp->gsnrc.v));
-		gtpie_gettlv(ie, GTPIE_GSN_ADDR, 1, &pdp->gsnru.l,
+		gtpie_gettlv(&ie, GTPIE_GSN_ADDR, 1, &pdp->gsnru.l,
 			     &pdp->gsnru.v, sizeof(pdp->gsnru.v));
+		gtp_update_ind(gsn, pdp);
 
 		if (gsn->cb_conf)
 			gsn->cb_conf(type, cause, pdp, cbp);
@@ -2406,19 +2604,15 @@ int gtp_delete_context_req(struct gsn_t *gsn, struct pdp_t *pdp, void *cbp,
 					return EOF;
 				}
 				if (linked_pdp != secondary_pdp) {
-					if (gsn->cb_delete_context)
-						gsn->cb_delete_context
-						    (secondary_pdp);
+					gtp_delete_ind(gsn, secondary_pdp);
 					pdp_freepdp(secondary_pdp);
 				}
 			}
 		}
-		if (gsn->cb_delete_context)
-			gsn->cb_delete_context(linked_pdp);
+		gtp_delete_ind(gsn, linked_pdp);
 		pdp_freepdp(linked_pdp);
 	} else {
-		if (gsn->cb_delete_context)
-			gsn->cb_delete_context(pdp);
+		gtp_delete_ind(gsn, pdp);
 		if (pdp == linked_pdp) {
 			linked_pdp->secondary_tei[pdp->nsapi & 0xf0] = 0;
 			linked_pdp->nodata = 1;
@@ -2440,9 +2634,17 @@ int gtp_delete_pdp_resp(struct gsn_t *gsn, int version,
 	struct pdp_t *secondary_pdp;
 	unsigned int length =
 	    get_default_gtp(version, GTP_DELETE_PDP_RSP, &packet);
+	struct gtpie_bld b;
 	int n;
 
-	gtpie_tv1(&packet, &length, GTP_MAX, GTPIE_CAUSE, cause);
+	gtpie_bld_init(&b, &packet, length, GTP_MAX);
+	gtpie_bld_tv1(&b, GTPIE_CAUSE, cause);
+
+	if (gtpie_bld_end(&b, &length)) {
+		gtp_err(LOG_ERR, __FILE__, __LINE__,
+			"Failed to encode delete PDP context response");
+		return EOF;
+	}
 
 	gtp_resp(version, gsn, pdp, &packet, length, peer, fd,
 		 get_seq(pack), get_tid(pack));
@@ -2460,19 +2662,15 @@ int gtp_delete_pdp_resp(struct gsn_t *gsn, int version,
 						return EOF;
 					}
 					if (linked_pdp != secondary_pdp) {
-						if (gsn->cb_delete_context)
-							gsn->cb_delete_context
-							    (secondary_pdp);
+						gtp_delete_ind(gsn, secondary_pdp);
 						pdp_freepdp(secondary_pdp);
 					}
 				}
 			}
-			if (gsn->cb_delete_context)
-				gsn->cb_delete_context(linked_pdp);
+			gtp_delete_ind(gsn, linked_pdp);
 			pdp_freepdp(linked_pdp);
 		} else {	/* Remove only current context */
-			if (gsn->cb_delete_context)
-				gsn->cb_delete_context(pdp);
+			gtp_delete_ind(gsn, pdp);
 			if (pdp == linked_pdp) {
 				linked_pdp->secondary_tei[pdp->nsapi & 0xf0] =
 				    0;
@@ -2492,7 +2690,7 @@ int gtp_delete_pdp_ind(struct gsn_t *gsn, int version,
 {
 	struct pdp_t *pdp = NULL;
 	struct pdp_t *linked_pdp = NULL;
-	union gtpie_member *ie[GTPIE_SIZE];
+	struct gtpie_tab ie;
 
 	uint16_t seq = get_seq(pack);
 	int hlen = get_hlen(pack);
@@ -2522,7 +2720,7 @@ int gtp_delete_pdp_ind(struct gsn_t *gsn, int version,
 		pdp = linked_pdp;
 
 	/* Decode information elements */
-	if (gtpie_decaps(ie, version, pack + hlen, len - hlen)) {
+	if (gtpie_decaps(&ie, version, pack + hlen, len - hlen)) {
 		gsn->invalid++;
 		gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack, len,
 			    "Invalid message format");
@@ -2535,17 +2733,19 @@ int gtp_delete_pdp_ind(struct gsn_t *gsn, int version,
 						   teardown);
 	}
 
+	/* Check for unconditionally mandatory information elements */
+	if (gtpie_check(&ie, version, GTPIE_MSG_DELETE_REQ)) {
+		gsn->missing++;
+		gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack, len,
+			    "Missing mandatory information field");
+		return gtp_delete_pdp_resp(gsn, version, peer, fd, pack, len,
+					   NULL, NULL, GTPCAUSE_MAN_IE_MISSING,
+					   teardown);
+	}
+
 	if (version == 1) {
 		/* NSAPI (mandatory) */
-		if (gtpie_gettv1(ie, GTPIE_NSAPI, 0, &nsapi)) {
-			gsn->missing++;
-			gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack,
-				    len, "Missing mandatory information field");
-			return gtp_delete_pdp_resp(gsn, version, peer, fd, pack,
-						   len, NULL, NULL,
-						   GTPCAUSE_MAN_IE_MISSING,
-						   teardown);
-		}
+		gtpie_gettv1(&ie, GTPIE_NSAPI, 0, &nsapi);
 
 		/* Find the context in question */
 		if (pdp_getgtp1(&pdp, linked_pdp->secondary_tei[nsapi & 0x0f])) {
@@ -2559,7 +2759,7 @@ int gtp_delete_pdp_ind(struct gsn_t *gsn, int version,
 		}
 
 		/* Teardown (conditional) */
-		gtpie_gettv1(ie, GTPIE_TEARDOWN, 0, &teardown);
+		gtpie_gettv1(&ie, GTPIE_TEARDOWN, 0, &teardown);
 
 		if (!teardown) {
 			for (n = 0; n < PDP_MAXNSAPI; n++)
@@ -2579,7 +2779,7 @@ int gtp_delete_pdp_ind(struct gsn_t *gsn, int version,
 int gtp_delete_pdp_conf(struct gsn_t *gsn, int version,
 			struct sockaddr_in *peer, void *pack, unsigned len)
 {
-	union gtpie_member *ie[GTPIE_SIZE];
+	struct gtpie_tab ie;
 	uint8_t cause;
 	void *cbp = NULL;
 	uint8_t type = 0;
@@ -2590,7 +2790,7 @@ int gtp_delete_pdp_conf(struct gsn_t *gsn, int version,
 		return EOF;
 
 	/* Decode information elements */
-	if (gtpie_decaps(ie, version, pack + hlen, len - hlen)) {
+	if (gtpie_decaps(&ie, version, pack + hlen, len - hlen)) {
 		gsn->invalid++;
 		gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack, len,
 			    "Invalid message format");
@@ -2600,7 +2800,7 @@ int gtp_delete_pdp_conf(struct gsn_t *gsn, int version,
 	}
 
 	/* Extract cause value (mandatory) */
-	if (gtpie_gettv1(ie, GTPIE_CAUSE, 0, &cause)) {
+	if (gtpie_gettv1(&ie, GTPIE_CAUSE, 0, &cause)) {
 		gsn->missing++;
 		gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack, len,
 			    "Missing mandatory information field");
@@ -2656,17 +2856,42 @@ int gtp_error_ind_conf(struct gsn_t *gsn, int version,
 	gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack, len,
 		    "Received Error Indication");
 
-	if (gsn->cb_delete_context)
-		gsn->cb_delete_context(pdp);
+	gtp_delete_ind(gsn, pdp);
 	pdp_freepdp(pdp);
 	return 0;
 }
 
-int gtp_gpdu_ind(struct gsn_t *gsn, int version,
-		 struct sockaddr_in *peer, int fd, void *pack, unsigned len)
+/* Tell the peer that a G-PDU was for an unknown context. Called from
+ * data plane threads, so the response queue is locked */
+static int gtp_gpdu_unknown(struct gsn_t *gsn, int version,
+			    struct sockaddr_in *peer, int fd,
+			    void *pack, unsigned len)
+{
+	int rc;
+
+	gsn->err_unknownpdp++;
+	gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack, len,
+		    "Unknown PDP context");
+	gtp_lock(gsn);
+	rc = gtp_error_ind_resp(gsn, version, peer, fd, pack, len);
+	gtp_unlock(gsn);
+	return rc;
+}
+
+/* Find the context of a G-PDU, and check that it came from the peer of
+ * the context. Returns 0 with the payload in pkt, 1 when the G-PDU was
+ * not for a known context, or EOF for an unknown version. Takes no lock,
+ * so that no context found in a burst can be deleted meanwhile. The
+ * caller answers unknown contexts with gtp_gpdu_unknown() */
+static int gtp_gpdu_lookup(struct gsn_t *gsn, int version,
+			   struct sockaddr_in *peer, int fd, void *pack,
+			   unsigned len, struct gtp_pkt *pkt)
 {
 
 	int hlen = GTP1_HEADER_SIZE_SHORT;
+	uint8_t hdr[sizeof(((struct pdp_t *) 0)->gpdu_hdr)];
+	struct sockaddr_in src;
+	unsigned int tlen;
 
 	/* Need to include code to verify packet src and dest addresses */
 	struct pdp_t *pdp;
@@ -2674,21 +2899,13 @@ int gtp_gpdu_ind(struct gsn_t *gsn, int version,
 	if (version == 0) {
 		if (pdp_getgtp0
 		    (&pdp, ntoh16(((union gtp_packet *)pack)->gtp0.h.flow))) {
-			gsn->err_unknownpdp++;
-			gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack,
-				    len, "Unknown PDP context");
-			return gtp_error_ind_resp(gsn, version, peer, fd, pack,
-						  len);
+			return 1;
 		}
 		hlen = GTP0_HEADER_SIZE;
 	} else if (version == 1) {
 		if (pdp_getgtp1
 		    (&pdp, ntoh32(((union gtp_packet *)pack)->gtp1l.h.tei))) {
-			gsn->err_unknownpdp++;
-			gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack,
-				    len, "Unknown PDP context");
-			return gtp_error_ind_resp(gsn, version, peer, fd, pack,
-						  len);
+			return 1;
 		}
 
 		/* Is this a long or a short header ? */
@@ -2699,27 +2916,70 @@ int gtp_gpdu_ind(struct gsn_t *gsn, int version,
 	} else {
 		gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack, len,
 			    "Unknown version");
+		return EOF;
 	}
 
-	/* If the GPDU was not from the peer GSN tell him to delete context */
-	if (memcmp(&peer->sin_addr, pdp->gsnru.v, pdp->gsnru.l)) {	/* TODO Range? */
-		gsn->err_unknownpdp++;
-		gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack, len,
-			    "Unknown PDP context");
-		return gtp_error_ind_resp(gsn, version, peer, fd, pack, len);
+	/* Contexts being set up or deleted are unknown to the data plane */
+	if (!__atomic_load_n(&pdp->ready, __ATOMIC_ACQUIRE)) {
+		return 1;
 	}
 
-	/* Callback function */
-	if (gsn->cb_data_ind != 0)
-		return gsn->cb_data_ind(pdp, pack + hlen, len - hlen);
+	/* If the GPDU was not from the peer GSN tell him to delete context.
+	   The address is taken from the template, as gsnru may be changed
+	   by an update meanwhile */
+	gtp_gpdu_copy(pdp, hdr, &tlen, &src);
+	if (peer->sin_addr.s_addr != src.sin_addr.s_addr) {	/* TODO Range? */
+		return 1;
+	}
 
+	pkt->pdp = pdp;
+	pkt->pack = (uint8_t *) pack + hlen;
+	pkt->len = len - hlen;
 	return 0;
 }
 
+/* Hand the payloads of G-PDUs to the application, as one burst or one
+ * by one */
+static int gtp_gpdu_deliver(struct gsn_t *gsn, struct gtp_pkt *pkts, int n)
+{
+	int i, rc = 0;
+
+	if (!n)
+		return 0;
+	if (gsn->cb_data_ind_burst)
+		return gsn->cb_data_ind_burst(pkts, n);
+	if (!gsn->cb_data_ind)
+		return 0;
+	for (i = 0; i < n; i++)
+		if (gsn->cb_data_ind(pkts[i].pdp, pkts[i].pack, pkts[i].len))
+			rc = EOF;
+	return rc;
+}
+
+int gtp_gpdu_ind(struct gsn_t *gsn, int version,
+		 struct sockaddr_in *peer, int fd, void *pack, unsigned len)
+{
+	struct gtp_pkt pkt;
+
+	switch (gtp_gpdu_lookup(gsn, version, peer, fd, pack, len, &pkt)) {
+	case 0:
+		break;
+	case 1:
+		return gtp_gpdu_unknown(gsn, version, peer, fd, pack, len);
+	default:
+		return EOF;
+	}
+
+	/* Callback function */
+	return gtp_gpdu_deliver(gsn, &pkt, 1);
+}
+
 /* Receives GTP packet and sends off for further processing 
  * Function will check the validity of the header. If the header
  * is not valid the packet is either dropped or a version not 
  * supported is returned to the peer. 
+ * Returns 0 when the socket is empty, 1 if the budget was used up
+ * and -1 on error.
  * TODO: Need to decide on return values! */
 int gtp_decaps0(struct gsn_t *gsn)
 {
@@ -2730,19 +2990,21 @@ int gtp_decaps0(struct gsn_t *gsn)
 	struct gtp0_header *pheader;
 	int version = 0;	/* GTP version should be determined from header! */
 	int fd = gsn->fd0;
+	int n = 0;
 
 	/* TODO: Need strategy of userspace buffering and blocking */
-	/* Currently read is non-blocking and send is blocking. */
+	/* Currently read is non-blocking and send is blocking. The socket
+	   itself stays blocking, so that threads can share it */
 	/* This means that the program have to wait for busy send calls... */
 
 	while (1) {		/* Loop until no more to read */
-		if (fcntl(gsn->fd0, F_SETFL, O_NONBLOCK)) {
-			gtp_err(LOG_ERR, __FILE__, __LINE__, "fnctl()");
-			return -1;
+		if (gsn->budget_c && (n++ >= gsn->budget_c)) {
+			gsn->exhausted0++;
+			return 1;	/* Budget used up. Rest stays queued */
 		}
 		peerlen = sizeof(peer);
 		if ((status =
-		     recvfrom(gsn->fd0, buffer, sizeof(buffer), 0,
+		     recvfrom(gsn->fd0, buffer, sizeof(buffer), MSG_DONTWAIT,
 			      (struct sockaddr *)&peer, &peerlen)) < 0) {
 			if (errno == EAGAIN)
 				return 0;
@@ -2875,19 +3137,21 @@ int gtp_decaps1c(struct gsn_t *gsn)
 	struct gtp1_header_short *pheader;
 	int version = 1;	/* TODO GTP version should be determined from header! */
 	int fd = gsn->fd1c;
+	int n = 0;
 
 	/* TODO: Need strategy of userspace buffering and blocking */
-	/* Currently read is non-blocking and send is blocking. */
+	/* Currently read is non-blocking and send is blocking. The socket
+	   itself stays blocking, so that threads can share it */
 	/* This means that the program have to wait for busy send calls... */
 
 	while (1) {		/* Loop until no more to read */
-		if (fcntl(fd, F_SETFL, O_NONBLOCK)) {
-			gtp_err(LOG_ERR, __FILE__, __LINE__, "fnctl()");
-			return -1;
+		if (gsn->budget_c && (n++ >= gsn->budget_c)) {
+			gsn->exhausted1c++;
+			return 1;	/* Budget used up. Rest stays queued */
 		}
 		peerlen = sizeof(peer);
 		if ((status =
-		     recvfrom(fd, buffer, sizeof(buffer), 0,
+		     recvfrom(fd, buffer, sizeof(buffer), MSG_DONTWAIT,
 			      (struct sockaddr *)&peer, &peerlen)) < 0) {
 			if (errno == EAGAIN)
 				return 0;
@@ -3041,217 +3305,507 @@ int gtp_decaps1c(struct gsn_t *gsn)
 	}
 }
 
-int gtp_decaps1u(struct gsn_t *gsn)
+/* Check the header of a GTPv1-U message received from peer. Messages
+ * other than G-PDUs are handled under the lock. Returns 1 for a G-PDU,
+ * to be handled by the caller without the lock, otherwise 0 */
+static int gtp_check1u(struct gsn_t *gsn, struct sockaddr_in *peer,
+		       void *pack, unsigned len)
 {
-	unsigned char buffer[PACKET_MAX];
-	struct sockaddr_in peer;
-	socklen_t peerlen;
-	int status;
 	struct gtp1_header_short *pheader;
 	int version = 1;	/* GTP version should be determined from header! */
 	int fd = gsn->fd1u;
 
+	/* Need at least 1 byte in order to check version */
+	if (len < (1)) {
+		gsn->empty++;
+		gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack, len,
+			    "Discarding packet - too small");
+		return 0;
+	}
+
+	pheader = (struct gtp1_header_short *)(pack);
+
+	/* Version must be no larger than GTP 1 */
+	if (((pheader->flags & 0xe0) > 0x20)) {
+		gsn->unsup++;
+		gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack, len,
+			    "Unsupported GTP version");
+		gtp_lock(gsn);
+		gtp_unsup_req(gsn, 1, peer, gsn->fd1c, pack, len);	/*29.60: 11.1.1 */
+		gtp_unlock(gsn);
+		return 0;
+	}
+
+	/* Version must be at least GTP 1 */
+	/* 29.060 is somewhat unclear on this issue. On gsn->fd1c we expect only */
+	/* GTP 1 messages. If GTP 0 message is received we silently discard */
+	/* the message */
+	if (((pheader->flags & 0xe0) < 0x20)) {
+		gsn->unsup++;
+		gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack, len,
+			    "Unsupported GTP version");
+		return 0;
+	}
+
+	/* Check packet flag field (allow both with and without sequence number) */
+	if (((pheader->flags & 0xf5) != 0x30)) {
+		gsn->unsup++;
+		gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack, len,
+			    "Unsupported packet flag");
+		return 0;
+	}
+
+	/* Check length of packet */
+	if (len < GTP1_HEADER_SIZE_SHORT) {
+		gsn->tooshort++;
+		gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack, len,
+			    "GTP packet too short");
+		return 0;	/* Silently discard 29.60: 11.1.2 */
+	}
+
+	/* Check packet length field versus length of packet */
+	if (len != (ntoh16(pheader->length) + GTP1_HEADER_SIZE_SHORT)) {
+		gsn->tooshort++;
+		gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack, len,
+			    "GTP packet length field does not match actual length");
+		return 0;	/* Silently discard */
+	}
+
+	/* Check for extension headers */
+	/* TODO: We really should cycle through the headers and determine */
+	/* if any have the comprehension required flag set */
+	if (((pheader->flags & 0x04) != 0x00)) {
+		gsn->unsup++;
+		gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack, len,
+			    "Unsupported extension header");
+		gtp_lock(gsn);
+		gtp_extheader_req(gsn, version, peer, fd, pack, len);
+		gtp_unlock(gsn);
+
+		return 0;
+	}
+
+	/* G-PDUs are handled without the lock, by data plane threads */
+	if (pheader->type == GTP_GPDU)
+		return 1;
+
+	gtp_lock(gsn);
+	switch (pheader->type) {
+	case GTP_ECHO_REQ:
+		gtp_echo_ind(gsn, version, peer, fd, pack, len);
+		break;
+	case GTP_ECHO_RSP:
+		gtp_echo_conf(gsn, version, peer, pack, len);
+		break;
+	case GTP_SUPP_EXT_HEADER:
+		gtp_extheader_ind(gsn, peer, pack, len);
+		break;
+	case GTP_ERROR:
+		gtp_error_ind_conf(gsn, version, peer, pack, len);
+		break;
+	default:
+		gsn->unknown++;
+		gtp_errpack(LOG_ERR, __FILE__, __LINE__, peer, pack, len,
+			    "Unknown GTP message type received");
+		break;
+	}
+	gtp_unlock(gsn);
+	return 0;
+}
+
+/* Handle a GTPv1-U message received from peer. G-PDUs are handled
+ * without the lock, other messages under it */
+int gtp_decaps1u_buf(struct gsn_t *gsn, struct sockaddr_in *peer,
+		     void *pack, unsigned len)
+{
+	if (gtp_check1u(gsn, peer, pack, len))
+		gtp_gpdu_ind(gsn, 1, peer, gsn->fd1u, pack, len);
+	return 0;
+}
+
+/* Handle a burst of GTPv1-U messages in stages, each over the whole
+ * burst: headers are checked, and messages other than G-PDUs handled,
+ * then the contexts of the G-PDUs are looked up, prefetching those a
+ * few packets ahead, and the payloads are handed over. G-PDUs for
+ * unknown contexts are answered last, as that takes the lock, during
+ * which the contexts found may be deleted */
+static void gtp_decaps1u_burst(struct gsn_t *gsn, struct sockaddr_in *peer,
+			       uint8_t ** pack, unsigned *len, int n)
+{
+	struct gtp_pkt pkts[GTP_BURST];
+	int gpdu[GTP_BURST];
+	int unknown[GTP_BURST];
+	int i, j, k = 0, m = 0, u = 0;
+
+	for (i = 0; i < n; i++)
+		if (gtp_check1u(gsn, &peer[i], pack[i], len[i]))
+			gpdu[k++] = i;
+
+	for (i = 0; i < k; i++) {
+		if (i + GTP_PREFETCH < k)
+			pdp_prefetchgtp1(ntoh32(((union gtp_packet *)
+						 pack[gpdu[i + GTP_PREFETCH]])->
+						gtp1l.h.tei));
+		j = gpdu[i];
+		switch (gtp_gpdu_lookup(gsn, 1, &peer[j], gsn->fd1u, pack[j],
+					len[j], &pkts[m])) {
+		case 0:
+			m++;
+			break;
+		case 1:
+			unknown[u++] = j;
+			break;
+		}
+	}
+
+	gtp_gpdu_deliver(gsn, pkts, m);
+
+	for (i = 0; i < u; i++) {
+		j = unknown[i];
+		gtp_gpdu_unknown(gsn, 1, &peer[j], gsn->fd1u, pack[j], len[j]);
+	}
+}
+
+/* Receive buffers of the thread, for one burst. Allocated on first use,
+ * and kept for the life of the thread */
+static __thread uint8_t(*gtp_rxbuf)[PACKET_MAX];
+
+/* Receive up to n messages from fd1u. Returns the number received, or
+ * -1 with errno set when there were none */
+static int gtp_recv1u(struct gsn_t *gsn, struct sockaddr_in *peer,
+		      uint8_t ** pack, unsigned *len, int n)
+{
+#ifdef HAVE_RECVMMSG
+	struct mmsghdr msg[GTP_BURST];
+	struct iovec iov[GTP_BURST];
+	int i, k;
+
+	memset(msg, 0, n * sizeof(msg[0]));
+	for (i = 0; i < n; i++) {
+		iov[i].iov_base = pack[i];
+		iov[i].iov_len = PACKET_MAX;
+		msg[i].msg_hdr.msg_name = &peer[i];
+		msg[i].msg_hdr.msg_namelen = sizeof(peer[i]);
+		msg[i].msg_hdr.msg_iov = &iov[i];
+		msg[i].msg_hdr.msg_iovlen = 1;
+	}
+	if ((k = recvmmsg(gsn->fd1u, msg, n, MSG_DONTWAIT, NULL)) < 0)
+		return -1;
+	for (i = 0; i < k; i++)
+		len[i] = msg[i].msg_len;
+	return k;
+#else
+	socklen_t peerlen;
+	int k, status;
+
+	for (k = 0; k < n; k++) {
+		peerlen = sizeof(peer[k]);
+		if ((status = recvfrom(gsn->fd1u, pack[k], PACKET_MAX,
+				       MSG_DONTWAIT,
+				       (struct sockaddr *)&peer[k],
+				       &peerlen)) < 0)
+			return k ? k : -1;
+		len[k] = status;
+	}
+	return k;
+#endif
+}
+
+int gtp_decaps1u(struct gsn_t *gsn)
+{
+	struct sockaddr_in peer[GTP_BURST];
+	uint8_t *pack[GTP_BURST];
+	unsigned len[GTP_BURST];
+	int i, k, want;
+	int n = 0;
+
 	/* TODO: Need strategy of userspace buffering and blocking */
-	/* Currently read is non-blocking and send is blocking. */
+	/* Currently read is non-blocking and send is blocking. The socket
+	   itself stays blocking, so that threads can share it */
 	/* This means that the program have to wait for busy send calls... */
 
+	if (!gtp_rxbuf && !(gtp_rxbuf = malloc(GTP_BURST * PACKET_MAX))) {
+		gtp_err(LOG_ERR, __FILE__, __LINE__,
+			"Failed to allocate receive buffers");
+		return -1;
+	}
+	for (i = 0; i < GTP_BURST; i++)
+		pack[i] = gtp_rxbuf[i];
+
 	while (1) {		/* Loop until no more to read */
-		if (fcntl(gsn->fd1u, F_SETFL, O_NONBLOCK)) {
-			gtp_err(LOG_ERR, __FILE__, __LINE__, "fnctl()");
-			return -1;
-		}
-		peerlen = sizeof(peer);
-		if ((status =
-		     recvfrom(gsn->fd1u, buffer, sizeof(buffer), 0,
-			      (struct sockaddr *)&peer, &peerlen)) < 0) {
+		if (gsn->budget_u && (n >= gsn->budget_u)) {
+			gsn->exhausted1u++;
+			return 1;	/* Budget used up. Rest stays queued */
+		}
+		want = GTP_BURST;
+		if (gsn->budget_u && (gsn->budget_u - n < want))
+			want = gsn->budget_u - n;
+		if ((k = gtp_recv1u(gsn, peer, pack, len, want)) < 0) {
 			if (errno == EAGAIN)
 				return 0;
 			gsn->err_readfrom++;
 			gtp_err(LOG_ERR, __FILE__, __LINE__,
-				"recvfrom(fd1u=%d, buffer=%lx, len=%d) failed: status = %d error = %s",
-				gsn->fd1u, (unsigned long)buffer,
-				sizeof(buffer), status,
-				status ? strerror(errno) : "No error");
+				"recvfrom(fd1u=%d) failed: error = %s",
+				gsn->fd1u, strerror(errno));
 			return -1;
 		}
+		n += k;
 
-		/* Need at least 1 byte in order to check version */
-		if (status < (1)) {
-			gsn->empty++;
-			gtp_errpack(LOG_ERR, __FILE__, __LINE__, &peer, buffer,
-				    status, "Discarding packet - too small");
-			continue;
-		}
-
-		pheader = (struct gtp1_header_short *)(buffer);
+		gtp_decaps1u_burst(gsn, peer, pack, len, k);
+		if (k < want)
+			return 0;	/* Drained */
+	}
+}
 
-		/* Version must be no larger than GTP 1 */
-		if (((pheader->flags & 0xe0) > 0x20)) {
-			gsn->unsup++;
-			gtp_errpack(LOG_ERR, __FILE__, __LINE__, &peer, buffer,
-				    status, "Unsupported GTP version");
-			gtp_unsup_req(gsn, 1, &peer, gsn->fd1c, buffer, status);	/*29.60: 11.1.1 */
-			continue;
-		}
+/* Build the G-PDU header and destination of a context. Only length and
+ * sequence number change from packet to packet. Data plane threads may
+ * be copying them, so they are written under the sequence lock */
+static void gtp_gpdu_build(struct gsn_t *gsn, struct pdp_t *pdp)
+{
+	struct gtp0_header *gtp0 = (struct gtp0_header *)pdp->gpdu_hdr;
+	struct gtp1_header_long *gtp1 = (struct gtp1_header_long *)pdp->gpdu_hdr;
+	unsigned int seq = pdp->gpdu_seq;
 
-		/* Version must be at least GTP 1 */
-		/* 29.060 is somewhat unclear on this issue. On gsn->fd1c we expect only */
-		/* GTP 1 messages. If GTP 0 message is received we silently discard */
-		/* the message */
-		if (((pheader->flags & 0xe0) < 0x20)) {
-			gsn->unsup++;
-			gtp_errpack(LOG_ERR, __FILE__, __LINE__, &peer, buffer,
-				    status, "Unsupported GTP version");
-			continue;
-		}
+	__atomic_store_n(&pdp->gpdu_seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
 
-		/* Check packet flag field (allow both with and without sequence number) */
-		if (((pheader->flags & 0xf5) != 0x30)) {
-			gsn->unsup++;
-			gtp_errpack(LOG_ERR, __FILE__, __LINE__, &peer, buffer,
-				    status, "Unsupported packet flag");
-			continue;
-		}
+	memset(&pdp->gpdu_peer, 0, sizeof(pdp->gpdu_peer));
+	pdp->gpdu_peer.sin_family = AF_INET;
+#if defined(__FreeBSD__) || defined(__APPLE__)
+	pdp->gpdu_peer.sin_len = sizeof(pdp->gpdu_peer);
+#endif
+	memcpy(&pdp->gpdu_peer.sin_addr, pdp->gsnru.v,
+	       pdp->gsnru.l < sizeof(struct in_addr) ?
+	       pdp->gsnru.l : sizeof(struct in_addr));
 
-		/* Check length of packet */
-		if (status < GTP1_HEADER_SIZE_SHORT) {
-			gsn->tooshort++;
-			gtp_errpack(LOG_ERR, __FILE__, __LINE__, &peer, buffer,
-				    status, "GTP packet too short");
-			continue;	/* Silently discard 29.60: 11.1.2 */
+	if (pdp->version == 0) {
+		pdp->gpdu_peer.sin_port = htons(GTP0_PORT);
+		pdp->gpdu_hlen = get_default_gtp(0, GTP_GPDU, gtp0);
+		gtp0->flow = hton16(pdp->flru);
+		gtp0->tid = (pdp->imsi & 0x0fffffffffffffffull) +
+		    ((uint64_t) pdp->nsapi << 60);
+	} else {
+		pdp->gpdu_peer.sin_port = htons(GTP1U_PORT);
+		pdp->gpdu_hlen = get_default_gtp(1, GTP_GPDU, gtp1);
+		gtp1->tei = hton32(pdp->teid_gn);
+		if (gsn->gpdu_short) {
+			gtp1->flags = 0x30;	/* No sequence number */
+			pdp->gpdu_hlen = GTP1_HEADER_SIZE_SHORT;
 		}
+	}
 
-		/* Check packet length field versus length of packet */
-		if (status !=
-		    (ntoh16(pheader->length) + GTP1_HEADER_SIZE_SHORT)) {
-			gsn->tooshort++;
-			gtp_errpack(LOG_ERR, __FILE__, __LINE__, &peer, buffer,
-				    status,
-				    "GTP packet length field does not match actual length");
-			continue;	/* Silently discard */
-		}
+	__atomic_store_n(&pdp->gpdu_seq, seq + 2, __ATOMIC_RELEASE);
+}
 
-		/* Check for extension headers */
-		/* TODO: We really should cycle through the headers and determine */
-		/* if any have the comprehension required flag set */
-		if (((pheader->flags & 0x04) != 0x00)) {
-			gsn->unsup++;
-			gtp_errpack(LOG_ERR, __FILE__, __LINE__, &peer, buffer,
-				    status, "Unsupported extension header");
-			gtp_extheader_req(gsn, version, &peer, fd, buffer,
-					  status);
+/* Copy the G-PDU header and destination of a context. Retries while
+ * the control plane is rebuilding them */
+static void gtp_gpdu_copy(struct pdp_t *pdp, uint8_t * hdr,
+			  unsigned int *hlen, struct sockaddr_in *peer)
+{
+	unsigned int seq;
+
+	do {
+		while ((seq = __atomic_load_n(&pdp->gpdu_seq,
+					      __ATOMIC_ACQUIRE)) & 1) ;
+		*hlen = pdp->gpdu_hlen;
+		memcpy(hdr, pdp->gpdu_hdr, sizeof(pdp->gpdu_hdr));
+		if (peer)
+			memcpy(peer, &pdp->gpdu_peer, sizeof(*peer));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while (__atomic_load_n(&pdp->gpdu_seq, __ATOMIC_RELAXED) != seq);
+}
 
-			continue;
-		}
+/* Make a newly set up context usable by the data plane */
+static void gtp_gpdu_publish(struct gsn_t *gsn, struct pdp_t *pdp)
+{
+	gtp_gpdu_build(gsn, pdp);
+	__atomic_store_n(&pdp->ready, 1, __ATOMIC_RELEASE);
+}
 
-		switch (pheader->type) {
-		case GTP_ECHO_REQ:
-			gtp_echo_ind(gsn, version, &peer, fd, buffer, status);
-			break;
-		case GTP_ECHO_RSP:
-			gtp_echo_conf(gsn, version, &peer, buffer, status);
-			break;
-		case GTP_SUPP_EXT_HEADER:
-			gtp_extheader_ind(gsn, &peer, buffer, status);
-			break;
-		case GTP_ERROR:
-			gtp_error_ind_conf(gsn, version, &peer, buffer, status);
-			break;
-			/* Supported header extensions */
-		case GTP_GPDU:
-			gtp_gpdu_ind(gsn, version, &peer, fd, buffer, status);
-			break;
-		default:
-			gsn->unknown++;
-			gtp_errpack(LOG_ERR, __FILE__, __LINE__, &peer, buffer,
-				    status,
-				    "Unknown GTP message type received");
-			break;
-		}
-	}
+/* The peer changed the user plane of a context */
+static void gtp_update_ind(struct gsn_t *gsn, struct pdp_t *pdp)
+{
+	gtp_gpdu_build(gsn, pdp);
+	if (gsn->cb_update_context)
+		gsn->cb_update_context(pdp);
 }
 
-int gtp_data_req(struct gsn_t *gsn, struct pdp_t *pdp, void *pack, unsigned len)
+/* Withdraw a context from the data plane, and tell the application that
+ * it is deleted. The application waits for data plane threads before
+ * returning, after which the context may be freed */
+static void gtp_delete_ind(struct gsn_t *gsn, struct pdp_t *pdp)
 {
-	union gtp_packet packet;
-	struct sockaddr_in addr;
-	int fd;
-	int length;
+	__atomic_store_n(&pdp->ready, 0, __ATOMIC_SEQ_CST);
+	if (gsn->cb_delete_context)
+		gsn->cb_delete_context(pdp);
+}
 
-	memset(&addr, 0, sizeof(addr));
-	addr.sin_family = AF_INET;
-#if defined(__FreeBSD__) || defined(__APPLE__)
-	addr.sin_len = sizeof(addr);
+/* Send n messages on fd, with as few system calls as the platform
+ * allows. Returns 0, or EOF if any failed */
+static int gtp_sendv(struct gsn_t *gsn, int fd, struct msghdr *msg, int n)
+{
+	int i = 0, rc = 0;
+#ifdef HAVE_SENDMMSG
+	struct mmsghdr mmsg[GTP_BURST];
+	int k;
+
+	for (k = 0; k < n; k++) {
+		mmsg[k].msg_hdr = msg[k];
+		mmsg[k].msg_len = 0;
+	}
+	while (i < n) {
+		if ((k = sendmmsg(fd, &mmsg[i], n - i, 0)) > 0) {
+			i += k;
+			continue;
+		}
+		/* Only the first message failed. Skip it */
+		gsn->err_sendto++;
+		gtp_err(LOG_ERR, __FILE__, __LINE__,
+			"Sendmsg(fd=%d, len=%d) failed: Error = %s", fd,
+			msg[i].msg_iov[0].iov_len + msg[i].msg_iov[1].iov_len,
+			strerror(errno));
+		rc = EOF;
+		i++;
+	}
+#else
+	for (; i < n; i++)
+		if (sendmsg(fd, &msg[i], 0) < 0) {
+			gsn->err_sendto++;
+			gtp_err(LOG_ERR, __FILE__, __LINE__,
+				"Sendmsg(fd=%d, len=%d) failed: Error = %s", fd,
+				msg[i].msg_iov[0].iov_len +
+				msg[i].msg_iov[1].iov_len, strerror(errno));
+			rc = EOF;
+		}
 #endif
+	return rc;
+}
 
-	memcpy(&addr.sin_addr, pdp->gsnru.v, pdp->gsnru.l);	/* TODO range check */
+/* Send the payloads of a burst as G-PDUs, in stages over the whole
+ * burst: contexts are checked and their header templates copied, with
+ * those a few packets ahead prefetched, then the headers are completed,
+ * and the packets handed to cb_data_send or sent on the sockets, in
+ * runs of one system call. Returns 0, or EOF if any packet was not
+ * sent */
+int gtp_data_req_burst(struct gsn_t *gsn, struct gtp_pkt *pkts, int n)
+{
+	uint8_t hdr[GTP_BURST][sizeof(((struct pdp_t *) 0)->gpdu_hdr)];
+	struct sockaddr_in peer[GTP_BURST];
+	unsigned int hlen[GTP_BURST];
+	struct iovec iov[GTP_BURST][2];
+	struct msghdr msg[GTP_BURST];
+	int fd[GTP_BURST];
+	struct gtp0_header *gtp0;
+	struct gtp1_header_long *gtp1;
+	struct pdp_t *pdp;
+	int i, k, first, sent, rc = 0;
 
-	if (pdp->version == 0) {
+	while (n > GTP_BURST) {
+		if (gtp_data_req_burst(gsn, pkts, GTP_BURST))
+			rc = EOF;
+		pkts += GTP_BURST;
+		n -= GTP_BURST;
+	}
 
-		length = GTP0_HEADER_SIZE + len;
-		addr.sin_port = htons(GTP0_PORT);
-		fd = gsn->fd0;
+	for (i = 0; i < n; i++) {
+		if (i + GTP_PREFETCH < n)
+			__builtin_prefetch(pkts[i + GTP_PREFETCH].pdp);
+		pdp = pkts[i].pdp;
+		fd[i] = -1;
 
-		get_default_gtp(0, GTP_GPDU, &packet);
-		packet.gtp0.h.length = hton16(len);
-		packet.gtp0.h.seq = hton16(pdp->gtpsntx++);
-		packet.gtp0.h.flow = hton16(pdp->flru);
-		packet.gtp0.h.tid =
-		    (pdp->imsi & 0x0fffffffffffffffull) +
-		    ((uint64_t) pdp->nsapi << 60);
+		if (!__atomic_load_n(&pdp->ready, __ATOMIC_ACQUIRE)) {
+			rc = EOF;	/* Not set up, or being deleted */
+			continue;
+		}
 
-		if (len > sizeof(union gtp_packet) - sizeof(struct gtp0_header)) {
-			gsn->err_memcpy++;
+		if ((pdp->version != 0) && (pdp->version != 1)) {
 			gtp_err(LOG_ERR, __FILE__, __LINE__,
-				"Memcpy failed: %d > %d", len,
-				sizeof(union gtp_packet) -
-				sizeof(struct gtp0_header));
-			return EOF;
+				"Unknown version");
+			rc = EOF;
+			continue;
 		}
-		memcpy(packet.gtp0.p, pack, len);	/* TODO Should be avoided! */
-	} else if (pdp->version == 1) {
-
-		length = GTP1_HEADER_SIZE_LONG + len;
-		addr.sin_port = htons(GTP1U_PORT);
-		fd = gsn->fd1u;
 
-		get_default_gtp(1, GTP_GPDU, &packet);
-		packet.gtp1l.h.length = hton16(len - GTP1_HEADER_SIZE_SHORT +
-					       GTP1_HEADER_SIZE_LONG);
-		packet.gtp1l.h.seq = hton16(pdp->gtpsntx++);
-		packet.gtp1l.h.tei = hton32(pdp->teid_gn);
+		/* The shared template is copied, and only the copy is
+		   patched */
+		gtp_gpdu_copy(pdp, hdr[i], &hlen[i], &peer[i]);
 
-		if (len >
-		    sizeof(union gtp_packet) -
-		    sizeof(struct gtp1_header_long)) {
+		if (pkts[i].len > sizeof(union gtp_packet) - hlen[i]) {
 			gsn->err_memcpy++;
 			gtp_err(LOG_ERR, __FILE__, __LINE__,
-				"Memcpy failed: %d > %d", len,
-				sizeof(union gtp_packet) -
-				sizeof(struct gtp0_header));
-			return EOF;
+				"Packet too long: %d > %d", pkts[i].len,
+				sizeof(union gtp_packet) - hlen[i]);
+			rc = EOF;
+			continue;
 		}
-		memcpy(packet.gtp1l.p, pack, len);	/* TODO Should be avoided! */
-	} else {
-		gtp_err(LOG_ERR, __FILE__, __LINE__, "Unknown version");
-		return EOF;
+		fd[i] = (pdp->version == 0) ? gsn->fd0 : gsn->fd1u;
 	}
 
-	if (fcntl(fd, F_SETFL, 0)) {
-		gtp_err(LOG_ERR, __FILE__, __LINE__, "fnctl()");
-		return -1;
+	for (i = 0; i < n; i++) {
+		if (fd[i] < 0)
+			continue;
+		pdp = pkts[i].pdp;
+		if (pdp->version == 0) {
+			gtp0 = (struct gtp0_header *)hdr[i];
+			gtp0->length = hton16(pkts[i].len);
+			gtp0->seq =
+			    hton16(__atomic_fetch_add
+				   (&pdp->gtpsntx, 1, __ATOMIC_RELAXED));
+		} else {
+			gtp1 = (struct gtp1_header_long *)hdr[i];
+			gtp1->length = hton16(pkts[i].len + hlen[i] -
+					      GTP1_HEADER_SIZE_SHORT);
+			if (hlen[i] == GTP1_HEADER_SIZE_LONG)
+				gtp1->seq =
+				    hton16(__atomic_fetch_add
+					   (&pdp->gtpsntx, 1,
+					    __ATOMIC_RELAXED));
+		}
 	}
 
-	if (sendto(fd, &packet, length, 0,
-		   (struct sockaddr *)&addr, sizeof(addr)) < 0) {
-		gsn->err_sendto++;
-		gtp_err(LOG_ERR, __FILE__, __LINE__,
-			"Sendto(fd=%d, msg=%lx, len=%d) failed: Error = %s", fd,
-			(unsigned long)&packet, GTP0_HEADER_SIZE + len,
-			strerror(errno));
-		return EOF;
-	}
-	return 0;
+	/* Header and packet are sent without copying them together */
+	for (i = 0, k = 0, first = 0; i < n; i++) {
+		if (fd[i] < 0)
+			continue;
+		if (gsn->cb_data_send) {
+			sent = gsn->cb_data_send(pkts[i].pdp, &peer[i],
+						 hdr[i], hlen[i], pkts[i].pack,
+						 pkts[i].len);
+			if (sent < 0)
+				rc = EOF;
+			if (sent <= 0)
+				continue;
+		}
+		if (k && (fd[i] != fd[first])) {
+			if (gtp_sendv(gsn, fd[first], msg, k))
+				rc = EOF;
+			k = 0;
+		}
+		if (!k)
+			first = i;
+		iov[i][0].iov_base = hdr[i];
+		iov[i][0].iov_len = hlen[i];
+		iov[i][1].iov_base = pkts[i].pack;
+		iov[i][1].iov_len = pkts[i].len;
+		memset(&msg[k], 0, sizeof(msg[k]));
+		msg[k].msg_name = &peer[i];
+		msg[k].msg_namelen = sizeof(peer[i]);
+		msg[k].msg_iov = iov[i];
+		msg[k].msg_iovlen = 2;
+		k++;
+	}
+	if (k && gtp_sendv(gsn, fd[first], msg, k))
+		rc = EOF;
+	return rc;
+}
+
+int gtp_data_req(struct gsn_t *gsn, struct pdp_t *pdp, void *pack, unsigned len)
+{
+	struct gtp_pkt pkt;
+
+	pkt.pdp = pdp;
+	pkt.pack = pack;
+	pkt.len = len;
+	return gtp_data_req_burst(gsn, &pkt, 1);
 }
 
 /* ***********************************************************
@@ -12,6 +12,8 @@
 #ifndef _GTP_H
 #define _GTP_H
 
+#include <pthread.h>
+
 #define GTP_DEBUG 0		/* Print debug information */
 
 #define GTP_MODE_GGSN 1
@@ -226,6 +228,25 @@ union gtp_packet {
  * each pdp context. This is stored in another struct.
  *************************************************************/
 
+#define GTP_ADM_PEERS 256	/* Size of per peer admission control table */
+
+/* Token bucket. Holds up to one second worth of tokens, in 1/1000 */
+struct gtp_bucket {
+	struct in_addr addr;	/* Peer owning the bucket */
+	uint64_t tokens;	/* Available tokens times 1000 */
+	struct timeval last;	/* Time refilled up to */
+};
+
+#define GTP_BURST 256		/* Packets per burst of the vector API */
+#define GTP_PREFETCH 4		/* Packets looked ahead in a burst */
+
+/* A packet of a burst. Payload of a G-PDU, without the GTP header */
+struct gtp_pkt {
+	struct pdp_t *pdp;
+	void *pack;
+	unsigned len;
+};
+
 struct gsn_t {
 	/* Parameters related to the network interface */
 
@@ -247,6 +268,24 @@ struct gsn_t {
 	struct queue_t *queue_req;	/* Request queue */
 	struct queue_t *queue_resp;	/* Response queue */
 
+	/* Scheduling: packets read per call of gtp_decaps*(). 0 = no limit */
+	int budget_c;		/* For fd0 and fd1c */
+	int budget_u;		/* For fd1u */
+
+	int gpdu_short;		/* Send GTPv1 G-PDUs without sequence numbers */
+
+	/* Serialises signalling, queues and context changes between the
+	   control thread and data plane threads. Recursive */
+	pthread_mutex_t lock;
+
+	/* Admission control of create PDP context requests */
+	int adm_rate;		/* Requests per second. 0 = no limit */
+	int adm_peer_rate;	/* Requests per second per peer. 0 = no limit */
+	int adm_reserve;	/* PDP contexts to keep free */
+	int overload;		/* Set by application to reject all creates */
+	struct gtp_bucket adm_bucket;	/* Bucket for adm_rate */
+	struct gtp_bucket *adm_peers;	/* GTP_ADM_PEERS buckets for adm_peer_rate */
+
 	/* Call back functions */
 	int (*cb_delete_context) (struct pdp_t *);
 	int (*cb_create_context_ind) (struct pdp_t *);
@@ -255,6 +294,12 @@ struct gsn_t {
 	int (*cb_conf) (int type, int cause, struct pdp_t * pdp, void *cbp);
 	int (*cb_data_ind) (struct pdp_t * pdp, void *pack, unsigned len);
 	int (*cb_recovery) (struct sockaddr_in * peer, uint8_t recovery);
+	void (*cb_lock_wait) (int waiting);
+	int (*cb_update_context) (struct pdp_t * pdp);
+	int (*cb_data_send) (struct pdp_t * pdp, struct sockaddr_in * peer,
+			     void *hdr, unsigned hlen, void *pack,
+			     unsigned len);
+	int (*cb_data_ind_burst) (struct gtp_pkt * pkts, int n);
 
 	/* Counters */
 
@@ -279,6 +324,13 @@ struct gsn_t {
 	uint64_t missing;	/* Number of missing information field messages */
 	uint64_t incorrect;	/* Number of incorrect information field messages */
 	uint64_t invalid;	/* Number of invalid message format messages */
+	uint64_t exhausted0;	/* Number of times fd0 budget was used up */
+	uint64_t exhausted1c;	/* Number of times fd1c budget was used up */
+	uint64_t exhausted1u;	/* Number of times fd1u budget was used up */
+	uint64_t adm_accept;	/* Create requests admitted */
+	uint64_t adm_reject_rate;	/* Create requests over adm_rate */
+	uint64_t adm_reject_peer;	/* Create requests over adm_peer_rate */
+	uint64_t adm_reject_full;	/* Create requests rejected for overload */
 };
 
 /* External API functions */
@@ -292,6 +344,9 @@ extern int gtp_free(struct gsn_t *gsn);
 extern int gtp_newpdp(struct gsn_t *gsn, struct pdp_t **pdp,
 		      uint64_t imsi, uint8_t nsapi);
 extern int gtp_freepdp(struct gsn_t *gsn, struct pdp_t *pdp);
+extern int gtp_newpdp_tei(struct gsn_t *gsn, struct pdp_t **pdp, uint32_t tei,
+			  uint64_t imsi, uint8_t nsapi);
+extern int gtp_set_ready(struct gsn_t *gsn, struct pdp_t *pdp, int ready);
 
 extern int gtp_create_context_req(struct gsn_t *gsn, struct pdp_t *pdp,
 				  void *cbp);
@@ -313,16 +368,38 @@ extern int gtp_delete_context_req(struct gsn_t *gsn, struct pdp_t *pdp,
 extern int gtp_data_req(struct gsn_t *gsn, struct pdp_t *pdp,
 			void *pack, unsigned len);
 
+extern int gtp_data_req_burst(struct gsn_t *gsn, struct gtp_pkt *pkts,
+			      int n);
+
 extern int gtp_set_cb_data_ind(struct gsn_t *gsn,
 			       int (*cb_data_ind) (struct pdp_t * pdp,
 						   void *pack, unsigned len));
+extern int gtp_set_cb_data_ind_burst(struct gsn_t *gsn,
+				     int (*cb) (struct gtp_pkt * pkts, int n));
 
 extern int gtp_fd(struct gsn_t *gsn);
 extern int gtp_decaps0(struct gsn_t *gsn);
 extern int gtp_decaps1c(struct gsn_t *gsn);
 extern int gtp_decaps1u(struct gsn_t *gsn);
+extern int gtp_decaps1u_buf(struct gsn_t *gsn, struct sockaddr_in *peer,
+			    void *pack, unsigned len);
 extern int gtp_retrans(struct gsn_t *gsn);
 extern int gtp_retranstimeout(struct gsn_t *gsn, struct timeval *timeout);
+extern int gtp_set_budget(struct gsn_t *gsn, int budget_c, int budget_u);
+extern int gtp_set_admission(struct gsn_t *gsn, int rate, int peer_rate,
+			     int reserve);
+extern int gtp_set_overload(struct gsn_t *gsn, int overload);
+extern int gtp_set_gpdu_short(struct gsn_t *gsn, int gpdu_short);
+extern void gtp_lock(struct gsn_t *gsn);
+extern void gtp_unlock(struct gsn_t *gsn);
+extern int gtp_set_cb_lock_wait(struct gsn_t *gsn, void (*cb) (int waiting));
+extern int gtp_set_cb_update_context(struct gsn_t *gsn,
+				     int (*cb) (struct pdp_t * pdp));
+extern int gtp_set_cb_data_send(struct gsn_t *gsn,
+				int (*cb) (struct pdp_t * pdp,
+					   struct sockaddr_in * peer,
+					   void *hdr, unsigned hlen,
+					   void *pack, unsigned len));
 
 extern int gtp_set_cb_delete_context(struct gsn_t *gsn,
 				     int (*cb_delete_context) (struct pdp_t *
@@ -17,12 +17,15 @@
  * Encapsulation
  * - gtpie_tlv, gtpie_tv0, gtpie_tv1, gtpie_tv2 ... Adds information
  * elements to a buffer.
+ * - gtpie_bld_init, gtpie_bld_tv1 ... gtpie_bld_end: Builds a sequence of
+ * information elements in ascending type order with bounds checking.
  *
  * Decapsulation
- *  - gtpie_decaps: Returns array with pointers to information elements.
- *  - getie_getie: Returns the pointer of a particular element.
+ *  - gtpie_decaps: Returns table of information elements indexed by type.
+ *  - gtpie_getie: Returns the index of a particular element.
  *  - gtpie_gettlv: Copies tlv information element. Return 0 on success.
  *  - gtpie_gettv: Copies tv information element. Return 0 on success.
+ *  - gtpie_check: Returns the first missing mandatory element, or 0.
  *
  */
 
@@ -36,6 +39,7 @@
 #include <sys/types.h>
 #include <netinet/in.h>
 #include <string.h>
+#include <strings.h>
 
 #include "gtpie.h"
 
@@ -106,418 +110,407 @@ int gtpie_tv8(void *p, unsigned int *length, unsigned int size, uint8_t t,
 	return 0;
 }
 
-int gtpie_getie(union gtpie_member *ie[], int type, int instance)
+/* Reserve n bytes for an element of type t. Returns NULL on failure */
+static uint8_t *gtpie_bld_get(struct gtpie_bld *b, uint8_t t, unsigned int n)
 {
-	int j;
-	for (j = 0; j < GTPIE_SIZE; j++) {
-		if ((ie[j] != 0) && (ie[j]->t == type)) {
-			if (instance-- == 0)
-				return j;
-		}
+	uint8_t *p;
+
+	if (b->err)
+		return NULL;
+	if ((t < b->last) || (n > b->size - b->len)) {
+		b->err = 1;
+		return NULL;
 	}
-	return -1;
+	p = b->p + b->len;
+	p[0] = t;
+	b->len += n;
+	b->last = t;
+	return p;
 }
 
-int gtpie_exist(union gtpie_member *ie[], int type, int instance)
+void gtpie_bld_init(struct gtpie_bld *b, void *p, unsigned int len,
+		    unsigned int size)
 {
-	int j;
-	for (j = 0; j < GTPIE_SIZE; j++) {
-		if ((ie[j] != 0) && (ie[j]->t == type)) {
-			if (instance-- == 0)
-				return 1;
-		}
+	b->p = p;
+	b->len = len;
+	b->size = size;
+	b->last = 0;
+	b->err = (len > size);
+}
+
+void gtpie_bld_tlv(struct gtpie_bld *b, uint8_t t, int l, void *v)
+{
+	uint8_t *p;
+	uint16_t n;
+
+	if ((l < 0) || (l > 0xffff)) {
+		b->err = 1;
+		return;
+	}
+	if (!(p = gtpie_bld_get(b, t, 3 + l)))
+		return;
+	n = hton16(l);
+	memcpy(p + 1, &n, 2);
+	memcpy(p + 3, v, l);
+}
+
+void gtpie_bld_tv0(struct gtpie_bld *b, uint8_t t, int l, uint8_t * v)
+{
+	uint8_t *p;
+
+	if (l < 0) {
+		b->err = 1;
+		return;
 	}
+	if ((p = gtpie_bld_get(b, t, 1 + l)))
+		memcpy(p + 1, v, l);
+}
+
+void gtpie_bld_tv1(struct gtpie_bld *b, uint8_t t, uint8_t v)
+{
+	uint8_t *p;
+
+	if ((p = gtpie_bld_get(b, t, 2)))
+		p[1] = v;
+}
+
+void gtpie_bld_tv2(struct gtpie_bld *b, uint8_t t, uint16_t v)
+{
+	uint8_t *p;
+
+	v = hton16(v);
+	if ((p = gtpie_bld_get(b, t, 3)))
+		memcpy(p + 1, &v, 2);
+}
+
+void gtpie_bld_tv4(struct gtpie_bld *b, uint8_t t, uint32_t v)
+{
+	uint8_t *p;
+
+	v = hton32(v);
+	if ((p = gtpie_bld_get(b, t, 5)))
+		memcpy(p + 1, &v, 4);
+}
+
+/* Returns the total length in *length. Returns EOF if any append failed */
+int gtpie_bld_end(struct gtpie_bld *b, unsigned int *length)
+{
+	if (b->err)
+		return EOF;
+	*length = b->len;
 	return 0;
 }
 
-int gtpie_gettlv(union gtpie_member *ie[], int type, int instance,
+/* Record element j of the table in the instance chain of its type */
+static void gtpie_index(struct gtpie_tab *ie, int j)
+{
+	uint8_t t = ie->ie[j]->t;
+
+	if (ie->present[t / 32] & (1u << (t % 32))) {
+		ie->next[ie->last[t]] = j;
+		ie->count[t]++;
+	} else {
+		ie->present[t / 32] |= (1u << (t % 32));
+		ie->first[t] = j;
+		ie->count[t] = 1;
+	}
+	ie->last[t] = j;
+}
+
+int gtpie_getie(struct gtpie_tab *ie, int type, int instance)
+{
+	int j;
+
+	if ((type < 0) || (type >= GTPIE_SIZE) || (instance < 0))
+		return -1;
+	if (!(ie->present[type / 32] & (1u << (type % 32))))
+		return -1;
+	if (instance >= ie->count[type])
+		return -1;
+
+	j = ie->first[type];
+	while (instance--)
+		j = ie->next[j];
+	return j;
+}
+
+int gtpie_exist(struct gtpie_tab *ie, int type, int instance)
+{
+	return (gtpie_getie(ie, type, instance) >= 0);
+}
+
+int gtpie_gettlv(struct gtpie_tab *ie, int type, int instance,
 		 unsigned int *length, void *dst, unsigned int size)
 {
 	int ien;
 	ien = gtpie_getie(ie, type, instance);
 	if (ien >= 0) {
-		*length = ntoh16(ie[ien]->tlv.l);
+		*length = ntoh16(ie->ie[ien]->tlv.l);
 		if (*length <= size)
-			memcpy(dst, ie[ien]->tlv.v, *length);
+			memcpy(dst, ie->ie[ien]->tlv.v, *length);
 		else
 			return EOF;
 	}
 	return 0;
 }
 
-int gtpie_gettv0(union gtpie_member *ie[], int type, int instance,
+int gtpie_gettv0(struct gtpie_tab *ie, int type, int instance,
 		 void *dst, unsigned int size)
 {
 	int ien;
 	ien = gtpie_getie(ie, type, instance);
 	if (ien >= 0)
-		memcpy(dst, ie[ien]->tv0.v, size);
+		memcpy(dst, ie->ie[ien]->tv0.v, size);
 	else
 		return EOF;
 	return 0;
 }
 
-int gtpie_gettv1(union gtpie_member *ie[], int type, int instance,
+int gtpie_gettv1(struct gtpie_tab *ie, int type, int instance,
 		 uint8_t * dst)
 {
 	int ien;
 	ien = gtpie_getie(ie, type, instance);
 	if (ien >= 0)
-		*dst = ntoh8(ie[ien]->tv1.v);
+		*dst = ntoh8(ie->ie[ien]->tv1.v);
 	else
 		return EOF;
 	return 0;
 }
 
-int gtpie_gettv2(union gtpie_member *ie[], int type, int instance,
+int gtpie_gettv2(struct gtpie_tab *ie, int type, int instance,
 		 uint16_t * dst)
 {
 	int ien;
 	ien = gtpie_getie(ie, type, instance);
 	if (ien >= 0)
-		*dst = ntoh16(ie[ien]->tv2.v);
+		*dst = ntoh16(ie->ie[ien]->tv2.v);
 	else
 		return EOF;
 	return 0;
 }
 
-int gtpie_gettv4(union gtpie_member *ie[], int type, int instance,
+int gtpie_gettv4(struct gtpie_tab *ie, int type, int instance,
 		 uint32_t * dst)
 {
 	int ien;
 	ien = gtpie_getie(ie, type, instance);
 	if (ien >= 0)
-		*dst = ntoh32(ie[ien]->tv4.v);
+		*dst = ntoh32(ie->ie[ien]->tv4.v);
 	else
 		return EOF;
 	return 0;
 }
 
-int gtpie_gettv8(union gtpie_member *ie[], int type, int instance,
+int gtpie_gettv8(struct gtpie_tab *ie, int type, int instance,
 		 uint64_t * dst)
 {
 	int ien;
 	ien = gtpie_getie(ie, type, instance);
 	if (ien >= 0)
-		*dst = ntoh64(ie[ien]->tv8.v);
+		*dst = ntoh64(ie->ie[ien]->tv8.v);
 	else
 		return EOF;
 	return 0;
 }
 
-int gtpie_decaps(union gtpie_member *ie[], int version, void *pack,
+/* Information element descriptors.
+ * Every element known to the decoder and encoder is described here, once.
+ * TV elements have a fixed value length, which for types 16 and 17 differs
+ * between GTPv0 (flow labels) and GTPv1 (tunnel endpoint identifiers).
+ * man[] holds the GTPIE_MSG_* bits of the messages in which the element is
+ * unconditionally mandatory, for GTPv0 and GTPv1 respectively. */
+
+#define GTPIE_FMT_NONE 0	/* Unknown element */
+#define GTPIE_FMT_TV   1	/* Type, fixed length value */
+#define GTPIE_FMT_TLV  2	/* Type, 16 bit length, value */
+#define GTPIE_FMT_EXT  3	/* Type, 8 bit length, value */
+
+#define TV(l0, l1, m0, m1)	{ GTPIE_FMT_TV, { l0, l1 }, { m0, m1 } }
+#define TLV(m0, m1)		{ GTPIE_FMT_TLV, { 0, 0 }, { m0, m1 } }
+
+#define CRQ (1 << GTPIE_MSG_CREATE_REQ)
+#define URQ (1 << GTPIE_MSG_UPDATE_REQ)
+#define DRQ (1 << GTPIE_MSG_DELETE_REQ)
+
+static const struct gtpie_desc {
+	uint8_t fmt;		/* GTPIE_FMT_* */
+	uint8_t len[2];		/* Value length of TV elements */
+	uint8_t man[2];		/* Messages where mandatory */
+} gtpie_desc[GTPIE_SIZE] = {
+	[GTPIE_CAUSE] = TV(1, 1, 0, 0),
+	[GTPIE_IMSI] = TV(8, 8, 0, 0),
+	[GTPIE_RAI] = TV(6, 6, 0, 0),
+	[GTPIE_TLLI] = TV(4, 4, 0, 0),
+	[GTPIE_P_TMSI] = TV(4, 4, 0, 0),
+	[GTPIE_QOS_PROFILE0] = TV(3, 3, CRQ | URQ, 0),
+	[GTPIE_REORDER] = TV(1, 1, 0, 0),
+	[GTPIE_AUTH_TRIPLET] = TV(28, 28, 0, 0),
+	[GTPIE_MAP_CAUSE] = TV(1, 1, 0, 0),
+	[GTPIE_P_TMSI_S] = TV(3, 3, 0, 0),
+	[GTPIE_MS_VALIDATED] = TV(1, 1, 0, 0),
+	[GTPIE_RECOVERY] = TV(1, 1, 0, 0),
+	[GTPIE_SELECTION_MODE] = TV(1, 1, CRQ, 0),
+	[GTPIE_FL_DI] = TV(2, 4, CRQ | URQ, CRQ | URQ),	/* GTPIE_TEI_DI */
+	[GTPIE_FL_C] = TV(2, 4, CRQ | URQ, 0),	/* GTPIE_TEI_C */
+	[GTPIE_TEI_DII] = TV(5, 5, 0, 0),
+	[GTPIE_TEARDOWN] = TV(1, 1, 0, 0),
+	[GTPIE_NSAPI] = TV(1, 1, 0, CRQ | URQ | DRQ),
+	[GTPIE_RANAP_CAUSE] = TV(1, 1, 0, 0),
+	[GTPIE_RAB_CONTEXT] = TV(7, 7, 0, 0),
+	[GTPIE_RP_SMS] = TV(1, 1, 0, 0),
+	[GTPIE_RP] = TV(1, 1, 0, 0),
+	[GTPIE_PFI] = TV(2, 2, 0, 0),
+	[GTPIE_CHARGING_C] = TV(2, 2, 0, 0),
+	[GTPIE_TRACE_REF] = TV(2, 2, 0, 0),
+	[GTPIE_TRACE_TYPE] = TV(2, 2, 0, 0),
+	[GTPIE_MS_NOT_REACH] = TV(1, 1, 0, 0),
+	[GTPIE_CHARGING_ID] = TV(4, 4, 0, 0),
+	[GTPIE_EUA] = TLV(CRQ, 0),
+	[GTPIE_MM_CONTEXT] = TLV(0, 0),
+	[GTPIE_PDP_CONTEXT] = TLV(0, 0),
+	[GTPIE_APN] = TLV(CRQ, 0),
+	[GTPIE_PCO] = TLV(0, 0),
+	[GTPIE_GSN_ADDR] = TLV(CRQ | URQ, CRQ | URQ),
+	[GTPIE_MSISDN] = TLV(CRQ, 0),
+	[GTPIE_QOS_PROFILE] = TLV(0, CRQ | URQ),
+	[GTPIE_AUTH_QUINTUP] = TLV(0, 0),
+	[GTPIE_TFT] = TLV(0, 0),
+	[GTPIE_TARGET_INF] = TLV(0, 0),
+	[GTPIE_UTRAN_TRANS] = TLV(0, 0),
+	[GTPIE_RAB_SETUP] = TLV(0, 0),
+	[GTPIE_EXT_HEADER_T] = { GTPIE_FMT_EXT, { 0, 0 }, { 0, 0 } },
+	[GTPIE_TRIGGER_ID] = TLV(0, 0),
+	[GTPIE_OMC_ID] = TLV(0, 0),
+	[GTPIE_RAT_TYPE] = TLV(0, 0),
+	[GTPIE_USER_LOC] = TLV(0, 0),
+	[GTPIE_MS_TZ] = TLV(0, 0),
+	[GTPIE_IMEI_SV] = TLV(0, 0),
+	[GTPIE_CHARGING_ADDR] = TLV(0, 0),
+	[GTPIE_PRIVATE] = TLV(0, 0),
+};
+
+#undef TV
+#undef TLV
+#undef CRQ
+#undef URQ
+#undef DRQ
+
+/* Bitmaps of mandatory types per version and message, built on first use */
+static uint32_t gtpie_man[2][GTPIE_MSG_MAX][GTPIE_SIZE / 32];
+static int gtpie_man_init = 0;
+
+/* Returns the size of the element at p, or 0 if unknown or if it does
+ * not fit within avail bytes */
+static unsigned int gtpie_size(int version, uint8_t * p, unsigned int avail)
+{
+	const struct gtpie_desc *d = &gtpie_desc[*p];
+	unsigned int n;
+
+	switch (d->fmt) {
+	case GTPIE_FMT_TV:
+		n = 1 + d->len[version != 0];
+		break;
+	case GTPIE_FMT_TLV:
+		if (avail < 3)
+			return 0;
+		n = 3 + ((p[1] << 8) | p[2]);
+		break;
+	case GTPIE_FMT_EXT:
+		if (avail < 2)
+			return 0;
+		n = 2 + p[1];
+		break;
+	default:
+		return 0;
+	}
+	return (n <= avail) ? n : 0;
+}
+
+int gtpie_decaps(struct gtpie_tab *ie, int version, void *pack,
 		 unsigned len)
 {
-	int i;
 	int j = 0;
 	unsigned char *p;
 	unsigned char *end;
+	unsigned int n;
 
 	end = (unsigned char *)pack + len;
 	p = pack;
 
-	memset(ie, 0, sizeof(union gtpie_member *) * GTPIE_SIZE);
+	/* Only the bitmap needs clearing. The rest is valid where set */
+	memset(ie->present, 0, sizeof(ie->present));
 
 	while ((p < end) && (j < GTPIE_SIZE)) {
-		if (GTPIE_DEBUG) {
-			printf("The packet looks like this:\n");
-			for (i = 0; i < (end - p); i++) {
-				printf("%02x ",
-				       (unsigned char)*(char *)(p + i));
-				if (!((i + 1) % 16))
-					printf("\n");
-			};
-			printf("\n");
-		}
-
-		switch (*p) {
-		case GTPIE_CAUSE:	/* TV GTPIE types with value length 1 */
-		case GTPIE_REORDER:
-		case GTPIE_MAP_CAUSE:
-		case GTPIE_MS_VALIDATED:
-		case GTPIE_RECOVERY:
-		case GTPIE_SELECTION_MODE:
-		case GTPIE_TEARDOWN:
-		case GTPIE_NSAPI:
-		case GTPIE_RANAP_CAUSE:
-		case GTPIE_RP_SMS:
-		case GTPIE_RP:
-		case GTPIE_MS_NOT_REACH:
-			if (j < GTPIE_SIZE) {
-				ie[j] = (union gtpie_member *)p;
-				if (GTPIE_DEBUG)
-					printf
-					    ("GTPIE TV1 found. Type %d, value %d\n",
-					     ie[j]->tv1.t, ie[j]->tv1.v);
-				p += 1 + 1;
-				j++;
-			}
-			break;
-		case GTPIE_FL_DI:	/* TV GTPIE types with value length 2 or 4 */
-		case GTPIE_FL_C:
-			if (version != 0) {
-				if (j < GTPIE_SIZE) {	/* GTPIE_TEI_DI & GTPIE_TEI_C with length 4 */
-					/* case GTPIE_TEI_DI: gtp1 */
-					/* case GTPIE_TEI_C:  gtp1 */
-					ie[j] = (union gtpie_member *)p;
-					if (GTPIE_DEBUG)
-						printf
-						    ("GTPIE TV 4 found. Type %d, value %d\n",
-						     ie[j]->tv4.t,
-						     ie[j]->tv4.v);
-					p += 1 + 4;
-					j++;
-				}
-				break;
-			}
-		case GTPIE_PFI:	/* TV GTPIE types with value length 2 */
-		case GTPIE_CHARGING_C:
-		case GTPIE_TRACE_REF:
-		case GTPIE_TRACE_TYPE:
-			if (j < GTPIE_SIZE) {
-				ie[j] = (union gtpie_member *)p;
-				if (GTPIE_DEBUG)
-					printf
-					    ("GTPIE TV2 found. Type %d, value %d\n",
-					     ie[j]->tv2.t, ie[j]->tv2.v);
-				p += 1 + 2;
-				j++;
-			}
-			break;
-		case GTPIE_QOS_PROFILE0:	/* TV GTPIE types with value length 3 */
-		case GTPIE_P_TMSI_S:
-			if (j < GTPIE_SIZE) {
-				ie[j] = (union gtpie_member *)p;
-				if (GTPIE_DEBUG)
-					printf
-					    ("GTPIE TV 3 found. Type %d, value %d, %d, %d\n",
-					     ie[j]->tv0.t, ie[j]->tv0.v[0],
-					     ie[j]->tv0.v[1], ie[j]->tv0.v[2]);
-				p += 1 + 3;
-				j++;
-			}
-			break;
-		case GTPIE_TLLI:	/* TV GTPIE types with value length 4 */
-		case GTPIE_P_TMSI:
-		case GTPIE_CHARGING_ID:
-			/* case GTPIE_TEI_DI: Handled by GTPIE_FL_DI */
-			/* case GTPIE_TEI_C:  Handled by GTPIE_FL_DI */
-			if (j < GTPIE_SIZE) {
-				ie[j] = (union gtpie_member *)p;
-				if (GTPIE_DEBUG)
-					printf
-					    ("GTPIE TV 4 found. Type %d, value %d\n",
-					     ie[j]->tv4.t, ie[j]->tv4.v);
-				p += 1 + 4;
-				j++;
-			}
-			break;
-		case GTPIE_TEI_DII:	/* TV GTPIE types with value length 5 */
-			if (j < GTPIE_SIZE) {
-				ie[j] = (union gtpie_member *)p;
-				if (GTPIE_DEBUG)
-					printf("GTPIE TV 5 found. Type %d\n",
-					       ie[j]->tv0.t);
-				p += 1 + 5;
-				j++;
-			}
-			break;
-		case GTPIE_RAB_CONTEXT:	/* TV GTPIE types with value length 7 */
-			if (j < GTPIE_SIZE) {
-				ie[j] = (union gtpie_member *)p;
-				if (GTPIE_DEBUG)
-					printf("GTPIE TV 7 found. Type %d\n",
-					       ie[j]->tv0.t);
-				p += 1 + 7;
-				j++;
-			}
-			break;
-		case GTPIE_IMSI:	/* TV GTPIE types with value length 8 */
-			if (j < GTPIE_SIZE) {
-				ie[j] = (union gtpie_member *)p;
-				if (GTPIE_DEBUG)
-					printf
-					    ("GTPIE_IMSI - GTPIE TV 8 found. Type %d, value 0x%llx\n",
-					     ie[j]->tv0.t, ie[j]->tv8.v);
-				p += 1 + 8;
-				j++;
-			}
-			break;
-		case GTPIE_RAI:	/* TV GTPIE types with value length 6 */
-			if (j < GTPIE_SIZE) {
-				ie[j] = (union gtpie_member *)p;
-				if (GTPIE_DEBUG)
-					printf
-					    ("GTPIE_RAI - GTPIE TV 6 found. Type %d, value 0x%llx\n",
-					     ie[j]->tv0.t, ie[j]->tv8.v);
-				p += 1 + 6;
-				j++;
-			}
-			break;
-		case GTPIE_AUTH_TRIPLET:	/* TV GTPIE types with value length 28 */
-			if (j < GTPIE_SIZE) {
-				ie[j] = (union gtpie_member *)p;
-				if (GTPIE_DEBUG)
-					printf("GTPIE TV 28 found. Type %d\n",
-					       ie[j]->tv0.t);
-				p += 1 + 28;
-				j++;
-			}
-			break;
-		case GTPIE_EXT_HEADER_T:	/* GTP extension header */
-			if (j < GTPIE_SIZE) {
-				ie[j] = (union gtpie_member *)p;
-				if (GTPIE_DEBUG)
-					printf
-					    ("GTPIE GTP extension header found. Type %d\n",
-					     ie[j]->ext.t);
-				p += 2 + ntoh8(ie[j]->ext.l);
-				j++;
-			}
-			break;
-		case GTPIE_EUA:	/* TLV GTPIE types with variable length */
-		case GTPIE_MM_CONTEXT:
-		case GTPIE_PDP_CONTEXT:
-		case GTPIE_APN:
-		case GTPIE_PCO:
-		case GTPIE_GSN_ADDR:
-		case GTPIE_MSISDN:
-		case GTPIE_QOS_PROFILE:
-		case GTPIE_AUTH_QUINTUP:
-		case GTPIE_TFT:
-		case GTPIE_TARGET_INF:
-		case GTPIE_UTRAN_TRANS:
-		case GTPIE_RAB_SETUP:
-		case GTPIE_TRIGGER_ID:
-		case GTPIE_OMC_ID:
-		case GTPIE_CHARGING_ADDR:
-		case GTPIE_RAT_TYPE:
-		case GTPIE_USER_LOC:
-		case GTPIE_MS_TZ:
-		case GTPIE_IMEI_SV:
-		case GTPIE_PRIVATE:
-			if (j < GTPIE_SIZE) {
-				ie[j] = (union gtpie_member *)p;
-				if (GTPIE_DEBUG)
-					printf("GTPIE TLV found. Type %d\n",
-					       ie[j]->tlv.t);
-				p += 3 + ntoh16(ie[j]->tlv.l);
-				j++;
-			}
-			break;
-		default:
+		if (!(n = gtpie_size(version, p, end - p))) {
 			if (GTPIE_DEBUG)
-				printf("GTPIE something unknown. Type %d\n",
+				printf("GTPIE unknown or truncated. Type %d\n",
 				       *p);
-			return EOF;	/* We received something unknown */
+			ie->n = j;
+			return EOF;	/* Unknown or exceeds end of packet */
 		}
+		if (GTPIE_DEBUG)
+			printf("GTPIE found. Type %d, length %d\n", *p, n);
+		ie->ie[j] = (union gtpie_member *)p;
+		gtpie_index(ie, j++);
+		p += n;
 	}
+	ie->n = j;
 	if (p == end) {
 		if (GTPIE_DEBUG)
 			printf("GTPIE normal return. %lx %lx\n",
 			       (unsigned long)p, (unsigned long)end);
 		return 0;	/* We landed at the end of the packet: OK */
-	} else if (!(j < GTPIE_SIZE)) {
+	} else {
 		if (GTPIE_DEBUG)
 			printf("GTPIE too many elements.\n");
 		return EOF;	/* We received too many information elements */
-	} else {
-		if (GTPIE_DEBUG)
-			printf("GTPIE exceeded end of packet. %lx %lx\n",
-			       (unsigned long)p, (unsigned long)end);
-		return EOF;	/* We exceeded the end of the packet: Error */
 	}
 }
 
+int gtpie_check(struct gtpie_tab *ie, int version, int msg)
+{
+	uint32_t *man;
+	int t, v, m;
+
+	if ((msg < 0) || (msg >= GTPIE_MSG_MAX))
+		return 0;
+
+	if (!gtpie_man_init) {
+		for (t = 0; t < GTPIE_SIZE; t++)
+			for (v = 0; v < 2; v++)
+				for (m = 0; m < GTPIE_MSG_MAX; m++)
+					if (gtpie_desc[t].man[v] & (1 << m))
+						gtpie_man[v][m][t / 32] |=
+						    (1u << (t % 32));
+		gtpie_man_init = 1;
+	}
+
+	man = gtpie_man[version != 0][msg];
+	for (v = 0; v < GTPIE_SIZE / 32; v++) {
+		uint32_t missing = man[v] & ~ie->present[v];
+		if (missing)
+			return v * 32 + ffs(missing) - 1;
+	}
+	return 0;
+}
+
 int gtpie_encaps(union gtpie_member *ie[], void *pack, unsigned *len)
 {
 	int i;
 	unsigned char *p;
 	unsigned char *end;
-	union gtpie_member *m;
-	int iesize;
+	unsigned int iesize;
 
 	p = pack;
-
-	memset(pack, 0, GTPIE_MAX);
 	end = p + GTPIE_MAX;
 	for (i = 1; i < GTPIE_SIZE; i++)
 		if (ie[i] != 0) {
 			if (GTPIE_DEBUG)
 				printf("gtpie_encaps. Type %d\n", i);
-			m = (union gtpie_member *)p;
-			switch (i) {
-			case GTPIE_CAUSE:	/* TV GTPIE types with value length 1 */
-			case GTPIE_REORDER:
-			case GTPIE_MAP_CAUSE:
-			case GTPIE_MS_VALIDATED:
-			case GTPIE_RECOVERY:
-			case GTPIE_SELECTION_MODE:
-			case GTPIE_TEARDOWN:
-			case GTPIE_NSAPI:
-			case GTPIE_RANAP_CAUSE:
-			case GTPIE_RP_SMS:
-			case GTPIE_RP:
-			case GTPIE_MS_NOT_REACH:
-				iesize = 2;
-				break;
-			case GTPIE_FL_DI:	/* TV GTPIE types with value length 2 */
-			case GTPIE_FL_C:
-			case GTPIE_PFI:
-			case GTPIE_CHARGING_C:
-			case GTPIE_TRACE_REF:
-			case GTPIE_TRACE_TYPE:
-				iesize = 3;
-				break;
-			case GTPIE_QOS_PROFILE0:	/* TV GTPIE types with value length 3 */
-			case GTPIE_P_TMSI_S:
-				iesize = 4;
-				break;
-			case GTPIE_TLLI:	/* TV GTPIE types with value length 4 */
-			case GTPIE_P_TMSI:
-				/* case GTPIE_TEI_DI: only in gtp1 */
-				/* case GTPIE_TEI_C: only in gtp1 */
-			case GTPIE_CHARGING_ID:
-				iesize = 5;
-				break;
-			case GTPIE_TEI_DII:	/* TV GTPIE types with value length 5 */
-				iesize = 6;
-				break;
-			case GTPIE_RAB_CONTEXT:	/* TV GTPIE types with value length 7 */
-				iesize = 8;
-				break;
-			case GTPIE_IMSI:	/* TV GTPIE types with value length 8 */
-			case GTPIE_RAI:
-				iesize = 9;
-				break;
-			case GTPIE_AUTH_TRIPLET:	/* TV GTPIE types with value length 28 */
-				iesize = 29;
-				break;
-			case GTPIE_EXT_HEADER_T:	/* GTP extension header */
-				iesize = 2 + hton8(ie[i]->ext.l);
-				break;
-			case GTPIE_EUA:	/* TLV GTPIE types with length length 2 */
-			case GTPIE_MM_CONTEXT:
-			case GTPIE_PDP_CONTEXT:
-			case GTPIE_APN:
-			case GTPIE_PCO:
-			case GTPIE_GSN_ADDR:
-			case GTPIE_MSISDN:
-			case GTPIE_QOS_PROFILE:
-			case GTPIE_AUTH_QUINTUP:
-			case GTPIE_TFT:
-			case GTPIE_TARGET_INF:
-			case GTPIE_UTRAN_TRANS:
-			case GTPIE_RAB_SETUP:
-			case GTPIE_TRIGGER_ID:
-			case GTPIE_OMC_ID:
-			case GTPIE_CHARGING_ADDR:
-			case GTPIE_PRIVATE:
-				iesize = 3 + hton16(ie[i]->tlv.l);
-				break;
-			default:
+			if (!(iesize = gtpie_size(0, (uint8_t *) ie[i],
+						  GTPIE_MAX)))
 				return 2;	/* We received something unknown */
-			}
 			if (p + iesize < end) {
 				memcpy(p, ie[i], iesize);
 				p += iesize;
@@ -534,12 +527,9 @@ int gtpie_encaps2(union gtpie_member ie[], unsigned int size,
 	unsigned int i, j;
 	unsigned char *p;
 	unsigned char *end;
-	union gtpie_member *m;
-	int iesize;
+	unsigned int iesize;
 
 	p = pack;
-
-	memset(pack, 0, GTPIE_MAX);
 	end = p + GTPIE_MAX;
 	for (j = 0; j < GTPIE_SIZE; j++)
 		for (i = 0; i < size; i++)
@@ -548,77 +538,9 @@ int gtpie_encaps2(union gtpie_member ie[], unsigned int size,
 					printf
 					    ("gtpie_encaps. Number %d, Type %d\n",
 					     i, ie[i].t);
-				m = (union gtpie_member *)p;
-				switch (ie[i].t) {
-				case GTPIE_CAUSE:	/* TV GTPIE types with value length 1 */
-				case GTPIE_REORDER:
-				case GTPIE_MAP_CAUSE:
-				case GTPIE_MS_VALIDATED:
-				case GTPIE_RECOVERY:
-				case GTPIE_SELECTION_MODE:
-				case GTPIE_TEARDOWN:
-				case GTPIE_NSAPI:
-				case GTPIE_RANAP_CAUSE:
-				case GTPIE_RP_SMS:
-				case GTPIE_RP:
-				case GTPIE_MS_NOT_REACH:
-					iesize = 2;
-					break;
-				case GTPIE_PFI:	/* TV GTPIE types with value length 2 */
-				case GTPIE_CHARGING_C:
-				case GTPIE_TRACE_REF:
-				case GTPIE_TRACE_TYPE:
-					iesize = 3;
-					break;
-				case GTPIE_QOS_PROFILE0:	/* TV GTPIE types with value length 3 */
-				case GTPIE_P_TMSI_S:
-					iesize = 4;
-					break;
-				case GTPIE_TLLI:	/* TV GTPIE types with value length 4 */
-				case GTPIE_P_TMSI:
-				case GTPIE_TEI_DI:
-				case GTPIE_TEI_C:
-					iesize = 5;
-					break;
-				case GTPIE_TEI_DII:	/* TV GTPIE types with value length 5 */
-					iesize = 6;
-					break;
-				case GTPIE_RAB_CONTEXT:	/* TV GTPIE types with value length 7 */
-					iesize = 8;
-					break;
-				case GTPIE_IMSI:	/* TV GTPIE types with value length 8 */
-				case GTPIE_RAI:
-					iesize = 9;
-					break;
-				case GTPIE_AUTH_TRIPLET:	/* TV GTPIE types with value length 28 */
-					iesize = 29;
-					break;
-				case GTPIE_EXT_HEADER_T:	/* GTP extension header */
-					iesize = 2 + hton8(ie[i].ext.l);
-					break;
-				case GTPIE_CHARGING_ID:	/* TLV GTPIE types with length length 2 */
-				case GTPIE_EUA:
-				case GTPIE_MM_CONTEXT:
-				case GTPIE_PDP_CONTEXT:
-				case GTPIE_APN:
-				case GTPIE_PCO:
-				case GTPIE_GSN_ADDR:
-				case GTPIE_MSISDN:
-				case GTPIE_QOS_PROFILE:
-				case GTPIE_AUTH_QUINTUP:
-				case GTPIE_TFT:
-				case GTPIE_TARGET_INF:
-				case GTPIE_UTRAN_TRANS:
-				case GTPIE_RAB_SETUP:
-				case GTPIE_TRIGGER_ID:
-				case GTPIE_OMC_ID:
-				case GTPIE_CHARGING_ADDR:
-				case GTPIE_PRIVATE:
-					iesize = 3 + hton16(ie[i].tlv.l);
-					break;
-				default:
+				if (!(iesize = gtpie_size(1, (uint8_t *) & ie[i],
+							  GTPIE_MAX)))
 					return 2;	/* We received something unknown */
-				}
 				if (p + iesize < end) {
 					memcpy(p, &ie[i], iesize);
 					p += iesize;
@@ -209,6 +209,42 @@ charging_addr
 private
 */
 
+/* Messages with mandatory information elements, see gtpie_check() */
+#define GTPIE_MSG_CREATE_REQ 0	/* Create PDP Context Request */
+#define GTPIE_MSG_UPDATE_REQ 1	/* Update PDP Context Request */
+#define GTPIE_MSG_DELETE_REQ 2	/* Delete PDP Context Request */
+#define GTPIE_MSG_MAX        3
+
+/* Decoded information elements.
+ * ie[] holds the elements in the order they appeared in the message.
+ * For each type present first[] is the index of its first instance in
+ * ie[], and next[] chains further instances of the same type, so that
+ * a lookup by type and instance does not have to scan the message.
+ * Only the present bitmap is cleared by gtpie_decaps(); first[], last[],
+ * count[] and next[] are valid only for types with their bit set. */
+struct gtpie_tab {
+	uint32_t present[GTPIE_SIZE / 32];	/* Bitmap of types present */
+	uint8_t first[GTPIE_SIZE];	/* Index of first instance of type */
+	uint8_t last[GTPIE_SIZE];	/* Index of last instance of type */
+	uint8_t next[GTPIE_SIZE];	/* Index of next instance of same type */
+	uint16_t count[GTPIE_SIZE];	/* Number of instances of type */
+	unsigned int n;		/* Number of elements in ie[] */
+	union gtpie_member *ie[GTPIE_SIZE];	/* Elements in message order */
+};
+
+/* Information element builder.
+ * Appends elements to a caller supplied buffer in a single pass. Elements
+ * must be appended in ascending type order. The first element that does
+ * not fit or is out of order sets err, and all later appends are ignored,
+ * so that callers only need to check the result of gtpie_bld_end(). */
+struct gtpie_bld {
+	uint8_t *p;		/* Start of buffer */
+	unsigned int len;	/* Bytes used so far, including header */
+	unsigned int size;	/* Size of buffer */
+	uint8_t last;		/* Type of last element appended */
+	int err;		/* Set when an element could not be appended */
+};
+
 struct tlv1 {
 	uint8_t type;
 	uint8_t length;
@@ -231,23 +267,34 @@ extern int gtpie_tv4(void *p, unsigned int *length, unsigned int size,
 		     uint8_t t, uint32_t v);
 extern int gtpie_tv8(void *p, unsigned int *length, unsigned int size,
 		     uint8_t t, uint64_t v);
-extern int gtpie_getie(union gtpie_member *ie[], int type, int instance);
-extern int gtpie_exist(union gtpie_member *ie[], int type, int instance);
-extern int gtpie_gettlv(union gtpie_member *ie[], int type, int instance,
+
+extern void gtpie_bld_init(struct gtpie_bld *b, void *p, unsigned int len,
+			   unsigned int size);
+extern void gtpie_bld_tlv(struct gtpie_bld *b, uint8_t t, int l, void *v);
+extern void gtpie_bld_tv0(struct gtpie_bld *b, uint8_t t, int l, uint8_t * v);
+extern void gtpie_bld_tv1(struct gtpie_bld *b, uint8_t t, uint8_t v);
+extern void gtpie_bld_tv2(struct gtpie_bld *b, uint8_t t, uint16_t v);
+extern void gtpie_bld_tv4(struct gtpie_bld *b, uint8_t t, uint32_t v);
+extern int gtpie_bld_end(struct gtpie_bld *b, unsigned int *length);
+
+extern int gtpie_getie(struct gtpie_tab *ie, int type, int instance);
+extern int gtpie_exist(struct gtpie_tab *ie, int type, int instance);
+extern int gtpie_gettlv(struct gtpie_tab *ie, int type, int instance,
 			unsigned int *length, void *dst, unsigned int size);
-extern int gtpie_gettv0(union gtpie_member *ie[], int type, int instance,
+extern int gtpie_gettv0(struct gtpie_tab *ie, int type, int instance,
 			void *dst, unsigned int size);
-extern int gtpie_gettv1(union gtpie_member *ie[], int type, int instance,
+extern int gtpie_gettv1(struct gtpie_tab *ie, int type, int instance,
 			uint8_t * dst);
-extern int gtpie_gettv2(union gtpie_member *ie[], int type, int instance,
+extern int gtpie_gettv2(struct gtpie_tab *ie, int type, int instance,
 			uint16_t * dst);
-extern int gtpie_gettv4(union gtpie_member *ie[], int type, int instance,
+extern int gtpie_gettv4(struct gtpie_tab *ie, int type, int instance,
 			uint32_t * dst);
-extern int gtpie_gettv8(union gtpie_member *ie[], int type, int instance,
+extern int gtpie_gettv8(struct gtpie_tab *ie, int type, int instance,
 			uint64_t * dst);
 
-extern int gtpie_decaps(union gtpie_member *ie[], int version,
+extern int gtpie_decaps(struct gtpie_tab *ie, int version,
 			void *pack, unsigned len);
+extern int gtpie_check(struct gtpie_tab *ie, int version, int msg);
 extern int gtpie_encaps(union gtpie_member *ie[], void *pack, unsigned *len);
 extern int gtpie_encaps2(union gtpie_member ie[], unsigned int size,
 			 void *pack, unsigned *len);
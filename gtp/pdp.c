@@ -32,6 +32,7 @@
  *************************************************************/
 
 struct pdp_t pdpa[PDP_MAX];	/* PDP storage */
+int pdp_used = 0;		/* Number of contexts in pdpa in use */
 struct pdp_t *hashtid[PDP_MAX];	/* Hash table for IMSI + NSAPI */
 /* struct pdp_t* haship[PDP_MAX];  Hash table for IP and network interface */
 
@@ -110,6 +111,7 @@ struct pdp_t *hashtid[PDP_MAX];	/* Hash table for IMSI + NSAPI */
 int pdp_init()
 {
 	memset(&pdpa, 0, sizeof(pdpa));
+	pdp_used = 0;
 	memset(&hashtid, 0, sizeof(hashtid));
 	/*  memset(&haship, 0, sizeof(haship)); */
 
@@ -128,6 +130,8 @@ int pdp_newpdp(struct pdp_t **pdp, uint64_t imsi, uint8_t nsapi,
 			else
 				memset(*pdp, 0, sizeof(struct pdp_t));
 			(*pdp)->inuse = 1;
+			(*pdp)->ready = 0;
+			pdp_used++;
 			(*pdp)->imsi = imsi;
 			(*pdp)->nsapi = nsapi;
 			(*pdp)->fllc = (uint16_t) n + 1;
@@ -151,6 +155,27 @@ int pdp_newpdp(struct pdp_t **pdp, uint64_t imsi, uint8_t nsapi,
 	return EOF;		/* No more available */
 }
 
+/* Take the context of a given TEID. For user plane processes, which
+   are given the TEIDs allocated by their control plane */
+int pdp_newpdp_tei(struct pdp_t **pdp, uint32_t tei, uint64_t imsi,
+		   uint8_t nsapi)
+{
+	if ((tei > PDP_MAX) || (tei < 1) || pdpa[tei - 1].inuse)
+		return EOF;
+	*pdp = &pdpa[tei - 1];
+	memset(*pdp, 0, sizeof(struct pdp_t));
+	(*pdp)->inuse = 1;
+	pdp_used++;
+	(*pdp)->imsi = imsi;
+	(*pdp)->nsapi = nsapi;
+	(*pdp)->fllc = (uint16_t) tei;
+	(*pdp)->fllu = (uint16_t) tei;
+	(*pdp)->teid_own = tei;
+	(*pdp)->teic_own = tei;
+	pdp_tidset(*pdp, pdp_gettid(imsi, nsapi));
+	return 0;
+}
+
 int pdp_freepdp(struct pdp_t *pdp)
 {
 	pdp_tiddel(pdp);
@@ -161,10 +186,18 @@ int pdp_freepdp(struct pdp_t *pdp)
 		pdpa[pdp->teic_own - 1].secondary_tei[pdp->nsapi & 0x0f] = 0;
 	}
 
+	if (pdp->inuse)
+		pdp_used--;
 	memset(pdp, 0, sizeof(struct pdp_t));
 	return 0;
 }
 
+/* Number of contexts allocated with pdp_newpdp() and not yet freed */
+int pdp_inuse()
+{
+	return pdp_used;
+}
+
 int pdp_getpdp(struct pdp_t **pdp)
 {
 	*pdp = &pdpa[0];
@@ -199,6 +232,14 @@ int pdp_getgtp1(struct pdp_t **pdp, uint32_t tei)
 	}
 }
 
+/* Start loading the context of tei into the cache, ahead of
+ * pdp_getgtp1() */
+void pdp_prefetchgtp1(uint32_t tei)
+{
+	if ((tei <= PDP_MAX) && (tei >= 1))
+		__builtin_prefetch(&pdpa[tei - 1]);
+}
+
 int pdp_tidhash(uint64_t tid)
 {
 	return (lookup(&tid, sizeof(tid), 0) % PDP_MAX);
@@ -365,6 +406,32 @@ int pdp_euaton(struct ul66_t *eua, struct in_addr *dst)
 	return 0;
 }
 
+int pdp_ntoeua6(struct in6_addr *src, struct ul66_t *eua)
+{
+	eua->l = 18;
+	eua->v[0] = 0xf1;	/* IETF */
+	eua->v[1] = 0x57;	/* IPv6 */
+	memcpy(&eua->v[2], src, 16);	/* Copy a 16 byte address */
+	return 0;
+}
+
+int pdp_euaton6(struct ul66_t *eua, struct in6_addr *dst)
+{
+	if ((eua->l != 18) || (eua->v[0] != 0xf1) || (eua->v[1] != 0x57)) {
+		return EOF;
+	}
+	memcpy(dst, &eua->v[2], 16);	/* Copy a 16 byte address */
+	return 0;
+}
+
+/* True if the end user address asks for an IPv6 PDP type. The
+   address itself may be left out to ask for a dynamic address */
+int pdp_euaisv6(struct ul66_t *eua)
+{
+	return (eua->l >= 2) && ((eua->v[0] & 0x0f) == 0x01) &&
+	    (eua->v[1] == 0x57);
+}
+
 uint64_t pdp_gettid(uint64_t imsi, uint8_t nsapi)
 {
 	return (imsi & 0x0fffffffffffffffull) + ((uint64_t) nsapi << 60);
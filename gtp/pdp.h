@@ -223,17 +223,30 @@ struct pdp_t {
 
 	/* to be used by libgtp callers/users (to attach their own private state) */
 	void *priv;
+
+	/* G-PDU header and user plane address of the peer, built when the
+	   context is set up or updated. Data plane threads copy them under
+	   the gpdu_seq sequence lock, which is odd while they are written */
+	uint8_t gpdu_hdr[24];	/* Room for struct gtp0_header */
+	unsigned int gpdu_hlen;	/* Header length */
+	struct sockaddr_in gpdu_peer;	/* Destination of G-PDUs */
+	unsigned int gpdu_seq;	/* Sequence lock of the above */
+	uint8_t ready;		/* Accepted, may be used by the data plane */
 };
 
 /* functions related to pdp_t management */
 int pdp_init();
 int pdp_newpdp(struct pdp_t **pdp, uint64_t imsi, uint8_t nsapi,
 	       struct pdp_t *pdp_old);
+int pdp_newpdp_tei(struct pdp_t **pdp, uint32_t tei, uint64_t imsi,
+		   uint8_t nsapi);
 int pdp_freepdp(struct pdp_t *pdp);
+int pdp_inuse();
 int pdp_getpdp(struct pdp_t **pdp);
 
 int pdp_getgtp0(struct pdp_t **pdp, uint16_t fl);
 int pdp_getgtp1(struct pdp_t **pdp, uint32_t tei);
+void pdp_prefetchgtp1(uint32_t tei);
 
 int pdp_getimsi(struct pdp_t **pdp, uint64_t imsi, uint8_t nsapi);
 
@@ -251,6 +264,9 @@ int pdp_ipget(struct pdp_t **pdp, void* ipif, struct ul66_t *eua);
 
 int pdp_ntoeua(struct in_addr *src, struct ul66_t *eua);
 int pdp_euaton(struct ul66_t *eua, struct in_addr *dst);
+int pdp_ntoeua6(struct in6_addr *src, struct ul66_t *eua);
+int pdp_euaton6(struct ul66_t *eua, struct in6_addr *dst);
+int pdp_euaisv6(struct ul66_t *eua);
 uint64_t pdp_gettid(uint64_t imsi, uint8_t nsapi);
 int ulcpy(void *dst, void *src, size_t size);
 
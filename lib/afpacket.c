@@ -0,0 +1,418 @@
+/*
+ * SGi interface on AF_PACKET rings.
+ *
+ * The contents of this file may be used under the terms of the GNU
+ * General Public License Version 2, provided that the above copyright
+ * notice and this permission notice is included in all copies or
+ * substantial portions of the software.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <syslog.h>
+#include <time.h>
+
+#if defined(__linux__) && HAVE_DECL_TPACKET_V3
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <linux/filter.h>
+#endif
+
+#include "tun.h"
+#include "syserr.h"
+#include "afpacket.h"
+
+#if defined(__linux__) && HAVE_DECL_TPACKET_V3
+
+#define AFPACKET_RXSIZE (AFPACKET_RXBLOCKS * AFPACKET_BLOCKSIZE)
+#define AFPACKET_TXSIZE (AFPACKET_TXBLOCKS * AFPACKET_BLOCKSIZE)
+#define AFPACKET_TXFRAMES (AFPACKET_TXSIZE / AFPACKET_FRAMESIZE)
+#define AFPACKET_TXDATA TPACKET_ALIGN(sizeof(struct tpacket3_hdr))
+#define AFPACKET_ARPLEN 42	/* Ethernet and ARP for IPv4 */
+
+/* Receive IPv4 and IPv6 packets to our Ethernet address, but not to the
+   own IPv4 address, and ARP replies */
+static int afpacket_filter(int fd, struct in_addr *addr)
+{
+	struct sock_filter code[] = {
+		BPF_STMT(BPF_LD | BPF_B | BPF_ABS, SKF_AD_OFF + SKF_AD_PKTTYPE),
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, PACKET_HOST, 0, 7),
+		BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 12),
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_IP, 2, 0),
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_IPV6, 3, 0),
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETH_P_ARP, 2, 3),
+		BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 30),
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ntohl(addr->s_addr), 1, 0),
+		BPF_STMT(BPF_RET | BPF_K, 0xffffffff),
+		BPF_STMT(BPF_RET | BPF_K, 0),
+	};
+	struct sock_fprog prog;
+
+	prog.len = sizeof(code) / sizeof(code[0]);
+	prog.filter = code;
+	return setsockopt(fd, SOL_SOCKET, SO_ATTACH_FILTER, &prog,
+			  sizeof(prog));
+}
+
+/* Index, Ethernet and IPv4 address of dev, and no forwarding on it */
+static int afpacket_dev(struct afpacket_t *this, char *dev)
+{
+	struct ifreq ifr;
+	char path[64];
+	FILE *f;
+
+	if (!(this->ifindex = if_nametoindex(dev))) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+			"No interface %s", dev);
+		return -1;
+	}
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, dev, IFNAMSIZ);
+	ifr.ifr_name[IFNAMSIZ - 1] = 0;
+	if (ioctl(this->tun->fd, SIOCGIFHWADDR, &ifr)) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+			"Failed to get Ethernet address of %s", dev);
+		return -1;
+	}
+	memcpy(this->mac, ifr.ifr_hwaddr.sa_data, sizeof(this->mac));
+	ifr.ifr_addr.sa_family = AF_INET;
+	if (!ioctl(this->tun->fd, SIOCGIFADDR, &ifr))
+		this->addr = ((struct sockaddr_in *)&ifr.ifr_addr)->sin_addr;
+
+	snprintf(path, sizeof(path), "/proc/sys/net/ipv4/conf/%s/forwarding",
+		 dev);
+	if (!(f = fopen(path, "w")) || (fputs("0\n", f) < 0) | fclose(f)) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+			"Failed to turn off forwarding on %s", dev);
+		return -1;
+	}
+	return 0;
+}
+
+/* Shared rings, filter and binding to the interface */
+static int afpacket_rings(struct afpacket_t *this)
+{
+	struct tpacket_req3 req;
+	struct sockaddr_ll sll;
+	int v = TPACKET_V3;
+	int fd = this->tun->fd;
+
+	if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &v, sizeof(v))) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+			"TPACKET_V3 not supported");
+		return -1;
+	}
+	memset(&req, 0, sizeof(req));
+	req.tp_block_size = AFPACKET_BLOCKSIZE;
+	req.tp_block_nr = AFPACKET_RXBLOCKS;
+	req.tp_frame_size = AFPACKET_FRAMESIZE;
+	req.tp_frame_nr = AFPACKET_RXSIZE / AFPACKET_FRAMESIZE;
+	req.tp_retire_blk_tov = AFPACKET_TIMEOUT;
+	if (setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req))) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+			"Failed to set up receive ring");
+		return -1;
+	}
+	memset(&req, 0, sizeof(req));
+	req.tp_block_size = AFPACKET_BLOCKSIZE;
+	req.tp_block_nr = AFPACKET_TXBLOCKS;
+	req.tp_frame_size = AFPACKET_FRAMESIZE;
+	req.tp_frame_nr = AFPACKET_TXFRAMES;
+	if (setsockopt(fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req))) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+			"Failed to set up transmit ring");
+		return -1;
+	}
+
+	/* Frames go straight to the driver. Not available everywhere */
+	v = 1;
+	setsockopt(fd, SOL_PACKET, PACKET_QDISC_BYPASS, &v, sizeof(v));
+
+	if (afpacket_filter(fd, &this->addr)) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+			"Failed to attach socket filter");
+		return -1;
+	}
+	this->maplen = AFPACKET_RXSIZE + AFPACKET_TXSIZE;
+	this->map = mmap(NULL, this->maplen, PROT_READ | PROT_WRITE,
+			 MAP_SHARED | MAP_POPULATE, fd, 0);
+	if (this->map == MAP_FAILED) {
+		this->map = NULL;
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+			"Failed to map rings");
+		return -1;
+	}
+
+	memset(&sll, 0, sizeof(sll));
+	sll.sll_family = AF_PACKET;
+	sll.sll_protocol = htons(ETH_P_ALL);
+	sll.sll_ifindex = this->ifindex;
+	if (bind(fd, (struct sockaddr *)&sll, sizeof(sll))) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+			"Failed to bind packet socket");
+		return -1;
+	}
+	return 0;
+}
+
+/* The next free transmit frame, with room for len bytes. NULL when the
+   ring is full */
+static uint8_t *afpacket_txframe(struct afpacket_t *this, unsigned len)
+{
+	struct tpacket3_hdr *h = (struct tpacket3_hdr *)
+	    (this->map + AFPACKET_RXSIZE +
+	     this->txframe * AFPACKET_FRAMESIZE);
+
+	if ((len > AFPACKET_FRAMESIZE - AFPACKET_TXDATA) ||
+	    (__atomic_load_n(&h->tp_status, __ATOMIC_ACQUIRE) &
+	     (TP_STATUS_SEND_REQUEST | TP_STATUS_SENDING))) {
+		this->txdrop++;
+		return NULL;
+	}
+	h->tp_len = len;
+	h->tp_next_offset = 0;
+	return (uint8_t *) h + AFPACKET_TXDATA;
+}
+
+/* Hand the frame from afpacket_txframe() to the kernel */
+static void afpacket_txsend(struct afpacket_t *this)
+{
+	struct tpacket3_hdr *h = (struct tpacket3_hdr *)
+	    (this->map + AFPACKET_RXSIZE +
+	     this->txframe * AFPACKET_FRAMESIZE);
+
+	__atomic_store_n(&h->tp_status, TP_STATUS_SEND_REQUEST,
+			 __ATOMIC_RELEASE);
+	this->txframe = (this->txframe + 1) % AFPACKET_TXFRAMES;
+	if (++this->txpending >= AFPACKET_BURST)
+		afpacket_kick(this);
+}
+
+/* Ask for the Ethernet address of the gateway, at most once a second */
+static void afpacket_arp(struct afpacket_t *this)
+{
+	static const uint8_t req[8] = { 0, 1, 8, 0, 6, 4, 0, 1 };
+	time_t now = time(NULL);
+	uint8_t *p;
+
+	if ((now == this->arptime) ||
+	    !(p = afpacket_txframe(this, AFPACKET_ARPLEN)))
+		return;
+	this->arptime = now;
+	memset(p, 0xff, 6);
+	memcpy(p + 6, this->mac, 6);
+	p[12] = 0x08;
+	p[13] = 0x06;
+	memcpy(p + 14, req, sizeof(req));
+	memcpy(p + 22, this->mac, 6);
+	memcpy(p + 28, &this->addr.s_addr, 4);
+	memset(p + 32, 0, 6);
+	memcpy(p + 38, &this->gw.s_addr, 4);
+	afpacket_txsend(this);
+	afpacket_kick(this);
+}
+
+int afpacket_new(struct afpacket_t **this, char *dev, struct in_addr *gw)
+{
+	if (!(*this = calloc(sizeof(struct afpacket_t), 1)) ||
+	    !((*this)->tun = calloc(sizeof(struct tun_t), 1))) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Failed to allocate memory for SGi interface");
+		free(*this);
+		return -1;
+	}
+	strncpy((*this)->tun->devname, dev, IFNAMSIZ);
+	(*this)->tun->devname[IFNAMSIZ - 1] = 0;
+	(*this)->gw = *gw;
+
+	/* Nothing is received before the socket is bound */
+	if (((*this)->tun->fd = socket(AF_PACKET, SOCK_RAW, 0)) < 0) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+			"Failed to create packet socket");
+		goto err;
+	}
+	if (afpacket_dev(*this, dev) || afpacket_rings(*this))
+		goto err;
+	afpacket_arp(*this);
+	return 0;
+
+err:
+	if ((*this)->map)
+		munmap((*this)->map, (*this)->maplen);
+	tun_free((*this)->tun);
+	free(*this);
+	return -1;
+}
+
+int afpacket_free(struct afpacket_t *this)
+{
+	afpacket_kick(this);
+	munmap(this->map, this->maplen);
+	tun_free(this->tun);
+	free(this);
+	return 0;
+}
+
+/* Learn the gateway from an ARP packet */
+static void afpacket_rxarp(struct afpacket_t *this, uint8_t * p,
+			   unsigned len)
+{
+	static const uint8_t ipv4[6] = { 0, 1, 8, 0, 6, 4 };
+
+	if ((len >= AFPACKET_ARPLEN) && !memcmp(p + 14, ipv4, sizeof(ipv4))
+	    && !memcmp(p + 28, &this->gw.s_addr, 4)) {
+		memcpy(this->gwmac, p + 22, 6);
+		this->gwknown = 1;
+	}
+}
+
+/* Hand a received frame to the callback of the tun, without Ethernet
+   header and padding */
+static void afpacket_rx(struct afpacket_t *this, uint8_t * p, unsigned len)
+{
+	unsigned iplen;
+
+	if (len < 14)
+		return;
+	if ((p[12] == 0x08) && (p[13] == 0x06)) {
+		afpacket_rxarp(this, p, len);
+		return;
+	}
+
+	p += 14;
+	len -= 14;
+	if ((len >= 20) && ((p[0] >> 4) == 4))
+		iplen = (p[2] << 8) | p[3];
+	else if ((len >= 40) && ((p[0] >> 4) == 6))
+		iplen = 40 + ((p[4] << 8) | p[5]);
+	else
+		return;
+	if (iplen < len)
+		len = iplen;
+
+	this->rxpackets++;
+	this->rxbytes += len;
+	if (this->tun->cb_ind)
+		this->tun->cb_ind(this->tun, p, len);
+}
+
+int afpacket_decaps(struct afpacket_t *this, int budget)
+{
+	struct tpacket_block_desc *b;
+	struct tpacket3_hdr *h;
+	int n = 0;
+	unsigned i;
+
+	while (1) {
+		b = (struct tpacket_block_desc *)(this->map + this->rxblock *
+						  AFPACKET_BLOCKSIZE);
+		if (!(__atomic_load_n(&b->hdr.bh1.block_status,
+				      __ATOMIC_ACQUIRE) & TP_STATUS_USER))
+			return 0;
+		if (budget && (n >= budget))
+			return 1;	/* Budget used up. Rest stays queued */
+
+		h = (struct tpacket3_hdr *)((uint8_t *) b +
+					    b->hdr.bh1.offset_to_first_pkt);
+		for (i = 0; i < b->hdr.bh1.num_pkts; i++) {
+			afpacket_rx(this, (uint8_t *) h + h->tp_mac,
+				    h->tp_snaplen);
+			h = (struct tpacket3_hdr *)((uint8_t *) h +
+						    h->tp_next_offset);
+		}
+		n += b->hdr.bh1.num_pkts;
+		this->rxblocks++;
+		__atomic_store_n(&b->hdr.bh1.block_status, TP_STATUS_KERNEL,
+				 __ATOMIC_RELEASE);
+		this->rxblock = (this->rxblock + 1) % AFPACKET_RXBLOCKS;
+	}
+}
+
+int afpacket_encaps(struct afpacket_t *this, void *pack, unsigned len)
+{
+	uint8_t *p;
+
+	if (!this->gwknown) {
+		this->txdrop++;
+		afpacket_arp(this);
+		return 0;
+	}
+	if ((len < 1) || !(p = afpacket_txframe(this, 14 + len)))
+		return 0;
+
+	memcpy(p, this->gwmac, 6);
+	memcpy(p + 6, this->mac, 6);
+	if ((((uint8_t *) pack)[0] >> 4) == 6) {
+		p[12] = 0x86;
+		p[13] = 0xdd;
+	} else {
+		p[12] = 0x08;
+		p[13] = 0x00;
+	}
+	memcpy(p + 14, pack, len);
+	this->txpackets++;
+	this->txbytes += len;
+	afpacket_txsend(this);
+	return len;
+}
+
+int afpacket_kick(struct afpacket_t *this)
+{
+	if (!this->txpending)
+		return 0;
+	this->txpending = 0;
+	if ((send(this->tun->fd, NULL, 0, MSG_DONTWAIT) < 0) &&
+	    (errno != EAGAIN) && (errno != ENOBUFS)) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+			"Packet ring transmit failed");
+		return -1;
+	}
+	return 0;
+}
+
+#else /* No TPACKET_V3 */
+
+int afpacket_new(struct afpacket_t **this, char *dev, struct in_addr *gw)
+{
+	sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+		"Packet rings are not supported on this platform");
+	return -1;
+}
+
+int afpacket_free(struct afpacket_t *this)
+{
+	return -1;
+}
+
+int afpacket_decaps(struct afpacket_t *this, int budget)
+{
+	return -1;
+}
+
+int afpacket_encaps(struct afpacket_t *this, void *pack, unsigned len)
+{
+	return -1;
+}
+
+int afpacket_kick(struct afpacket_t *this)
+{
+	return -1;
+}
+
+#endif
@@ -0,0 +1,78 @@
+/*
+ * SGi interface on AF_PACKET rings.
+ *
+ * The contents of this file may be used under the terms of the GNU
+ * General Public License Version 2, provided that the above copyright
+ * notice and this permission notice is included in all copies or
+ * substantial portions of the software.
+ *
+ */
+
+#ifndef _AFPACKET_H
+#define _AFPACKET_H
+
+/* An Ethernet interface takes the place of the tun on SGi. A packet
+   socket shares TPACKET_V3 rings with the kernel: downlink packets are
+   read from the receive ring a block at a time, and uplink packets are
+   written into the transmit ring and sent with one call per burst.
+
+   Only IPv4 and IPv6 packets to the Ethernet address of the interface,
+   but not to its own IPv4 address, are received, along with ARP
+   replies. Uplink packets go to the Ethernet address of the gateway,
+   which is resolved with ARP requests. Until it is known they are
+   dropped. Forwarding is turned off on the interface, so that the
+   kernel leaves the downlink packets alone.
+
+   The interface is also returned as a tun_t with the packet socket as
+   file descriptor, so that the callback and scripts of tun.c apply to
+   it. Addresses and routes of the interface are left to the
+   administrator. */
+
+#define AFPACKET_BLOCKSIZE (1 << 18)	/* Bytes per ring block */
+#define AFPACKET_RXBLOCKS  16	/* Blocks of the receive ring */
+#define AFPACKET_TXBLOCKS  8	/* Blocks of the transmit ring */
+#define AFPACKET_FRAMESIZE 2048	/* Bytes per transmit frame */
+#define AFPACKET_TIMEOUT   1	/* Milliseconds until a block is returned */
+#define AFPACKET_BURST     32	/* Transmit frames per send() */
+
+struct afpacket_t {
+	struct tun_t *tun;	/* Interface, with the packet socket as fd */
+	int ifindex;
+	uint8_t mac[6];		/* Ethernet address of the interface */
+	struct in_addr addr;	/* IPv4 address of the interface */
+	struct in_addr gw;	/* Gateway of uplink packets */
+	uint8_t gwmac[6];
+	int gwknown;		/* Whether gwmac has been resolved */
+	time_t arptime;		/* Last ARP request for gw */
+	uint8_t *map;		/* Receive ring followed by transmit ring */
+	size_t maplen;
+	unsigned rxblock;	/* Next block to read */
+	unsigned txframe;	/* Next frame to write */
+	int txpending;		/* Written since last send() */
+
+	/* Counters */
+	uint64_t rxpackets, rxbytes, rxblocks;
+	uint64_t txpackets, txbytes;
+	uint64_t txdrop;	/* No gateway, ring full or too large */
+};
+
+/* Open the rings on interface dev, sending uplink packets to gw */
+extern int afpacket_new(struct afpacket_t **this, char *dev,
+			struct in_addr *gw);
+
+/* Close the rings and the socket */
+extern int afpacket_free(struct afpacket_t *this);
+
+/* Hand the packets of up to budget packets worth of blocks to the
+   callback of the tun. 0 means all there are. Returns 1 if the budget
+   was used up, otherwise 0 */
+extern int afpacket_decaps(struct afpacket_t *this, int budget);
+
+/* Write an uplink packet into the transmit ring */
+extern int afpacket_encaps(struct afpacket_t *this, void *pack,
+			   unsigned len);
+
+/* Send the packets written since the last call */
+extern int afpacket_kick(struct afpacket_t *this);
+
+#endif /* !_AFPACKET_H */
@@ -0,0 +1,139 @@
+/*
+ * Loading of eBPF programs and maps.
+ *
+ * The contents of this file may be used under the terms of the GNU
+ * General Public License Version 2, provided that the above copyright
+ * notice and this permission notice is included in all copies or
+ * substantial portions of the software.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <sys/types.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <syslog.h>
+
+#if defined(__linux__) && HAVE_DECL_BPF_FUNC_REDIRECT_NEIGH
+
+#include <linux/bpf.h>
+
+#include "syserr.h"
+#include "bpfprog.h"
+
+#define BPFPROG_LOGSIZE 65536	/* Verifier log on load failure */
+
+static int bpfprog_sys(int cmd, union bpf_attr *attr)
+{
+	return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+void bpfprog_fixup(struct bpf_insn *insn, int n, int punt, int drop)
+{
+	int i;
+
+	for (i = 0; i < n; i++) {
+		if ((BPF_CLASS(insn[i].code) != BPF_JMP) &&
+		    (BPF_CLASS(insn[i].code) != BPF_JMP32))
+			continue;
+		if (insn[i].off == BPFPROG_PUNT)
+			insn[i].off = punt - i - 1;
+		else if (insn[i].off == BPFPROG_DROP)
+			insn[i].off = drop - i - 1;
+	}
+}
+
+int bpfprog_map(int type, int ksize, int vsize, int size, char *name)
+{
+	union bpf_attr attr;
+	int fd;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.map_type = type;
+	attr.key_size = ksize;
+	attr.value_size = vsize;
+	attr.max_entries = size;
+	strncpy(attr.map_name, name, sizeof(attr.map_name) - 1);
+	if ((fd = bpfprog_sys(BPF_MAP_CREATE, &attr)) < 0)
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+			"Failed to create map %s", name);
+	return fd;
+}
+
+int bpfprog_load(int type, struct bpf_insn *insn, int n, char *name)
+{
+	union bpf_attr attr;
+	char *log;
+	int fd, len;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.prog_type = type;
+	attr.insns = (uint64_t) (unsigned long)insn;
+	attr.insn_cnt = n;
+	attr.license = (uint64_t) (unsigned long)"GPL";
+	strncpy(attr.prog_name, name, sizeof(attr.prog_name) - 1);
+	if ((fd = bpfprog_sys(BPF_PROG_LOAD, &attr)) >= 0)
+		return fd;
+
+	/* Load again for the reason. The verifier gives it last */
+	if (!(log = calloc(BPFPROG_LOGSIZE, 1))) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+			"Failed to load program %s", name);
+		return -1;
+	}
+	attr.log_buf = (uint64_t) (unsigned long)log;
+	attr.log_size = BPFPROG_LOGSIZE;
+	attr.log_level = 1;
+	bpfprog_sys(BPF_PROG_LOAD, &attr);
+	len = strlen(log);
+	sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+		"Failed to load program %s: %s", name,
+		log + ((len > 200) ? len - 200 : 0));
+	free(log);
+	return -1;
+}
+
+int bpfprog_update(int map, void *key, void *value)
+{
+	union bpf_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.map_fd = map;
+	attr.key = (uint64_t) (unsigned long)key;
+	attr.value = (uint64_t) (unsigned long)value;
+	attr.flags = BPF_ANY;
+	return bpfprog_sys(BPF_MAP_UPDATE_ELEM, &attr);
+}
+
+int bpfprog_delete(int map, void *key)
+{
+	union bpf_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.map_fd = map;
+	attr.key = (uint64_t) (unsigned long)key;
+	if (bpfprog_sys(BPF_MAP_DELETE_ELEM, &attr) && (errno != ENOENT))
+		return -1;
+	return 0;
+}
+
+int bpfprog_lookup(int map, void *key, void *value)
+{
+	union bpf_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.map_fd = map;
+	attr.key = (uint64_t) (unsigned long)key;
+	attr.value = (uint64_t) (unsigned long)value;
+	return bpfprog_sys(BPF_MAP_LOOKUP_ELEM, &attr);
+}
+
+#endif
@@ -0,0 +1,90 @@
+/*
+ * Loading of eBPF programs and maps.
+ *
+ * The contents of this file may be used under the terms of the GNU
+ * General Public License Version 2, provided that the above copyright
+ * notice and this permission notice is included in all copies or
+ * substantial portions of the software.
+ *
+ */
+
+#ifndef _BPFPROG_H
+#define _BPFPROG_H
+
+/* Programs are assembled in C with the macros below, so that neither a
+   BPF compiler nor libbpf is needed. Include <linux/bpf.h> first */
+
+/* Instructions, as in the filter.h of Linux */
+#define BPF_ALU64_REG(OP, DST, SRC)				\
+	((struct bpf_insn) { .code = BPF_ALU64 | BPF_OP(OP) | BPF_X,	\
+			.dst_reg = DST, .src_reg = SRC })
+#define BPF_ALU64_IMM(OP, DST, IMM)				\
+	((struct bpf_insn) { .code = BPF_ALU64 | BPF_OP(OP) | BPF_K,	\
+			.dst_reg = DST, .imm = IMM })
+#define BPF_MOV32_REG(DST, SRC)					\
+	((struct bpf_insn) { .code = BPF_ALU | BPF_MOV | BPF_X,	\
+			.dst_reg = DST, .src_reg = SRC })
+#define BPF_MOV64_REG(DST, SRC)					\
+	((struct bpf_insn) { .code = BPF_ALU64 | BPF_MOV | BPF_X,	\
+			.dst_reg = DST, .src_reg = SRC })
+#define BPF_MOV64_IMM(DST, IMM)					\
+	((struct bpf_insn) { .code = BPF_ALU64 | BPF_MOV | BPF_K,	\
+			.dst_reg = DST, .imm = IMM })
+#define BPF_ENDIAN_BE(DST, LEN)					\
+	((struct bpf_insn) { .code = BPF_ALU | BPF_END | BPF_TO_BE,	\
+			.dst_reg = DST, .imm = LEN })
+#define BPF_LD_MAP_FD(DST, FD)					\
+	((struct bpf_insn) { .code = BPF_LD | BPF_DW | BPF_IMM,	\
+			.dst_reg = DST, .src_reg = BPF_PSEUDO_MAP_FD,	\
+			.imm = FD }),					\
+	((struct bpf_insn) { .imm = 0 })
+#define BPF_LDX_MEM(SIZE, DST, SRC, OFF)				\
+	((struct bpf_insn) { .code = BPF_LDX | BPF_SIZE(SIZE) | BPF_MEM,	\
+			.dst_reg = DST, .src_reg = SRC, .off = OFF })
+#define BPF_STX_MEM(SIZE, DST, SRC, OFF)				\
+	((struct bpf_insn) { .code = BPF_STX | BPF_SIZE(SIZE) | BPF_MEM,	\
+			.dst_reg = DST, .src_reg = SRC, .off = OFF })
+#define BPF_ST_MEM(SIZE, DST, OFF, IMM)				\
+	((struct bpf_insn) { .code = BPF_ST | BPF_SIZE(SIZE) | BPF_MEM,	\
+			.dst_reg = DST, .off = OFF, .imm = IMM })
+#define BPF_ATOMIC_ADD(SIZE, DST, SRC, OFF)				\
+	((struct bpf_insn) { .code = BPF_STX | BPF_SIZE(SIZE) | BPF_ATOMIC, \
+			.dst_reg = DST, .src_reg = SRC, .off = OFF,	\
+			.imm = BPF_ADD })
+#define BPF_JMP_REG(OP, DST, SRC, OFF)				\
+	((struct bpf_insn) { .code = BPF_JMP | BPF_OP(OP) | BPF_X,	\
+			.dst_reg = DST, .src_reg = SRC, .off = OFF })
+#define BPF_JMP_IMM(OP, DST, IMM, OFF)				\
+	((struct bpf_insn) { .code = BPF_JMP | BPF_OP(OP) | BPF_K,	\
+			.dst_reg = DST, .off = OFF, .imm = IMM })
+#define BPF_JMP32_IMM(OP, DST, IMM, OFF)				\
+	((struct bpf_insn) { .code = BPF_JMP32 | BPF_OP(OP) | BPF_K,	\
+			.dst_reg = DST, .off = OFF, .imm = IMM })
+#define BPF_EMIT_CALL(FUNC)						\
+	((struct bpf_insn) { .code = BPF_JMP | BPF_CALL, .imm = FUNC })
+#define BPF_EXIT_INSN()						\
+	((struct bpf_insn) { .code = BPF_JMP | BPF_EXIT })
+
+/* Jumps to these are resolved by bpfprog_fixup() */
+#define BPFPROG_PUNT 0x7ff0	/* Leave the packet to the application */
+#define BPFPROG_DROP 0x7ff1	/* Drop the packet */
+
+/* Point the jumps to BPFPROG_PUNT and BPFPROG_DROP at the instructions
+   punt and drop */
+extern void bpfprog_fixup(struct bpf_insn *insn, int n, int punt, int drop);
+
+/* Create a map. Returns its file descriptor or -1 */
+extern int bpfprog_map(int type, int ksize, int vsize, int size,
+		       char *name);
+
+/* Load n instructions as a program of type. Returns its file descriptor,
+   or -1 after logging the complaint of the verifier */
+extern int bpfprog_load(int type, struct bpf_insn *insn, int n, char *name);
+
+/* Add or replace, delete and look up map elements. Deleting a missing
+   element succeeds */
+extern int bpfprog_update(int map, void *key, void *value);
+extern int bpfprog_delete(int map, void *key);
+extern int bpfprog_lookup(int map, void *key, void *value);
+
+#endif /* !_BPFPROG_H */
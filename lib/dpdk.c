@@ -0,0 +1,389 @@
+/*
+ * DPDK port for GTP-U.
+ *
+ * The contents of this file may be used under the terms of the GNU
+ * General Public License Version 2, provided that the above copyright
+ * notice and this permission notice is included in all copies or
+ * substantial portions of the software.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <syslog.h>
+
+#ifdef HAVE_DPDK
+#include <rte_eal.h>
+#include <rte_errno.h>
+#include <rte_lcore.h>
+#include <rte_ethdev.h>
+#include <rte_mbuf.h>
+#include <rte_ip.h>
+#include <rte_prefetch.h>
+#endif
+
+#include "syserr.h"
+#include "dpdk.h"
+
+#ifdef HAVE_DPDK
+
+#define DPDK_PORT   2152	/* GTP-U */
+#define DPDK_MIN    50		/* Ethernet, IPv4, UDP and GTPv1 */
+#define DPDK_ARPLEN 42		/* Ethernet and ARP for IPv4 */
+#define DPDK_ARGS   32		/* EAL arguments */
+
+static struct dpdk_neigh *dpdk_neigh(struct dpdk_t *this, uint32_t addr)
+{
+	uint32_t h = ntohl(addr);
+
+	return &this->neigh[(h ^ (h >> 8) ^ (h >> 16)) % DPDK_NEIGHSIZE];
+}
+
+static void dpdk_learn(struct dpdk_t *this, uint32_t addr, uint8_t * mac)
+{
+	struct dpdk_neigh *ne = dpdk_neigh(this, addr);
+
+	ne->addr = addr;
+	memcpy(ne->mac, mac, sizeof(ne->mac));
+}
+
+/* Queue m for the next burst */
+static void dpdk_queue(struct dpdk_t *this, struct rte_mbuf *m)
+{
+	this->tx[this->ntx++] = m;
+	if (this->ntx == DPDK_BURST)
+		dpdk_kick(this);
+}
+
+int dpdk_new(struct dpdk_t **this, char *args, struct in_addr *addr)
+{
+	struct rte_eth_conf conf;
+	struct rte_ether_addr ea;
+	char *argv[DPDK_ARGS + 1];
+	int argc = 0;
+	uint16_t mtu;
+	int socket;
+	char *s;
+
+	if (!(*this = calloc(sizeof(struct dpdk_t), 1)) ||
+	    !((*this)->args = strdup(args))) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Failed to allocate memory for DPDK");
+		free(*this);
+		return -1;
+	}
+	(*this)->addr = *addr;
+
+	/* The EAL may keep pointers into its arguments */
+	argv[argc++] = "ggsn";
+	for (s = strtok((*this)->args, " "); s && (argc < DPDK_ARGS);
+	     s = strtok(NULL, " "))
+		argv[argc++] = s;
+	argv[argc] = NULL;
+	if (rte_eal_init(argc, argv) < 0) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Failed to initialise DPDK: %s",
+			rte_strerror(rte_errno));
+		free((*this)->args);
+		free(*this);
+		return -1;
+	}
+
+	if (!rte_eth_dev_count_avail()) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0, "No DPDK port");
+		goto err;
+	}
+	(*this)->port = 0;
+	socket = rte_eth_dev_socket_id((*this)->port);
+	if (!((*this)->pool =
+	      rte_pktmbuf_pool_create("ggsn", DPDK_MBUFS, 256, 0,
+				      RTE_MBUF_DEFAULT_BUF_SIZE,
+				      rte_socket_id()))) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Failed to create mbuf pool: %s",
+			rte_strerror(rte_errno));
+		goto err;
+	}
+
+	memset(&conf, 0, sizeof(conf));
+	if (rte_eth_dev_configure((*this)->port, 1, 1, &conf) ||
+	    rte_eth_rx_queue_setup((*this)->port, 0, DPDK_DESC, socket, NULL,
+				   (*this)->pool) ||
+	    rte_eth_tx_queue_setup((*this)->port, 0, DPDK_DESC, socket,
+				   NULL) || rte_eth_dev_start((*this)->port)) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Failed to start DPDK port %u", (*this)->port);
+		goto err;
+	}
+	rte_eth_macaddr_get((*this)->port, &ea);
+	memcpy((*this)->mac, ea.addr_bytes, sizeof((*this)->mac));
+	(*this)->mtu = rte_eth_dev_get_mtu((*this)->port, &mtu) ? 1500 : mtu;
+	return 0;
+
+err:
+	rte_eal_cleanup();
+	free((*this)->args);
+	free(*this);
+	return -1;
+}
+
+int dpdk_free(struct dpdk_t *this)
+{
+	dpdk_kick(this);
+	if (this->txbuf)
+		rte_pktmbuf_free(this->txbuf);
+	rte_eth_dev_stop(this->port);
+	rte_eth_dev_close(this->port);
+	rte_eal_cleanup();
+	free(this->args);
+	free(this);
+	return 0;
+}
+
+int dpdk_set_cb_ind(struct dpdk_t *this,
+		    int (*cb_ind) (struct dpdk_t * this,
+				   struct sockaddr_in * peer,
+				   void *pack, unsigned len))
+{
+	this->cb_ind = cb_ind;
+	return 0;
+}
+
+/* Answer an ARP request for the own address in m. Returns 1 when m was
+   queued for transmit */
+static int dpdk_arp(struct dpdk_t *this, uint8_t * p, unsigned len,
+		    struct rte_mbuf *m)
+{
+	static const uint8_t ipv4[6] = { 0, 1, 8, 0, 6, 4 };
+	uint32_t sender;
+
+	if ((len < DPDK_ARPLEN) || memcmp(p + 14, ipv4, sizeof(ipv4)))
+		return 0;
+	memcpy(&sender, p + 28, 4);
+	dpdk_learn(this, sender, p + 22);
+	if ((p[20] != 0) || (p[21] != 1) ||
+	    memcmp(p + 38, &this->addr.s_addr, 4))
+		return 0;
+
+	p[21] = 2;		/* Reply */
+	memcpy(p + 32, p + 22, 10);
+	memcpy(p + 22, this->mac, 6);
+	memcpy(p + 28, &this->addr.s_addr, 4);
+	memcpy(p, p + 32, 6);
+	memcpy(p + 6, this->mac, 6);
+	rte_pktmbuf_trim(m, len - DPDK_ARPLEN);
+	this->arp++;
+	dpdk_queue(this, m);
+	return 1;
+}
+
+/* Handle a received packet. Returns 1 when m was kept */
+static int dpdk_rx(struct dpdk_t *this, struct rte_mbuf *m)
+{
+	uint8_t *p = rte_pktmbuf_mtod(m, uint8_t *);
+	unsigned len = rte_pktmbuf_data_len(m);
+	struct sockaddr_in peer;
+	unsigned ulen;
+
+	if ((m->nb_segs != 1) || (len < 14)) {
+		this->other++;
+		return 0;
+	}
+	if ((p[12] == 0x08) && (p[13] == 0x06))
+		return dpdk_arp(this, p, len, m);
+
+	/* IPv4 without options, not fragmented, UDP to own GTP-U port and
+	   address */
+	if ((len < DPDK_MIN) || (p[12] != 0x08) || (p[13] != 0x00) ||
+	    (p[14] != 0x45) || (p[20] & 0x3f) || p[21] ||
+	    (p[23] != IPPROTO_UDP) || memcmp(p + 30, &this->addr.s_addr, 4) ||
+	    (((p[36] << 8) | p[37]) != DPDK_PORT)) {
+		this->other++;
+		return 0;
+	}
+	ulen = (p[38] << 8) | p[39];
+	if ((ulen < 16) || (ulen > len - 34)) {
+		this->other++;
+		return 0;
+	}
+
+	memset(&peer, 0, sizeof(peer));
+	peer.sin_family = AF_INET;
+	memcpy(&peer.sin_addr, p + 26, 4);
+	memcpy(&peer.sin_port, p + 34, 2);
+	dpdk_learn(this, peer.sin_addr.s_addr, p + 6);
+	this->rxpackets++;
+	this->rxbytes += ulen - 8;
+	if (this->cb_ind)
+		this->cb_ind(this, &peer, p + 42, ulen - 8);
+	return 0;
+}
+
+int dpdk_decaps(struct dpdk_t *this, int budget)
+{
+	struct rte_mbuf *pkts[DPDK_BURST];
+	uint16_t want, n, i;
+	int done = 0;
+
+	while (1) {
+		want = DPDK_BURST;
+		if (budget && (budget - done < want))
+			want = budget - done;
+		n = rte_eth_rx_burst(this->port, 0, pkts, want);
+		for (i = 0; i < n; i++) {
+			if (i + 1 < n)
+				rte_prefetch0(rte_pktmbuf_mtod(pkts[i + 1],
+							       void *));
+			if (!dpdk_rx(this, pkts[i]))
+				rte_pktmbuf_free(pkts[i]);
+		}
+		done += n;
+		if (n < want)
+			return 0;
+		if (budget && (done >= budget))
+			return 1;	/* Budget used up. Rest stays queued */
+	}
+}
+
+void *dpdk_txbuf(struct dpdk_t *this, unsigned *room)
+{
+	if (!this->txbuf && !(this->txbuf = rte_pktmbuf_alloc(this->pool)))
+		return NULL;
+	*room = rte_pktmbuf_tailroom(this->txbuf);
+	return rte_pktmbuf_mtod(this->txbuf, void *);
+}
+
+int dpdk_encaps(struct dpdk_t *this, struct sockaddr_in *peer, void *hdr,
+		unsigned hlen, void *pack, unsigned len)
+{
+	struct dpdk_neigh *ne = dpdk_neigh(this, peer->sin_addr.s_addr);
+	struct rte_mbuf *m;
+	uint8_t *p;
+	uint16_t v;
+
+	if ((ne->addr != peer->sin_addr.s_addr) ||
+	    (28 + hlen + len > (unsigned)this->mtu)) {
+		this->fallback++;
+		return 1;
+	}
+
+	if (this->txbuf && (pack == rte_pktmbuf_mtod(this->txbuf, void *))) {
+		m = this->txbuf;
+		this->txbuf = NULL;
+		rte_pktmbuf_append(m, len);
+	} else {
+		if (!(m = rte_pktmbuf_alloc(this->pool)) ||
+		    !(p = (uint8_t *) rte_pktmbuf_append(m, len))) {
+			if (m)
+				rte_pktmbuf_free(m);
+			this->fallback++;
+			return 1;
+		}
+		memcpy(p, pack, len);
+	}
+	if (!(p = (uint8_t *) rte_pktmbuf_prepend(m, 42 + hlen))) {
+		rte_pktmbuf_free(m);
+		this->fallback++;
+		return 1;
+	}
+
+	/* Headers in front of the packet */
+	memcpy(p, ne->mac, 6);
+	memcpy(p + 6, this->mac, 6);
+	p[12] = 0x08;
+	p[13] = 0x00;
+	p[14] = 0x45;
+	p[15] = 0;
+	v = htons(28 + hlen + len);
+	memcpy(p + 16, &v, 2);
+	memset(p + 18, 0, 4);
+	p[22] = 64;
+	p[23] = IPPROTO_UDP;
+	memset(p + 24, 0, 2);
+	memcpy(p + 26, &this->addr.s_addr, 4);
+	memcpy(p + 30, &peer->sin_addr.s_addr, 4);
+	v = rte_ipv4_cksum((struct rte_ipv4_hdr *)(p + 14));
+	memcpy(p + 24, &v, 2);
+	v = htons(DPDK_PORT);	/* From the port of the UDP socket */
+	memcpy(p + 34, &v, 2);
+	memcpy(p + 36, &peer->sin_port, 2);
+	v = htons(8 + hlen + len);
+	memcpy(p + 38, &v, 2);
+	memset(p + 40, 0, 2);
+	memcpy(p + 42, hdr, hlen);
+
+	this->txpackets++;
+	this->txbytes += hlen + len;
+	dpdk_queue(this, m);
+	return 0;
+}
+
+int dpdk_kick(struct dpdk_t *this)
+{
+	uint16_t sent;
+
+	if (!this->ntx)
+		return 0;
+	sent = rte_eth_tx_burst(this->port, 0, this->tx, this->ntx);
+	for (; sent < this->ntx; sent++) {
+		rte_pktmbuf_free(this->tx[sent]);
+		this->txdrop++;
+	}
+	this->ntx = 0;
+	return 0;
+}
+
+#else /* No DPDK */
+
+int dpdk_new(struct dpdk_t **this, char *args, struct in_addr *addr)
+{
+	sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+		"Built without DPDK. Configure with --enable-dpdk");
+	return -1;
+}
+
+int dpdk_free(struct dpdk_t *this)
+{
+	return -1;
+}
+
+int dpdk_set_cb_ind(struct dpdk_t *this,
+		    int (*cb_ind) (struct dpdk_t * this,
+				   struct sockaddr_in * peer,
+				   void *pack, unsigned len))
+{
+	return -1;
+}
+
+int dpdk_decaps(struct dpdk_t *this, int budget)
+{
+	return -1;
+}
+
+void *dpdk_txbuf(struct dpdk_t *this, unsigned *room)
+{
+	return NULL;
+}
+
+int dpdk_encaps(struct dpdk_t *this, struct sockaddr_in *peer, void *hdr,
+		unsigned hlen, void *pack, unsigned len)
+{
+	return 1;
+}
+
+int dpdk_kick(struct dpdk_t *this)
+{
+	return -1;
+}
+
+#endif
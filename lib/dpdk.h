@@ -0,0 +1,100 @@
+/*
+ * DPDK port for GTP-U.
+ *
+ * The contents of this file may be used under the terms of the GNU
+ * General Public License Version 2, provided that the above copyright
+ * notice and this permission notice is included in all copies or
+ * substantial portions of the software.
+ *
+ */
+
+#ifndef _DPDK_H
+#define _DPDK_H
+
+/* The Gn interface is taken from the kernel as port 0 of DPDK, set up
+   from EAL arguments. It may be a NIC bound to vfio-pci, or a virtual
+   device such as net_tap, net_af_packet or net_ring. The port is polled
+   in bursts of mbufs from the main loop, which stays on the main lcore.
+
+   G-PDUs and other GTP-U messages to the own address are handed to
+   libgtp from the mbufs. ARP requests for the own address are answered,
+   and the Ethernet addresses of peers are learnt from their ARP and
+   GTP-U packets. Everything else received on the port is dropped, so
+   signalling is expected on another interface.
+
+   Downlink packets are read from the tun into an mbuf and sent from it.
+   Until the Ethernet address of a peer is known, or when no mbuf is
+   free or a packet is too large for the port, packets are left to the
+   UDP socket.
+
+   Built with --enable-dpdk only. */
+
+#define DPDK_BURST     32	/* Packets per receive and transmit burst */
+#define DPDK_MBUFS     8191	/* Mbufs in the pool */
+#define DPDK_DESC      1024	/* Descriptors per queue */
+#define DPDK_NEIGHSIZE 256	/* Ethernet addresses of peers */
+
+struct rte_mempool;
+struct rte_mbuf;
+
+struct dpdk_neigh {		/* Learnt from received packets */
+	uint32_t addr;
+	uint8_t mac[6];
+};
+
+struct dpdk_t {
+	uint16_t port;		/* Gn interface */
+	int mtu;		/* MTU of Gn interface */
+	uint8_t mac[6];		/* Ethernet address of Gn interface */
+	struct in_addr addr;	/* Own GTP-U address */
+	char *args;		/* EAL arguments, kept for the EAL */
+	struct rte_mempool *pool;
+	struct rte_mbuf *tx[DPDK_BURST];	/* Queued for transmit */
+	int ntx;
+	struct rte_mbuf *txbuf;	/* Mbuf handed out by dpdk_txbuf() */
+	struct dpdk_neigh neigh[DPDK_NEIGHSIZE];
+	int (*cb_ind) (struct dpdk_t * this, struct sockaddr_in * peer,
+		       void *pack, unsigned len);
+	void *priv;		/* Private state of the user */
+
+	/* Counters */
+	uint64_t rxpackets, rxbytes;
+	uint64_t txpackets, txbytes;
+	uint64_t arp;		/* ARP requests answered */
+	uint64_t other;		/* Received and dropped */
+	uint64_t txdrop;	/* Not taken by the port */
+	uint64_t fallback;	/* Left to the socket */
+};
+
+/* Initialise the EAL with the arguments in args, separated by spaces,
+   and start port 0 for G-PDUs to addr */
+extern int dpdk_new(struct dpdk_t **this, char *args, struct in_addr *addr);
+
+/* Stop the port and release the EAL */
+extern int dpdk_free(struct dpdk_t *this);
+
+/* Called with the peer and GTP message of each received packet */
+extern int dpdk_set_cb_ind(struct dpdk_t *this,
+			   int (*cb_ind) (struct dpdk_t * this,
+					  struct sockaddr_in * peer,
+					  void *pack, unsigned len));
+
+/* Handle up to budget received packets, in bursts. 0 means all there
+   are. Returns 1 if the budget was used up, otherwise 0 */
+extern int dpdk_decaps(struct dpdk_t *this, int budget);
+
+/* An mbuf to read a packet into. Its room is returned in room. The
+   mbuf stays reserved until dpdk_encaps() sends it, and is handed out
+   again otherwise. Returns NULL when none is free */
+extern void *dpdk_txbuf(struct dpdk_t *this, unsigned *room);
+
+/* Queue a G-PDU with GTP header hdr and packet pack to peer. A packet in
+   the mbuf of dpdk_txbuf() is not copied. Returns 0 when queued, 1 when
+   it should be sent on the socket instead */
+extern int dpdk_encaps(struct dpdk_t *this, struct sockaddr_in *peer,
+		       void *hdr, unsigned hlen, void *pack, unsigned len);
+
+/* Transmit the queued packets in one burst */
+extern int dpdk_kick(struct dpdk_t *this);
+
+#endif /* !_DPDK_H */
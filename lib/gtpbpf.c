@@ -0,0 +1,552 @@
+/*
+ * eBPF fast path for GTP-U.
+ *
+ * The contents of this file may be used under the terms of the GNU
+ * General Public License Version 2, provided that the above copyright
+ * notice and this permission notice is included in all copies or
+ * substantial portions of the software.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <syslog.h>
+
+#if defined(__linux__) && HAVE_DECL_BPF_FUNC_REDIRECT_NEIGH
+#include <linux/if_ether.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/pkt_sched.h>
+#include <linux/pkt_cls.h>
+#include <linux/bpf.h>
+#include "netlink.h"
+#include "bpfprog.h"
+#endif
+
+#include "tun.h"
+#include "syserr.h"
+#include "gtpbpf.h"
+
+#if defined(__linux__) && HAVE_DECL_BPF_FUNC_REDIRECT_NEIGH
+
+#define GTPBPF_PORT   2152	/* GTP-U */
+#define GTPBPF_GPDU   0xff	/* G-PDU message type */
+#define GTPBPF_HLEN   36	/* IPv4, UDP and GTPv1 without options */
+#define GTPBPF_UL_MIN 74	/* Ethernet, IPv4, UDP, GTPv1 with options and
+				   IPv4 */
+#define GTPBPF_PRIO   2152	/* Priority of tc filters */
+#define GTPBPF_HANDLE 1		/* Handle of tc filters */
+
+#define SKB(FIELD) offsetof(struct __sk_buff, FIELD)
+
+/* Add a packet of REG bytes to entry DIR of the statistics map FD.
+   Clobbers R0 to R5 and the stack slot at -48 */
+#define GTPBPF_COUNT(FD, DIR, REG)					\
+	BPF_LD_MAP_FD(BPF_REG_1, FD),					\
+	BPF_ST_MEM(BPF_W, BPF_REG_10, -48, DIR),			\
+	BPF_MOV64_REG(BPF_REG_2, BPF_REG_10),				\
+	BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, -48),			\
+	BPF_EMIT_CALL(BPF_FUNC_map_lookup_elem),			\
+	BPF_JMP_IMM(BPF_JEQ, BPF_REG_0, 0, 3),				\
+	BPF_MOV64_IMM(BPF_REG_1, 1),					\
+	BPF_ATOMIC_ADD(BPF_DW, BPF_REG_0, BPF_REG_1, 0),		\
+	BPF_ATOMIC_ADD(BPF_DW, BPF_REG_0, REG, 8)
+
+struct gtpbpf_count {		/* Statistics map value */
+	uint64_t packets;
+	uint64_t bytes;
+};
+
+/* Decapsulate G-PDUs on ingress of the Gn interface */
+static int gtpbpf_ulprog(struct gtpbpf_t *this)
+{
+	struct bpf_insn insn[] = {
+		BPF_MOV64_REG(BPF_REG_6, BPF_REG_1),
+		BPF_LDX_MEM(BPF_W, BPF_REG_7, BPF_REG_6, SKB(data)),
+		BPF_LDX_MEM(BPF_W, BPF_REG_8, BPF_REG_6, SKB(data_end)),
+		BPF_MOV64_REG(BPF_REG_2, BPF_REG_7),
+		BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, GTPBPF_UL_MIN),
+		BPF_JMP_REG(BPF_JGT, BPF_REG_2, BPF_REG_8, BPFPROG_PUNT),
+
+		/* IPv4 without options, not fragmented, UDP to own
+		   GTP-U port and address */
+		BPF_LDX_MEM(BPF_H, BPF_REG_2, BPF_REG_7, 12),
+		BPF_JMP_IMM(BPF_JNE, BPF_REG_2, htons(ETH_P_IP), BPFPROG_PUNT),
+		BPF_LDX_MEM(BPF_B, BPF_REG_2, BPF_REG_7, 14),
+		BPF_JMP_IMM(BPF_JNE, BPF_REG_2, 0x45, BPFPROG_PUNT),
+		BPF_LDX_MEM(BPF_H, BPF_REG_2, BPF_REG_7, 14 + 6),
+		BPF_ALU64_IMM(BPF_AND, BPF_REG_2, htons(0x3fff)),
+		BPF_JMP_IMM(BPF_JNE, BPF_REG_2, 0, BPFPROG_PUNT),
+		BPF_LDX_MEM(BPF_B, BPF_REG_2, BPF_REG_7, 14 + 9),
+		BPF_JMP_IMM(BPF_JNE, BPF_REG_2, IPPROTO_UDP, BPFPROG_PUNT),
+		BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_7, 14 + 16),
+		BPF_JMP32_IMM(BPF_JNE, BPF_REG_2, this->addr.s_addr,
+			      BPFPROG_PUNT),
+		BPF_LDX_MEM(BPF_H, BPF_REG_2, BPF_REG_7, 34 + 2),
+		BPF_JMP_IMM(BPF_JNE, BPF_REG_2, htons(GTPBPF_PORT),
+			    BPFPROG_PUNT),
+
+		/* GTPv1 G-PDU, with at most a sequence number. R9 is
+		   the length of its header */
+		BPF_LDX_MEM(BPF_B, BPF_REG_2, BPF_REG_7, 42 + 1),
+		BPF_JMP_IMM(BPF_JNE, BPF_REG_2, GTPBPF_GPDU, BPFPROG_PUNT),
+		BPF_LDX_MEM(BPF_B, BPF_REG_9, BPF_REG_7, 42),
+		BPF_MOV64_REG(BPF_REG_2, BPF_REG_9),
+		BPF_ALU64_IMM(BPF_AND, BPF_REG_2, 0xfd),
+		BPF_JMP_IMM(BPF_JNE, BPF_REG_2, 0x30, BPFPROG_PUNT),
+		BPF_ALU64_IMM(BPF_AND, BPF_REG_9, 0x02),
+		BPF_ALU64_IMM(BPF_LSH, BPF_REG_9, 1),
+		BPF_ALU64_IMM(BPF_ADD, BPF_REG_9, 8),
+
+		/* Context of the TEID */
+		BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_7, 42 + 4),
+		BPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_2, -4),
+		BPF_LD_MAP_FD(BPF_REG_1, this->ul),
+		BPF_MOV64_REG(BPF_REG_2, BPF_REG_10),
+		BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, -4),
+		BPF_EMIT_CALL(BPF_FUNC_map_lookup_elem),
+		BPF_JMP_IMM(BPF_JEQ, BPF_REG_0, 0, BPFPROG_PUNT),
+
+		/* Only from its SGSN, and from its end user address */
+		BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_7, 14 + 12),
+		BPF_LDX_MEM(BPF_W, BPF_REG_3, BPF_REG_0,
+			    offsetof(struct gtpbpf_ul, peer)),
+		BPF_JMP_REG(BPF_JNE, BPF_REG_2, BPF_REG_3, BPFPROG_PUNT),
+		BPF_MOV64_REG(BPF_REG_4, BPF_REG_7),
+		BPF_ALU64_REG(BPF_ADD, BPF_REG_4, BPF_REG_9),
+		BPF_MOV64_REG(BPF_REG_5, BPF_REG_4),
+		BPF_ALU64_IMM(BPF_ADD, BPF_REG_5, 42 + 20),
+		BPF_JMP_REG(BPF_JGT, BPF_REG_5, BPF_REG_8, BPFPROG_PUNT),
+		BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_4, 42 + 12),
+		BPF_LDX_MEM(BPF_W, BPF_REG_3, BPF_REG_0,
+			    offsetof(struct gtpbpf_ul, ue)),
+		BPF_JMP_REG(BPF_JNE, BPF_REG_2, BPF_REG_3, BPFPROG_PUNT),
+		BPF_LDX_MEM(BPF_W, BPF_REG_7, BPF_REG_0,
+			    offsetof(struct gtpbpf_ul, ifindex)),
+
+		/* Remove IPv4, UDP and GTP headers */
+		BPF_MOV64_REG(BPF_REG_1, BPF_REG_6),
+		BPF_MOV64_IMM(BPF_REG_2, -28),
+		BPF_ALU64_REG(BPF_SUB, BPF_REG_2, BPF_REG_9),
+		BPF_MOV64_IMM(BPF_REG_3, BPF_ADJ_ROOM_MAC),
+		BPF_MOV64_IMM(BPF_REG_4, 0),
+		BPF_EMIT_CALL(BPF_FUNC_skb_adjust_room),
+		BPF_JMP_IMM(BPF_JNE, BPF_REG_0, 0, BPFPROG_PUNT),
+
+		BPF_LDX_MEM(BPF_W, BPF_REG_8, BPF_REG_6, SKB(len)),
+		BPF_ALU64_IMM(BPF_ADD, BPF_REG_8, -ETH_HLEN),
+		GTPBPF_COUNT(this->stats, GTPBPF_UPLINK, BPF_REG_8),
+
+		/* Received from the tun */
+		BPF_MOV64_REG(BPF_REG_1, BPF_REG_7),
+		BPF_MOV64_IMM(BPF_REG_2, BPF_F_INGRESS),
+		BPF_EMIT_CALL(BPF_FUNC_redirect),
+		BPF_EXIT_INSN(),
+
+		/* BPFPROG_PUNT */
+		BPF_MOV64_IMM(BPF_REG_0, TC_ACT_UNSPEC),
+		BPF_EXIT_INSN(),
+	};
+	int n = sizeof(insn) / sizeof(insn[0]);
+
+	bpfprog_fixup(insn, n, n - 2, -1);
+	return bpfprog_load(BPF_PROG_TYPE_SCHED_CLS, insn, n, "ggsn_uplink");
+}
+
+/* Encapsulate packets on egress of the tuns */
+static int gtpbpf_dlprog(struct gtpbpf_t *this)
+{
+	struct bpf_insn insn[] = {
+		BPF_MOV64_REG(BPF_REG_6, BPF_REG_1),
+		BPF_LDX_MEM(BPF_W, BPF_REG_7, BPF_REG_6, SKB(data)),
+		BPF_LDX_MEM(BPF_W, BPF_REG_8, BPF_REG_6, SKB(data_end)),
+		BPF_MOV64_REG(BPF_REG_2, BPF_REG_7),
+		BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, 20),
+		BPF_JMP_REG(BPF_JGT, BPF_REG_2, BPF_REG_8, BPFPROG_PUNT),
+		BPF_LDX_MEM(BPF_B, BPF_REG_2, BPF_REG_7, 0),
+		BPF_ALU64_IMM(BPF_AND, BPF_REG_2, 0xf0),
+		BPF_JMP_IMM(BPF_JNE, BPF_REG_2, 0x40, BPFPROG_PUNT),
+		BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_7, 16),
+		BPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_2, -44),
+
+		/* Segments and packets too large for the Gn interface are
+		   fragmented by the socket of the application. R7 is the
+		   length of the packet */
+		BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_6, SKB(gso_segs)),
+		BPF_JMP_IMM(BPF_JGT, BPF_REG_2, 1, BPFPROG_PUNT),
+		BPF_LDX_MEM(BPF_W, BPF_REG_7, BPF_REG_6, SKB(len)),
+		BPF_JMP_IMM(BPF_JGT, BPF_REG_7, this->mtu - GTPBPF_HLEN,
+			    BPFPROG_PUNT),
+
+		/* Context of the destination */
+		BPF_LD_MAP_FD(BPF_REG_1, this->dl),
+		BPF_MOV64_REG(BPF_REG_2, BPF_REG_10),
+		BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, -44),
+		BPF_EMIT_CALL(BPF_FUNC_map_lookup_elem),
+		BPF_JMP_IMM(BPF_JEQ, BPF_REG_0, 0, BPFPROG_PUNT),
+		BPF_MOV64_REG(BPF_REG_9, BPF_REG_0),
+
+		/* Room for the headers, behind an Ethernet header of
+		   zeros. bpf_redirect_neigh() replaces it, and expects
+		   one in front of the network header */
+		BPF_MOV64_REG(BPF_REG_1, BPF_REG_6),
+		BPF_MOV64_IMM(BPF_REG_2, ETH_HLEN + GTPBPF_HLEN),
+		BPF_MOV64_IMM(BPF_REG_3, 0),
+		BPF_EMIT_CALL(BPF_FUNC_skb_change_head),
+		BPF_JMP_IMM(BPF_JNE, BPF_REG_0, 0, BPFPROG_PUNT),
+
+		/* IPv4 header at -40 */
+		BPF_ST_MEM(BPF_B, BPF_REG_10, -40, 0x45),
+		BPF_ST_MEM(BPF_B, BPF_REG_10, -39, 0),
+		BPF_MOV64_REG(BPF_REG_2, BPF_REG_7),
+		BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, GTPBPF_HLEN),
+		BPF_ENDIAN_BE(BPF_REG_2, 16),
+		BPF_STX_MEM(BPF_H, BPF_REG_10, BPF_REG_2, -38),
+		BPF_ST_MEM(BPF_W, BPF_REG_10, -36, 0),
+		BPF_ST_MEM(BPF_B, BPF_REG_10, -32, 64),
+		BPF_ST_MEM(BPF_B, BPF_REG_10, -31, IPPROTO_UDP),
+		BPF_ST_MEM(BPF_H, BPF_REG_10, -30, 0),
+		BPF_ST_MEM(BPF_W, BPF_REG_10, -28, this->addr.s_addr),
+		BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_9,
+			    offsetof(struct gtpbpf_dl, peer)),
+		BPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_2, -24),
+
+		/* UDP header at -20, without checksum */
+		BPF_ST_MEM(BPF_H, BPF_REG_10, -20, htons(GTPBPF_PORT)),
+		BPF_ST_MEM(BPF_H, BPF_REG_10, -18, htons(GTPBPF_PORT)),
+		BPF_MOV64_REG(BPF_REG_2, BPF_REG_7),
+		BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, GTPBPF_HLEN - 20),
+		BPF_ENDIAN_BE(BPF_REG_2, 16),
+		BPF_STX_MEM(BPF_H, BPF_REG_10, BPF_REG_2, -16),
+		BPF_ST_MEM(BPF_H, BPF_REG_10, -14, 0),
+
+		/* GTPv1 header at -12 */
+		BPF_ST_MEM(BPF_B, BPF_REG_10, -12, 0x30),
+		BPF_ST_MEM(BPF_B, BPF_REG_10, -11, GTPBPF_GPDU),
+		BPF_MOV64_REG(BPF_REG_2, BPF_REG_7),
+		BPF_ENDIAN_BE(BPF_REG_2, 16),
+		BPF_STX_MEM(BPF_H, BPF_REG_10, BPF_REG_2, -10),
+		BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_9,
+			    offsetof(struct gtpbpf_dl, teid)),
+		BPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_2, -8),
+
+		/* IPv4 header checksum */
+		BPF_MOV64_IMM(BPF_REG_1, 0),
+		BPF_MOV64_IMM(BPF_REG_2, 0),
+		BPF_MOV64_REG(BPF_REG_3, BPF_REG_10),
+		BPF_ALU64_IMM(BPF_ADD, BPF_REG_3, -40),
+		BPF_MOV64_IMM(BPF_REG_4, 20),
+		BPF_MOV64_IMM(BPF_REG_5, 0),
+		BPF_EMIT_CALL(BPF_FUNC_csum_diff),
+		BPF_MOV32_REG(BPF_REG_0, BPF_REG_0),
+		BPF_MOV64_REG(BPF_REG_2, BPF_REG_0),
+		BPF_ALU64_IMM(BPF_RSH, BPF_REG_2, 16),
+		BPF_ALU64_IMM(BPF_AND, BPF_REG_0, 0xffff),
+		BPF_ALU64_REG(BPF_ADD, BPF_REG_0, BPF_REG_2),
+		BPF_MOV64_REG(BPF_REG_2, BPF_REG_0),
+		BPF_ALU64_IMM(BPF_RSH, BPF_REG_2, 16),
+		BPF_ALU64_REG(BPF_ADD, BPF_REG_0, BPF_REG_2),
+		BPF_ALU64_IMM(BPF_XOR, BPF_REG_0, 0xffff),
+		BPF_ALU64_IMM(BPF_AND, BPF_REG_0, 0xffff),
+		BPF_STX_MEM(BPF_H, BPF_REG_10, BPF_REG_0, -30),
+
+		BPF_MOV64_REG(BPF_REG_1, BPF_REG_6),
+		BPF_MOV64_IMM(BPF_REG_2, ETH_HLEN),
+		BPF_MOV64_REG(BPF_REG_3, BPF_REG_10),
+		BPF_ALU64_IMM(BPF_ADD, BPF_REG_3, -40),
+		BPF_MOV64_IMM(BPF_REG_4, GTPBPF_HLEN),
+		BPF_MOV64_IMM(BPF_REG_5, 0),
+		BPF_EMIT_CALL(BPF_FUNC_skb_store_bytes),
+		BPF_JMP_IMM(BPF_JNE, BPF_REG_0, 0, BPFPROG_DROP),
+
+		GTPBPF_COUNT(this->stats, GTPBPF_DOWNLINK, BPF_REG_7),
+
+		/* Out of the Gn interface, to the neighbour of the route */
+		BPF_MOV64_IMM(BPF_REG_1, this->ifindex),
+		BPF_MOV64_IMM(BPF_REG_2, 0),
+		BPF_MOV64_IMM(BPF_REG_3, 0),
+		BPF_MOV64_IMM(BPF_REG_4, 0),
+		BPF_EMIT_CALL(BPF_FUNC_redirect_neigh),
+		BPF_EXIT_INSN(),
+
+		/* BPFPROG_PUNT */
+		BPF_MOV64_IMM(BPF_REG_0, TC_ACT_UNSPEC),
+		BPF_EXIT_INSN(),
+
+		/* BPFPROG_DROP */
+		BPF_MOV64_IMM(BPF_REG_0, TC_ACT_SHOT),
+		BPF_EXIT_INSN(),
+	};
+	int n = sizeof(insn) / sizeof(insn[0]);
+
+	bpfprog_fixup(insn, n, n - 4, n - 2);
+	return bpfprog_load(BPF_PROG_TYPE_SCHED_CLS, insn, n,
+			    "ggsn_downlink");
+}
+
+/* Attach prog to the ingress or egress hook of an interface. A negative
+   prog detaches */
+static int gtpbpf_tc(int ifindex, int egress, int prog)
+{
+	struct netlink_req req;
+	struct tcmsg *t = NLMSG_DATA(&req.n);
+	struct rtattr *opt;
+	uint32_t v;
+	int fd, rc;
+
+	if ((fd = netlink_socket(NETLINK_ROUTE)) < 0)
+		return -1;
+
+	/* The clsact qdisc provides the hooks. It may be there already */
+	if (prog >= 0) {
+		memset(&req, 0, sizeof(req));
+		req.n.nlmsg_len = NLMSG_LENGTH(sizeof(*t));
+		req.n.nlmsg_type = RTM_NEWQDISC;
+		req.n.nlmsg_flags = NLM_F_CREATE | NLM_F_EXCL;
+		req.n.nlmsg_seq = 1;
+		t->tcm_family = AF_UNSPEC;
+		t->tcm_ifindex = ifindex;
+		t->tcm_handle = TC_H_MAKE(TC_H_CLSACT, 0);
+		t->tcm_parent = TC_H_CLSACT;
+		netlink_attr(&req, TCA_KIND, "clsact", 7);
+		if (netlink_talk(fd, &req, NULL) && (errno != EEXIST)) {
+			sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+				"Failed to add clsact qdisc");
+			close(fd);
+			return -1;
+		}
+	}
+
+	/* Without NLM_F_EXCL a filter left by an earlier run is replaced */
+	memset(&req, 0, sizeof(req));
+	req.n.nlmsg_len = NLMSG_LENGTH(sizeof(*t));
+	req.n.nlmsg_type = (prog >= 0) ? RTM_NEWTFILTER : RTM_DELTFILTER;
+	req.n.nlmsg_flags = (prog >= 0) ? NLM_F_CREATE : 0;
+	req.n.nlmsg_seq = 2;
+	t->tcm_family = AF_UNSPEC;
+	t->tcm_ifindex = ifindex;
+	t->tcm_handle = GTPBPF_HANDLE;
+	t->tcm_parent = TC_H_MAKE(TC_H_CLSACT,
+				  egress ? TC_H_MIN_EGRESS : TC_H_MIN_INGRESS);
+	t->tcm_info = TC_H_MAKE(GTPBPF_PRIO << 16, htons(ETH_P_ALL));
+	netlink_attr(&req, TCA_KIND, "bpf", 4);
+	if (prog >= 0) {
+		opt = netlink_attr(&req, TCA_OPTIONS, NULL, 0);
+		v = prog;
+		netlink_attr(&req, TCA_BPF_FD, &v, sizeof(v));
+		netlink_attr(&req, TCA_BPF_NAME, "ggsn", 5);
+		v = TCA_BPF_FLAG_ACT_DIRECT;
+		netlink_attr(&req, TCA_BPF_FLAGS, &v, sizeof(v));
+		netlink_nest_end(&req, opt);
+	}
+	if ((rc = netlink_talk(fd, &req, NULL)))
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+			"Failed to %s tc filter of interface %d",
+			(prog >= 0) ? "add" : "delete", ifindex);
+	close(fd);
+	return rc;
+}
+
+int gtpbpf_new(struct gtpbpf_t **this, char *dev, struct in_addr *addr,
+	       int size)
+{
+	struct ifreq ifr;
+	int fd;
+
+	if (!(*this = calloc(sizeof(struct gtpbpf_t), 1))) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Failed to allocate memory for eBPF fast path");
+		return -1;
+	}
+	(*this)->addr = *addr;
+	(*this)->ul = (*this)->dl = (*this)->stats = -1;
+	(*this)->ulprog = (*this)->dlprog = -1;
+
+	if (!((*this)->ifindex = if_nametoindex(dev))) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+			"No interface %s", dev);
+		goto err;
+	}
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, dev, IFNAMSIZ);
+	ifr.ifr_name[IFNAMSIZ - 1] = 0;
+	if (((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) ||
+	    ioctl(fd, SIOCGIFMTU, &ifr)) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+			"Failed to get MTU of %s", dev);
+		if (fd >= 0)
+			close(fd);
+		goto err;
+	}
+	close(fd);
+	(*this)->mtu = ifr.ifr_mtu;
+
+	if (((*this)->ul = bpfprog_map(BPF_MAP_TYPE_HASH, sizeof(uint32_t),
+				       sizeof(struct gtpbpf_ul), size,
+				       "ggsn_uplink")) < 0 ||
+	    ((*this)->dl = bpfprog_map(BPF_MAP_TYPE_HASH, sizeof(uint32_t),
+				       sizeof(struct gtpbpf_dl), size,
+				       "ggsn_downlink")) < 0 ||
+	    ((*this)->stats = bpfprog_map(BPF_MAP_TYPE_ARRAY,
+					  sizeof(uint32_t),
+					  sizeof(struct gtpbpf_count), 2,
+					  "ggsn_stats")) < 0 ||
+	    ((*this)->ulprog = gtpbpf_ulprog(*this)) < 0 ||
+	    ((*this)->dlprog = gtpbpf_dlprog(*this)) < 0 ||
+	    gtpbpf_tc((*this)->ifindex, 0, (*this)->ulprog))
+		goto err;
+	return 0;
+
+err:
+	if ((*this)->dlprog >= 0)
+		close((*this)->dlprog);
+	if ((*this)->ulprog >= 0)
+		close((*this)->ulprog);
+	if ((*this)->stats >= 0)
+		close((*this)->stats);
+	if ((*this)->dl >= 0)
+		close((*this)->dl);
+	if ((*this)->ul >= 0)
+		close((*this)->ul);
+	free(*this);
+	return -1;
+}
+
+int gtpbpf_free(struct gtpbpf_t *this)
+{
+	int i;
+
+	gtpbpf_tc(this->ifindex, 0, -1);
+	for (i = 0; i < this->ntuns; i++)
+		gtpbpf_tc(this->tuns[i], 1, -1);
+	close(this->dlprog);
+	close(this->ulprog);
+	close(this->stats);
+	close(this->dl);
+	close(this->ul);
+	free(this->tuns);
+	free(this);
+	return 0;
+}
+
+int gtpbpf_attach(struct gtpbpf_t *this, struct tun_t *tun, int *ifindex)
+{
+	int *tuns;
+
+	if (!(*ifindex = if_nametoindex(tun->devname))) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+			"No interface %s", tun->devname);
+		return -1;
+	}
+	if (!(tuns = realloc(this->tuns, sizeof(int) * (this->ntuns + 1)))) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Failed to allocate memory for eBPF fast path");
+		return -1;
+	}
+	this->tuns = tuns;
+	if (gtpbpf_tc(*ifindex, 1, this->dlprog))
+		return -1;
+	this->tuns[this->ntuns++] = *ifindex;
+	return 0;
+}
+
+int gtpbpf_addpdp(struct gtpbpf_t *this, uint32_t i_tei, uint32_t o_tei,
+		  struct in_addr *peer, struct in_addr *ms, int ifindex)
+{
+	struct gtpbpf_ul ul;
+	struct gtpbpf_dl dl;
+	uint32_t teid = htonl(i_tei);
+
+	ul.peer = peer->s_addr;
+	ul.ue = ms->s_addr;
+	ul.ifindex = ifindex;
+	dl.peer = peer->s_addr;
+	dl.teid = htonl(o_tei);
+	if (bpfprog_update(this->ul, &teid, &ul) ||
+	    bpfprog_update(this->dl, &ms->s_addr, &dl)) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+			"Failed to add context %u to eBPF fast path", i_tei);
+		return -1;
+	}
+	return 0;
+}
+
+int gtpbpf_delpdp(struct gtpbpf_t *this, uint32_t i_tei, struct in_addr *ms)
+{
+	uint32_t teid = htonl(i_tei);
+
+	if (bpfprog_delete(this->dl, &ms->s_addr) ||
+	    bpfprog_delete(this->ul, &teid)) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+			"Failed to delete context %u from eBPF fast path",
+			i_tei);
+		return -1;
+	}
+	return 0;
+}
+
+int gtpbpf_stats(struct gtpbpf_t *this, int dir, uint64_t *packets,
+		 uint64_t *bytes)
+{
+	struct gtpbpf_count count;
+	uint32_t key = dir;
+
+	if (bpfprog_lookup(this->stats, &key, &count))
+		return -1;
+	*packets = count.packets;
+	*bytes = count.bytes;
+	return 0;
+}
+
+#else /* No eBPF */
+
+int gtpbpf_new(struct gtpbpf_t **this, char *dev, struct in_addr *addr,
+	       int size)
+{
+	sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+		"eBPF is not supported on this platform");
+	return -1;
+}
+
+int gtpbpf_free(struct gtpbpf_t *this)
+{
+	return -1;
+}
+
+int gtpbpf_attach(struct gtpbpf_t *this, struct tun_t *tun, int *ifindex)
+{
+	return -1;
+}
+
+int gtpbpf_addpdp(struct gtpbpf_t *this, uint32_t i_tei, uint32_t o_tei,
+		  struct in_addr *peer, struct in_addr *ms, int ifindex)
+{
+	return -1;
+}
+
+int gtpbpf_delpdp(struct gtpbpf_t *this, uint32_t i_tei, struct in_addr *ms)
+{
+	return -1;
+}
+
+int gtpbpf_stats(struct gtpbpf_t *this, int dir, uint64_t *packets,
+		 uint64_t *bytes)
+{
+	return -1;
+}
+
+#endif
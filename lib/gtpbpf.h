@@ -0,0 +1,77 @@
+/*
+ * eBPF fast path for GTP-U.
+ *
+ * The contents of this file may be used under the terms of the GNU
+ * General Public License Version 2, provided that the above copyright
+ * notice and this permission notice is included in all copies or
+ * substantial portions of the software.
+ *
+ */
+
+#ifndef _GTPBPF_H
+#define _GTPBPF_H
+
+/* Two tc programs carry the packets of known GTPv1 contexts past the
+   application. On ingress of the Gn interface, G-PDUs are decapsulated
+   and redirected into the tun of their context. On egress of the tun
+   interfaces, packets are encapsulated and sent out of the Gn interface.
+   The contexts are kept in hash maps that the application updates.
+
+   Everything else continues to the sockets and tuns as before: other
+   messages, GTPv0, fragments, packets with GTP extension headers,
+   packets too large for the Gn interface, and contexts not in the
+   maps. */
+
+#define GTPBPF_UPLINK   0	/* Statistics of decapsulated packets */
+#define GTPBPF_DOWNLINK 1	/* Statistics of encapsulated packets */
+
+struct gtpbpf_ul {		/* Uplink map value. Key: own TEID */
+	uint32_t peer;		/* GTP-U address of the SGSN */
+	uint32_t ue;		/* End user address */
+	uint32_t ifindex;	/* Tun of the context */
+};
+
+struct gtpbpf_dl {		/* Downlink map value. Key: end user address */
+	uint32_t peer;		/* GTP-U address of the SGSN */
+	uint32_t teid;		/* TEID of the SGSN */
+};
+
+struct gtpbpf_t {
+	int ifindex;		/* Gn interface */
+	int mtu;		/* MTU of Gn interface */
+	struct in_addr addr;	/* Own GTP-U address */
+	int ul, dl, stats;	/* Maps */
+	int ulprog, dlprog;	/* Programs */
+	int *tuns;		/* Interface index of tuns with dlprog */
+	int ntuns;
+};
+
+/* Load the programs and attach the uplink one to the Gn interface dev,
+   on which addr receives GTP-U. The maps hold size contexts */
+extern int gtpbpf_new(struct gtpbpf_t **this, char *dev,
+		      struct in_addr *addr, int size);
+
+/* Detach the programs and free the maps */
+extern int gtpbpf_free(struct gtpbpf_t *this);
+
+/* Attach the downlink program to tun. Returns its interface index in
+   ifindex, for gtpbpf_addpdp() */
+extern int gtpbpf_attach(struct gtpbpf_t *this, struct tun_t *tun,
+			 int *ifindex);
+
+/* Add or replace a context with own TEID i_tei, TEID o_tei at the SGSN
+   peer, and end user address ms on the tun with interface index ifindex */
+extern int gtpbpf_addpdp(struct gtpbpf_t *this, uint32_t i_tei,
+			 uint32_t o_tei, struct in_addr *peer,
+			 struct in_addr *ms, int ifindex);
+
+/* Delete a context */
+extern int gtpbpf_delpdp(struct gtpbpf_t *this, uint32_t i_tei,
+			 struct in_addr *ms);
+
+/* Packets and bytes of end user data of direction GTPBPF_UPLINK or
+   GTPBPF_DOWNLINK */
+extern int gtpbpf_stats(struct gtpbpf_t *this, int dir, uint64_t *packets,
+			uint64_t *bytes);
+
+#endif /* !_GTPBPF_H */
@@ -0,0 +1,260 @@
+/*
+ * GTP-U in the Linux kernel.
+ *
+ * The contents of this file may be used under the terms of the GNU
+ * General Public License Version 2, provided that the above copyright
+ * notice and this permission notice is included in all copies or
+ * substantial portions of the software.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <net/if.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <syslog.h>
+
+#if defined(__linux__) && defined(HAVE_LINUX_GTP_H)
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/genetlink.h>
+#include <linux/gtp.h>
+#include "netlink.h"
+#endif
+
+#include "tun.h"
+#include "syserr.h"
+#include "gtpkern.h"
+
+#if defined(__linux__) && defined(HAVE_LINUX_GTP_H)
+
+#define GTPKERN_HASHSIZE 1024	/* Buckets of the context hash in the kernel */
+#define GTPKERN_FAMILY "gtp"	/* Generic netlink family */
+
+/* Start a generic netlink request */
+static void gtpkern_genl(struct netlink_req *req, int family, int cmd,
+			 uint32_t seq)
+{
+	struct genlmsghdr *g = NLMSG_DATA(&req->n);
+
+	memset(req, 0, sizeof(*req));
+	req->n.nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN);
+	req->n.nlmsg_type = family;
+	req->n.nlmsg_seq = seq;
+	g->cmd = cmd;
+	g->version = 0;
+}
+
+/* Look up the family id of gtp */
+static int gtpkern_family(struct gtpkern_t *this)
+{
+	struct netlink_req req, reply;
+	struct rtattr *rta;
+	int len;
+
+	gtpkern_genl(&req, GENL_ID_CTRL, CTRL_CMD_GETFAMILY, ++this->seq);
+	netlink_attr(&req, CTRL_ATTR_FAMILY_NAME, GTPKERN_FAMILY,
+		     strlen(GTPKERN_FAMILY) + 1);
+	memset(&reply, 0, sizeof(reply));
+	if (netlink_talk(this->genl, &req, &reply)) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+			"Kernel gtp module not available");
+		return -1;
+	}
+
+	len = reply.n.nlmsg_len - NLMSG_LENGTH(GENL_HDRLEN);
+	rta = (struct rtattr *)((char *)NLMSG_DATA(&reply.n) + GENL_HDRLEN);
+	for (; RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+		if (rta->rta_type == CTRL_ATTR_FAMILY_ID) {
+			this->family = *(uint16_t *) RTA_DATA(rta);
+			return 0;
+		}
+	}
+	sys_err(LOG_ERR, __FILE__, __LINE__, 0, "No family id for gtp");
+	return -1;
+}
+
+/* Create or delete the device over rtnetlink */
+static int gtpkern_link(struct gtpkern_t *this, char *name, int fd0,
+			int fd1u, int create)
+{
+	struct netlink_req req;
+	struct ifinfomsg *ifi = NLMSG_DATA(&req.n);
+	struct rtattr *linkinfo, *data;
+	uint32_t v;
+	int fd, rc;
+
+	memset(&req, 0, sizeof(req));
+	req.n.nlmsg_len = NLMSG_LENGTH(sizeof(*ifi));
+	req.n.nlmsg_seq = ++this->seq;
+	ifi->ifi_family = AF_UNSPEC;
+
+	if (create) {
+		req.n.nlmsg_type = RTM_NEWLINK;
+		req.n.nlmsg_flags = NLM_F_CREATE | NLM_F_EXCL;
+		netlink_attr(&req, IFLA_IFNAME, name, strlen(name) + 1);
+		linkinfo = netlink_attr(&req, IFLA_LINKINFO, NULL, 0);
+		netlink_attr(&req, IFLA_INFO_KIND, "gtp", 4);
+		data = netlink_attr(&req, IFLA_INFO_DATA, NULL, 0);
+		v = fd0;
+		netlink_attr(&req, IFLA_GTP_FD0, &v, sizeof(v));
+		v = fd1u;
+		netlink_attr(&req, IFLA_GTP_FD1, &v, sizeof(v));
+		v = GTPKERN_HASHSIZE;
+		netlink_attr(&req, IFLA_GTP_PDP_HASHSIZE, &v, sizeof(v));
+		v = GTP_ROLE_GGSN;
+		netlink_attr(&req, IFLA_GTP_ROLE, &v, sizeof(v));
+		netlink_nest_end(&req, data);
+		netlink_nest_end(&req, linkinfo);
+	} else {
+		req.n.nlmsg_type = RTM_DELLINK;
+		ifi->ifi_index = this->ifindex;
+	}
+
+	if ((fd = netlink_socket(NETLINK_ROUTE)) < 0)
+		return -1;
+	rc = netlink_talk(fd, &req, NULL);
+	if (rc)
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+			"Failed to %s gtp device %s",
+			create ? "create" : "delete", this->tun->devname);
+	close(fd);
+	return rc;
+}
+
+int gtpkern_new(struct gtpkern_t **this, char *name, int fd0, int fd1u)
+{
+	if (!(*this = calloc(sizeof(struct gtpkern_t), 1)) ||
+	    !((*this)->tun = calloc(sizeof(struct tun_t), 1))) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Failed to allocate memory for gtp device");
+		free(*this);
+		return -1;
+	}
+	(*this)->tun->fd = -1;
+	strncpy((*this)->tun->devname, name, IFNAMSIZ);
+	(*this)->tun->devname[IFNAMSIZ - 1] = 0;
+	(*this)->genl = -1;
+
+	if (((*this)->genl = netlink_socket(NETLINK_GENERIC)) < 0 ||
+	    gtpkern_family(*this) ||
+	    gtpkern_link(*this, (*this)->tun->devname, fd0, fd1u, 1))
+		goto err;
+	if (!((*this)->ifindex = if_nametoindex((*this)->tun->devname))) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+			"No gtp device %s", (*this)->tun->devname);
+		goto err;
+	}
+	return 0;
+
+err:
+	if ((*this)->genl >= 0)
+		close((*this)->genl);
+	free((*this)->tun);
+	free(*this);
+	return -1;
+}
+
+int gtpkern_free(struct gtpkern_t *this)
+{
+	gtpkern_link(this, NULL, -1, -1, 0);
+	close(this->genl);
+	tun_free(this->tun);
+	free(this);
+	return 0;
+}
+
+int gtpkern_addpdp(struct gtpkern_t *this, int version, uint64_t tid,
+		   uint16_t flow, uint32_t i_tei, uint32_t o_tei,
+		   struct in_addr *peer, struct in_addr *ms)
+{
+	struct netlink_req req;
+	uint32_t v;
+
+	gtpkern_genl(&req, this->family, GTP_CMD_NEWPDP, ++this->seq);
+	v = this->ifindex;
+	netlink_attr(&req, GTPA_LINK, &v, sizeof(v));
+	v = version;
+	netlink_attr(&req, GTPA_VERSION, &v, sizeof(v));
+	netlink_attr(&req, GTPA_PEER_ADDRESS, &peer->s_addr,
+		     sizeof(peer->s_addr));
+	netlink_attr(&req, GTPA_MS_ADDRESS, &ms->s_addr, sizeof(ms->s_addr));
+	if (version == 0) {
+		netlink_attr(&req, GTPA_TID, &tid, sizeof(tid));
+		netlink_attr(&req, GTPA_FLOW, &flow, sizeof(flow));
+	} else {
+		netlink_attr(&req, GTPA_I_TEI, &i_tei, sizeof(i_tei));
+		netlink_attr(&req, GTPA_O_TEI, &o_tei, sizeof(o_tei));
+	}
+
+	/* Refused with EEXIST if the device has a context of the address
+	   and one of the tunnel. The old one is deleted first to replace it */
+	if (netlink_talk(this->genl, &req, NULL)) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+			"Failed to add context to %s", this->tun->devname);
+		return -1;
+	}
+	return 0;
+}
+
+int gtpkern_delpdp(struct gtpkern_t *this, int version, uint64_t tid,
+		   uint32_t i_tei)
+{
+	struct netlink_req req;
+	uint32_t v;
+
+	gtpkern_genl(&req, this->family, GTP_CMD_DELPDP, ++this->seq);
+	v = this->ifindex;
+	netlink_attr(&req, GTPA_LINK, &v, sizeof(v));
+	v = version;
+	netlink_attr(&req, GTPA_VERSION, &v, sizeof(v));
+	if (version == 0)
+		netlink_attr(&req, GTPA_TID, &tid, sizeof(tid));
+	else
+		netlink_attr(&req, GTPA_I_TEI, &i_tei, sizeof(i_tei));
+
+	if (netlink_talk(this->genl, &req, NULL)) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+			"Failed to delete context from %s", this->tun->devname);
+		return -1;
+	}
+	return 0;
+}
+
+#else /* No kernel gtp */
+
+int gtpkern_new(struct gtpkern_t **this, char *name, int fd0, int fd1u)
+{
+	sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+		"Kernel gtp is not supported on this platform");
+	return -1;
+}
+
+int gtpkern_free(struct gtpkern_t *this)
+{
+	return -1;
+}
+
+int gtpkern_addpdp(struct gtpkern_t *this, int version, uint64_t tid,
+		   uint16_t flow, uint32_t i_tei, uint32_t o_tei,
+		   struct in_addr *peer, struct in_addr *ms)
+{
+	return -1;
+}
+
+int gtpkern_delpdp(struct gtpkern_t *this, int version, uint64_t tid,
+		   uint32_t i_tei)
+{
+	return -1;
+}
+
+#endif
@@ -0,0 +1,52 @@
+/*
+ * GTP-U in the Linux kernel.
+ *
+ * The contents of this file may be used under the terms of the GNU
+ * General Public License Version 2, provided that the above copyright
+ * notice and this permission notice is included in all copies or
+ * substantial portions of the software.
+ *
+ */
+
+#ifndef _GTPKERN_H
+#define _GTPKERN_H
+
+/* The kernel gtp device takes the GTP-U sockets of the application.
+   G-PDUs of known contexts are decapsulated to the device, and packets
+   routed to the device are encapsulated, without passing user space.
+   Other messages, such as echo requests, are still read from the
+   sockets. Contexts are added and deleted over generic netlink.
+
+   The device is also returned as a tun_t without file descriptor, so
+   that addresses, routes and scripts of tun.c apply to it. */
+
+struct gtpkern_t {
+	struct tun_t *tun;	/* Device, with fd -1 */
+	int ifindex;		/* Interface index of device */
+	int genl;		/* Generic netlink socket */
+	int family;		/* Family id of gtp */
+	uint32_t seq;		/* Netlink sequence number */
+};
+
+/* Create the device name on the GTPv0 socket fd0 and GTPv1-U socket
+   fd1u, in the GGSN role */
+extern int gtpkern_new(struct gtpkern_t **this, char *name, int fd0,
+		       int fd1u);
+
+/* Delete the device and its contexts */
+extern int gtpkern_free(struct gtpkern_t *this);
+
+/* Add the context of end user address ms. For GTPv0 tid and flow
+   identify the tunnel, for GTPv1 the own TEID i_tei and the TEID o_tei of
+   the peer. A context of the same address and tunnel is not replaced, it
+   has to be deleted first */
+extern int gtpkern_addpdp(struct gtpkern_t *this, int version,
+			  uint64_t tid, uint16_t flow, uint32_t i_tei,
+			  uint32_t o_tei, struct in_addr *peer,
+			  struct in_addr *ms);
+
+/* Delete a context */
+extern int gtpkern_delpdp(struct gtpkern_t *this, int version,
+			  uint64_t tid, uint32_t i_tei);
+
+#endif /* !_GTPKERN_H */
@@ -20,13 +20,14 @@
 #include "syserr.h"
 #include "ippool.h"
 #include "lookup.h"
+#include "rcu.h"
 
 int ippool_printaddr(struct ippool_t *this)
 {
 	unsigned int n;
 	printf("ippool_printaddr\n");
-	printf("Firstdyn %d\n", this->firstdyn - this->member);
-	printf("Lastdyn %d\n", this->lastdyn - this->member);
+	printf("Dynsize %d\n", this->dynsize);
+	printf("Dynfree %d\n", this->dynfree);
 	printf("Firststat %d\n", this->firststat - this->member);
 	printf("Laststat %d\n", this->laststat - this->member);
 	printf("Listsize %d\n", this->listsize);
@@ -102,13 +103,26 @@ unsigned long int ippool_hash6(struct in6_addr *addr)
 }
 #endif
 
+/* Return token number in a string of networks, or NULL */
+static char *ippool_token(char *pool, int number)
+{
+	while (pool && *pool) {
+		pool += strspn(pool, " \t,");
+		if (!*pool)
+			break;
+		if (!number--)
+			return pool;
+		pool += strcspn(pool, " \t,");
+	}
+	return NULL;
+}
+
 /* Get IP address and mask */
 int ippool_aton(struct in_addr *addr, struct in_addr *mask,
 		char *pool, int number)
 {
 
-	/* Parse only first instance of network for now */
-	/* Eventually "number" will indicate the token which we want to parse */
+	/* "number" indicates the token which we want to parse */
 
 	unsigned int a1, a2, a3, a4;
 	unsigned int m1, m2, m3, m4;
@@ -116,6 +130,11 @@ int ippool_aton(struct in_addr *addr, struct in_addr *mask,
 	int m;
 	int masklog;
 
+	if (!(pool = ippool_token(pool, number))) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0, "Missing network");
+		return -1;
+	}
+
 	c = sscanf(pool, "%u.%u.%u.%u/%u.%u.%u.%u",
 		   &a1, &a2, &a3, &a4, &m1, &m2, &m3, &m4);
 	switch (c) {
@@ -158,6 +177,275 @@ int ippool_aton(struct in_addr *addr, struct in_addr *mask,
 	return 0;
 }
 
+/* Mark a dynamic address as free */
+static void ippool_dynset(struct ippool_t *this, uint32_t off)
+{
+	unsigned int w = off / 64;
+
+	this->dynbits[w] |= 1ULL << (off % 64);
+	this->dynsum[w / 64] |= 1ULL << (w % 64);
+}
+
+/* Mark a dynamic address as taken */
+static void ippool_dynclr(struct ippool_t *this, uint32_t off)
+{
+	unsigned int w = off / 64;
+
+	this->dynbits[w] &= ~(1ULL << (off % 64));
+	if (!this->dynbits[w])
+		this->dynsum[w / 64] &= ~(1ULL << (w % 64));
+}
+
+/* Find the first set bit at or after pos in a bitmap of nbits bits */
+static int ippool_findbit(uint64_t * map, unsigned int nbits,
+			  unsigned int pos)
+{
+	unsigned int w = pos / 64;
+	uint64_t bits;
+
+	if (pos >= nbits)
+		return -1;
+	bits = map[w] & (~0ULL << (pos % 64));
+	while (!bits) {
+		if (++w >= (nbits + 63) / 64)
+			return -1;
+		bits = map[w];
+	}
+	return w * 64 + __builtin_ctzll(bits);
+}
+
+/* Get the offset of a dynamic address in dynbits */
+static int ippool_dynoff(struct ippool_t *this, struct in_addr *addr,
+			 uint32_t * off)
+{
+	uint32_t a = ntohl(addr->s_addr);
+	struct ippool_index *x = __atomic_load_n(&this->index,
+						 __ATOMIC_ACQUIRE);
+	int lo = 0, hi, n;
+
+	if (!x)
+		return -1;
+	for (hi = x->n; lo < hi;) {
+		n = (lo + hi) / 2;
+		if (a < x->span[n].base)
+			hi = n;
+		else if (a - x->span[n].base >= x->span[n].size)
+			lo = n + 1;
+		else {
+			*off = x->span[n].first + a - x->span[n].base;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+/* Find a free dynamic address. The search continues from the last
+   allocation so that released addresses are not reused at once */
+static int ippool_dynfind(struct ippool_t *this, uint32_t * off)
+{
+	unsigned int w = this->dynnext / 64;
+	uint64_t bits;
+	int s;
+
+	bits = this->dynbits[w] & (~0ULL << (this->dynnext % 64));
+	if (bits) {
+		*off = w * 64 + __builtin_ctzll(bits);
+		return 0;
+	}
+
+	s = ippool_findbit(this->dynsum, this->dynwords, w + 1);
+	if (s < 0)
+		s = ippool_findbit(this->dynsum, this->dynwords, 0);
+	if (s < 0)
+		return -1;
+	*off = s * 64 + __builtin_ctzll(this->dynbits[s]);
+	return 0;
+}
+
+/* Return the member for a dynamic address, allocating its page */
+static struct ippoolm_t *ippool_dynmember(struct ippool_t *this,
+					  uint32_t off)
+{
+	struct ippoolm_t **page = &this->dynpage[off >> IPPOOL_PAGELOG];
+	uint32_t first = off & ~(IPPOOL_PAGESIZE - 1);
+	struct ippool_range *r;
+	struct ippoolm_t *p;
+	unsigned int i;
+
+	if (!*page) {
+		if (!(p = calloc(sizeof(struct ippoolm_t), IPPOOL_PAGESIZE))) {
+			sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+				"Failed to allocate memory for ippool page");
+			return NULL;
+		}
+		/* Ranges start on a page, so a page is within one range */
+		for (r = this->range; first - r->first >= r->size; r++) ;
+		for (i = 0; (i < IPPOOL_PAGESIZE) &&
+		     (first + i - r->first < r->size); i++)
+			p[i].addr.s_addr = htonl(r->base + first + i - r->first);
+		/* Readers see the page filled in */
+		__atomic_store_n(page, p, __ATOMIC_RELEASE);
+	}
+	return &(*page)[off & (IPPOOL_PAGESIZE - 1)];
+}
+
+/* Add a dynamic range. Returns 1 if the range is already in the pool */
+static int ippool_addrange(struct ippool_t *this, struct in_addr *net,
+			   struct in_addr *mask)
+{
+	struct ippool_range *r;
+	uint32_t base, size, first, end, off;
+	unsigned int words, sums, pages;
+	unsigned int owords, osums, opages;
+	uint64_t *bits;
+	struct ippoolm_t **page;
+	struct ippool_index *index;
+	int n, i;
+
+	base = ntohl(net->s_addr) & ntohl(mask->s_addr);
+	size = ~ntohl(mask->s_addr) + 1;
+	for (n = 0; n < this->nranges; n++) {
+		r = &this->range[n];
+		if ((r->net.s_addr == net->s_addr) &&
+		    (r->mask.s_addr == mask->s_addr))
+			return 1;
+		if (((ntohl(r->net.s_addr) & ntohl(mask->s_addr)) == base) ||
+		    ((base & ntohl(r->mask.s_addr)) ==
+		     (ntohl(r->net.s_addr) & ntohl(r->mask.s_addr)))) {
+			sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+				"Dynamic range overlaps existing range");
+			return -1;
+		}
+	}
+
+	if (this->flags & IPPOOL_NONETWORK) {	/* Exclude network address from pool */
+		base++;
+		size--;
+	}
+	if (this->flags & IPPOOL_NOGATEWAY) {	/* Exclude gateway address from pool */
+		base++;
+		size--;
+	}
+	if (this->flags & IPPOOL_NOBROADCAST)	/* Exclude broadcast address from pool */
+		size--;
+	if ((int32_t) size <= 0) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Dynamic range too small");
+		return -1;
+	}
+
+	/* Start on a new page, so that a page is within one range */
+	first = (this->dynsize + IPPOOL_PAGESIZE - 1) & ~(IPPOOL_PAGESIZE - 1);
+	end = first + size;
+	if (end < first) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Dynamic ranges too large");
+		return -1;
+	}
+
+	/* Grow bitmaps and page directory. Allocated members are in pages
+	   which do not move, so existing allocations are left alone */
+	owords = this->dynbits ? this->dynwords + 1 : 0;
+	osums = this->dynsum ? this->dynwords / 64 + 1 : 0;
+	opages = this->dynpage ? (this->dynsize >> IPPOOL_PAGELOG) + 1 : 0;
+	words = (end + 63) / 64 + 1;
+	sums = (end + 63) / 64 / 64 + 1;
+	pages = (end >> IPPOOL_PAGELOG) + 1;
+
+	/* Range array and page directory are read by lookups in other
+	   threads, so the old ones are freed after a grace period */
+	if (!(r = rcu_realloc(this->range,
+			      sizeof(struct ippool_range) * this->nranges,
+			      sizeof(struct ippool_range) *
+			      (this->nranges + 1))))
+		goto nomem;
+	r[this->nranges].net = *net;
+	r[this->nranges].mask = *mask;
+	r[this->nranges].base = base;
+	r[this->nranges].size = size;
+	r[this->nranges].first = first;
+	this->range = r;
+	if (!(bits = realloc(this->dynbits, sizeof(uint64_t) * words)))
+		goto nomem;
+	memset(bits + owords, 0, sizeof(uint64_t) * (words - owords));
+	this->dynbits = bits;
+	if (!(bits = realloc(this->dynsum, sizeof(uint64_t) * sums)))
+		goto nomem;
+	memset(bits + osums, 0, sizeof(uint64_t) * (sums - osums));
+	this->dynsum = bits;
+	if (!(page = rcu_realloc(this->dynpage,
+				 sizeof(struct ippoolm_t *) * opages,
+				 sizeof(struct ippoolm_t *) * pages)))
+		goto nomem;
+	memset(page + opages, 0, sizeof(struct ippoolm_t *) * (pages - opages));
+	this->dynpage = page;
+
+	/* The index is built anew with the range in its place */
+	if (!(index = malloc(sizeof(struct ippool_index) +
+			     sizeof(index->span[0]) * (this->nranges + 1))))
+		goto nomem;
+	for (i = 0; (i < this->nranges) &&
+	     (this->index->span[i].base < base); i++)
+		index->span[i] = this->index->span[i];
+	for (n = i; n < this->nranges; n++)
+		index->span[n + 1] = this->index->span[n];
+	index->span[i].base = base;
+	index->span[i].size = size;
+	index->span[i].first = first;
+	index->n = this->nranges + 1;
+
+	/* Publish the range after the arrays covering it */
+	rcu_free(this->index);
+	__atomic_store_n(&this->index, index, __ATOMIC_RELEASE);
+	__atomic_store_n(&this->nranges, this->nranges + 1, __ATOMIC_RELEASE);
+	this->dynsize = end;
+	this->dynwords = (end + 63) / 64;
+	this->dynfree += size;
+
+	/* Mark the new addresses free, a word at a time where possible */
+	for (off = first; off < end;) {
+		if (!(off % 64) && (off + 64 <= end)) {
+			this->dynbits[off / 64] = ~0ULL;
+			off += 64;
+		} else {
+			this->dynbits[off / 64] |= 1ULL << (off % 64);
+			off++;
+		}
+	}
+	for (off = first / 64; off < this->dynwords; off++)
+		this->dynsum[off / 64] |= 1ULL << (off % 64);
+	return 0;
+
+      nomem:
+	sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+		"Failed to allocate memory for dynamic range");
+	return -1;
+}
+
+/* Add the dynamic ranges in dyn that are not already in the pool */
+int ippool_grow(struct ippool_t *this, char *dyn)
+{
+	struct in_addr addr;
+	struct in_addr mask;
+	int added = 0;
+	int n;
+
+	for (n = 0; ippool_token(dyn, n); n++) {
+		if (ippool_aton(&addr, &mask, dyn, n))
+			return -1;
+		switch (ippool_addrange(this, &addr, &mask)) {
+		case 0:
+			added++;
+			break;
+		case 1:	/* Already in pool */
+			break;
+		default:
+			return -1;
+		}
+	}
+	return added;
+}
+
 /* Create new address pool */
 int ippool_new(struct ippool_t **this, char *dyn, char *stat,
 	       int allowdyn, int allowstat, int flags)
@@ -166,37 +454,15 @@ int ippool_new(struct ippool_t **this, char *dyn, char *stat,
 	/* Parse only first instance of pool for now */
 
 	int i;
-	struct in_addr addr;
-	struct in_addr mask;
 	struct in_addr stataddr;
 	struct in_addr statmask;
 	unsigned int m;
 	int listsize;
-	int dynsize;
 	unsigned int statsize;
 
-	if (!allowdyn) {
-		dynsize = 0;
-	} else {
-		if (ippool_aton(&addr, &mask, dyn, 0)) {
-			sys_err(LOG_ERR, __FILE__, __LINE__, 0,
-				"Failed to parse dynamic pool");
-			return -1;
-		}
-
-		/* Set IPPOOL_NONETWORK if IPPOOL_NOGATEWAY is set */
-		if (flags & IPPOOL_NOGATEWAY) {
-			flags |= IPPOOL_NONETWORK;
-		}
-
-		m = ntohl(mask.s_addr);
-		dynsize = ((~m) + 1);
-		if (flags & IPPOOL_NONETWORK)	/* Exclude network address from pool */
-			dynsize--;
-		if (flags & IPPOOL_NOGATEWAY)	/* Exclude gateway address from pool */
-			dynsize--;
-		if (flags & IPPOOL_NOBROADCAST)	/* Exclude broadcast address from pool */
-			dynsize--;
+	/* Set IPPOOL_NONETWORK if IPPOOL_NOGATEWAY is set */
+	if (flags & IPPOOL_NOGATEWAY) {
+		flags |= IPPOOL_NONETWORK;
 	}
 
 	if (!allowstat) {
@@ -216,7 +482,7 @@ int ippool_new(struct ippool_t **this, char *dyn, char *stat,
 			statsize = IPPOOL_STATSIZE;
 	}
 
-	listsize = dynsize + statsize;	/* Allocate space for static IP addresses */
+	listsize = statsize;	/* Allocate space for static IP addresses */
 
 	if (!(*this = calloc(sizeof(struct ippool_t), 1))) {
 		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
@@ -230,7 +496,8 @@ int ippool_new(struct ippool_t **this, char *dyn, char *stat,
 	(*this)->statmask = statmask;
 
 	(*this)->listsize += listsize;
-	if (!((*this)->member = calloc(sizeof(struct ippoolm_t), listsize))) {
+	if (!((*this)->member = calloc(sizeof(struct ippoolm_t), listsize)) &&
+	    listsize) {
 		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
 			"Failed to allocate memory for members in ippool");
 		return -1;
@@ -254,38 +521,18 @@ int ippool_new(struct ippool_t **this, char *dyn, char *stat,
 		return -1;
 	}
 
-	(*this)->firstdyn = NULL;
-	(*this)->lastdyn = NULL;
-	for (i = 0; i < dynsize; i++) {
-
-		if (flags & IPPOOL_NOGATEWAY)
-			(*this)->member[i].addr.s_addr =
-			    htonl(ntohl(addr.s_addr) + i + 2);
-		else if (flags & IPPOOL_NONETWORK)
-			(*this)->member[i].addr.s_addr =
-			    htonl(ntohl(addr.s_addr) + i + 1);
-		else
-			(*this)->member[i].addr.s_addr =
-			    htonl(ntohl(addr.s_addr) + i);
-
-		(*this)->member[i].inuse = 0;
-
-		/* Insert into list of unused */
-		(*this)->member[i].prev = (*this)->lastdyn;
-		if ((*this)->lastdyn) {
-			(*this)->lastdyn->next = &((*this)->member[i]);
-		} else {
-			(*this)->firstdyn = &((*this)->member[i]);
-		}
-		(*this)->lastdyn = &((*this)->member[i]);
-		(*this)->member[i].next = NULL;	/* Redundant */
-
-		(void)ippool_hashadd(*this, &(*this)->member[i]);
+	/* Add dynamic ranges. Members are allocated by
+	   ippool_dynmember() as addresses are handed out */
+	(*this)->flags = flags;
+	if (allowdyn && (ippool_grow(*this, dyn) <= 0)) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Failed to parse dynamic pool");
+		return -1;
 	}
 
 	(*this)->firststat = NULL;
 	(*this)->laststat = NULL;
-	for (i = dynsize; i < listsize; i++) {
+	for (i = 0; i < listsize; i++) {
 
 		(*this)->member[i].addr.s_addr = 0;
 		(*this)->member[i].inuse = 0;
@@ -309,6 +556,16 @@ int ippool_new(struct ippool_t **this, char *dyn, char *stat,
 /* Delete existing address pool */
 int ippool_free(struct ippool_t *this)
 {
+	unsigned int n;
+
+	if (this->dynpage)
+		for (n = 0; n <= (this->dynsize >> IPPOOL_PAGELOG); n++)
+			free(this->dynpage[n]);
+	free(this->dynpage);
+	free(this->dynsum);
+	free(this->dynbits);
+	free(this->range);
+	free(this->index);
 	free(this->hash);
 	free(this->member);
 	free(this);
@@ -321,6 +578,21 @@ int ippool_getip(struct ippool_t *this, struct ippoolm_t **member,
 {
 	struct ippoolm_t *p;
 	uint32_t hash;
+	uint32_t off;
+
+	/* The dynamic range is contiguous, so its members are indexed
+	   directly by offset. Only static addresses need the hash table */
+	if (!ippool_dynoff(this, addr, &off)) {
+		p = this->dynpage[off >> IPPOOL_PAGELOG];
+		if (p && (p += off & (IPPOOL_PAGESIZE - 1))->inuse) {
+			if (member)
+				*member = p;
+			return 0;
+		}
+		if (member)
+			*member = NULL;
+		return -1;
+	}
 
 	/* Find in hash table */
 	hash = ippool_hash4(addr) & this->hashmask;
@@ -337,6 +609,16 @@ int ippool_getip(struct ippool_t *this, struct ippoolm_t **member,
 	return -1;
 }
 
+void ippool_prefetch(struct ippool_t *this, struct in_addr *addr)
+{
+	struct ippoolm_t *p;
+	uint32_t off;
+
+	if (!ippool_dynoff(this, addr, &off) &&
+	    (p = this->dynpage[off >> IPPOOL_PAGELOG]))
+		__builtin_prefetch(p + (off & (IPPOOL_PAGESIZE - 1)));
+}
+
 /**
  * ippool_newip
  * Get an IP address. If addr = 0.0.0.0 get a dynamic IP address. Otherwise
@@ -347,9 +629,8 @@ int ippool_getip(struct ippool_t *this, struct ippoolm_t **member,
 int ippool_newip(struct ippool_t *this, struct ippoolm_t **member,
 		 struct in_addr *addr, int statip)
 {
-	struct ippoolm_t *p;
 	struct ippoolm_t *p2 = NULL;
-	uint32_t hash;
+	uint32_t off;
 
 	/* If static:
 	 *   Look in dynaddr. 
@@ -389,14 +670,9 @@ int ippool_newip(struct ippool_t *this, struct ippoolm_t **member,
 
 	/* If IP address given try to find it in dynamic address pool */
 	if ((addr) && (addr->s_addr)) {	/* IP address given */
-		/* Find in hash table */
-		hash = ippool_hash4(addr) & this->hashmask;
-		for (p = this->hash[hash]; p; p = p->nexthash) {
-			if ((p->addr.s_addr == addr->s_addr)) {
-				p2 = p;
-				break;
-			}
-		}
+		if (!ippool_dynoff(this, addr, &off) &&
+		    !(p2 = ippool_dynmember(this, off)))
+			return -1;
 	}
 
 	/* If IP was already allocated we can not use it */
@@ -406,12 +682,13 @@ int ippool_newip(struct ippool_t *this, struct ippoolm_t **member,
 
 	/* If not found yet and dynamic IP then allocate dynamic IP */
 	if ((!p2) && (!statip)) {
-		if (!this->firstdyn) {
+		if (ippool_dynfind(this, &off)) {
 			sys_err(LOG_ERR, __FILE__, __LINE__, 0,
 				"No more IP addresses available");
 			return -1;
-		} else
-			p2 = this->firstdyn;
+		}
+		if (!(p2 = ippool_dynmember(this, off)))
+			return -1;
 	}
 
 	if (p2) {		/* Was allocated from dynamic address pool */
@@ -421,18 +698,12 @@ int ippool_newip(struct ippool_t *this, struct ippoolm_t **member,
 			return -1;	/* Allready in use / Should not happen */
 		}
 
-		/* Remove from linked list of free dynamic addresses */
-		if (p2->prev)
-			p2->prev->next = p2->next;
-		else
-			this->firstdyn = p2->next;
-		if (p2->next)
-			p2->next->prev = p2->prev;
-		else
-			this->lastdyn = p2->prev;
-		p2->next = NULL;
-		p2->prev = NULL;
+		/* Remove from bitmap of free dynamic addresses */
+		(void)ippool_dynoff(this, &p2->addr, &off);
+		ippool_dynclr(this, off);
+		this->dynnext = (off + 1 < this->dynsize) ? off + 1 : 0;
 		p2->inuse = 1;	/* Dynamic address in use */
+		this->dynfree--;
 
 		*member = p2;
 		if (0)
@@ -478,6 +749,7 @@ int ippool_newip(struct ippool_t *this, struct ippoolm_t **member,
 
 int ippool_freeip(struct ippool_t *this, struct ippoolm_t *member)
 {
+	uint32_t off;
 
 	if (0)
 		(void)ippool_printaddr(this);
@@ -492,14 +764,11 @@ int ippool_freeip(struct ippool_t *this, struct ippoolm_t *member)
 		sys_err(LOG_ERR, __FILE__, __LINE__, 0, "Address not in use");
 		return -1;
 	case 1:		/* Allocated from dynamic address space */
-		/* Insert into list of unused */
-		member->prev = this->lastdyn;
-		if (this->lastdyn) {
-			this->lastdyn->next = member;
-		} else {
-			this->firstdyn = member;
-		}
-		this->lastdyn = member;
+		/* Insert into bitmap of unused */
+		if (ippool_dynoff(this, &member->addr, &off))
+			return -1;	/* Should not happen */
+		ippool_dynset(this, off);
+		this->dynfree++;
 
 		member->inuse = 0;
 		member->peer = NULL;
@@ -537,3 +806,242 @@ extern unsigned long int ippool_hash6(struct in6_addr *addr);
 extern int ippool_getip6(struct ippool_t *this, struct in6_addr *addr);
 extern int ippool_returnip6(struct ippool_t *this, struct in6_addr *addr);
 #endif
+
+/* Hash a host order /64 prefix into a table of 1 << hashlog entries */
+static unsigned int ippool6_hash(uint64_t prefix, int hashlog)
+{
+	return (prefix * 0x9e3779b97f4a7c15ULL) >> (64 - hashlog);
+}
+
+/* Get the host order upper 64 bits of an address */
+static uint64_t ippool6_prefix(struct in6_addr *addr)
+{
+	uint64_t prefix = 0;
+	int i;
+
+	for (i = 0; i < 8; i++)
+		prefix = (prefix << 8) | addr->s6_addr[i];
+	return prefix;
+}
+
+static struct ippool6_hash *ippool6_newhash(int hashlog, int link)
+{
+	struct ippool6_hash *hash;
+
+	if (!(hash = calloc(sizeof(struct ippool6_hash) +
+			    (sizeof(struct ippool6m_t *) << hashlog), 1))) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Failed to allocate memory for ippool6 hash");
+		return NULL;
+	}
+	hash->hashlog = hashlog;
+	hash->link = link;
+	return hash;
+}
+
+/* Wait for a grace period, after which members released before it are
+   no longer read by lookups, and nothing reads the table before the
+   current one */
+static void ippool6_grace(struct ippool6_t *this)
+{
+	rcu_synchronize();
+	this->recent = NULL;
+}
+
+/* Double the hash table when it holds more members than entries. The
+   members are chained through the nexthash that the old table does not
+   use, which was last used by the table before it */
+static int ippool6_rehash(struct ippool6_t *this)
+{
+	struct ippool6_hash *old = this->hash, *hash;
+	struct ippool6m_t *p;
+	unsigned int n, h;
+
+	ippool6_grace(this);
+	if (!(hash = ippool6_newhash(old->hashlog + 1, !old->link)))
+		return -1;
+	for (n = 0; n < (1U << old->hashlog); n++) {
+		for (p = old->entry[n]; p; p = p->nexthash[old->link]) {
+			h = ippool6_hash(p->prefix, hash->hashlog);
+			p->nexthash[hash->link] = hash->entry[h];
+			hash->entry[h] = p;
+		}
+	}
+	/* The chains are complete before the table is published */
+	__atomic_store_n(&this->hash, hash, __ATOMIC_RELEASE);
+	rcu_free(old);
+	return 0;
+}
+
+/* Create new IPv6 prefix pool */
+int ippool6_new(struct ippool6_t **this, char *pool)
+{
+	char buf[INET6_ADDRSTRLEN];
+	struct in6_addr net;
+	unsigned int len;
+	char *slash;
+
+	if (!(slash = strchr(pool, '/')) ||
+	    ((size_t)(slash - pool) >= sizeof(buf)) ||
+	    (sscanf(slash + 1, "%u", &len) != 1)) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Invalid IPv6 prefix: %s", pool);
+		return -1;
+	}
+	memcpy(buf, pool, slash - pool);
+	buf[slash - pool] = 0;
+	if (inet_pton(AF_INET6, buf, &net) != 1) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Invalid IPv6 address: %s", buf);
+		return -1;
+	}
+	if ((len < 32) || (len > 64)) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"IPv6 prefix length must be 32 to 64: %u", len);
+		return -1;
+	}
+
+	if (!(*this = calloc(sizeof(struct ippool6_t), 1))) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Failed to allocate memory for ippool6");
+		return -1;
+	}
+	if (!((*this)->hash = ippool6_newhash(IPPOOL6_HASHLOG, 0))) {
+		free(*this);
+		return -1;
+	}
+	(*this)->net = net;
+	(*this)->prefixlen = len;
+	(*this)->size = 1ULL << (64 - len);
+	(*this)->base = ippool6_prefix(&net) & ~((*this)->size - 1);
+	(*this)->free = (*this)->size;
+	return 0;
+}
+
+/* Delete existing IPv6 prefix pool */
+int ippool6_free(struct ippool6_t *this)
+{
+	struct ippool6_hash *hash = this->hash;
+	struct ippool6m_t *p, *next;
+	unsigned int n;
+
+	for (n = 0; n < (1U << hash->hashlog); n++)
+		for (p = hash->entry[n]; p; p = next) {
+			next = p->nexthash[hash->link];
+			free(p);
+		}
+	for (p = this->firstfree; p; p = next) {
+		next = p->next;
+		free(p);
+	}
+	free(this->hash);
+	free(this);
+	return 0;		/* Always OK */
+}
+
+/* Find the member holding the /64 prefix of addr */
+int ippool6_getip(struct ippool6_t *this, struct ippool6m_t **member,
+		  struct in6_addr *addr)
+{
+	uint64_t prefix = ippool6_prefix(addr);
+	struct ippool6_hash *hash = __atomic_load_n(&this->hash,
+						    __ATOMIC_ACQUIRE);
+	struct ippool6m_t *p;
+
+	for (p = __atomic_load_n(&hash->entry[ippool6_hash(prefix,
+							   hash->hashlog)],
+				 __ATOMIC_ACQUIRE); p;
+	     p = __atomic_load_n(&p->nexthash[hash->link], __ATOMIC_ACQUIRE)) {
+		if (p->prefix == prefix) {
+			if (member)
+				*member = p;
+			return 0;
+		}
+	}
+	if (member)
+		*member = NULL;
+	return -1;
+}
+
+/* Get a free /64 prefix. Prefixes never handed out are used first, so
+   that released prefixes are not reused at once */
+int ippool6_newip(struct ippool6_t *this, struct ippool6m_t **member)
+{
+	struct ippool6_hash *hash;
+	struct ippool6m_t *p;
+	unsigned int h;
+	int i;
+
+	if ((this->count >= (1U << this->hash->hashlog)) &&
+	    (this->hash->hashlog < 30))
+		(void)ippool6_rehash(this);
+	hash = this->hash;
+
+	if (this->used < this->size) {
+		if (!(p = calloc(sizeof(struct ippool6m_t), 1))) {
+			sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+				"Failed to allocate memory for ippool6 member");
+			return -1;
+		}
+		p->prefix = this->base + this->used++;
+		for (i = 0; i < 8; i++)
+			p->addr.s6_addr[i] = p->prefix >> (56 - 8 * i);
+	} else if ((p = this->firstfree)) {
+		/* Lookups may still follow its nexthash */
+		if (p == this->recent)
+			ippool6_grace(this);
+		if (!(this->firstfree = p->next))
+			this->lastfree = NULL;
+		p->next = NULL;
+	} else {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"No more IPv6 prefixes available");
+		return -1;
+	}
+
+	p->inuse = 1;
+	h = ippool6_hash(p->prefix, hash->hashlog);
+	p->nexthash[hash->link] = hash->entry[h];
+	__atomic_store_n(&hash->entry[h], p, __ATOMIC_RELEASE);
+	this->count++;
+	this->free--;
+	*member = p;
+	return 0;
+}
+
+/* Return a previously allocated prefix */
+int ippool6_freeip(struct ippool6_t *this, struct ippool6m_t *member)
+{
+	struct ippool6_hash *hash = this->hash;
+	struct ippool6m_t **pp;
+
+	if (!member->inuse) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0, "Prefix not in use");
+		return -1;
+	}
+
+	for (pp = &hash->entry[ippool6_hash(member->prefix, hash->hashlog)];
+	     *pp != member; pp = &(*pp)->nexthash[hash->link]) {
+		if (!*pp) {
+			sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+				"Prefix not in hash table");
+			return -1;
+		}
+	}
+	/* Its nexthash is left for lookups standing on it */
+	__atomic_store_n(pp, member->nexthash[hash->link], __ATOMIC_RELEASE);
+	this->count--;
+
+	/* Insert into list of unused */
+	if (this->lastfree)
+		this->lastfree->next = member;
+	else
+		this->firstfree = member;
+	this->lastfree = member;
+	if (!this->recent)
+		this->recent = member;
+	this->free++;
+	member->inuse = 0;
+	member->peer = NULL;
+	return 0;
+}
@@ -24,6 +24,18 @@
 
    The above also applies to IPv6 which can be specified as described
    in RFC2373.
+
+   Each dynamic range is a CIDR network, so its members are looked up
+   by offset from the base of the range, found by binary search of the
+   ranges sorted by address. Only static addresses, which
+   are assigned as they are requested, are kept in the hash table.
+   Ranges can be added with ippool_grow() while the pool is in use.
+
+   Free dynamic addresses are tracked in a bitmap with one bit per
+   address, and a summary bitmap with one bit per bitmap word that has
+   a free address. Dynamic members are allocated a page at a time when
+   an address in the page is first handed out, so a large pool costs
+   little more than its bitmap until it fills up.
 */
 
 #define IPPOOL_NOIP6
@@ -34,23 +46,54 @@
 
 #define IPPOOL_STATSIZE 0x10000
 
+#define IPPOOL_PAGELOG  8	/* Log2 of dynamic members per page */
+#define IPPOOL_PAGESIZE (1 << IPPOOL_PAGELOG)
+
 struct ippoolm_t;		/* Forward declaration */
 
+struct ippool_range {
+	struct in_addr net;	/* Network address as configured */
+	struct in_addr mask;	/* Network mask as configured */
+	uint32_t base;		/* Host order address of first member */
+	uint32_t size;		/* Number of addresses */
+	uint32_t first;		/* Offset of first member in dynbits */
+};
+
+/* Dynamic ranges sorted by address, for lookups by binary search. A
+   new index replaces the old one as a whole when a range is added */
+struct ippool_index {
+	int n;			/* Number of ranges */
+	struct {
+		uint32_t base;	/* Host order address of first member */
+		uint32_t size;	/* Number of addresses */
+		uint32_t first;	/* Offset of first member in dynbits */
+	} span[];
+};
+
 struct ippool_t {
-	unsigned int listsize;	/* Total number of addresses */
+	unsigned int listsize;	/* Number of static addresses */
 	int allowdyn;		/* Allow dynamic IP address allocation */
 	int allowstat;		/* Allow static IP address allocation */
 	struct in_addr stataddr;	/* Static address range network address */
 	struct in_addr statmask;	/* Static address range network mask */
-	struct ippoolm_t *member;	/* Listsize array of members */
+	struct ippoolm_t *member;	/* Listsize array of static members */
 	unsigned int hashsize;	/* Size of hash table */
 	int hashlog;		/* Log2 size of hash table */
 	int hashmask;		/* Bitmask for calculating hash */
 	struct ippoolm_t **hash;	/* Hashsize array of pointer to member */
-	struct ippoolm_t *firstdyn;	/* Pointer to first free dynamic member */
-	struct ippoolm_t *lastdyn;	/* Pointer to last free dynamic member */
 	struct ippoolm_t *firststat;	/* Pointer to first free static member */
 	struct ippoolm_t *laststat;	/* Pointer to last free static member */
+	int flags;		/* IPPOOL_NONETWORK etc. for dynamic ranges */
+	struct ippool_range *range;	/* Nranges array of dynamic ranges */
+	int nranges;		/* Number of dynamic ranges */
+	struct ippool_index *index;	/* Ranges sorted by address */
+	unsigned int dynfree;	/* Number of free dynamic addresses */
+	unsigned int dynsize;	/* Number of dynamic offsets */
+	unsigned int dynwords;	/* Number of words in dynbits */
+	uint64_t *dynbits;	/* One bit per free dynamic address */
+	uint64_t *dynsum;	/* One bit per dynbits word with a free bit */
+	uint32_t dynnext;	/* Offset to start the next search from */
+	struct ippoolm_t **dynpage;	/* Pages of dynamic members */
 };
 
 struct ippoolm_t {
@@ -66,8 +109,9 @@ struct ippoolm_t {
 };
 
 /* The above structures require approximately 20+4 = 24 bytes for
-   each address (IPv4). For IPv6 the corresponding value is 32+4 = 36
-   bytes for each address. */
+   each static address or dynamic address in an allocated page (IPv4).
+   For IPv6 the corresponding value is 32+4 = 36 bytes for each
+   address. Dynamic addresses in pages not yet allocated cost one bit. */
 
 /* Hash an IP address using code based on Bob Jenkins lookupa */
 extern unsigned long int ippool_hash4(struct in_addr *addr);
@@ -76,6 +120,10 @@ extern unsigned long int ippool_hash4(struct in_addr *addr);
 extern int ippool_new(struct ippool_t **this, char *dyn, char *stat,
 		      int allowdyn, int allowstat, int flags);
 
+/* Add the dynamic ranges in dyn that are not already in the pool.
+   Returns the number of ranges added */
+extern int ippool_grow(struct ippool_t *this, char *dyn);
+
 /* Delete existing address pool */
 extern int ippool_free(struct ippool_t *this);
 
@@ -83,6 +131,10 @@ extern int ippool_free(struct ippool_t *this);
 extern int ippool_getip(struct ippool_t *this, struct ippoolm_t **member,
 			struct in_addr *addr);
 
+/* Start loading the member of a dynamic address into the cache, ahead
+   of ippool_getip() */
+extern void ippool_prefetch(struct ippool_t *this, struct in_addr *addr);
+
 /* Get an IP address. If addr = 0.0.0.0 get a dynamic IP address. Otherwise
    check to see if the given address is available */
 extern int ippool_newip(struct ippool_t *this, struct ippoolm_t **member,
@@ -101,4 +153,61 @@ extern int ippool_getip6(struct ippool_t *this, struct in6_addr *addr);
 extern int ippool_returnip6(struct ippool_t *this, struct in6_addr *addr);
 #endif
 
+/* IPv6 prefix pool. Each member is a /64 prefix, and only the upper
+   64 bits of an address are used to find it. Members are allocated as
+   prefixes are handed out, so the pool can be as large as a /32, and
+   are found through a hash of the 64 bit prefix.
+
+   Lookups take no lock. When the hash table grows, the new one is
+   chained through the other nexthash of the members, so that lookups
+   in the old table can go on. Members that are freed keep their
+   nexthash, and are handed out again only after a grace period. */
+
+#define IPPOOL6_HASHLOG 10	/* Initial log2 size of hash table */
+
+struct ippool6m_t {
+	struct in6_addr addr;	/* Prefix of this member */
+	uint64_t prefix;	/* Host order upper 64 bits of addr */
+	int inuse;		/* 0=available; 1=dynamic */
+	struct ippool6m_t *nexthash[2];	/* Chains of current and old table */
+	struct ippool6m_t *next;	/* Linked list of free members */
+	void *peer;		/* Pointer to peer protocol handler */
+};
+
+struct ippool6_hash {
+	int hashlog;		/* Log2 size of table */
+	int link;		/* Nexthash of members used by the chains */
+	struct ippool6m_t *entry[];	/* Chains of members */
+};
+
+struct ippool6_t {
+	struct in6_addr net;	/* Network address as configured */
+	int prefixlen;		/* Prefix length as configured */
+	uint64_t base;		/* Host order first /64 prefix */
+	uint64_t size;		/* Number of /64 prefixes */
+	uint64_t used;		/* Prefixes handed out at least once */
+	uint64_t free;		/* Number of free prefixes */
+	unsigned int count;	/* Members in hash table */
+	struct ippool6_hash *hash;	/* Replaced as a whole when it grows */
+	struct ippool6m_t *firstfree;	/* First released member */
+	struct ippool6m_t *lastfree;	/* Last released member */
+	struct ippool6m_t *recent;	/* First released since a grace period */
+};
+
+/* Create new IPv6 prefix pool from a string such as "2001:db8::/48" */
+extern int ippool6_new(struct ippool6_t **this, char *pool);
+
+/* Delete existing IPv6 prefix pool */
+extern int ippool6_free(struct ippool6_t *this);
+
+/* Find the member holding the /64 prefix of addr */
+extern int ippool6_getip(struct ippool6_t *this, struct ippool6m_t **member,
+			 struct in6_addr *addr);
+
+/* Get a free /64 prefix */
+extern int ippool6_newip(struct ippool6_t *this, struct ippool6m_t **member);
+
+/* Return a previously allocated prefix */
+extern int ippool6_freeip(struct ippool6_t *this, struct ippool6m_t *member);
+
 #endif /* !_IPPOOL_H */
@@ -0,0 +1,307 @@
+/*
+ * IPv4 longest prefix match table.
+ *
+ * The contents of this file may be used under the terms of the GNU
+ * General Public License Version 2, provided that the above copyright
+ * notice and this permission notice is included in all copies or
+ * substantial portions of the software.
+ *
+ */
+
+#include <sys/types.h>
+#include <netinet/in.h>		/* in_addr */
+#include <stdlib.h>		/* calloc */
+#include <string.h>
+#include <syslog.h>
+#include "syserr.h"
+#include "rcu.h"
+#include "lpm.h"
+
+#define LPM_ENTRY(len, value) (LPM_VALID | ((uint32_t)(len) << 24) | (value))
+
+/* Create new table */
+int lpm_new(struct lpm_t **this, unsigned int maxgroups)
+{
+	if ((maxgroups == 0) || (maxgroups > LPM_VALUE(~0U))) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Invalid number of lpm groups: %u", maxgroups);
+		return -1;
+	}
+
+	if (!(*this = calloc(sizeof(struct lpm_t), 1)) ||
+	    !((*this)->tbl24 = calloc(sizeof(uint32_t), 1 << 24)) ||
+	    !((*this)->freegroup = calloc(sizeof(unsigned int), maxgroups))) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Failed to allocate memory for lpm table");
+		if (*this)
+			free((*this)->tbl24);
+		free(*this);
+		return -1;
+	}
+	(*this)->maxgroups = maxgroups;
+	return 0;
+}
+
+/* Delete existing table */
+int lpm_free(struct lpm_t *this)
+{
+	free(this->rule);
+	free(this->freegroup);
+	free(this->tbl8);
+	free(this->tbl24);
+	free(this);
+	return 0;		/* Always OK */
+}
+
+/* Find a rule. Returns its index or -1 */
+static int lpm_findrule(struct lpm_t *this, uint32_t net, int len)
+{
+	unsigned int n;
+
+	for (n = 0; n < this->nrules; n++)
+		if ((this->rule[n].len == len) && (this->rule[n].net == net))
+			return n;
+	return -1;
+}
+
+/* Entry for the longest rule covering net/len, shorter than len */
+static uint32_t lpm_covering(struct lpm_t *this, uint32_t net, int len)
+{
+	unsigned int n;
+	int best = -1;
+	int l;
+
+	for (n = 0; n < this->nrules; n++) {
+		l = this->rule[n].len;
+		if ((l > 0) && (l < len) &&
+		    (((net ^ this->rule[n].net) >> (32 - l)) == 0) &&
+		    ((best < 0) || (l > this->rule[best].len)))
+			best = n;
+	}
+	return (best < 0) ? 0 : LPM_ENTRY(this->rule[best].len, best);
+}
+
+/* Get a tbl8 group, filled with the entry it replaces */
+static int lpm_newgroup(struct lpm_t *this, uint32_t e)
+{
+	uint32_t *tbl8;
+	unsigned int g;
+	int i;
+
+	if (this->nfree) {
+		g = this->freegroup[--this->nfree];
+	} else {
+		if (this->ngroups >= this->maxgroups) {
+			sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+				"No more lpm groups available");
+			return -1;
+		}
+		if (!(tbl8 = rcu_realloc(this->tbl8, sizeof(uint32_t) * 256 *
+					 this->ngroups,
+					 sizeof(uint32_t) * 256 *
+					 (this->ngroups + 1)))) {
+			sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+				"Failed to allocate memory for lpm group");
+			return -1;
+		}
+		this->tbl8 = tbl8;
+		g = this->ngroups++;
+	}
+	for (i = 0; i < 256; i++)
+		this->tbl8[g * 256 + i] = e;
+	/* The group is filled before a tbl24 entry points to it */
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	return g;
+}
+
+/* Set entries in [first, first + n) that hold no longer rule. Each
+   entry is stored whole, after the rule or group it refers to */
+static void lpm_fill(uint32_t * tbl, unsigned int first, unsigned int n,
+		     int len, uint32_t e)
+{
+	unsigned int i;
+
+	for (i = first; i < first + n; i++)
+		if (!(tbl[i] & LPM_VALID) || (LPM_DEPTH(tbl[i]) <= len))
+			__atomic_store_n(&tbl[i], e, __ATOMIC_RELEASE);
+}
+
+/* Replace entries in [first, first + n) that hold rule r */
+static void lpm_clear(uint32_t * tbl, unsigned int first, unsigned int n,
+		      int len, unsigned int r, uint32_t e)
+{
+	unsigned int i;
+
+	for (i = first; i < first + n; i++)
+		if ((tbl[i] & LPM_VALID) && (LPM_DEPTH(tbl[i]) == len) &&
+		    (LPM_VALUE(tbl[i]) == r))
+			__atomic_store_n(&tbl[i], e, __ATOMIC_RELEASE);
+}
+
+/* Add a route */
+int lpm_add(struct lpm_t *this, struct in_addr *net, int len, void *data)
+{
+	struct lpm_rule *rule;
+	uint32_t addr, e;
+	unsigned int i, n;
+	int r, g;
+
+	if ((len < 1) || (len > 32)) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Invalid prefix length: %d", len);
+		return -1;
+	}
+	addr = ntohl(net->s_addr) & (0xffffffff << (32 - len));
+
+	if ((r = lpm_findrule(this, addr, len)) >= 0) {
+		this->rule[r].data = data;
+		return 0;
+	}
+
+	/* Find a free rule slot */
+	for (r = 0; (r < (int)this->nrules) && this->rule[r].len; r++) ;
+	if (r == (int)this->nrules) {
+		if ((this->nrules >= LPM_VALUE(~0U)) ||
+		    !(rule = rcu_realloc(this->rule, sizeof(struct lpm_rule) *
+					 this->nrules,
+					 sizeof(struct lpm_rule) *
+					 (this->nrules * 2 + 16)))) {
+			sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+				"Failed to allocate memory for lpm rule");
+			return -1;
+		}
+		memset(rule + this->nrules, 0,
+		       sizeof(struct lpm_rule) * (this->nrules + 16));
+		this->rule = rule;
+		this->nrules = this->nrules * 2 + 16;
+	}
+
+	this->rule[r].net = addr;
+	this->rule[r].len = len;
+	this->rule[r].data = data;
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	e = LPM_ENTRY(len, r);
+	if (len <= 24) {
+		/* Whole /24 blocks, and the groups within them */
+		n = 1 << (24 - len);
+		for (i = addr >> 8; i < (addr >> 8) + n; i++) {
+			if (this->tbl24[i] & LPM_EXT)
+				lpm_fill(this->tbl8,
+					 LPM_VALUE(this->tbl24[i]) * 256, 256,
+					 len, e);
+			else
+				lpm_fill(this->tbl24, i, 1, len, e);
+		}
+	} else {
+		/* Part of one /24 block, split into a group if needed */
+		i = addr >> 8;
+		if (!(this->tbl24[i] & LPM_EXT)) {
+			if ((g = lpm_newgroup(this, this->tbl24[i])) < 0) {
+				this->rule[r].len = 0;
+				this->rule[r].data = NULL;
+				return -1;
+			}
+			__atomic_store_n(&this->tbl24[i],
+					 LPM_VALID | LPM_EXT | g,
+					 __ATOMIC_RELEASE);
+		}
+		lpm_fill(this->tbl8,
+			 LPM_VALUE(this->tbl24[i]) * 256 + (addr & 0xff),
+			 1 << (32 - len), len, e);
+	}
+
+	this->count++;
+	return 0;
+}
+
+/* Delete a route */
+int lpm_del(struct lpm_t *this, struct in_addr *net, int len, void *data)
+{
+	uint32_t addr, e, *grp;
+	unsigned int i, n;
+	int r;
+
+	if ((len < 1) || (len > 32))
+		return -1;
+	addr = ntohl(net->s_addr) & (0xffffffff << (32 - len));
+	if ((r = lpm_findrule(this, addr, len)) < 0) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0, "Route not found");
+		return -1;
+	}
+	if (data && (this->rule[r].data != data))
+		return 0;	/* Taken over by another owner */
+
+	/* Entries of the rule fall back to the rule covering it */
+	e = lpm_covering(this, addr, len);
+	if (len <= 24) {
+		n = 1 << (24 - len);
+		for (i = addr >> 8; i < (addr >> 8) + n; i++) {
+			if (this->tbl24[i] & LPM_EXT)
+				lpm_clear(this->tbl8,
+					  LPM_VALUE(this->tbl24[i]) * 256, 256,
+					  len, r, e);
+			else
+				lpm_clear(this->tbl24, i, 1, len, r, e);
+		}
+	} else {
+		i = addr >> 8;
+		grp = &this->tbl8[LPM_VALUE(this->tbl24[i]) * 256];
+		lpm_clear(grp, addr & 0xff, 1 << (32 - len), len, r, e);
+
+		/* Free the group when it holds no rule longer than /24 */
+		for (n = 0; n < 256; n++)
+			if ((grp[n] & LPM_VALID) && (LPM_DEPTH(grp[n]) > 24))
+				break;
+		if (n == 256) {
+			this->freegroup[this->nfree++] =
+			    LPM_VALUE(this->tbl24[i]);
+			__atomic_store_n(&this->tbl24[i], grp[0],
+					 __ATOMIC_RELEASE);
+		}
+	}
+
+	this->rule[r].len = 0;
+	this->rule[r].data = NULL;
+	this->count--;
+	return 0;
+}
+
+/* Find the data of the longest route matching a host order address.
+   Entries are loaded with acquire, so that the rule or group they refer
+   to is seen, when the table is changed by another thread */
+void *lpm_lookup(struct lpm_t *this, uint32_t addr)
+{
+	uint32_t e = __atomic_load_n(&this->tbl24[addr >> 8], __ATOMIC_ACQUIRE);
+
+	if (e & LPM_EXT)
+		e = __atomic_load_n(&this->tbl8[(LPM_VALUE(e) << 8) |
+						(addr & 0xff)],
+				    __ATOMIC_ACQUIRE);
+	return (e & LPM_VALID) ? this->rule[LPM_VALUE(e)].data : NULL;
+}
+
+/* Look up n addresses. All tbl24 loads are issued before any tbl8
+   load, so that cache misses of different addresses overlap */
+void lpm_lookup_bulk(struct lpm_t *this, const uint32_t * addr,
+		     void **data, unsigned int n)
+{
+	uint32_t e[64];
+	unsigned int i, j, k;
+
+	for (i = 0; i < n; i += k) {
+		k = (n - i < 64) ? n - i : 64;
+		for (j = 0; j < k; j++)
+			e[j] = __atomic_load_n(&this->tbl24[addr[i + j] >> 8],
+					       __ATOMIC_ACQUIRE);
+		for (j = 0; j < k; j++) {
+			if (e[j] & LPM_EXT)
+				e[j] = __atomic_load_n(&this->tbl8
+						       [(LPM_VALUE(e[j]) << 8) |
+							(addr[i + j] & 0xff)],
+						       __ATOMIC_ACQUIRE);
+			data[i + j] = (e[j] & LPM_VALID) ?
+			    this->rule[LPM_VALUE(e[j])].data : NULL;
+		}
+	}
+}
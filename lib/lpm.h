@@ -0,0 +1,67 @@
+/*
+ * IPv4 longest prefix match table.
+ *
+ * The contents of this file may be used under the terms of the GNU
+ * General Public License Version 2, provided that the above copyright
+ * notice and this permission notice is included in all copies or
+ * substantial portions of the software.
+ *
+ */
+
+#ifndef _LPM_H
+#define _LPM_H
+
+/* DIR-24-8 table: the upper 24 bits of an address index tbl24. An
+   entry either holds the rule for the whole /24, or points to a group
+   of 256 tbl8 entries indexed by the lower 8 bits. A lookup is one or
+   two array loads.
+
+   tbl24 is 64 MB of address space, of which only the pages holding
+   routes are touched. tbl8 groups are allocated as routes longer than
+   /24 are added, up to maxgroups, which bounds the memory used. */
+
+#define LPM_VALID   0x80000000	/* Entry holds a rule or a group */
+#define LPM_EXT     0x40000000	/* tbl24 entry points to a tbl8 group */
+#define LPM_DEPTH(e) (((e) >> 24) & 0x3f)	/* Prefix length of rule */
+#define LPM_VALUE(e) ((e) & 0xffffff)	/* Rule or group index */
+
+struct lpm_rule {
+	uint32_t net;		/* Host order network address */
+	int len;		/* Prefix length. 0 if slot is free */
+	void *data;		/* Returned by lookup */
+};
+
+struct lpm_t {
+	uint32_t *tbl24;	/* 1 << 24 entries */
+	uint32_t *tbl8;		/* Groups of 256 entries */
+	unsigned int ngroups;	/* Groups allocated in tbl8 */
+	unsigned int maxgroups;	/* Max number of groups */
+	unsigned int *freegroup;	/* Stack of free group numbers */
+	unsigned int nfree;	/* Number of free groups on stack */
+	struct lpm_rule *rule;	/* Nrules array of rules */
+	unsigned int nrules;	/* Size of rule array */
+	unsigned int count;	/* Rules in use */
+};
+
+/* Create new table with room for maxgroups routes longer than /24 */
+extern int lpm_new(struct lpm_t **this, unsigned int maxgroups);
+
+/* Delete existing table */
+extern int lpm_free(struct lpm_t *this);
+
+/* Add a route. Replaces the data of an existing route */
+extern int lpm_add(struct lpm_t *this, struct in_addr *net, int len,
+		   void *data);
+
+/* Delete a route. If data is not NULL, only if the route holds data */
+extern int lpm_del(struct lpm_t *this, struct in_addr *net, int len,
+		   void *data);
+
+/* Find the data of the longest route matching a host order address */
+extern void *lpm_lookup(struct lpm_t *this, uint32_t addr);
+
+/* Look up n host order addresses */
+extern void lpm_lookup_bulk(struct lpm_t *this, const uint32_t * addr,
+			    void **data, unsigned int n);
+
+#endif /* !_LPM_H */
@@ -0,0 +1,104 @@
+/*
+ * Memory of the process in hugepages, locked and prefaulted.
+ *
+ * The contents of this file may be used under the terms of the GNU
+ * General Public License Version 2, provided that the above copyright
+ * notice and this permission notice is included in all copies or
+ * substantial portions of the software.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <syslog.h>
+#include "syserr.h"
+#include "memlock.h"
+
+long mem_huge(void)
+{
+#ifdef MADV_HUGEPAGE
+	unsigned long start, end, inode;
+	char line[512], perms[8], path[256];
+	long advised = 0;
+	FILE *f;
+
+	if (!(f = fopen("/proc/self/maps", "r"))) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+			"Failed to read /proc/self/maps");
+		return -1;
+	}
+	while (fgets(line, sizeof(line), f)) {
+		path[0] = 0;
+		if (sscanf(line, "%lx-%lx %7s %*s %*s %lu %255s", &start, &end,
+			   perms, &inode, path) < 4)
+			continue;
+
+		/* Anonymous, private and writable: heap, bss and large
+		   allocations. Not the stack, which grows by small pages */
+		if (inode || strcmp(perms, "rw-p") ||
+		    (path[0] && strcmp(path, "[heap]")))
+			continue;
+
+		/* Only whole hugepages can be backed by them */
+		start = (start + MEMLOCK_HUGESIZE - 1) &
+		    ~(unsigned long)(MEMLOCK_HUGESIZE - 1);
+		end &= ~(unsigned long)(MEMLOCK_HUGESIZE - 1);
+		if ((end <= start) ||
+		    madvise((void *)start, end - start, MADV_HUGEPAGE))
+			continue;
+		advised += end - start;
+	}
+	fclose(f);
+	return advised;
+#else
+	sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+		"Hugepages are not supported on this platform");
+	return -1;
+#endif
+}
+
+int mem_lock(void)
+{
+	if (mlockall(MCL_CURRENT | MCL_FUTURE)) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+			"Failed to lock memory. Check RLIMIT_MEMLOCK");
+		return -1;
+	}
+	return 0;
+}
+
+/* Value in kB of a line "name: value kB" of a file in /proc */
+static long mem_field(char *file, char *name)
+{
+	char line[256];
+	size_t n = strlen(name);
+	long kb = -1;
+	FILE *f;
+
+	if (!(f = fopen(file, "r")))
+		return -1;
+	while (fgets(line, sizeof(line), f))
+		if (!strncmp(line, name, n) && (line[n] == ':')) {
+			sscanf(line + n + 1, "%ld", &kb);
+			break;
+		}
+	fclose(f);
+	return kb;
+}
+
+int mem_usage(long *rss, long *locked, long *huge)
+{
+	*rss = mem_field("/proc/self/status", "VmRSS");
+	*locked = mem_field("/proc/self/status", "VmLck");
+	*huge = mem_field("/proc/self/smaps_rollup", "AnonHugePages");
+	return ((*rss < 0) || (*locked < 0)) ? -1 : 0;
+}
@@ -0,0 +1,38 @@
+/*
+ * Memory of the process in hugepages, locked and prefaulted.
+ *
+ * The contents of this file may be used under the terms of the GNU
+ * General Public License Version 2, provided that the above copyright
+ * notice and this permission notice is included in all copies or
+ * substantial portions of the software.
+ *
+ */
+
+#ifndef _MEMLOCK_H
+#define _MEMLOCK_H
+
+/* The large tables of the process are static arrays or allocated once
+   at startup, so the mappings that hold them are found in
+   /proc/self/maps rather than asked from each module.
+
+   mem_huge() asks for transparent hugepages on the anonymous private
+   mappings. Called before the tables are first touched, they are
+   faulted in as hugepages where the kernel has them. Mappings touched
+   already are collapsed into hugepages later by the kernel.
+
+   mem_lock() then locks all current and future mappings in memory,
+   which faults in every page at once rather than on first use. */
+
+#define MEMLOCK_HUGESIZE (2 * 1024 * 1024)	/* Size of a hugepage */
+
+/* Advise hugepages for the anonymous mappings. Returns the number of
+   bytes advised, or -1 if not supported */
+extern long mem_huge(void);
+
+/* Lock and prefault all current and future mappings */
+extern int mem_lock(void);
+
+/* Resident, locked and hugepage memory of the process, in kB */
+extern int mem_usage(long *rss, long *locked, long *huge);
+
+#endif /* !_MEMLOCK_H */
@@ -0,0 +1,106 @@
+/*
+ * Netlink requests.
+ *
+ * The contents of this file may be used under the terms of the GNU
+ * General Public License Version 2, provided that the above copyright
+ * notice and this permission notice is included in all copies or
+ * substantial portions of the software.
+ *
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <syslog.h>
+#include "syserr.h"
+
+#if defined(__linux__)
+
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include "netlink.h"
+
+struct rtattr *netlink_attr(struct netlink_req *req, int type, void *d,
+			    int dlen)
+{
+	int alen = NLMSG_ALIGN(req->n.nlmsg_len);
+	struct rtattr *rta = (struct rtattr *)(((char *)&req->n) + alen);
+
+	if (alen + RTA_LENGTH(dlen) > sizeof(*req))
+		return NULL;
+	rta->rta_len = RTA_LENGTH(dlen);
+	rta->rta_type = type;
+	if (dlen)
+		memcpy(RTA_DATA(rta), d, dlen);
+	req->n.nlmsg_len = alen + RTA_ALIGN(rta->rta_len);
+	return rta;
+}
+
+void netlink_nest_end(struct netlink_req *req, struct rtattr *nest)
+{
+	nest->rta_len = ((char *)&req->n) + req->n.nlmsg_len - (char *)nest;
+}
+
+int netlink_socket(int protocol)
+{
+	struct sockaddr_nl local;
+	int fd;
+
+	if ((fd = socket(AF_NETLINK, SOCK_RAW, protocol)) < 0) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno, "socket() failed");
+		return -1;
+	}
+	memset(&local, 0, sizeof(local));
+	local.nl_family = AF_NETLINK;
+	if (bind(fd, (struct sockaddr *)&local, sizeof(local)) < 0) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno, "bind() failed");
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+int netlink_talk(int fd, struct netlink_req *req, struct netlink_req *reply)
+{
+	struct sockaddr_nl nladdr;
+	struct nlmsghdr *h;
+	struct nlmsgerr *err;
+	char buf[8192];
+	int len;
+
+	memset(&nladdr, 0, sizeof(nladdr));
+	nladdr.nl_family = AF_NETLINK;
+	req->n.nlmsg_flags |= NLM_F_REQUEST | NLM_F_ACK;
+
+	if (sendto(fd, &req->n, req->n.nlmsg_len, 0,
+		   (struct sockaddr *)&nladdr, sizeof(nladdr)) < 0)
+		return -1;
+
+	while (1) {
+		if ((len = recv(fd, buf, sizeof(buf), 0)) < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		for (h = (struct nlmsghdr *)buf; NLMSG_OK(h, len);
+		     h = NLMSG_NEXT(h, len)) {
+			if (h->nlmsg_seq != req->n.nlmsg_seq)
+				continue;
+			if (h->nlmsg_type == NLMSG_ERROR) {
+				err = NLMSG_DATA(h);
+				if (err->error) {
+					errno = -err->error;
+					return -1;
+				}
+				return 0;
+			}
+			if (reply && (h->nlmsg_len <= sizeof(*reply)))
+				memcpy(reply, h, h->nlmsg_len);
+		}
+	}
+}
+
+#endif
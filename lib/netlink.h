@@ -0,0 +1,38 @@
+/*
+ * Netlink requests.
+ *
+ * The contents of this file may be used under the terms of the GNU
+ * General Public License Version 2, provided that the above copyright
+ * notice and this permission notice is included in all copies or
+ * substantial portions of the software.
+ *
+ */
+
+#ifndef _NETLINK_H
+#define _NETLINK_H
+
+#define NETLINK_BUFSIZE 1024
+
+struct netlink_req {		/* Request or reply with its attributes */
+	struct nlmsghdr n;
+	char buf[NETLINK_BUFSIZE];
+};
+
+/* Open a netlink socket of protocol. Returns the socket or -1 */
+extern int netlink_socket(int protocol);
+
+/* Append an attribute. With no data it opens a nested attribute, which
+   netlink_nest_end() closes. Returns NULL when the request is full */
+extern struct rtattr *netlink_attr(struct netlink_req *req, int type,
+				   void *d, int dlen);
+
+/* Close a nested attribute */
+extern void netlink_nest_end(struct netlink_req *req, struct rtattr *nest);
+
+/* Send a request and wait for its acknowledgement. A message answering
+   it is copied to reply, which may be NULL. Returns 0, or -1 with errno
+   set */
+extern int netlink_talk(int fd, struct netlink_req *req,
+			struct netlink_req *reply);
+
+#endif /* !_NETLINK_H */
@@ -0,0 +1,134 @@
+/*
+ * Quiescent state based reclamation.
+ *
+ * The contents of this file may be used under the terms of the GNU
+ * General Public License Version 2, provided that the above copyright
+ * notice and this permission notice is included in all copies or
+ * substantial portions of the software.
+ *
+ */
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <sched.h>
+#include <syslog.h>
+#include "syserr.h"
+#include "rcu.h"
+
+/* Each reader on its own cache line. seen is the epoch at its last
+   quiescent state, or 0 while offline */
+struct rcu_reader {
+	uint64_t seen;
+	char pad[64 - sizeof(uint64_t)];
+};
+
+static uint64_t rcu_epoch = 1;
+static struct rcu_reader rcu_readers[RCU_MAXREADERS];
+static int rcu_nreaders;
+
+static void **rcu_pending;	/* Memory waiting for a grace period */
+static unsigned int rcu_npending;
+static unsigned int rcu_maxpending;
+
+int rcu_register(void)
+{
+	if (rcu_nreaders >= RCU_MAXREADERS) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Too many rcu readers");
+		return -1;
+	}
+	rcu_readers[rcu_nreaders].seen = 0;
+	return rcu_nreaders++;
+}
+
+void rcu_quiescent(int reader)
+{
+	__atomic_store_n(&rcu_readers[reader].seen,
+			 __atomic_load_n(&rcu_epoch, __ATOMIC_ACQUIRE),
+			 __ATOMIC_RELEASE);
+}
+
+void rcu_offline(int reader)
+{
+	__atomic_store_n(&rcu_readers[reader].seen, 0, __ATOMIC_RELEASE);
+}
+
+void rcu_online(int reader)
+{
+	/* The epoch must be announced before any table is read */
+	__atomic_store_n(&rcu_readers[reader].seen,
+			 __atomic_load_n(&rcu_epoch, __ATOMIC_ACQUIRE),
+			 __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void rcu_synchronize(void)
+{
+	uint64_t epoch, seen;
+	int n;
+
+	if (!rcu_nreaders)
+		return;
+
+	/* Readers seeing the new epoch started after the unpublishing */
+	epoch = __atomic_add_fetch(&rcu_epoch, 1, __ATOMIC_SEQ_CST);
+	for (n = 0; n < rcu_nreaders; n++) {
+		while ((seen = __atomic_load_n(&rcu_readers[n].seen,
+					       __ATOMIC_ACQUIRE)) &&
+		       (seen < epoch))
+			sched_yield();
+	}
+}
+
+void rcu_free(void *p)
+{
+	void **pending;
+
+	if (!p)
+		return;
+	if (!rcu_nreaders) {
+		free(p);
+		return;
+	}
+	if (rcu_npending == rcu_maxpending) {
+		if (!(pending = realloc(rcu_pending, sizeof(void *) *
+					(rcu_maxpending * 2 + 16)))) {
+			/* Wait here rather than leak */
+			rcu_synchronize();
+			free(p);
+			return;
+		}
+		rcu_pending = pending;
+		rcu_maxpending = rcu_maxpending * 2 + 16;
+	}
+	rcu_pending[rcu_npending++] = p;
+}
+
+void *rcu_realloc(void *p, size_t oldsize, size_t size)
+{
+	void *n;
+
+	if (!(n = malloc(size)))
+		return NULL;
+	if (p)
+		memcpy(n, p, (oldsize < size) ? oldsize : size);
+	/* The copy must be complete before the caller publishes it */
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	rcu_free(p);
+	return n;
+}
+
+void rcu_reclaim(void)
+{
+	unsigned int n;
+
+	if (!rcu_npending)
+		return;
+	rcu_synchronize();
+	for (n = 0; n < rcu_npending; n++)
+		free(rcu_pending[n]);
+	rcu_npending = 0;
+}
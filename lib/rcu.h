@@ -0,0 +1,50 @@
+/*
+ * Quiescent state based reclamation.
+ *
+ * The contents of this file may be used under the terms of the GNU
+ * General Public License Version 2, provided that the above copyright
+ * notice and this permission notice is included in all copies or
+ * substantial portions of the software.
+ *
+ */
+
+#ifndef _RCU_H
+#define _RCU_H
+
+/* Readers are data plane threads. They take no locks, but report a
+   quiescent state between batches of packets, when they hold no
+   pointer into shared tables, and go offline while blocked in select().
+
+   The writer is the thread that changes the tables. It unpublishes old
+   memory, and frees it only when every reader has been quiescent or
+   offline since. Writer functions are called from one thread only.
+   Without registered readers memory is freed at once. */
+
+#define RCU_MAXREADERS 64	/* Max number of reader threads */
+
+/* Register a reader before its thread starts. Returns its number, or
+   -1 if there are too many. The reader starts offline */
+extern int rcu_register(void);
+
+/* Reader: Announce that no shared pointers are held */
+extern void rcu_quiescent(int reader);
+
+/* Reader: Stop and resume reading, around blocking calls */
+extern void rcu_offline(int reader);
+extern void rcu_online(int reader);
+
+/* Writer: Wait until all readers have been quiescent or offline */
+extern void rcu_synchronize(void);
+
+/* Writer: Free p after the next grace period */
+extern void rcu_free(void *p);
+
+/* Writer: Copy p of oldsize bytes to new memory of size bytes, and free
+   p after the next grace period. The caller publishes the copy */
+extern void *rcu_realloc(void *p, size_t oldsize, size_t size);
+
+/* Writer: Free memory given to rcu_free(), waiting for a grace period
+   if needed. Called regularly from the main loop */
+extern void rcu_reclaim(void);
+
+#endif /* !_RCU_H */
@@ -0,0 +1,200 @@
+/*
+ * Sessions between control plane and user plane processes.
+ *
+ * The contents of this file may be used under the terms of the GNU
+ * General Public License Version 2, provided that the above copyright
+ * notice and this permission notice is included in all copies or
+ * substantial portions of the software.
+ *
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <syslog.h>
+#include "syserr.h"
+#include "session.h"
+
+static int session_addr(struct sockaddr_un *addr, char *path)
+{
+	memset(addr, 0, sizeof(*addr));
+	addr->sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(addr->sun_path)) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Socket path too long: %s", path);
+		return -1;
+	}
+	strcpy(addr->sun_path, path);
+	return 0;
+}
+
+int session_listen(char *path)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	if (session_addr(&addr, path))
+		return -1;
+	if ((fd = socket(AF_UNIX, SOCK_SEQPACKET, 0)) < 0) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+			"socket() failed");
+		return -1;
+	}
+	unlink(path);		/* Left by an earlier run */
+	if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    listen(fd, 16)) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+			"Failed to listen on %s", path);
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static void session_init(struct session_t *this, int fd)
+{
+	memset(this, 0, sizeof(*this));
+	this->fd = fd;
+}
+
+int session_accept(struct session_t *this, int fd)
+{
+	int s;
+
+	if ((s = accept(fd, NULL, NULL)) < 0) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+			"accept() failed");
+		return -1;
+	}
+	session_init(this, s);
+	return 0;
+}
+
+int session_connect(struct session_t *this, char *path)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	if (session_addr(&addr, path))
+		return -1;
+	if ((fd = socket(AF_UNIX, SOCK_SEQPACKET, 0)) < 0) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+			"socket() failed");
+		return -1;
+	}
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr))) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+			"Failed to connect to %s", path);
+		close(fd);
+		return -1;
+	}
+	session_init(this, fd);
+	return 0;
+}
+
+int session_queue(struct session_t *this, struct session_msg *msg)
+{
+	if (this->fd < 0)
+		return -1;
+	if (!this->queue &&
+	    !(this->queue = malloc(sizeof(struct session_msg) *
+				   SESSION_BACKLOG))) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Failed to allocate memory for session queue");
+		return -1;
+	}
+	if ((this->n == SESSION_BACKLOG) && this->head) {
+		memmove(this->queue, this->queue + this->head,
+			sizeof(struct session_msg) * (this->n - this->head));
+		this->n -= this->head;
+		this->head = 0;
+	}
+	if (this->n == SESSION_BACKLOG) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Other end fell %d messages behind", SESSION_BACKLOG);
+		session_close(this);
+		return -1;
+	}
+	memcpy(&this->queue[this->n++], msg, sizeof(*msg));
+	if (this->n - this->head >= SESSION_BATCH)
+		return session_flush(this);
+	return 0;
+}
+
+int session_flush(struct session_t *this)
+{
+	int n;
+
+	if (this->fd < 0)
+		return -1;
+
+	/* The other end reads its batches in its main loop. While it is
+	   busy the rest stays queued for the next call */
+	while ((n = this->n - this->head)) {
+		if (n > SESSION_BATCH)
+			n = SESSION_BATCH;
+		if (send(this->fd, this->queue + this->head,
+			 sizeof(struct session_msg) * n,
+			 MSG_NOSIGNAL | MSG_DONTWAIT) < 0) {
+			if (errno == EAGAIN)
+				return 0;
+			sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+				"Failed to send sessions");
+			session_close(this);
+			return -1;
+		}
+		this->msgs += n;
+		this->batches++;
+		this->head += n;
+	}
+	this->head = this->n = 0;
+	return 0;
+}
+
+int session_pending(struct session_t *this)
+{
+	return this->n - this->head;
+}
+
+int session_recv(struct session_t *this, struct session_msg *msgs)
+{
+	ssize_t len;
+
+	if (this->fd < 0)
+		return -1;
+	if ((len = recv(this->fd, msgs,
+			sizeof(struct session_msg) * SESSION_BATCH,
+			MSG_DONTWAIT)) < 0) {
+		if (errno == EAGAIN)
+			return 0;
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno, "recv() failed");
+		session_close(this);
+		return -1;
+	}
+	if (len == 0) {
+		session_close(this);
+		return -1;
+	}
+	if (len % sizeof(struct session_msg)) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Invalid session batch length: %d", (int)len);
+		return 0;
+	}
+	return len / sizeof(struct session_msg);
+}
+
+void session_close(struct session_t *this)
+{
+	if (this->fd >= 0)
+		close(this->fd);
+	free(this->queue);
+	this->queue = NULL;
+	this->fd = -1;
+	this->head = this->n = 0;
+}
@@ -0,0 +1,89 @@
+/*
+ * Sessions between control plane and user plane processes.
+ *
+ * The contents of this file may be used under the terms of the GNU
+ * General Public License Version 2, provided that the above copyright
+ * notice and this permission notice is included in all copies or
+ * substantial portions of the software.
+ *
+ */
+
+#ifndef _SESSION_H
+#define _SESSION_H
+
+/* The control plane listens on a Unix socket. Each user plane process
+   connects, and announces its GTP-U address and the network of its tun
+   interface with SESSION_HELLO. The control plane then sends the
+   sessions of the contexts whose end user address is in that network.
+
+   Messages are fixed size records in host byte order. Each datagram of
+   the SOCK_SEQPACKET socket carries a batch of up to SESSION_BATCH of
+   them, and nothing is answered, so that many session changes cost one
+   system call. Messages are applied in the order they were queued.
+
+   Sending never blocks. Messages the socket has no room for stay queued
+   until session_flush() is called again, up to SESSION_BACKLOG of them.
+   A connection that falls further behind is closed. */
+
+#define SESSION_HELLO     1	/* User plane: own address and network */
+#define SESSION_ESTABLISH 2	/* Control plane: new context */
+#define SESSION_MODIFY    3	/* Control plane: peer of context changed */
+#define SESSION_DELETE    4	/* Control plane: context deleted */
+
+#define SESSION_BATCH   256	/* Messages per datagram */
+#define SESSION_BACKLOG (64 * SESSION_BATCH)	/* Max queued messages */
+
+struct session_msg {
+	uint8_t type;		/* SESSION_* */
+	uint8_t version;	/* GTP version of the context */
+	uint8_t nsapi;
+	uint8_t spare;
+	uint32_t tei;		/* Own TEID, the same at both ends */
+	uint32_t teid_gn;	/* TEID of the peer */
+	uint16_t flru;		/* GTPv0 flow label of the peer */
+	uint16_t spare2;
+	uint64_t imsi;
+	struct in_addr peer;	/* GTP-U address of the peer, or own */
+	struct in_addr ue;	/* End user address, or network */
+	struct in_addr mask;	/* Netmask of network */
+};
+
+struct session_t {		/* One end of a connection */
+	int fd;			/* Socket. -1 when closed */
+	struct in_addr addr;	/* HELLO: GTP-U address of user plane */
+	struct in_addr net, mask;	/* HELLO: network. 0/0 until then */
+	struct session_msg *queue;	/* SESSION_BACKLOG messages */
+	int head;		/* First message not yet sent */
+	int n;			/* End of queued messages */
+	uint64_t msgs;		/* Messages sent */
+	uint64_t batches;	/* Datagrams sent */
+};
+
+/* Control plane: Listen on path. Returns the socket or -1 */
+extern int session_listen(char *path);
+
+/* Control plane: Accept a user plane on the listening socket fd */
+extern int session_accept(struct session_t *this, int fd);
+
+/* User plane: Connect to the control plane at path */
+extern int session_connect(struct session_t *this, char *path);
+
+/* Queue a message. Sends a batch when one is full */
+extern int session_queue(struct session_t *this, struct session_msg *msg);
+
+/* Send the queued messages, as far as the socket takes them. Closes the
+   connection on error */
+extern int session_flush(struct session_t *this);
+
+/* Number of queued messages not yet sent */
+extern int session_pending(struct session_t *this);
+
+/* Read one batch into msgs, which holds SESSION_BATCH messages. Returns
+   the number of messages, 0 if none is waiting, or -1 when the other end
+   closed the connection, after which it is closed here too */
+extern int session_recv(struct session_t *this, struct session_msg *msgs);
+
+/* Close the connection */
+extern void session_close(struct session_t *this);
+
+#endif /* !_SESSION_H */
@@ -604,6 +604,47 @@ int tun_route(struct tun_t *this,
 
 }
 
+/* Route an IPv6 prefix to the tun interface */
+int tun_addroute6(struct tun_t *this, struct in6_addr *dst, int prefixlen)
+{
+
+#if defined(__linux__)
+
+	struct in6_rtmsg r;
+	__u32 index;
+	int fd;
+
+	if (tun_gifindex(this, &index))
+		return -1;
+
+	memset(&r, '\0', sizeof(r));
+	r.rtmsg_dst = *dst;
+	r.rtmsg_dst_len = prefixlen;
+	r.rtmsg_metric = 1;
+	r.rtmsg_flags = RTF_UP;
+	r.rtmsg_ifindex = index;
+
+	if ((fd = socket(AF_INET6, SOCK_DGRAM, 0)) < 0) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno, "socket() failed");
+		return -1;
+	}
+	if (ioctl(fd, SIOCADDRT, (void *)&r) < 0) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+			"ioctl(SIOCADDRT) failed");
+		close(fd);
+		return -1;
+	}
+	close(fd);
+	return 0;
+
+#else
+	sys_err(LOG_WARNING, __FILE__, __LINE__, 0,
+		"Could not set up IPv6 routing. Please add route manually.");
+	return 0;
+#endif
+
+}
+
 int tun_addroute(struct tun_t *this,
 		 struct in_addr *dst,
 		 struct in_addr *gateway, struct in_addr *mask)
@@ -793,7 +834,7 @@ int tun_free(struct tun_t *tun)
 		tun_delroute(tun, &tun->dstaddr, &tun->addr, &tun->netmask);
 	}
 
-	if (close(tun->fd)) {
+	if ((tun->fd >= 0) && close(tun->fd)) {
 		sys_err(LOG_ERR, __FILE__, __LINE__, errno, "close() failed");
 	}
 
@@ -811,38 +852,47 @@ int tun_set_cb_ind(struct tun_t *this,
 }
 
 int tun_decaps(struct tun_t *this)
+{
+	unsigned char buffer[PACKET_MAX];
+
+	return tun_decaps_buf(this, buffer, sizeof(buffer));
+}
+
+/* Read a packet into buf, so that the caller can choose where it lands.
+   A packet longer than size is truncated */
+int tun_decaps_buf(struct tun_t *this, void *buf, unsigned size)
 {
 
 #if defined(__linux__) || defined (__FreeBSD__) || defined (__APPLE__)
 
-	unsigned char buffer[PACKET_MAX];
 	int status;
 
-	if ((status = read(this->fd, buffer, sizeof(buffer))) <= 0) {
+	if ((status = read(this->fd, buf, size)) <= 0) {
+		if ((status < 0) && (errno == EAGAIN))
+			return -1;	/* Non-blocking fd drained. Not an error */
 		sys_err(LOG_ERR, __FILE__, __LINE__, errno, "read() failed");
 		return -1;
 	}
 
 	if (this->cb_ind)
-		return this->cb_ind(this, buffer, status);
+		return this->cb_ind(this, buf, status);
 
 	return 0;
 
 #elif defined (__sun__)
 
-	unsigned char buffer[PACKET_MAX];
 	struct strbuf sbuf;
 	int f = 0;
 
-	sbuf.maxlen = PACKET_MAX;
-	sbuf.buf = buffer;
+	sbuf.maxlen = size;
+	sbuf.buf = buf;
 	if (getmsg(this->fd, NULL, &sbuf, &f) < 0) {
 		sys_err(LOG_ERR, __FILE__, __LINE__, errno, "getmsg() failed");
 		return -1;
 	}
 
 	if (this->cb_ind)
-		return this->cb_ind(this, buffer, sbuf.len);
+		return this->cb_ind(this, buf, sbuf.len);
 
 	return 0;
 
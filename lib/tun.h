@@ -46,11 +46,13 @@ struct tun_t {
 	int routes;		/* One if we allocated an automatic route */
 	char devname[IFNAMSIZ];	/* Name of the tun device */
 	int (*cb_ind) (struct tun_t * tun, void *pack, unsigned len);
+	void *priv;		/* Private state of the user */
 };
 
 extern int tun_new(struct tun_t **tun);
 extern int tun_free(struct tun_t *tun);
 extern int tun_decaps(struct tun_t *this);
+extern int tun_decaps_buf(struct tun_t *this, void *buf, unsigned size);
 extern int tun_encaps(struct tun_t *tun, void *pack, unsigned len);
 
 extern int tun_addaddr(struct tun_t *this, struct in_addr *addr,
@@ -62,6 +64,8 @@ extern int tun_setaddr(struct tun_t *this, struct in_addr *our_adr,
 int tun_addroute(struct tun_t *this, struct in_addr *dst,
 		 struct in_addr *gateway, struct in_addr *mask);
 
+int tun_addroute6(struct tun_t *this, struct in6_addr *dst, int prefixlen);
+
 extern int tun_set_cb_ind(struct tun_t *this,
 			  int (*cb_ind) (struct tun_t * tun, void *pack,
 					 unsigned len));
@@ -0,0 +1,569 @@
+/*
+ * AF_XDP socket for GTP-U.
+ *
+ * The contents of this file may be used under the terms of the GNU
+ * General Public License Version 2, provided that the above copyright
+ * notice and this permission notice is included in all copies or
+ * substantial portions of the software.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <syslog.h>
+
+#if defined(__linux__) && defined(HAVE_LINUX_IF_XDP_H) && \
+    HAVE_DECL_BPF_FUNC_REDIRECT_NEIGH
+#include <linux/if_ether.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/bpf.h>
+#include "netlink.h"
+#include "bpfprog.h"
+#endif
+
+#include "syserr.h"
+#include "xsk.h"
+
+#if defined(__linux__) && defined(HAVE_LINUX_IF_XDP_H) && \
+    HAVE_DECL_BPF_FUNC_REDIRECT_NEIGH
+
+#define XSK_PORT  2152		/* GTP-U */
+#define XSK_GPDU  0xff		/* G-PDU message type */
+#define XSK_MIN   50		/* Ethernet, IPv4, UDP and GTPv1 */
+#define XSK_RING  (XSK_FRAMES / 2)	/* Descriptors per ring */
+
+#define XDP(FIELD) offsetof(struct xdp_md, FIELD)
+
+/* Redirect G-PDUs to the socket of their queue. Without one they pass */
+static int xsk_prog(struct xsk_t *this)
+{
+	struct bpf_insn insn[] = {
+		BPF_MOV64_REG(BPF_REG_6, BPF_REG_1),
+		BPF_LDX_MEM(BPF_W, BPF_REG_7, BPF_REG_6, XDP(data)),
+		BPF_LDX_MEM(BPF_W, BPF_REG_8, BPF_REG_6, XDP(data_end)),
+		BPF_MOV64_REG(BPF_REG_2, BPF_REG_7),
+		BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, XSK_MIN),
+		BPF_JMP_REG(BPF_JGT, BPF_REG_2, BPF_REG_8, BPFPROG_PUNT),
+
+		/* IPv4 without options, not fragmented, UDP to own
+		   GTP-U port and address, carrying a G-PDU */
+		BPF_LDX_MEM(BPF_H, BPF_REG_2, BPF_REG_7, 12),
+		BPF_JMP_IMM(BPF_JNE, BPF_REG_2, htons(ETH_P_IP), BPFPROG_PUNT),
+		BPF_LDX_MEM(BPF_B, BPF_REG_2, BPF_REG_7, 14),
+		BPF_JMP_IMM(BPF_JNE, BPF_REG_2, 0x45, BPFPROG_PUNT),
+		BPF_LDX_MEM(BPF_H, BPF_REG_2, BPF_REG_7, 14 + 6),
+		BPF_ALU64_IMM(BPF_AND, BPF_REG_2, htons(0x3fff)),
+		BPF_JMP_IMM(BPF_JNE, BPF_REG_2, 0, BPFPROG_PUNT),
+		BPF_LDX_MEM(BPF_B, BPF_REG_2, BPF_REG_7, 14 + 9),
+		BPF_JMP_IMM(BPF_JNE, BPF_REG_2, IPPROTO_UDP, BPFPROG_PUNT),
+		BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_7, 14 + 16),
+		BPF_JMP32_IMM(BPF_JNE, BPF_REG_2, this->addr.s_addr,
+			      BPFPROG_PUNT),
+		BPF_LDX_MEM(BPF_H, BPF_REG_2, BPF_REG_7, 34 + 2),
+		BPF_JMP_IMM(BPF_JNE, BPF_REG_2, htons(XSK_PORT), BPFPROG_PUNT),
+		BPF_LDX_MEM(BPF_B, BPF_REG_2, BPF_REG_7, 42 + 1),
+		BPF_JMP_IMM(BPF_JNE, BPF_REG_2, XSK_GPDU, BPFPROG_PUNT),
+
+		BPF_LD_MAP_FD(BPF_REG_1, this->map),
+		BPF_LDX_MEM(BPF_W, BPF_REG_2, BPF_REG_6, XDP(rx_queue_index)),
+		BPF_MOV64_IMM(BPF_REG_3, XDP_PASS),
+		BPF_EMIT_CALL(BPF_FUNC_redirect_map),
+		BPF_EXIT_INSN(),
+
+		/* BPFPROG_PUNT */
+		BPF_MOV64_IMM(BPF_REG_0, XDP_PASS),
+		BPF_EXIT_INSN(),
+	};
+	int n = sizeof(insn) / sizeof(insn[0]);
+
+	bpfprog_fixup(insn, n, n - 2, -1);
+	return bpfprog_load(BPF_PROG_TYPE_XDP, insn, n, "ggsn_xsk");
+}
+
+/* Attach prog to the interface in mode flags. A negative prog detaches */
+static int xsk_link(int ifindex, int prog, uint32_t flags)
+{
+	struct netlink_req req;
+	struct ifinfomsg *ifi = NLMSG_DATA(&req.n);
+	struct rtattr *xdp;
+	int32_t v = prog;
+	int fd, rc;
+
+	memset(&req, 0, sizeof(req));
+	req.n.nlmsg_len = NLMSG_LENGTH(sizeof(*ifi));
+	req.n.nlmsg_type = RTM_SETLINK;
+	req.n.nlmsg_seq = 1;
+	ifi->ifi_family = AF_UNSPEC;
+	ifi->ifi_index = ifindex;
+	xdp = netlink_attr(&req, IFLA_XDP, NULL, 0);
+	netlink_attr(&req, IFLA_XDP_FD, &v, sizeof(v));
+	netlink_attr(&req, IFLA_XDP_FLAGS, &flags, sizeof(flags));
+	netlink_nest_end(&req, xdp);
+
+	if ((fd = netlink_socket(NETLINK_ROUTE)) < 0)
+		return -1;
+	rc = netlink_talk(fd, &req, NULL);
+	close(fd);
+	return rc;
+}
+
+/* Map a ring of descriptors of size dsize */
+static int xsk_ring(struct xsk_t *this, struct xsk_ring *ring,
+		    struct xdp_ring_offset *off, size_t dsize, off_t pgoff)
+{
+	ring->maplen = off->desc + XSK_RING * dsize;
+	ring->map = mmap(NULL, ring->maplen, PROT_READ | PROT_WRITE,
+			 MAP_SHARED | MAP_POPULATE, this->fd, pgoff);
+	if (ring->map == MAP_FAILED) {
+		ring->map = NULL;
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+			"Failed to map AF_XDP ring");
+		return -1;
+	}
+	ring->producer = (uint32_t *) ((char *)ring->map + off->producer);
+	ring->consumer = (uint32_t *) ((char *)ring->map + off->consumer);
+	ring->flags = (uint32_t *) ((char *)ring->map + off->flags);
+	ring->desc = (char *)ring->map + off->desc;
+	ring->mask = XSK_RING - 1;
+	return 0;
+}
+
+/* Register the UMEM, create and map the rings, and hand the receive
+   half of the frames to the kernel */
+static int xsk_socket(struct xsk_t *this)
+{
+	struct xdp_umem_reg mr;
+	struct xdp_mmap_offsets off;
+	socklen_t optlen = sizeof(off);
+	int size = XSK_RING;
+	uint64_t *fill;
+	int i;
+
+	if ((this->fd = socket(AF_XDP, SOCK_RAW, 0)) < 0) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+			"Failed to create AF_XDP socket");
+		return -1;
+	}
+	this->umem = mmap(NULL, (size_t)XSK_FRAMES * XSK_FRAMESIZE,
+			  PROT_READ | PROT_WRITE,
+			  MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+	if (this->umem == MAP_FAILED) {
+		this->umem = NULL;
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+			"Failed to allocate UMEM");
+		return -1;
+	}
+
+	memset(&mr, 0, sizeof(mr));
+	mr.addr = (uint64_t) (unsigned long)this->umem;
+	mr.len = (uint64_t)XSK_FRAMES * XSK_FRAMESIZE;
+	mr.chunk_size = XSK_FRAMESIZE;
+	if (setsockopt(this->fd, SOL_XDP, XDP_UMEM_REG, &mr, sizeof(mr)) ||
+	    setsockopt(this->fd, SOL_XDP, XDP_UMEM_FILL_RING, &size,
+		       sizeof(size)) ||
+	    setsockopt(this->fd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &size,
+		       sizeof(size)) ||
+	    setsockopt(this->fd, SOL_XDP, XDP_RX_RING, &size, sizeof(size)) ||
+	    setsockopt(this->fd, SOL_XDP, XDP_TX_RING, &size, sizeof(size)) ||
+	    getsockopt(this->fd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &optlen)) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+			"Failed to set up AF_XDP socket");
+		return -1;
+	}
+	if (xsk_ring(this, &this->fill, &off.fr, sizeof(uint64_t),
+		     XDP_UMEM_PGOFF_FILL_RING) ||
+	    xsk_ring(this, &this->comp, &off.cr, sizeof(uint64_t),
+		     XDP_UMEM_PGOFF_COMPLETION_RING) ||
+	    xsk_ring(this, &this->rx, &off.rx, sizeof(struct xdp_desc),
+		     XDP_PGOFF_RX_RING) ||
+	    xsk_ring(this, &this->tx, &off.tx, sizeof(struct xdp_desc),
+		     XDP_PGOFF_TX_RING))
+		return -1;
+
+	/* First half of the frames receive, second half transmit */
+	fill = this->fill.desc;
+	for (i = 0; i < XSK_RING; i++)
+		fill[i] = (uint64_t)i * XSK_FRAMESIZE;
+	__atomic_store_n(this->fill.producer, XSK_RING, __ATOMIC_RELEASE);
+	for (i = 0; i < XSK_RING; i++)
+		this->txfree[i] = (uint64_t) (XSK_RING + i) * XSK_FRAMESIZE;
+	this->ntxfree = XSK_RING;
+	return 0;
+}
+
+/* Interface index, MTU and Ethernet address of dev */
+static int xsk_dev(struct xsk_t *this, char *dev)
+{
+	struct ifreq ifr;
+	int fd;
+
+	if (!(this->ifindex = if_nametoindex(dev))) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+			"No interface %s", dev);
+		return -1;
+	}
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, dev, IFNAMSIZ);
+	ifr.ifr_name[IFNAMSIZ - 1] = 0;
+	if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno, "socket() failed");
+		return -1;
+	}
+	if (ioctl(fd, SIOCGIFMTU, &ifr)) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+			"Failed to get MTU of %s", dev);
+		close(fd);
+		return -1;
+	}
+	this->mtu = ifr.ifr_mtu;
+	if (ioctl(fd, SIOCGIFHWADDR, &ifr)) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+			"Failed to get Ethernet address of %s", dev);
+		close(fd);
+		return -1;
+	}
+	memcpy(this->mac, ifr.ifr_hwaddr.sa_data, sizeof(this->mac));
+	close(fd);
+	return 0;
+}
+
+int xsk_new(struct xsk_t **this, char *dev, struct in_addr *addr)
+{
+	struct sockaddr_xdp sxdp;
+	uint32_t key = 0, value;
+
+	if (!(*this = calloc(sizeof(struct xsk_t), 1))) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+			"Failed to allocate memory for AF_XDP socket");
+		return -1;
+	}
+	(*this)->addr = *addr;
+	(*this)->fd = (*this)->map = (*this)->prog = -1;
+
+	if (xsk_dev(*this, dev) || xsk_socket(*this) ||
+	    ((*this)->map = bpfprog_map(BPF_MAP_TYPE_XSKMAP, sizeof(uint32_t),
+					sizeof(uint32_t), 1, "ggsn_xsk")) < 0 ||
+	    ((*this)->prog = xsk_prog(*this)) < 0)
+		goto err;
+
+	/* The driver's own XDP if it has one, otherwise generic XDP. Only
+	   the former may bind without copying */
+	(*this)->xdpflags = XDP_FLAGS_DRV_MODE;
+	if (xsk_link((*this)->ifindex, (*this)->prog, (*this)->xdpflags)) {
+		(*this)->xdpflags = XDP_FLAGS_SKB_MODE;
+		if (xsk_link((*this)->ifindex, (*this)->prog,
+			     (*this)->xdpflags)) {
+			sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+				"Failed to attach XDP program to %s", dev);
+			(*this)->xdpflags = 0;
+			goto err;
+		}
+	}
+
+	memset(&sxdp, 0, sizeof(sxdp));
+	sxdp.sxdp_family = AF_XDP;
+	sxdp.sxdp_ifindex = (*this)->ifindex;
+	sxdp.sxdp_queue_id = 0;
+	sxdp.sxdp_flags = XDP_USE_NEED_WAKEUP;
+	if ((*this)->xdpflags == XDP_FLAGS_SKB_MODE)
+		sxdp.sxdp_flags |= XDP_COPY;
+	value = (*this)->fd;
+	if (bind((*this)->fd, (struct sockaddr *)&sxdp, sizeof(sxdp))) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+			"Failed to bind AF_XDP socket to %s", dev);
+		goto err;
+	}
+	if (bpfprog_update((*this)->map, &key, &value)) {
+		sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+			"Failed to add AF_XDP socket to map");
+		goto err;
+	}
+	syslog(LOG_INFO, "AF_XDP socket on %s in %s mode", dev,
+	       ((*this)->xdpflags == XDP_FLAGS_DRV_MODE) ?
+	       "driver" : "generic");
+	return 0;
+
+err:
+	xsk_free(*this);
+	return -1;
+}
+
+int xsk_free(struct xsk_t *this)
+{
+	struct xsk_ring *rings[] = { &this->fill, &this->comp, &this->rx,
+		&this->tx
+	};
+	unsigned i;
+
+	if (this->xdpflags)
+		xsk_link(this->ifindex, -1, this->xdpflags);
+	if (this->prog >= 0)
+		close(this->prog);
+	if (this->map >= 0)
+		close(this->map);
+	for (i = 0; i < sizeof(rings) / sizeof(rings[0]); i++)
+		if (rings[i]->map)
+			munmap(rings[i]->map, rings[i]->maplen);
+	if (this->fd >= 0)
+		close(this->fd);
+	if (this->umem)
+		munmap(this->umem, (size_t)XSK_FRAMES * XSK_FRAMESIZE);
+	free(this);
+	return 0;
+}
+
+int xsk_set_cb_ind(struct xsk_t *this,
+		   int (*cb_ind) (struct xsk_t * this,
+				  struct sockaddr_in * peer,
+				  void *pack, unsigned len))
+{
+	this->cb_ind = cb_ind;
+	return 0;
+}
+
+static struct xsk_neigh *xsk_neigh(struct xsk_t *this, uint32_t addr)
+{
+	uint32_t h = ntohl(addr);
+
+	return &this->neigh[(h ^ (h >> 8) ^ (h >> 16)) % XSK_NEIGHSIZE];
+}
+
+int xsk_decaps(struct xsk_t *this, int budget)
+{
+	struct xdp_desc *rx = this->rx.desc;
+	uint64_t *fill = this->fill.desc;
+	struct sockaddr_in peer;
+	struct xsk_neigh *ne;
+	uint32_t cons, prod, fprod, n, i;
+	uint8_t *p;
+	unsigned len, ulen;
+
+	cons = *this->rx.consumer;
+	prod = __atomic_load_n(this->rx.producer, __ATOMIC_ACQUIRE);
+	n = prod - cons;
+	if (budget && (n > (uint32_t) budget))
+		n = budget;
+	if (!n)
+		return 0;
+
+	memset(&peer, 0, sizeof(peer));
+	peer.sin_family = AF_INET;
+	fprod = *this->fill.producer;
+	for (i = 0; i < n; i++) {
+		p = (uint8_t *) this->umem + rx[(cons + i) & this->rx.mask].addr;
+		len = rx[(cons + i) & this->rx.mask].len;
+
+		/* The program checked the headers up to the G-PDU */
+		ulen = (p[38] << 8) | p[39];
+		if ((len >= XSK_MIN) && (ulen >= 16) && (ulen <= len - 34)) {
+			memcpy(&peer.sin_addr, p + 26, 4);
+			memcpy(&peer.sin_port, p + 34, 2);
+			ne = xsk_neigh(this, peer.sin_addr.s_addr);
+			ne->addr = peer.sin_addr.s_addr;
+			memcpy(ne->mac, p + 6, sizeof(ne->mac));
+			this->rxpackets++;
+			this->rxbytes += ulen - 8;
+			if (this->cb_ind)
+				this->cb_ind(this, &peer, p + 42, ulen - 8);
+		}
+		fill[(fprod + i) & this->fill.mask] =
+		    rx[(cons + i) & this->rx.mask].addr &
+		    ~(uint64_t)(XSK_FRAMESIZE - 1);
+	}
+	__atomic_store_n(this->rx.consumer, cons + n, __ATOMIC_RELEASE);
+	__atomic_store_n(this->fill.producer, fprod + n, __ATOMIC_RELEASE);
+	if (__atomic_load_n(this->fill.flags, __ATOMIC_RELAXED) &
+	    XDP_RING_NEED_WAKEUP)
+		recvfrom(this->fd, NULL, 0, MSG_DONTWAIT, NULL, NULL);
+	return (prod - cons) > n;
+}
+
+/* Take back the frames the kernel has sent */
+static void xsk_complete(struct xsk_t *this)
+{
+	uint64_t *comp = this->comp.desc;
+	uint32_t cons, prod;
+
+	cons = *this->comp.consumer;
+	prod = __atomic_load_n(this->comp.producer, __ATOMIC_ACQUIRE);
+	for (; cons != prod; cons++)
+		this->txfree[this->ntxfree++] = comp[cons & this->comp.mask] &
+		    ~(uint64_t)(XSK_FRAMESIZE - 1);
+	__atomic_store_n(this->comp.consumer, cons, __ATOMIC_RELEASE);
+}
+
+void *xsk_txbuf(struct xsk_t *this, unsigned *room)
+{
+	if (!this->txbuf) {
+		if (!this->ntxfree)
+			xsk_complete(this);
+		if (!this->ntxfree)
+			return NULL;
+		this->txaddr = this->txfree[--this->ntxfree];
+		this->txbuf = (uint8_t *) this->umem + this->txaddr +
+		    XSK_HEADROOM;
+	}
+	*room = XSK_ROOM;
+	return this->txbuf;
+}
+
+/* Checksum of an IPv4 header without options */
+static uint16_t xsk_csum(uint8_t * p)
+{
+	uint32_t sum = 0;
+	int i;
+
+	for (i = 0; i < 20; i += 2)
+		sum += (p[i] << 8) | p[i + 1];
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum += sum >> 16;
+	return htons(~sum & 0xffff);
+}
+
+int xsk_encaps(struct xsk_t *this, struct sockaddr_in *peer, void *hdr,
+	       unsigned hlen, void *pack, unsigned len)
+{
+	struct xdp_desc *tx = this->tx.desc;
+	struct xsk_neigh *ne = xsk_neigh(this, peer->sin_addr.s_addr);
+	uint64_t addr;
+	uint8_t *p;
+	uint16_t v;
+	uint32_t prod;
+
+	if ((ne->addr != peer->sin_addr.s_addr) ||
+	    (hlen + 42 > XSK_HEADROOM) ||
+	    (28 + hlen + len > (unsigned)this->mtu)) {
+		this->fallback++;
+		return 1;
+	}
+
+	if (pack == this->txbuf) {
+		addr = this->txaddr;
+		this->txbuf = NULL;
+	} else {
+		if (!this->ntxfree)
+			xsk_complete(this);
+		if (!this->ntxfree || (len > XSK_ROOM)) {
+			this->fallback++;
+			return 1;
+		}
+		addr = this->txfree[--this->ntxfree];
+		memcpy((uint8_t *) this->umem + addr + XSK_HEADROOM, pack, len);
+	}
+
+	/* Headers in front of the packet */
+	addr += XSK_HEADROOM - hlen - 42;
+	p = (uint8_t *) this->umem + addr;
+	memcpy(p, ne->mac, 6);
+	memcpy(p + 6, this->mac, 6);
+	v = htons(ETH_P_IP);
+	memcpy(p + 12, &v, 2);
+	p[14] = 0x45;
+	p[15] = 0;
+	v = htons(28 + hlen + len);
+	memcpy(p + 16, &v, 2);
+	memset(p + 18, 0, 4);
+	p[22] = 64;
+	p[23] = IPPROTO_UDP;
+	memset(p + 24, 0, 2);
+	memcpy(p + 26, &this->addr.s_addr, 4);
+	memcpy(p + 30, &peer->sin_addr.s_addr, 4);
+	v = xsk_csum(p + 14);
+	memcpy(p + 24, &v, 2);
+	memcpy(p + 34, &peer->sin_port, 2);
+	memcpy(p + 36, &peer->sin_port, 2);
+	v = htons(8 + hlen + len);
+	memcpy(p + 38, &v, 2);
+	memset(p + 40, 0, 2);
+	memcpy(p + 42, hdr, hlen);
+
+	/* The ring has a descriptor for each transmit frame */
+	prod = *this->tx.producer;
+	tx[prod & this->tx.mask].addr = addr;
+	tx[prod & this->tx.mask].len = 42 + hlen + len;
+	tx[prod & this->tx.mask].options = 0;
+	__atomic_store_n(this->tx.producer, prod + 1, __ATOMIC_RELEASE);
+	this->txpending++;
+	this->txpackets++;
+	this->txbytes += hlen + len;
+	return 0;
+}
+
+int xsk_kick(struct xsk_t *this)
+{
+	if (this->txpending) {
+		this->txpending = 0;
+		if ((sendto(this->fd, NULL, 0, MSG_DONTWAIT, NULL, 0) < 0) &&
+		    (errno != EAGAIN) && (errno != EBUSY) &&
+		    (errno != ENOBUFS)) {
+			sys_err(LOG_ERR, __FILE__, __LINE__, errno,
+				"AF_XDP transmit failed");
+			return -1;
+		}
+	}
+	xsk_complete(this);
+	return 0;
+}
+
+#else /* No AF_XDP */
+
+int xsk_new(struct xsk_t **this, char *dev, struct in_addr *addr)
+{
+	sys_err(LOG_ERR, __FILE__, __LINE__, 0,
+		"AF_XDP is not supported on this platform");
+	return -1;
+}
+
+int xsk_free(struct xsk_t *this)
+{
+	return -1;
+}
+
+int xsk_set_cb_ind(struct xsk_t *this,
+		   int (*cb_ind) (struct xsk_t * this,
+				  struct sockaddr_in * peer,
+				  void *pack, unsigned len))
+{
+	return -1;
+}
+
+int xsk_decaps(struct xsk_t *this, int budget)
+{
+	return -1;
+}
+
+void *xsk_txbuf(struct xsk_t *this, unsigned *room)
+{
+	return NULL;
+}
+
+int xsk_encaps(struct xsk_t *this, struct sockaddr_in *peer, void *hdr,
+	       unsigned hlen, void *pack, unsigned len)
+{
+	return 1;
+}
+
+int xsk_kick(struct xsk_t *this)
+{
+	return -1;
+}
+
+#endif
@@ -0,0 +1,106 @@
+/*
+ * AF_XDP socket for GTP-U.
+ *
+ * The contents of this file may be used under the terms of the GNU
+ * General Public License Version 2, provided that the above copyright
+ * notice and this permission notice is included in all copies or
+ * substantial portions of the software.
+ *
+ */
+
+#ifndef _XSK_H
+#define _XSK_H
+
+/* An XDP program on the Gn interface redirects G-PDUs to the own GTP-U
+   address from queue 0 into an AF_XDP socket. They are read in batches
+   from the frames of the UMEM, a memory area shared with the kernel, and
+   recycled once handled. Everything else, and G-PDUs arriving on other
+   queues, continues to the UDP sockets.
+
+   Downlink packets are read from the tun into a free frame, behind room
+   for the headers, and sent from there. Until the Ethernet address of a
+   peer is learnt from its G-PDUs, or when no frame is free or a packet
+   is too large for the Gn interface, packets are left to the socket.
+
+   Generic (skb) XDP is used where the driver has no XDP of its own, as
+   for veth. Tuns with an MTU above XSK_ROOM are not supported. */
+
+#define XSK_FRAMES    2048	/* Frames in the UMEM. Half are for receive */
+#define XSK_FRAMESIZE 4096	/* Bytes per frame */
+#define XSK_HEADROOM  64	/* Room for Ethernet, IPv4, UDP and GTP */
+#define XSK_ROOM      (XSK_FRAMESIZE - XSK_HEADROOM)
+#define XSK_NEIGHSIZE 256	/* Ethernet addresses of peers */
+
+struct xsk_ring {		/* Ring shared with the kernel */
+	uint32_t *producer;
+	uint32_t *consumer;
+	uint32_t *flags;
+	void *desc;
+	uint32_t mask;
+	void *map;
+	size_t maplen;
+};
+
+struct xsk_neigh {		/* Learnt from received frames */
+	uint32_t addr;
+	uint8_t mac[6];
+};
+
+struct xsk_t {
+	int fd;			/* AF_XDP socket */
+	int ifindex;		/* Gn interface */
+	int mtu;		/* MTU of Gn interface */
+	uint8_t mac[6];		/* Ethernet address of Gn interface */
+	struct in_addr addr;	/* Own GTP-U address */
+	int map, prog;		/* Socket map and XDP program */
+	uint32_t xdpflags;	/* Mode the program was attached in */
+	void *umem;
+	struct xsk_ring fill, comp, rx, tx;
+	uint64_t txfree[XSK_FRAMES / 2];	/* Free transmit frames */
+	int ntxfree;
+	uint64_t txaddr;	/* Frame handed out by xsk_txbuf() */
+	void *txbuf;
+	int txpending;		/* Queued since last xsk_kick() */
+	struct xsk_neigh neigh[XSK_NEIGHSIZE];
+	int (*cb_ind) (struct xsk_t * this, struct sockaddr_in * peer,
+		       void *pack, unsigned len);
+	void *priv;		/* Private state of the user */
+
+	/* Counters */
+	uint64_t rxpackets, rxbytes;
+	uint64_t txpackets, txbytes;
+	uint64_t fallback;	/* Left to the socket */
+};
+
+/* Create the socket on queue 0 of the Gn interface dev, and attach the
+   program for G-PDUs to addr */
+extern int xsk_new(struct xsk_t **this, char *dev, struct in_addr *addr);
+
+/* Detach the program and free the socket */
+extern int xsk_free(struct xsk_t *this);
+
+/* Called with the peer and GTP message of each received frame */
+extern int xsk_set_cb_ind(struct xsk_t *this,
+			  int (*cb_ind) (struct xsk_t * this,
+					 struct sockaddr_in * peer,
+					 void *pack, unsigned len));
+
+/* Handle up to budget received frames. 0 means all there are. Returns
+   1 if the budget was used up, otherwise 0 */
+extern int xsk_decaps(struct xsk_t *this, int budget);
+
+/* A free transmit frame to read a packet into. Its room is returned in
+   room. The frame stays reserved until xsk_encaps() sends from it, and
+   is handed out again otherwise. Returns NULL when none is free */
+extern void *xsk_txbuf(struct xsk_t *this, unsigned *room);
+
+/* Queue a G-PDU with GTP header hdr and packet pack to peer. A packet in
+   the frame of xsk_txbuf() is not copied. Returns 0 when queued, 1 when
+   it should be sent on the socket instead */
+extern int xsk_encaps(struct xsk_t *this, struct sockaddr_in *peer,
+		      void *hdr, unsigned hlen, void *pack, unsigned len);
+
+/* Start transmission of queued frames, and take back sent ones */
+extern int xsk_kick(struct xsk_t *this);
+
+#endif /* !_XSK_H */
@@ -0,0 +1,127 @@
+/*
+ * Micro-benchmark of ippool_getip().
+ *
+ * The contents of this file may be used under the terms of the GNU
+ * General Public License Version 2, provided that the above copyright
+ * notice and this permission notice is included in all copies or
+ * substantial portions of the software.
+ *
+ */
+
+/*
+ * Usage: ippool_bench [lookups [dynamic [static]]]
+ *
+ * Fills a pool with the dynamic and static ranges, and times lookups of
+ * random members of each. Dynamic members are found by their offset in
+ * the range, static ones through the hash table. Lookups of addresses
+ * outside the pool are timed as well. Each lookup is checked, and the
+ * exit status is 1 if one returned the wrong member.
+ */
+
+#include <sys/types.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../lib/ippool.h"
+
+#define BENCH_LOOKUPS 10000000	/* Default lookups per kind */
+
+static uint32_t seed = 2463534242u;
+
+/* xorshift32, so that the order of lookups defeats the cache */
+static uint32_t bench_rand(void)
+{
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+	return seed;
+}
+
+static double bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Look up random addresses of addrs, which should give members, or no
+   member where members is NULL. Returns the number of wrong results */
+static int bench_run(struct ippool_t *pool, char *kind,
+		     struct in_addr *addrs, struct ippoolm_t **members,
+		     int n, long lookups)
+{
+	struct ippoolm_t *m;
+	double start;
+	long i;
+	int j, bad = 0;
+
+	if (!n)
+		return 0;
+	start = bench_now();
+	for (i = 0; i < lookups; i++) {
+		j = bench_rand() % n;
+		if (ippool_getip(pool, &m, &addrs[j]))
+			m = NULL;
+		if (m != (members ? members[j] : NULL))
+			bad++;
+	}
+	printf("%-8s %8d addresses %8.1f ns/lookup\n", kind, n,
+	       (bench_now() - start) * 1e9 / lookups);
+	return bad;
+}
+
+int main(int argc, char **argv)
+{
+	long lookups = argc > 1 ? atol(argv[1]) : BENCH_LOOKUPS;
+	char *dyn = argc > 2 ? argv[2] : "10.0.0.0/16";
+	char *stat = argc > 3 ? argv[3] : "10.128.0.0/16";
+	struct ippool_t *pool;
+	struct ippoolm_t **dynm, **statm;
+	struct in_addr *dyna, *stata, *missa, addr;
+	unsigned int ndyn = 0, nstat = 0, i;
+	int bad = 0;
+
+	if ((lookups <= 0) || ippool_new(&pool, dyn, stat, 1, 1, 0)) {
+		fprintf(stderr,
+			"Usage: %s [lookups [dynamic [static]]]\n", argv[0]);
+		return 2;
+	}
+	if (!(dynm = calloc(pool->dynsize, sizeof(*dynm))) ||
+	    !(statm = calloc(pool->listsize, sizeof(*statm))) ||
+	    !(dyna = calloc(pool->dynsize, sizeof(*dyna))) ||
+	    !(stata = calloc(pool->listsize, sizeof(*stata))) ||
+	    !(missa = calloc(pool->dynsize, sizeof(*missa)))) {
+		fprintf(stderr, "Out of memory\n");
+		return 2;
+	}
+
+	/* Take every address of the pool */
+	addr.s_addr = 0;
+	while (!ippool_newip(pool, &dynm[ndyn], &addr, 0)) {
+		dyna[ndyn] = dynm[ndyn]->addr;
+		ndyn++;
+	}
+	for (i = 1; i < pool->listsize; i++) {
+		addr.s_addr = htonl(ntohl(pool->stataddr.s_addr) + i);
+		if (ippool_newip(pool, &statm[nstat], &addr, 1))
+			break;
+		stata[nstat++] = addr;
+	}
+
+	/* Misses: the dynamic addresses moved to another /8 */
+	for (i = 0; i < ndyn; i++)
+		missa[i].s_addr = dyna[i].s_addr ^ htonl(0x01000000);
+
+	bad += bench_run(pool, "dynamic", dyna, dynm, ndyn, lookups);
+	bad += bench_run(pool, "static", stata, statm, nstat, lookups);
+	bad += bench_run(pool, "miss", missa, NULL, ndyn, lookups);
+	if (bad)
+		printf("%d lookups gave the wrong member\n", bad);
+
+	ippool_free(pool);
+	return bad ? 1 : 0;
+}